@@ -0,0 +1,268 @@
+#include "Precompiled.h"
+
+#include "RenderDevice-vk.h"
+
+static constexpr uint32 InvalidSlot = ~0u;
+
+static const VkDescriptorType DescriptorTypes[] = {
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+	VK_DESCRIPTOR_TYPE_SAMPLER,
+};
+
+bool TVulkanBindlessHeap::GetRequiredFeatures(const VkPhysicalDeviceVulkan12Features &supported, VkPhysicalDeviceVulkan12Features &required)
+{
+	required.descriptorIndexing = VK_TRUE;
+	required.runtimeDescriptorArray = VK_TRUE;
+	required.descriptorBindingPartiallyBound = VK_TRUE;
+	required.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	required.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+	required.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	// Slots may differ between the invocations of a draw, materials of instanced draws for one.
+	required.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+	required.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+	return supported.descriptorIndexing && supported.runtimeDescriptorArray && supported.descriptorBindingPartiallyBound && supported.descriptorBindingUpdateUnusedWhilePending &&
+		supported.descriptorBindingStorageBufferUpdateAfterBind && supported.descriptorBindingSampledImageUpdateAfterBind &&
+		supported.shaderStorageBufferArrayNonUniformIndexing && supported.shaderSampledImageArrayNonUniformIndexing;
+}
+
+void TVulkanBindlessHeap::Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator)
+{
+	Device = device;
+	Allocator = allocator;
+
+	VkPhysicalDeviceDescriptorIndexingProperties indexingProperties = {};
+	indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &indexingProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	uint32 buffers = Min(DesiredCapacity[uint32(TBindlessKind::Buffer)],
+		Min(indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers, indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers));
+	uint32 images = Min(DesiredCapacity[uint32(TBindlessKind::Image)],
+		Min(indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages));
+	const uint32 samplers = Min(DesiredCapacity[uint32(TBindlessKind::Sampler)],
+		Min(indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers, indexingProperties.maxDescriptorSetUpdateAfterBindSamplers));
+	// Every stage sees every array, buffers and images count against one limit together.
+	if (buffers + images > indexingProperties.maxPerStageUpdateAfterBindResources)
+	{
+		buffers = Min(buffers, indexingProperties.maxPerStageUpdateAfterBindResources / 2u);
+		images = Min(images, indexingProperties.maxPerStageUpdateAfterBindResources - buffers);
+	}
+	ASSERT(buffers + images + samplers <= indexingProperties.maxUpdateAfterBindDescriptorsInAllPools);
+
+	Arrays[uint32(TBindlessKind::Buffer)].Capacity = buffers;
+	Arrays[uint32(TBindlessKind::Image)].Capacity = images;
+	Arrays[uint32(TBindlessKind::Sampler)].Capacity = samplers;
+
+	VkDescriptorSetLayoutBinding bindings[KindCount];
+	VkDescriptorBindingFlags bindingFlags[KindCount];
+	VkDescriptorPoolSize poolSizes[KindCount];
+	for (uint32 i = 0; i < KindCount; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = DescriptorTypes[i];
+		bindings[i].descriptorCount = Arrays[i].Capacity;
+		bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+		bindings[i].pImmutableSamplers = nullptr;
+
+		bindingFlags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+		poolSizes[i].type = DescriptorTypes[i];
+		poolSizes[i].descriptorCount = Arrays[i].Capacity;
+	}
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo = {};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsCreateInfo.pNext = nullptr;
+	bindingFlagsCreateInfo.bindingCount = KindCount;
+	bindingFlagsCreateInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	setLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	setLayoutCreateInfo.bindingCount = KindCount;
+	setLayoutCreateInfo.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(Device, &setLayoutCreateInfo, Allocator, &SetLayout);
+	ASSERT(result == VK_SUCCESS);
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.pNext = nullptr;
+	poolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = KindCount;
+	poolCreateInfo.pPoolSizes = poolSizes;
+
+	result = vkCreateDescriptorPool(Device, &poolCreateInfo, Allocator, &Pool);
+	ASSERT(result == VK_SUCCESS);
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.pNext = nullptr;
+	setAllocateInfo.descriptorPool = Pool;
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &SetLayout;
+
+	result = vkAllocateDescriptorSets(Device, &setAllocateInfo, &Set);
+	ASSERT(result == VK_SUCCESS);
+
+	DebugPrint("Bindless heap: %u buffers, %u images, %u samplers\n", buffers, images, samplers);
+}
+
+void TVulkanBindlessHeap::Done()
+{
+	// Destroying the pool frees the set.
+	vkDestroyDescriptorPool(Device, Pool, Allocator);
+	vkDestroyDescriptorSetLayout(Device, SetLayout, Allocator);
+	Pool = VK_NULL_HANDLE;
+	SetLayout = VK_NULL_HANDLE;
+	Set = VK_NULL_HANDLE;
+
+	for (TArray &array : Arrays)
+		array = TArray();
+	RetiredSlots = TVarArray<TRetiredSlot>();
+}
+
+uint32 TVulkanBindlessHeap::AllocateSlot(TBindlessKind kind)
+{
+	TArray &array = Arrays[uint32(kind)];
+	uint32 slot = InvalidSlot;
+	if (!array.FreeSlots.empty())
+	{
+		slot = array.FreeSlots[array.FreeSlots.size() - 1];
+		array.FreeSlots.resize(array.FreeSlots.size() - 1);
+	}
+	else if (array.NextSlot < array.Capacity)
+	{
+		slot = array.NextSlot++;
+	}
+
+	if (slot != InvalidSlot)
+		++array.UsedCount;
+	return slot;
+}
+
+void TVulkanBindlessHeap::Write(VkWriteDescriptorSet &write, TBindlessKind kind, uint32 slot)
+{
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = Set;
+	write.dstBinding = uint32(kind);
+	write.dstArrayElement = slot;
+	write.descriptorCount = 1;
+	write.descriptorType = DescriptorTypes[uint32(kind)];
+	vkUpdateDescriptorSets(Device, 1, &write, 0, nullptr);
+}
+
+uint32 TVulkanBindlessHeap::AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = offset;
+	bufferInfo.range = range;
+
+	VkWriteDescriptorSet write = {};
+	write.pBufferInfo = &bufferInfo;
+
+	AcquireSRWLockExclusive(&Lock);
+	const uint32 slot = AllocateSlot(TBindlessKind::Buffer);
+	if (slot != InvalidSlot)
+		Write(write, TBindlessKind::Buffer, slot);
+	ReleaseSRWLockExclusive(&Lock);
+	return slot;
+}
+
+uint32 TVulkanBindlessHeap::AddImage(VkImageView view, VkImageLayout layout)
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = VK_NULL_HANDLE;
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = layout;
+
+	VkWriteDescriptorSet write = {};
+	write.pImageInfo = &imageInfo;
+
+	AcquireSRWLockExclusive(&Lock);
+	const uint32 slot = AllocateSlot(TBindlessKind::Image);
+	if (slot != InvalidSlot)
+		Write(write, TBindlessKind::Image, slot);
+	ReleaseSRWLockExclusive(&Lock);
+	return slot;
+}
+
+uint32 TVulkanBindlessHeap::AddSampler(VkSampler sampler)
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = sampler;
+	imageInfo.imageView = VK_NULL_HANDLE;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkWriteDescriptorSet write = {};
+	write.pImageInfo = &imageInfo;
+
+	AcquireSRWLockExclusive(&Lock);
+	const uint32 slot = AllocateSlot(TBindlessKind::Sampler);
+	if (slot != InvalidSlot)
+		Write(write, TBindlessKind::Sampler, slot);
+	ReleaseSRWLockExclusive(&Lock);
+	return slot;
+}
+
+void TVulkanBindlessHeap::Release(TBindlessKind kind, uint32 slot, uint64 frame)
+{
+	ASSERT(slot < Arrays[uint32(kind)].NextSlot);
+
+	// The descriptor stays as it is, partially bound arrays may hold stale ones as long as nothing reads them.
+	AcquireSRWLockExclusive(&Lock);
+	TRetiredSlot &retired = RetiredSlots.push_back(TRetiredSlot());
+	retired.Frame = frame;
+	retired.Kind = kind;
+	retired.Slot = slot;
+	ReleaseSRWLockExclusive(&Lock);
+}
+
+void TVulkanBindlessHeap::Collect(uint64 completedFrame)
+{
+	AcquireSRWLockExclusive(&Lock);
+	size_t kept = 0u;
+	for (size_t i = 0; i < RetiredSlots.size(); ++i)
+	{
+		const TRetiredSlot retired = RetiredSlots[i];
+		if (retired.Frame <= completedFrame)
+		{
+			TArray &array = Arrays[uint32(retired.Kind)];
+			array.FreeSlots.push_back(retired.Slot);
+			--array.UsedCount;
+		}
+		else
+		{
+			RetiredSlots[kept++] = retired;
+		}
+	}
+	RetiredSlots.resize(kept);
+	ReleaseSRWLockExclusive(&Lock);
+}
+
+uint32 TVulkanBindlessHeap::GetUsedCount(TBindlessKind kind) const
+{
+	AcquireSRWLockShared(&Lock);
+	const uint32 count = Arrays[uint32(kind)].UsedCount;
+	ReleaseSRWLockShared(&Lock);
+	return count;
+}
+
+void TVulkanBindlessHeap::Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout) const
+{
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, SetIndex, 1, &Set, 0, nullptr);
+}
+
+void TVulkanBindlessHeap::Push(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const void *data, uint32 size) const
+{
+	ASSERT(size <= PushConstantSize && size % 4u == 0u);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL, 0, size, data);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+// References:
+// https://www.khronos.org/registry/vulkan/specs/1.2/html/vkspec.html#descriptorsets-updates-consistency
+// https://vkguide.dev/docs/extra-chapter/abstracting_descriptors/
+// https://github.com/microsoft/DirectXShaderCompiler/blob/main/docs/SPIR-V.rst#resource-binding
+
+enum class TBindlessKind : uint8
+{
+	// Storage buffers, ByteAddressBuffer or StructuredBuffer in HLSL.
+	Buffer,
+	// Sampled images, Texture2D.
+	Image,
+	Sampler,
+	Count,
+};
+
+// One descriptor set with an array per kind that every pipeline shares. Resources get a slot in their array
+// and shaders index the arrays with slots passed in push constants, so the set is bound once per command
+// buffer instead of per draw. In HLSL:
+//   [[vk::binding(0, 1)]] ByteAddressBuffer Buffers[];
+//   [[vk::binding(1, 1)]] Texture2D Images[];
+//   [[vk::binding(2, 1)]] SamplerState Samplers[];
+//   [[vk::push_constant]] TDrawIndices DrawIndices;
+// The arrays are partially bound and updated after bind, so slots are written while frames using other slots
+// are in flight. Released slots are only handed out again once the frame that last used them is done. Thread safe.
+class TVulkanBindlessHeap
+{
+public:
+	// Set 0 belongs to the uniform ring.
+	static constexpr uint32 SetIndex = 1u;
+	// The minimum maxPushConstantsSize, shared by all stages.
+	static constexpr uint32 PushConstantSize = 128u;
+
+	// Fills in the descriptor indexing features the heap needs, false when the device lacks one of them.
+	static bool GetRequiredFeatures(const VkPhysicalDeviceVulkan12Features &supported, VkPhysicalDeviceVulkan12Features &required);
+
+	// The device has to be created with the required features.
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator);
+	void Done();
+
+	bool IsEnabled() const {
+		return Set != VK_NULL_HANDLE;
+	}
+
+	// Slots, or ~0u when the array is full.
+	uint32 AddBuffer(VkBuffer buffer, VkDeviceSize offset = 0u, VkDeviceSize range = VK_WHOLE_SIZE);
+	uint32 AddImage(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	uint32 AddSampler(VkSampler sampler);
+	// frame is the last frame that may read the slot.
+	void Release(TBindlessKind kind, uint32 slot, uint64 frame);
+	// Makes the slots released with completedFrame or earlier available again.
+	void Collect(uint64 completedFrame);
+
+	VkDescriptorSetLayout GetSetLayout() const {
+		return SetLayout;
+	}
+
+	// The pipeline layout has the heap's set layout at SetIndex and a push constant range of PushConstantSize for all stages.
+	void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout) const;
+	// Per draw data, slots most of all, at the start of the push constant range.
+	void Push(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const void *data, uint32 size) const;
+
+	uint32 GetCapacity(TBindlessKind kind) const {
+		return Arrays[uint32(kind)].Capacity;
+	}
+	uint32 GetUsedCount(TBindlessKind kind) const;
+
+private:
+	static constexpr uint32 KindCount = uint32(TBindlessKind::Count);
+	static constexpr uint32 DesiredCapacity[KindCount] = { 64u * 1024u, 64u * 1024u, 1024u };
+
+	struct TArray
+	{
+		uint32 Capacity = 0u;
+		// Slots below NextSlot that are free again.
+		TVarArray<uint32> FreeSlots;
+		uint32 NextSlot = 0u;
+		uint32 UsedCount = 0u;
+	};
+
+	struct TRetiredSlot
+	{
+		uint64 Frame;
+		TBindlessKind Kind;
+		uint32 Slot;
+	};
+
+	uint32 AllocateSlot(TBindlessKind kind);
+	void Write(VkWriteDescriptorSet &write, TBindlessKind kind, uint32 slot);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool Pool = VK_NULL_HANDLE;
+	VkDescriptorSet Set = VK_NULL_HANDLE;
+
+	// Also serializes descriptor writes, the set has to be externally synchronized for them.
+	mutable SRWLOCK Lock = SRWLOCK_INIT;
+	TArray Arrays[KindCount];
+	TVarArray<TRetiredSlot> RetiredSlots;
+};
@@ -0,0 +1,121 @@
+#include "Precompiled.h"
+
+#include "CommandList.h"
+
+TCommandList::TCommandList(size_t capacity)
+{
+	Data.resize(Max(capacity, size_t(64u)));
+}
+
+void TCommandList::Reset()
+{
+	ASSERT(!InRenderPass);
+	Size = 0u;
+	CommandCount = 0u;
+	Pipeline = nullptr;
+	VertexBuffer = nullptr;
+	VertexOffset = 0u;
+	IndexBuffer = nullptr;
+	IndexOffset = 0u;
+	IndexType = TIndexType::Uint16;
+}
+
+void TCommandList::BeginRenderPass(const float32 *clearColor)
+{
+	ASSERT(!InRenderPass);
+	TBeginRenderPassCommand command = {};
+	command.Clear = clearColor != nullptr;
+	if (command.Clear)
+		MemCopy(command.ClearColor, clearColor, sizeof(command.ClearColor));
+	Write(TCommandType::BeginRenderPass, command);
+	InRenderPass = true;
+	// Pipelines are looked up per render pass, the backend binds them again.
+	Pipeline = nullptr;
+}
+
+void TCommandList::ContinueRenderPass()
+{
+	ASSERT(!InRenderPass);
+	InRenderPass = true;
+	Continued = true;
+	Pipeline = nullptr;
+}
+
+void TCommandList::EndRenderPass()
+{
+	ASSERT(InRenderPass);
+	if (!Continued)
+	{
+		uint8 *data = Allocate(1u);
+		data[0] = uint8(TCommandType::EndRenderPass);
+		++CommandCount;
+	}
+	InRenderPass = false;
+	Continued = false;
+}
+
+void TCommandList::BindPipeline(IGraphicsPipeline *pipeline)
+{
+	ASSERT(InRenderPass && pipeline != nullptr);
+	if (pipeline == Pipeline)
+		return;
+	Write(TCommandType::BindPipeline, TBindPipelineCommand{ pipeline });
+	Pipeline = pipeline;
+}
+
+void TCommandList::BindVertexBuffer(IGraphicsBuffer *buffer, uint32 offset)
+{
+	if (buffer == VertexBuffer && offset == VertexOffset)
+		return;
+	Write(TCommandType::BindVertexBuffer, TBindVertexBufferCommand{ buffer, offset });
+	VertexBuffer = buffer;
+	VertexOffset = offset;
+}
+
+void TCommandList::BindIndexBuffer(IGraphicsBuffer *buffer, TIndexType type, uint32 offset)
+{
+	if (buffer == IndexBuffer && offset == IndexOffset && type == IndexType)
+		return;
+	Write(TCommandType::BindIndexBuffer, TBindIndexBufferCommand{ buffer, offset, type });
+	IndexBuffer = buffer;
+	IndexOffset = offset;
+	IndexType = type;
+}
+
+void TCommandList::PushConstants(const void *data, uint32 size)
+{
+	ASSERT(size != 0u && size <= MaxPushConstantSize && size % 4u == 0u);
+	uint8 *bytes = Allocate(1u + sizeof(TPushConstantsCommand) + size);
+	bytes[0] = uint8(TCommandType::PushConstants);
+	bytes[1] = uint8(size);
+	MemCopy(bytes + 1 + sizeof(TPushConstantsCommand), data, size);
+	++CommandCount;
+}
+
+void TCommandList::Draw(uint32 vertexCount, uint32 instanceCount, uint32 firstVertex, uint32 firstInstance)
+{
+	ASSERT(InRenderPass && Pipeline != nullptr);
+	Write(TCommandType::Draw, TDrawCommand{ vertexCount, instanceCount, firstVertex, firstInstance });
+}
+
+void TCommandList::DrawIndexed(uint32 indexCount, uint32 instanceCount, uint32 firstIndex, int32 vertexOffset, uint32 firstInstance)
+{
+	ASSERT(InRenderPass && Pipeline != nullptr && IndexBuffer != nullptr);
+	Write(TCommandType::DrawIndexed, TDrawIndexedCommand{ indexCount, instanceCount, firstIndex, vertexOffset, firstInstance });
+}
+
+void TCommandList::Barrier(IGraphicsBuffer *buffer, TResourceState before, TResourceState after)
+{
+	ASSERT(!InRenderPass);
+	Write(TCommandType::Barrier, TBarrierCommand{ buffer, before, after });
+}
+
+uint8 *TCommandList::Allocate(size_t size)
+{
+	// Only while the list grows to the largest frame it records.
+	if (Size + size > Data.size())
+		Data.resize(Max(Data.size() * 2u, Size + size));
+	uint8 *data = Data.data() + Size;
+	Size += size;
+	return data;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "Core/Containers/String.h"
+#include "RenderDevice.h"
+
+// References:
+// https://blog.molecular-matters.com/2014/11/06/stateless-layered-multi-threaded-rendering-part-1/
+// https://realtimecollisiondetection.net/blog/?p=86
+
+enum class TCommandType : uint8
+{
+	BeginRenderPass,
+	EndRenderPass,
+	BindPipeline,
+	BindVertexBuffer,
+	BindIndexBuffer,
+	// Followed by Size bytes of constants.
+	PushConstants,
+	Draw,
+	DrawIndexed,
+	Barrier,
+};
+
+// Payloads, each written right after its type without padding, so they are copied out rather than pointed at.
+struct TBeginRenderPassCommand
+{
+	float32 ClearColor[4];
+	bool Clear;
+};
+
+struct TBindPipelineCommand
+{
+	IGraphicsPipeline *Pipeline;
+};
+
+struct TBindVertexBufferCommand
+{
+	IGraphicsBuffer *Buffer;
+	uint32 Offset;
+};
+
+struct TBindIndexBufferCommand
+{
+	IGraphicsBuffer *Buffer;
+	uint32 Offset;
+	TIndexType Type;
+};
+
+struct TPushConstantsCommand
+{
+	uint8 Size;
+};
+
+struct TDrawCommand
+{
+	uint32 VertexCount;
+	uint32 InstanceCount;
+	uint32 FirstVertex;
+	uint32 FirstInstance;
+};
+
+struct TDrawIndexedCommand
+{
+	uint32 IndexCount;
+	uint32 InstanceCount;
+	uint32 FirstIndex;
+	int32 VertexOffset;
+	uint32 FirstInstance;
+};
+
+struct TBarrierCommand
+{
+	IGraphicsBuffer *Buffer;
+	TResourceState Before;
+	TResourceState After;
+};
+
+// Draws, binds and barriers in a compact binary stream, translated to API calls by the backend the list is
+// submitted to. Recording touches nothing but the list, so each thread records lists of its own without locks,
+// and binds that change nothing are dropped as they are recorded. The memory is kept across Reset, so once a
+// list has grown to what a frame needs, recording no longer allocates.
+class TCommandList
+{
+public:
+	static constexpr uint32 MaxPushConstantSize = 128u;
+
+	explicit TCommandList(size_t capacity = 16u * 1024u);
+
+	// Forgets the commands, keeps the memory.
+	void Reset();
+
+	// Draws into the back buffer, cleared to clearColor or, when it is null, keeping what is there.
+	void BeginRenderPass(const float32 *clearColor);
+	// Records into a render pass the backend begins, for lists submitted together to be translated in parallel.
+	// Ended by EndRenderPass, neither writes a command.
+	void ContinueRenderPass();
+	void EndRenderPass();
+	// Inside a render pass, the pipeline is compiled for it.
+	void BindPipeline(IGraphicsPipeline *pipeline);
+	void BindVertexBuffer(IGraphicsBuffer *buffer, uint32 offset = 0u);
+	void BindIndexBuffer(IGraphicsBuffer *buffer, TIndexType type, uint32 offset = 0u);
+	// From offset 0, visible to every stage.
+	void PushConstants(const void *data, uint32 size);
+	void Draw(uint32 vertexCount, uint32 instanceCount = 1u, uint32 firstVertex = 0u, uint32 firstInstance = 0u);
+	void DrawIndexed(uint32 indexCount, uint32 instanceCount = 1u, uint32 firstIndex = 0u, int32 vertexOffset = 0, uint32 firstInstance = 0u);
+	// Outside render passes. Makes what was done to the buffer as before available to what is done to it as after.
+	void Barrier(IGraphicsBuffer *buffer, TResourceState before, TResourceState after);
+
+	const uint8 *GetData() const {
+		return Data.data();
+	}
+	size_t GetSize() const {
+		return Size;
+	}
+	uint32 GetCommandCount() const {
+		return CommandCount;
+	}
+
+private:
+	template <typename TCommand>
+	void Write(TCommandType type, const TCommand &command)
+	{
+		uint8 *data = Allocate(1u + sizeof(TCommand));
+		data[0] = uint8(type);
+		MemCopy(data + 1, &command, sizeof(TCommand));
+		++CommandCount;
+	}
+
+	uint8 *Allocate(size_t size);
+
+	TVarArray<uint8> Data;
+	size_t Size = 0u;
+	uint32 CommandCount = 0u;
+
+	// What the commands so far left bound, unknown at the start of the list and the pipeline at every render pass.
+	bool InRenderPass = false;
+	bool Continued = false;
+	IGraphicsPipeline *Pipeline = nullptr;
+	IGraphicsBuffer *VertexBuffer = nullptr;
+	uint32 VertexOffset = 0u;
+	IGraphicsBuffer *IndexBuffer = nullptr;
+	uint32 IndexOffset = 0u;
+	TIndexType IndexType = TIndexType::Uint16;
+};
+
+// Walks a list's commands in order. Every Next is followed by the Read of its type's payload, and a
+// PushConstants one by ReadBytes of its size.
+class TCommandReader
+{
+public:
+	explicit TCommandReader(const TCommandList &list) :
+		Cursor(list.GetData()), End(list.GetData() + list.GetSize()) {}
+
+	bool Next(TCommandType &type)
+	{
+		if (Cursor == End)
+			return false;
+		type = TCommandType(*Cursor++);
+		return true;
+	}
+
+	template <typename TCommand>
+	TCommand Read()
+	{
+		TCommand command;
+		MemCopy(&command, ReadBytes(sizeof(TCommand)), sizeof(TCommand));
+		return command;
+	}
+
+	const uint8 *ReadBytes(size_t size)
+	{
+		ASSERT(size_t(End - Cursor) >= size);
+		const uint8 *bytes = Cursor;
+		Cursor += size;
+		return bytes;
+	}
+
+private:
+	const uint8 *Cursor;
+	const uint8 *End;
+};
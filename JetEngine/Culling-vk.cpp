@@ -0,0 +1,944 @@
+#include "Precompiled.h"
+
+#include "RenderDevice-vk.h"
+
+// Threads per group of every culling shader, along x, and along both axes for the depth pyramid.
+static constexpr uint32 GroupSize = 64u;
+static constexpr uint32 PyramidGroupSize = 8u;
+
+static constexpr uint32 OcclusionFlag = 1u;
+static constexpr uint32 CompactFlag = 2u;
+
+// Matches the constants of Test/Cull.cs.hlsl and Test/Compact.cs.hlsl.
+struct TCullConstants
+{
+	Vector4 Planes[6];
+	Matrix4x4 PreviousViewProjection;
+	uint32 InstanceCount;
+	uint32 DrawCount;
+	uint32 Flags;
+	uint32 LevelCount;
+	Vector2 PyramidSize;
+	Vector2 Padding;
+};
+
+static_assert(sizeof(TCullConstants) == 192u);
+
+// Matches the constants of Test/DepthPyramid.cs.hlsl.
+struct TPyramidSizes
+{
+	uint32 SourceWidth;
+	uint32 SourceHeight;
+	uint32 Width;
+	uint32 Height;
+};
+
+// The compute queue uses the handed over resources here, the fill that clears the counters included.
+static constexpr VkPipelineStageFlags ComputeStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+// Draws, depth tests and readback copies of the graphics queue.
+static constexpr VkPipelineStageFlags GraphicsStageMask = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+	VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+// The graphics queue waits for the compute queue here, which holds back every later stage of the draws as well.
+static constexpr VkPipelineStageFlags GraphicsWaitStageMask = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+static VkCommandPool CreateCommandPool(VkDevice device, const VkAllocationCallbacks *allocator, uint32 queueFamilyIndex)
+{
+	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.pNext = nullptr;
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+	VkCommandPool pool = VK_NULL_HANDLE;
+	VkResult result = vkCreateCommandPool(device, &commandPoolCreateInfo, allocator, &pool);
+	ASSERT(result == VK_SUCCESS);
+	return pool;
+}
+
+static VkCommandBuffer CreateCommandBuffer(VkDevice device, VkCommandPool pool)
+{
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = nullptr;
+	commandBufferAllocateInfo.commandPool = pool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkResult result = vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer);
+	ASSERT(result == VK_SUCCESS);
+	return commandBuffer;
+}
+
+static void BeginCommandBuffer(VkCommandBuffer commandBuffer)
+{
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = nullptr;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = nullptr;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	ASSERT(result == VK_SUCCESS);
+}
+
+static void EndCommandBuffer(VkCommandBuffer commandBuffer)
+{
+	VkResult result = vkEndCommandBuffer(commandBuffer);
+	ASSERT(result == VK_SUCCESS);
+}
+
+static void SubmitCommandBuffer(VkQueue queue, VkCommandBuffer commandBuffer, VkSemaphore wait, VkPipelineStageFlags waitStageMask, VkSemaphore signal)
+{
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = nullptr;
+	submitInfo.waitSemaphoreCount = wait != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pWaitSemaphores = &wait;
+	submitInfo.pWaitDstStageMask = &waitStageMask;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = signal != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pSignalSemaphores = &signal;
+
+	VkResult result = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	ASSERT(result == VK_SUCCESS);
+}
+
+static VkImageMemoryBarrier MakeImageBarrier(VkImage image, VkImageAspectFlags aspectMask, VkImageLayout oldLayout, VkImageLayout newLayout,
+	VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+	VkImageMemoryBarrier imageMemoryBarrier = {};
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.pNext = nullptr;
+	imageMemoryBarrier.srcAccessMask = srcAccessMask;
+	imageMemoryBarrier.dstAccessMask = dstAccessMask;
+	imageMemoryBarrier.oldLayout = oldLayout;
+	imageMemoryBarrier.newLayout = newLayout;
+	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.image = image;
+	imageMemoryBarrier.subresourceRange.aspectMask = aspectMask;
+	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+	imageMemoryBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+	imageMemoryBarrier.subresourceRange.layerCount = 1;
+	return imageMemoryBarrier;
+}
+
+// VK_NULL_HANDLE when the shader is not available.
+static VkPipeline CreateComputePipeline(VkDevice device, const VkAllocationCallbacks *allocator, TShaderCache *shaderCache, VkPipelineCache pipelineCache,
+	const char *path, VkPipelineLayout pipelineLayout)
+{
+	TShaderBinary shader = shaderCache->Load(path, TShaderStage::Compute, "CS_main");
+	if (shader.Code == nullptr)
+	{
+		DebugPrint("Compute shader %s is not available\n", path);
+		return VK_NULL_HANDLE;
+	}
+
+	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderModuleCreateInfo.pNext = nullptr;
+	shaderModuleCreateInfo.flags = 0;
+	shaderModuleCreateInfo.codeSize = shader.Size;
+	shaderModuleCreateInfo.pCode = shader.Code;
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	VkResult result = vkCreateShaderModule(device, &shaderModuleCreateInfo, allocator, &shaderModule);
+	ASSERT(result == VK_SUCCESS);
+	shaderCache->Release(shader);
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo = {};
+	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCreateInfo.pNext = nullptr;
+	computePipelineCreateInfo.flags = 0;
+	computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computePipelineCreateInfo.stage.pNext = nullptr;
+	computePipelineCreateInfo.stage.flags = 0;
+	computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computePipelineCreateInfo.stage.module = shaderModule;
+	computePipelineCreateInfo.stage.pName = "CS_main";
+	computePipelineCreateInfo.stage.pSpecializationInfo = nullptr;
+	computePipelineCreateInfo.layout = pipelineLayout;
+	computePipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	computePipelineCreateInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	result = vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, allocator, &pipeline);
+	ASSERT(result == VK_SUCCESS);
+	vkDestroyShaderModule(device, shaderModule, allocator);
+	return pipeline;
+}
+
+static VkImageView CreateImageView(VkDevice device, const VkAllocationCallbacks *allocator, VkImage image, uint32 baseLevel, uint32 levelCount)
+{
+	VkImageViewCreateInfo imageViewCreateInfo = {};
+	imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewCreateInfo.pNext = nullptr;
+	imageViewCreateInfo.flags = 0;
+	imageViewCreateInfo.image = image;
+	imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewCreateInfo.subresourceRange.baseMipLevel = baseLevel;
+	imageViewCreateInfo.subresourceRange.levelCount = levelCount;
+	imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+	VkImageView view = VK_NULL_HANDLE;
+	VkResult result = vkCreateImageView(device, &imageViewCreateInfo, allocator, &view);
+	ASSERT(result == VK_SUCCESS);
+	return view;
+}
+
+static void WriteImage(VkWriteDescriptorSet &write, VkDescriptorImageInfo &imageInfo, VkDescriptorSet set, uint32 binding, VkDescriptorType type,
+	VkImageView view, VkImageLayout layout)
+{
+	imageInfo.sampler = VK_NULL_HANDLE;
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = layout;
+
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = set;
+	write.dstBinding = binding;
+	write.dstArrayElement = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = type;
+	write.pImageInfo = &imageInfo;
+	write.pBufferInfo = nullptr;
+	write.pTexelBufferView = nullptr;
+}
+
+// Same sets before setLayout and the same push constant range as the shared pipeline layout, so binding setLayout's
+// set leaves the frame's bindless heap bound. Without the heap emptySetLayout takes its place.
+static VkPipelineLayout CreatePipelineLayout(VkDevice device, const VkAllocationCallbacks *allocator, const TVulkanUniformRing *uniformRing,
+	const TVulkanBindlessHeap *bindless, VkDescriptorSetLayout emptySetLayout, VkDescriptorSetLayout setLayout)
+{
+	VkDescriptorSetLayout setLayouts[3];
+	setLayouts[TVulkanUniformRing::SetIndex] = uniformRing->GetSetLayout();
+	setLayouts[TVulkanBindlessHeap::SetIndex] = bindless->IsEnabled() ? bindless->GetSetLayout() : emptySetLayout;
+	setLayouts[TVulkanCulling::SetIndex] = setLayout;
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_ALL;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = TVulkanBindlessHeap::PushConstantSize;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pNext = nullptr;
+	pipelineLayoutCreateInfo.flags = 0;
+	pipelineLayoutCreateInfo.setLayoutCount = ArrayLength(setLayouts);
+	pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = bindless->IsEnabled() ? 1 : 0;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, allocator, &pipelineLayout);
+	ASSERT(result == VK_SUCCESS);
+	return pipelineLayout;
+}
+
+// Makes one dispatch's writes visible to the next one in the same pass.
+static void ComputeBarrier(VkCommandBuffer commandBuffer)
+{
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = nullptr;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+bool TVulkanDepthPyramid::Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, TShaderCache *shaderCache,
+	VkPipelineCache pipelineCache, TVulkanUniformRing *uniformRing, const TVulkanBindlessHeap *bindless, VkDescriptorSetLayout emptySetLayout,
+	uint32 width, uint32 height)
+{
+	Device = device;
+	Allocator = allocator;
+	MemoryManager = memoryManager;
+	UniformRing = uniformRing;
+	DepthWidth = width;
+	DepthHeight = height;
+	Width = Max(width / 2u, 1u);
+	Height = Max(height / 2u, 1u);
+	LevelCount = 1u;
+	while ((Max(Width, Height) >> LevelCount) != 0u)
+		++LevelCount;
+	ASSERT(LevelCount <= MaxLevels);
+
+	VkDescriptorSetLayoutBinding bindings[2];
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[0].pImmutableSamplers = nullptr;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.pNext = nullptr;
+	setLayoutCreateInfo.flags = 0;
+	setLayoutCreateInfo.bindingCount = ArrayLength(bindings);
+	setLayoutCreateInfo.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(Device, &setLayoutCreateInfo, Allocator, &SetLayout);
+	ASSERT(result == VK_SUCCESS);
+
+	PipelineLayout = CreatePipelineLayout(Device, Allocator, UniformRing, bindless, emptySetLayout, SetLayout);
+
+	Pipeline = CreateComputePipeline(Device, Allocator, shaderCache, pipelineCache, "Test/DepthPyramid.cs.hlsl", PipelineLayout);
+	if (Pipeline == VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(Device, PipelineLayout, Allocator);
+		vkDestroyDescriptorSetLayout(Device, SetLayout, Allocator);
+		PipelineLayout = VK_NULL_HANDLE;
+		SetLayout = VK_NULL_HANDLE;
+		return false;
+	}
+
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.pNext = nullptr;
+	imageCreateInfo.flags = 0;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageCreateInfo.extent.width = Width;
+	imageCreateInfo.extent.height = Height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = LevelCount;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.queueFamilyIndexCount = 0;
+	imageCreateInfo.pQueueFamilyIndices = nullptr;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	result = vkCreateImage(Device, &imageCreateInfo, Allocator, &Image);
+	ASSERT(result == VK_SUCCESS);
+	Memory = MemoryManager->AllocateImage(Image, TVulkanMemoryUsage::GpuOnly);
+
+	View = CreateImageView(Device, Allocator, Image, 0u, LevelCount);
+	for (uint32 i = 0; i < LevelCount; ++i)
+		LevelViews[i] = CreateImageView(Device, Allocator, Image, i, 1u);
+
+	VkDescriptorPoolSize poolSizes[2];
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	poolSizes[0].descriptorCount = MaxLevels + MaxFrames;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = MaxLevels + MaxFrames;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.pNext = nullptr;
+	poolCreateInfo.flags = 0;
+	poolCreateInfo.maxSets = MaxLevels + MaxFrames;
+	poolCreateInfo.poolSizeCount = ArrayLength(poolSizes);
+	poolCreateInfo.pPoolSizes = poolSizes;
+
+	result = vkCreateDescriptorPool(Device, &poolCreateInfo, Allocator, &Pool);
+	ASSERT(result == VK_SUCCESS);
+
+	// Level 0 has no set of its own, it is read through the frame's depth set.
+	VkDescriptorSetLayout setLayouts[MaxLevels + MaxFrames];
+	for (VkDescriptorSetLayout &setLayout : setLayouts)
+		setLayout = SetLayout;
+	VkDescriptorSet sets[MaxLevels + MaxFrames];
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.pNext = nullptr;
+	setAllocateInfo.descriptorPool = Pool;
+	setAllocateInfo.descriptorSetCount = LevelCount - 1u + MaxFrames;
+	setAllocateInfo.pSetLayouts = setLayouts;
+
+	result = vkAllocateDescriptorSets(Device, &setAllocateInfo, sets);
+	ASSERT(result == VK_SUCCESS);
+
+	VkWriteDescriptorSet writes[2u * (MaxLevels + MaxFrames)];
+	VkDescriptorImageInfo imageInfos[2u * (MaxLevels + MaxFrames)];
+	uint32 writeCount = 0u;
+	for (uint32 i = 0; i < MaxFrames; ++i)
+	{
+		DepthSets[i] = sets[i];
+		DepthViews[i] = VK_NULL_HANDLE;
+		WriteImage(writes[writeCount], imageInfos[writeCount], DepthSets[i], 1u, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, LevelViews[0], VK_IMAGE_LAYOUT_GENERAL);
+		++writeCount;
+	}
+	for (uint32 i = 1; i < LevelCount; ++i)
+	{
+		LevelSets[i] = sets[MaxFrames + i - 1u];
+		WriteImage(writes[writeCount], imageInfos[writeCount], LevelSets[i], 0u, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, LevelViews[i - 1u], VK_IMAGE_LAYOUT_GENERAL);
+		++writeCount;
+		WriteImage(writes[writeCount], imageInfos[writeCount], LevelSets[i], 1u, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, LevelViews[i], VK_IMAGE_LAYOUT_GENERAL);
+		++writeCount;
+	}
+	vkUpdateDescriptorSets(Device, writeCount, writes, 0, nullptr);
+	return true;
+}
+
+void TVulkanDepthPyramid::Done()
+{
+	vkDestroyPipeline(Device, Pipeline, Allocator);
+	vkDestroyPipelineLayout(Device, PipelineLayout, Allocator);
+	// Destroying the pool frees the sets.
+	vkDestroyDescriptorPool(Device, Pool, Allocator);
+	vkDestroyDescriptorSetLayout(Device, SetLayout, Allocator);
+	for (uint32 i = 0; i < LevelCount; ++i)
+	{
+		vkDestroyImageView(Device, LevelViews[i], Allocator);
+		LevelViews[i] = VK_NULL_HANDLE;
+	}
+	vkDestroyImageView(Device, View, Allocator);
+	vkDestroyImage(Device, Image, Allocator);
+	MemoryManager->Free(Memory);
+
+	Pipeline = VK_NULL_HANDLE;
+	PipelineLayout = VK_NULL_HANDLE;
+	Pool = VK_NULL_HANDLE;
+	SetLayout = VK_NULL_HANDLE;
+	View = VK_NULL_HANDLE;
+	Image = VK_NULL_HANDLE;
+	LevelCount = 0u;
+}
+
+void TVulkanDepthPyramid::Record(VkCommandBuffer commandBuffer, uint32 frame, VkImageView depth)
+{
+	ASSERT(frame < MaxFrames);
+	if (DepthViews[frame] != depth)
+	{
+		VkWriteDescriptorSet write;
+		VkDescriptorImageInfo imageInfo;
+		WriteImage(write, imageInfo, DepthSets[frame], 0u, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, depth, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		vkUpdateDescriptorSets(Device, 1, &write, 0, nullptr);
+		DepthViews[frame] = depth;
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+
+	TPyramidSizes sizes;
+	sizes.SourceWidth = DepthWidth;
+	sizes.SourceHeight = DepthHeight;
+	for (uint32 i = 0; i < LevelCount; ++i)
+	{
+		sizes.Width = Max(Width >> i, 1u);
+		sizes.Height = Max(Height >> i, 1u);
+		if (i > 0u)
+			ComputeBarrier(commandBuffer);
+		const VkDescriptorSet set = i == 0u ? DepthSets[frame] : LevelSets[i];
+		UniformRing->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, UniformRing->Upload(&sizes, sizeof(sizes)));
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, TVulkanCulling::SetIndex, 1, &set, 0, nullptr);
+		vkCmdDispatch(commandBuffer, DivCeil(sizes.Width, PyramidGroupSize), DivCeil(sizes.Height, PyramidGroupSize), 1);
+		sizes.SourceWidth = sizes.Width;
+		sizes.SourceHeight = sizes.Height;
+	}
+}
+
+VkBuffer TVulkanCulling::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, TVulkanAllocation &memory, TVulkanMemoryUsage memoryUsage)
+{
+	VkBufferCreateInfo bufferCreateInfo = {};
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = nullptr;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = size;
+	bufferCreateInfo.usage = usage;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 0;
+	bufferCreateInfo.pQueueFamilyIndices = nullptr;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkResult result = vkCreateBuffer(Device, &bufferCreateInfo, Allocator, &buffer);
+	ASSERT(result == VK_SUCCESS);
+	memory = MemoryManager->AllocateBuffer(buffer, memoryUsage);
+	return buffer;
+}
+
+void TVulkanCulling::Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, VkQueue queue, uint32 queueFamilyIndex,
+	VkQueue graphicsQueue, uint32 graphicsQueueFamilyIndex, TShaderCache *shaderCache, VkPipelineCache pipelineCache, TVulkanUniformRing *uniformRing,
+	TVulkanBindlessHeap *bindless, TVulkanMeshBuffer *meshBuffer, uint32 width, uint32 height)
+{
+	Device = device;
+	Allocator = allocator;
+	MemoryManager = memoryManager;
+	UniformRing = uniformRing;
+	Bindless = bindless;
+	MeshBuffer = meshBuffer;
+	Queue = queue;
+	GraphicsQueue = graphicsQueue;
+	QueueFamilyIndex = queueFamilyIndex;
+	GraphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+	// Within one family the barriers only order the work of a single queue.
+	ASSERT(QueueFamilyIndex != GraphicsQueueFamilyIndex || Queue == GraphicsQueue);
+	Enabled = false;
+	Initialized = false;
+	Pending = false;
+	Recorded = false;
+
+	// Each draw's visible instances go to a range of their own, which only multiDrawIndirect can draw in one call.
+	if (!MeshBuffer->GetFeatures().MultiDrawIndirect)
+		return;
+	Compact = MeshBuffer->GetFeatures().DrawIndirectCount;
+
+	static const VkDescriptorType descriptorTypes[] = {
+		// Instances, bounds, draws
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		// Counters, visible instances, culled draws
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		// Depth pyramid
+		VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+	};
+	const uint32 bindingCount = ArrayLength(descriptorTypes);
+	VkDescriptorSetLayoutBinding bindings[ArrayLength(descriptorTypes)];
+	for (uint32 i = 0; i < bindingCount; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = descriptorTypes[i];
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.pNext = nullptr;
+	setLayoutCreateInfo.flags = 0;
+	setLayoutCreateInfo.bindingCount = bindingCount;
+	setLayoutCreateInfo.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(Device, &setLayoutCreateInfo, Allocator, &SetLayout);
+	ASSERT(result == VK_SUCCESS);
+
+	setLayoutCreateInfo.bindingCount = 0;
+	setLayoutCreateInfo.pBindings = nullptr;
+	result = vkCreateDescriptorSetLayout(Device, &setLayoutCreateInfo, Allocator, &EmptySetLayout);
+	ASSERT(result == VK_SUCCESS);
+
+	PipelineLayout = CreatePipelineLayout(Device, Allocator, UniformRing, bindless, EmptySetLayout, SetLayout);
+
+	CullPipeline = CreateComputePipeline(Device, Allocator, shaderCache, pipelineCache, "Test/Cull.cs.hlsl", PipelineLayout);
+	CompactPipeline = CreateComputePipeline(Device, Allocator, shaderCache, pipelineCache, "Test/Compact.cs.hlsl", PipelineLayout);
+	if (CullPipeline == VK_NULL_HANDLE || CompactPipeline == VK_NULL_HANDLE ||
+		!Pyramid.Init(Device, Allocator, MemoryManager, shaderCache, pipelineCache, UniformRing, bindless, EmptySetLayout, width, height))
+	{
+		DestroyPipelines();
+		return;
+	}
+
+	// The compacted draw count and a counter per draw.
+	const VkDeviceSize counterSize = VkDeviceSize(TVulkanMeshBuffer::MaxMeshes + 1u) * sizeof(uint32);
+	Counters = CreateBuffer(counterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		CounterMemory);
+	Visible = CreateBuffer(VkDeviceSize(MeshBuffer->GetMaxInstances()) * sizeof(uint32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VisibleMemory);
+	Commands = CreateBuffer(VkDeviceSize(TVulkanMeshBuffer::MaxMeshes) * sizeof(VkDrawIndexedIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, CommandMemory);
+	// Vertex shaders find their instances through it.
+	VisibleSlot = Bindless->IsEnabled() ? Bindless->AddBuffer(Visible) : ~0u;
+	for (TReadback &readback : Readbacks)
+	{
+		readback.Buffer = CreateBuffer(MeshBuffer->GetCountOffset() + sizeof(uint32), VK_BUFFER_USAGE_TRANSFER_DST_BIT, readback.Memory, TVulkanMemoryUsage::GpuToCpu);
+		ASSERT(readback.Memory.Mapped != nullptr);
+	}
+
+	VkDescriptorPoolSize poolSizes[2];
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = MaxFrames * (bindingCount - 1u);
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	poolSizes[1].descriptorCount = MaxFrames;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.pNext = nullptr;
+	poolCreateInfo.flags = 0;
+	poolCreateInfo.maxSets = MaxFrames;
+	poolCreateInfo.poolSizeCount = ArrayLength(poolSizes);
+	poolCreateInfo.pPoolSizes = poolSizes;
+
+	result = vkCreateDescriptorPool(Device, &poolCreateInfo, Allocator, &Pool);
+	ASSERT(result == VK_SUCCESS);
+
+	const VkDescriptorSetLayout frameSetLayouts[MaxFrames] = { SetLayout, SetLayout };
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.pNext = nullptr;
+	setAllocateInfo.descriptorPool = Pool;
+	setAllocateInfo.descriptorSetCount = MaxFrames;
+	setAllocateInfo.pSetLayouts = frameSetLayouts;
+
+	result = vkAllocateDescriptorSets(Device, &setAllocateInfo, Sets);
+	ASSERT(result == VK_SUCCESS);
+
+	for (uint32 frame = 0; frame < MaxFrames; ++frame)
+	{
+		const VkBuffer buffers[] = {
+			MeshBuffer->GetInstanceBuffer(frame),
+			MeshBuffer->GetBoundsBuffer(),
+			MeshBuffer->GetCommandBuffer(frame),
+			Counters,
+			Visible,
+			Commands,
+		};
+		VkDescriptorBufferInfo bufferInfos[ArrayLength(buffers)];
+		VkWriteDescriptorSet writes[ArrayLength(descriptorTypes)];
+		for (uint32 i = 0; i < ArrayLength(buffers); ++i)
+		{
+			bufferInfos[i].buffer = buffers[i];
+			bufferInfos[i].offset = 0u;
+			bufferInfos[i].range = VK_WHOLE_SIZE;
+
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].pNext = nullptr;
+			writes[i].dstSet = Sets[frame];
+			writes[i].dstBinding = i;
+			writes[i].dstArrayElement = 0;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = descriptorTypes[i];
+			writes[i].pImageInfo = nullptr;
+			writes[i].pBufferInfo = &bufferInfos[i];
+			writes[i].pTexelBufferView = nullptr;
+		}
+		VkDescriptorImageInfo imageInfo;
+		WriteImage(writes[bindingCount - 1u], imageInfo, Sets[frame], bindingCount - 1u, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+			Pyramid.GetView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		vkUpdateDescriptorSets(Device, bindingCount, writes, 0, nullptr);
+	}
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = nullptr;
+	semaphoreCreateInfo.flags = 0;
+
+	CommandPool = CreateCommandPool(Device, Allocator, QueueFamilyIndex);
+	if (QueueFamilyIndex != GraphicsQueueFamilyIndex)
+		GraphicsCommandPool = CreateCommandPool(Device, Allocator, GraphicsQueueFamilyIndex);
+	for (THandoff &handoff : Handoffs)
+	{
+		handoff.CommandBuffer = CreateCommandBuffer(Device, CommandPool);
+		if (GraphicsCommandPool == VK_NULL_HANDLE)
+			continue;
+		handoff.ReleaseCommandBuffer = CreateCommandBuffer(Device, GraphicsCommandPool);
+		handoff.AcquireCommandBuffer = CreateCommandBuffer(Device, GraphicsCommandPool);
+		result = vkCreateSemaphore(Device, &semaphoreCreateInfo, Allocator, &handoff.Released);
+		ASSERT(result == VK_SUCCESS);
+		result = vkCreateSemaphore(Device, &semaphoreCreateInfo, Allocator, &handoff.Culled);
+		ASSERT(result == VK_SUCCESS);
+	}
+
+	Enabled = true;
+}
+
+void TVulkanCulling::DestroyPipelines()
+{
+	// Null handles are ignored.
+	vkDestroyPipeline(Device, CullPipeline, Allocator);
+	vkDestroyPipeline(Device, CompactPipeline, Allocator);
+	vkDestroyPipelineLayout(Device, PipelineLayout, Allocator);
+	vkDestroyDescriptorSetLayout(Device, SetLayout, Allocator);
+	vkDestroyDescriptorSetLayout(Device, EmptySetLayout, Allocator);
+	CullPipeline = VK_NULL_HANDLE;
+	CompactPipeline = VK_NULL_HANDLE;
+	PipelineLayout = VK_NULL_HANDLE;
+	SetLayout = VK_NULL_HANDLE;
+	EmptySetLayout = VK_NULL_HANDLE;
+}
+
+void TVulkanCulling::Done()
+{
+	if (!Enabled)
+		return;
+
+	vkDestroyDescriptorPool(Device, Pool, Allocator);
+	Pool = VK_NULL_HANDLE;
+	// Destroying the pools frees the command buffers, null handles are ignored.
+	for (THandoff &handoff : Handoffs)
+	{
+		vkDestroySemaphore(Device, handoff.Released, Allocator);
+		vkDestroySemaphore(Device, handoff.Culled, Allocator);
+		handoff = THandoff();
+	}
+	vkDestroyCommandPool(Device, CommandPool, Allocator);
+	vkDestroyCommandPool(Device, GraphicsCommandPool, Allocator);
+	CommandPool = VK_NULL_HANDLE;
+	GraphicsCommandPool = VK_NULL_HANDLE;
+	vkDestroyBuffer(Device, Counters, Allocator);
+	MemoryManager->Free(CounterMemory);
+	vkDestroyBuffer(Device, Visible, Allocator);
+	MemoryManager->Free(VisibleMemory);
+	vkDestroyBuffer(Device, Commands, Allocator);
+	MemoryManager->Free(CommandMemory);
+	if (VisibleSlot != ~0u)
+		Bindless->Release(TBindlessKind::Buffer, VisibleSlot, 0u);
+	VisibleSlot = ~0u;
+	for (TReadback &readback : Readbacks)
+	{
+		vkDestroyBuffer(Device, readback.Buffer, Allocator);
+		MemoryManager->Free(readback.Memory);
+		readback = TReadback();
+	}
+	Counters = VK_NULL_HANDLE;
+	Visible = VK_NULL_HANDLE;
+	Commands = VK_NULL_HANDLE;
+	Pyramid.Done();
+	DestroyPipelines();
+	Enabled = false;
+}
+
+TVulkanCullOutput TVulkanCulling::AddPasses(TRenderGraph &graph, const TVulkanCullView &view)
+{
+	ASSERT(Enabled && !Pending);
+	const uint32 frame = MeshBuffer->GetFrameSlot();
+	PendingView = view;
+	PendingFrame = frame;
+	Pending = true;
+
+	// Back from the compute queue before the graph runs, in the state the graph leaves them in.
+	TVulkanCullOutput output;
+	output.Commands = graph.ImportBuffer("CullCommands", Commands, TRenderGraphUsage::IndirectBuffer, TRenderGraphUsage::IndirectBuffer);
+	output.Counters = graph.ImportBuffer("CullCounters", Counters, TRenderGraphUsage::IndirectBuffer, TRenderGraphUsage::IndirectBuffer);
+	output.Visible = graph.ImportBuffer("CullVisible", Visible, TRenderGraphUsage::ShaderRead, TRenderGraphUsage::ShaderRead);
+
+	// Imported, so the pass is never culled, and left to the host, which reads it once the frame's fence signals.
+	const TRenderGraphResource readback = graph.ImportBuffer("CullReadback", Readbacks[frame].Buffer, TRenderGraphUsage::HostRead, TRenderGraphUsage::HostRead);
+	const int32 readbackPass = graph.AddPass("CullReadback", [this, frame](VkCommandBuffer commandBuffer) {
+		TReadback &readback = Readbacks[frame];
+		readback.InstanceCount = MeshBuffer->GetStatistics().InstanceCount;
+		readback.DrawCount = MeshBuffer->GetDrawCount();
+		readback.Pending = true;
+		if (readback.DrawCount == 0u)
+			return;
+
+		VkBufferCopy bufferCopy = {};
+		bufferCopy.srcOffset = 0u;
+		bufferCopy.dstOffset = 0u;
+		bufferCopy.size = VkDeviceSize(readback.DrawCount) * sizeof(VkDrawIndexedIndirectCommand);
+		vkCmdCopyBuffer(commandBuffer, Commands, readback.Buffer, 1, &bufferCopy);
+		if (Compact)
+		{
+			bufferCopy.dstOffset = MeshBuffer->GetCountOffset();
+			bufferCopy.size = sizeof(uint32);
+			vkCmdCopyBuffer(commandBuffer, Counters, readback.Buffer, 1, &bufferCopy);
+		}
+	});
+	graph.Read(readbackPass, output.Commands, TRenderGraphUsage::TransferSource);
+	graph.Read(readbackPass, output.Counters, TRenderGraphUsage::TransferSource);
+	graph.Write(readbackPass, readback, TRenderGraphUsage::TransferDestination);
+	return output;
+}
+
+void TVulkanCulling::RecordHandoff(VkCommandBuffer commandBuffer, bool toCompute, bool release, bool acquire)
+{
+	const bool transfer = QueueFamilyIndex != GraphicsQueueFamilyIndex;
+	ASSERT(release || acquire);
+	ASSERT(transfer || (release && acquire));
+
+	// The graphics queue only reads the buffers and writes the depth, the compute queue the other way round.
+	const VkAccessFlags graphicsBufferAccess = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	const VkAccessFlags computeBufferAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	const VkAccessFlags graphicsDepthAccess = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	const VkAccessFlags computeDepthAccess = VK_ACCESS_SHADER_READ_BIT;
+	const uint32 graphicsFamily = transfer ? GraphicsQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+	const uint32 computeFamily = transfer ? QueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+
+	const VkBuffer buffers[] = { Commands, Counters, Visible };
+	VkBufferMemoryBarrier bufferMemoryBarriers[ArrayLength(buffers)];
+	for (uint32 i = 0; i < ArrayLength(buffers); ++i)
+	{
+		VkBufferMemoryBarrier &bufferMemoryBarrier = bufferMemoryBarriers[i];
+		bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferMemoryBarrier.pNext = nullptr;
+		bufferMemoryBarrier.srcAccessMask = release && !toCompute ? VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+		bufferMemoryBarrier.dstAccessMask = acquire ? (toCompute ? computeBufferAccess : graphicsBufferAccess) : 0;
+		bufferMemoryBarrier.srcQueueFamilyIndex = toCompute ? graphicsFamily : computeFamily;
+		bufferMemoryBarrier.dstQueueFamilyIndex = toCompute ? computeFamily : graphicsFamily;
+		bufferMemoryBarrier.buffer = buffers[i];
+		bufferMemoryBarrier.offset = 0u;
+		bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+	}
+
+	// Read in SHADER_READ_ONLY_OPTIMAL on the compute queue, the transition is part of the transfer.
+	VkImageMemoryBarrier imageMemoryBarrier;
+	const bool depth = PendingView.Depth != VK_NULL_HANDLE;
+	if (depth)
+	{
+		const VkImageLayout graphicsLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		const VkImageLayout computeLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageMemoryBarrier = MakeImageBarrier(PendingView.Depth, VK_IMAGE_ASPECT_DEPTH_BIT, toCompute ? graphicsLayout : computeLayout, toCompute ? computeLayout : graphicsLayout,
+			release && toCompute ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : 0, acquire ? (toCompute ? computeDepthAccess : graphicsDepthAccess) : 0);
+		imageMemoryBarrier.srcQueueFamilyIndex = bufferMemoryBarriers[0].srcQueueFamilyIndex;
+		imageMemoryBarrier.dstQueueFamilyIndex = bufferMemoryBarriers[0].dstQueueFamilyIndex;
+	}
+
+	// An acquire on its own is chained to the semaphore wait by its source stages.
+	VkPipelineStageFlags srcStageMask = toCompute ? GraphicsStageMask : ComputeStageMask;
+	if (!release)
+		srcStageMask = toCompute ? ComputeStageMask : GraphicsWaitStageMask;
+	VkPipelineStageFlags dstStageMask = toCompute ? ComputeStageMask : GraphicsStageMask;
+	if (!acquire)
+		dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, ArrayLength(bufferMemoryBarriers), bufferMemoryBarriers,
+		depth ? 1 : 0, &imageMemoryBarrier);
+}
+
+void TVulkanCulling::Record()
+{
+	if (!Pending)
+		return;
+	ASSERT(!Recorded);
+	const THandoff &handoff = Handoffs[PendingFrame];
+	const bool transfer = QueueFamilyIndex != GraphicsQueueFamilyIndex;
+	const bool occlusion = PendingView.Depth != VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = handoff.CommandBuffer;
+
+	BeginCommandBuffer(commandBuffer);
+	RecordHandoff(commandBuffer, true, !transfer, true);
+
+	if (!Initialized)
+	{
+		// Once, the compaction pass clears the counters again after reading them.
+		vkCmdFillBuffer(commandBuffer, Counters, 0u, VK_WHOLE_SIZE, 0u);
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.pNext = nullptr;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// The pyramid never leaves the compute queue. The cull pass reads it in SHADER_READ_ONLY_OPTIMAL even without
+	// occlusion, the first frame then only moves it out of UNDEFINED.
+	const VkImage pyramid = Pyramid.GetImage();
+	if (occlusion)
+	{
+		VkImageMemoryBarrier imageMemoryBarrier = MakeImageBarrier(pyramid, VK_IMAGE_ASPECT_COLOR_BIT,
+			Initialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		Pyramid.Record(commandBuffer, PendingFrame, PendingView.DepthView);
+		imageMemoryBarrier = MakeImageBarrier(pyramid, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	}
+	else if (!Initialized)
+	{
+		const VkImageMemoryBarrier imageMemoryBarrier = MakeImageBarrier(pyramid, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, VK_ACCESS_SHADER_READ_BIT);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	}
+	Initialized = true;
+
+	TCullConstants constants = {};
+	ExtractFrustumPlanes(PendingView.ViewProjection, constants.Planes);
+	constants.PreviousViewProjection = PendingView.PreviousViewProjection;
+	constants.InstanceCount = MeshBuffer->GetStatistics().InstanceCount;
+	constants.DrawCount = MeshBuffer->GetDrawCount();
+	constants.Flags = (occlusion ? OcclusionFlag : 0u) | (Compact ? CompactFlag : 0u);
+	constants.LevelCount = Pyramid.GetLevelCount();
+	constants.PyramidSize = Vector2(float32(Pyramid.GetWidth()), float32(Pyramid.GetHeight()));
+	if (constants.DrawCount != 0u)
+	{
+		UniformRing->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, UniformRing->Upload(&constants, sizeof(constants)));
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, SetIndex, 1, &Sets[PendingFrame], 0, nullptr);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CullPipeline);
+		vkCmdDispatch(commandBuffer, DivCeil(constants.InstanceCount, GroupSize), 1, 1);
+		ComputeBarrier(commandBuffer);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CompactPipeline);
+		vkCmdDispatch(commandBuffer, DivCeil(constants.DrawCount, GroupSize), 1, 1);
+	}
+
+	RecordHandoff(commandBuffer, false, true, !transfer);
+	EndCommandBuffer(commandBuffer);
+
+	if (transfer)
+	{
+		BeginCommandBuffer(handoff.ReleaseCommandBuffer);
+		RecordHandoff(handoff.ReleaseCommandBuffer, true, true, false);
+		EndCommandBuffer(handoff.ReleaseCommandBuffer);
+
+		BeginCommandBuffer(handoff.AcquireCommandBuffer);
+		RecordHandoff(handoff.AcquireCommandBuffer, false, false, true);
+		EndCommandBuffer(handoff.AcquireCommandBuffer);
+	}
+	Recorded = true;
+}
+
+void TVulkanCulling::Submit()
+{
+	if (!Pending)
+		return;
+	ASSERT(Recorded);
+	Pending = false;
+	Recorded = false;
+	const THandoff &handoff = Handoffs[PendingFrame];
+
+	if (QueueFamilyIndex == GraphicsQueueFamilyIndex)
+	{
+		// The graphics queue itself, which orders the work, the barriers cover what was submitted before and after.
+		SubmitCommandBuffer(Queue, handoff.CommandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+		return;
+	}
+
+	// The release follows the last frame's draws and this frame's uploads on the graphics queue, its semaphore
+	// makes both visible to the compute queue. The acquire holds back whatever is submitted after it.
+	SubmitCommandBuffer(GraphicsQueue, handoff.ReleaseCommandBuffer, VK_NULL_HANDLE, 0, handoff.Released);
+	SubmitCommandBuffer(Queue, handoff.CommandBuffer, handoff.Released, ComputeStageMask, handoff.Culled);
+	SubmitCommandBuffer(GraphicsQueue, handoff.AcquireCommandBuffer, handoff.Culled, GraphicsWaitStageMask, VK_NULL_HANDLE);
+}
+
+void TVulkanCulling::Draw(VkCommandBuffer commandBuffer)
+{
+	const uint32 drawCount = MeshBuffer->GetDrawCount();
+	if (drawCount == 0u)
+		return;
+
+	const VkDeviceSize offset = 0u;
+	const VkBuffer vertexBuffer = MeshBuffer->GetVertexBuffer();
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, MeshBuffer->GetIndexBuffer(), 0u, VK_INDEX_TYPE_UINT16);
+	// Without a GPU count every draw is issued, those with no visible instance draw nothing.
+	if (Compact)
+		vkCmdDrawIndexedIndirectCount(commandBuffer, Commands, 0u, Counters, 0u, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+	else
+		vkCmdDrawIndexedIndirect(commandBuffer, Commands, 0u, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void TVulkanCulling::ReadStatistics(uint32 frame)
+{
+	TReadback &readback = Readbacks[frame];
+	if (!readback.Pending)
+		return;
+	readback.Pending = false;
+
+	Statistics = TVulkanCullStatistics();
+	Statistics.InstanceCount = readback.InstanceCount;
+	if (readback.DrawCount == 0u)
+		return;
+
+	MemoryManager->Invalidate(readback.Memory);
+	// Without compaction every draw is written, those with no visible instance count none.
+	uint32 drawCount = readback.DrawCount;
+	if (Compact)
+		MemCopy(&drawCount, readback.Memory.Mapped + MeshBuffer->GetCountOffset(), sizeof(drawCount));
+	ASSERT(drawCount <= readback.DrawCount);
+
+	const auto *draws = reinterpret_cast<const VkDrawIndexedIndirectCommand *>(readback.Memory.Mapped);
+	for (uint32 i = 0; i < drawCount; ++i)
+	{
+		if (draws[i].instanceCount == 0u)
+			continue;
+		++Statistics.VisibleDrawCount;
+		Statistics.VisibleInstanceCount += draws[i].instanceCount;
+	}
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+// References:
+// https://vkguide.dev/docs/gpudriven/compute_culling/
+// https://advances.realtimerendering.com/s2015/aaltonenhaar_siggraph2015_combined_final_footer_220dpi.pdf
+// https://www.nickdarnell.com/hierarchical-z-buffer-occlusion-culling/
+
+// Max reduction of a depth image, each texel holding the farthest depth of the 2x2 texels below it, and of the last
+// row and column as well where the level below has an odd size. Level 0 is half the size of the depth image.
+// R32_SFLOAT, built by a compute shader with one dispatch per level.
+class TVulkanDepthPyramid
+{
+public:
+	static constexpr uint32 MaxLevels = 16u;
+	static constexpr uint32 MaxFrames = 2u;
+
+	// False when the shader is not available. Each level's sizes come from the uniform ring, the set is bound at
+	// TVulkanCulling::SetIndex, with emptySetLayout in place of the bindless heap's when it is disabled.
+	bool Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, TShaderCache *shaderCache,
+		VkPipelineCache pipelineCache, TVulkanUniformRing *uniformRing, const TVulkanBindlessHeap *bindless, VkDescriptorSetLayout emptySetLayout,
+		uint32 width, uint32 height);
+	// The GPU must be idle.
+	void Done();
+
+	// Reduces depth, a view of a depth image of the size given to Init in SHADER_READ_ONLY_OPTIMAL, into the pyramid,
+	// which has to be in GENERAL. Views are bound per frame slot, the GPU has to be done with the slot's last frame.
+	void Record(VkCommandBuffer commandBuffer, uint32 frame, VkImageView depth);
+
+	VkImage GetImage() const {
+		return Image;
+	}
+	// All levels, for reading with Load.
+	VkImageView GetView() const {
+		return View;
+	}
+	uint32 GetWidth() const {
+		return Width;
+	}
+	uint32 GetHeight() const {
+		return Height;
+	}
+	uint32 GetLevelCount() const {
+		return LevelCount;
+	}
+
+private:
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	TVulkanMemoryManager *MemoryManager = nullptr;
+	TVulkanUniformRing *UniformRing = nullptr;
+	uint32 DepthWidth = 0u;
+	uint32 DepthHeight = 0u;
+	uint32 Width = 0u;
+	uint32 Height = 0u;
+	uint32 LevelCount = 0u;
+
+	VkImage Image = VK_NULL_HANDLE;
+	TVulkanAllocation Memory;
+	VkImageView View = VK_NULL_HANDLE;
+	VkImageView LevelViews[MaxLevels] = {};
+
+	VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool Pool = VK_NULL_HANDLE;
+	// Level i reads level i - 1, level 0 reads the depth image, with a set per frame slot.
+	VkDescriptorSet LevelSets[MaxLevels] = {};
+	VkDescriptorSet DepthSets[MaxFrames] = {};
+	VkImageView DepthViews[MaxFrames] = {};
+	VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+	VkPipeline Pipeline = VK_NULL_HANDLE;
+};
+
+// What a frame is culled against.
+struct TVulkanCullView
+{
+	Matrix4x4 ViewProjection;
+	// Depth of the previous frame and the matrix it was rendered with, occlusion is only tested when Depth is not
+	// null. The image has to be the size the culling was initialized with, of a depth only format, and left in
+	// DEPTH_STENCIL_ATTACHMENT_OPTIMAL by the graphics queue, which gets it back in that layout.
+	VkImage Depth = VK_NULL_HANDLE;
+	VkImageView DepthView = VK_NULL_HANDLE;
+	Matrix4x4 PreviousViewProjection;
+};
+
+// Written on the compute queue, to be read by the pass that calls TVulkanCulling::Draw. Back on the graphics queue
+// before the frame's graph runs.
+struct TVulkanCullOutput
+{
+	// Read as IndirectBuffer.
+	TRenderGraphResource Commands;
+	TRenderGraphResource Counters;
+	// Read as ShaderRead by vertex shaders, which find their instance at Instances[Visible[SV_InstanceID]].
+	TRenderGraphResource Visible;
+};
+
+// Read back from the GPU once it is done with a frame, the frame culled last of those.
+struct TVulkanCullStatistics
+{
+	uint32 InstanceCount = 0u;
+	uint32 VisibleInstanceCount = 0u;
+	// Draws with at least one visible instance.
+	uint32 VisibleDrawCount = 0u;
+};
+
+// Culls the mesh buffer's instances on the GPU. A compute pass tests every instance's bounding sphere against the
+// frustum and, when the previous frame's depth is given, against a depth pyramid built from it, appending the
+// visible instances to their draw's range of Visible. A second pass writes the draws, compacted down to the ones
+// with visible instances and counted on the GPU when the device has drawIndirectCount. Needs multiDrawIndirect.
+// Both passes and the depth pyramid run on the async compute queue. With a compute queue of another family than
+// the graphics queue's, the graphics queue releases the output and the depth to the compute family, signaling a
+// semaphore the compute queue waits on, and acquires them back once the compute queue signals it is done, ahead of
+// the frame's graphics work. Otherwise the compute work shares the graphics queue, with plain barriers.
+class TVulkanCulling
+{
+public:
+	static constexpr uint32 MaxFrames = 2u;
+	// After the uniform ring's and the bindless heap's, with pipeline layouts that keep those bound. The set is
+	// there even without the heap, so the shaders have a single permutation.
+	static constexpr uint32 SetIndex = 2u;
+
+	// Disabled when the device lacks multiDrawIndirect or the shaders are not available. width and height are the
+	// size of the depth images. queue may be graphicsQueue, the mesh buffer's instances and draws and the uniform
+	// ring have to be shared with its family.
+	void Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, VkQueue queue, uint32 queueFamilyIndex,
+		VkQueue graphicsQueue, uint32 graphicsQueueFamilyIndex, TShaderCache *shaderCache, VkPipelineCache pipelineCache, TVulkanUniformRing *uniformRing,
+		TVulkanBindlessHeap *bindless, TVulkanMeshBuffer *meshBuffer, uint32 width, uint32 height);
+	// The GPU must be idle.
+	void Done();
+
+	bool IsEnabled() const {
+		return Enabled;
+	}
+
+	// Culls the frame's instances, importing the output into the graph with a pass that reads its counts back.
+	// The compute work is recorded by Record and submitted by Submit.
+	TVulkanCullOutput AddPasses(TRenderGraph &graph, const TVulkanCullView &view);
+	// Records the frame's compute work, after the mesh buffer's Build and before the uniform ring's EndFrame.
+	void Record();
+	// Submits what Record recorded. The compute queue starts after everything submitted to the graphics queue so
+	// far, uploads included, and everything submitted to the graphics queue afterwards waits for it.
+	void Submit();
+	// Records the visible instances' draws, in place of TVulkanMeshBuffer::Draw.
+	void Draw(VkCommandBuffer commandBuffer);
+	// Reads what the passes of the frame slot's last frame counted, the GPU has to be done with it.
+	void ReadStatistics(uint32 frame);
+
+	// Slot of Visible in the bindless heap, ~0u when the heap is disabled.
+	uint32 GetVisibleSlot() const {
+		return VisibleSlot;
+	}
+	const TVulkanCullStatistics &GetStatistics() const {
+		return Statistics;
+	}
+
+	const TVulkanDepthPyramid &GetDepthPyramid() const {
+		return Pyramid;
+	}
+
+private:
+	// A frame slot's trip to the compute queue and back, reused once the GPU is done with the slot's last frame.
+	struct THandoff
+	{
+		VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+		// From the graphics family's pool, only used with a compute queue of another family.
+		VkCommandBuffer ReleaseCommandBuffer = VK_NULL_HANDLE;
+		VkCommandBuffer AcquireCommandBuffer = VK_NULL_HANDLE;
+		VkSemaphore Released = VK_NULL_HANDLE;
+		VkSemaphore Culled = VK_NULL_HANDLE;
+	};
+
+	// Host visible copy of a frame's culled draws, with the compacted draw count after them.
+	struct TReadback
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		TVulkanAllocation Memory;
+		uint32 InstanceCount = 0u;
+		uint32 DrawCount = 0u;
+		bool Pending = false;
+	};
+
+	VkBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, TVulkanAllocation &memory, TVulkanMemoryUsage memoryUsage = TVulkanMemoryUsage::GpuOnly);
+	// Barriers of the output, and of the depth when it is tested against, from the graphics queue to the compute
+	// queue or back. Release and acquire are the two halves of an ownership transfer, both for a single family.
+	void RecordHandoff(VkCommandBuffer commandBuffer, bool toCompute, bool release, bool acquire);
+	void DestroyPipelines();
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	TVulkanMemoryManager *MemoryManager = nullptr;
+	TVulkanUniformRing *UniformRing = nullptr;
+	TVulkanBindlessHeap *Bindless = nullptr;
+	TVulkanMeshBuffer *MeshBuffer = nullptr;
+	VkQueue Queue = VK_NULL_HANDLE;
+	VkQueue GraphicsQueue = VK_NULL_HANDLE;
+	uint32 QueueFamilyIndex = 0u;
+	uint32 GraphicsQueueFamilyIndex = 0u;
+	bool Enabled = false;
+	bool Compact = false;
+	// The pyramid is undefined and the counters hold garbage until the first frame is culled.
+	bool Initialized = false;
+
+	// Added by AddPasses, recorded and submitted at the end of the frame.
+	TVulkanCullView PendingView;
+	uint32 PendingFrame = 0u;
+	bool Pending = false;
+	bool Recorded = false;
+
+	TVulkanDepthPyramid Pyramid;
+	// GPU only, shared by the frames, each of which hands them to the compute queue and back. Counters holds the
+	// compacted draw count, followed by the visible instances of each draw.
+	VkBuffer Counters = VK_NULL_HANDLE;
+	TVulkanAllocation CounterMemory;
+	VkBuffer Visible = VK_NULL_HANDLE;
+	TVulkanAllocation VisibleMemory;
+	uint32 VisibleSlot = ~0u;
+	VkBuffer Commands = VK_NULL_HANDLE;
+	TVulkanAllocation CommandMemory;
+
+	VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool Pool = VK_NULL_HANDLE;
+	// The mesh buffer's instances and draws of each frame slot.
+	VkDescriptorSet Sets[MaxFrames] = {};
+	// Stands in for the bindless heap's set layout when it is disabled.
+	VkDescriptorSetLayout EmptySetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+	VkPipeline CullPipeline = VK_NULL_HANDLE;
+	VkPipeline CompactPipeline = VK_NULL_HANDLE;
+
+	// Compute family, and graphics family for the handoffs when that is another one.
+	VkCommandPool CommandPool = VK_NULL_HANDLE;
+	VkCommandPool GraphicsCommandPool = VK_NULL_HANDLE;
+	THandoff Handoffs[MaxFrames];
+
+	TReadback Readbacks[MaxFrames];
+	TVulkanCullStatistics Statistics;
+};
@@ -0,0 +1,121 @@
+#include "Precompiled.h"
+
+#include "RenderDevice-vk.h"
+
+void TVulkanDeletionQueue::Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager)
+{
+	Device = device;
+	Allocator = allocator;
+	MemoryManager = memoryManager;
+}
+
+void TVulkanDeletionQueue::Done()
+{
+	Collect(TNumericLimits<uint64>::Max());
+	Entries = TVarArray<TEntry>();
+}
+
+void TVulkanDeletionQueue::Release(VkBuffer buffer, const TVulkanAllocation &memory, uint64 frame)
+{
+	TEntry entry = {};
+	entry.Frame = frame;
+	entry.Kind = TKind::Buffer;
+	entry.Buffer = buffer;
+	entry.Memory = memory;
+	Add(entry);
+}
+
+void TVulkanDeletionQueue::Release(VkImage image, const TVulkanAllocation &memory, uint64 frame)
+{
+	TEntry entry = {};
+	entry.Frame = frame;
+	entry.Kind = TKind::Image;
+	entry.Image = image;
+	entry.Memory = memory;
+	Add(entry);
+}
+
+void TVulkanDeletionQueue::Release(VkImageView view, uint64 frame)
+{
+	TEntry entry = {};
+	entry.Frame = frame;
+	entry.Kind = TKind::ImageView;
+	entry.View = view;
+	Add(entry);
+}
+
+void TVulkanDeletionQueue::Release(VkPipeline pipeline, uint64 frame)
+{
+	TEntry entry = {};
+	entry.Frame = frame;
+	entry.Kind = TKind::Pipeline;
+	entry.Pipeline = pipeline;
+	Add(entry);
+}
+
+void TVulkanDeletionQueue::Release(VkDescriptorPool pool, VkDescriptorSet set, uint64 frame)
+{
+	TEntry entry = {};
+	entry.Frame = frame;
+	entry.Kind = TKind::DescriptorSet;
+	entry.DescriptorSet = set;
+	entry.Pool = pool;
+	Add(entry);
+}
+
+void TVulkanDeletionQueue::Add(const TEntry &entry)
+{
+	AcquireSRWLockExclusive(&Lock);
+	Entries.push_back(entry);
+	ReleaseSRWLockExclusive(&Lock);
+}
+
+void TVulkanDeletionQueue::Collect(uint64 completedFrame)
+{
+	// Releases come from several threads and are not sorted by frame, so the survivors are compacted in place.
+	AcquireSRWLockExclusive(&Lock);
+	size_t kept = 0u;
+	for (size_t i = 0; i < Entries.size(); ++i)
+	{
+		if (Entries[i].Frame <= completedFrame)
+			Destroy(Entries[i]);
+		else
+			Entries[kept++] = Entries[i];
+	}
+	Entries.resize(kept);
+	ReleaseSRWLockExclusive(&Lock);
+}
+
+uint32 TVulkanDeletionQueue::GetPendingCount() const
+{
+	AcquireSRWLockShared(&Lock);
+	const uint32 count = uint32(Entries.size());
+	ReleaseSRWLockShared(&Lock);
+	return count;
+}
+
+void TVulkanDeletionQueue::Destroy(TEntry &entry)
+{
+	switch (entry.Kind)
+	{
+	case TKind::Buffer:
+		vkDestroyBuffer(Device, entry.Buffer, Allocator);
+		break;
+	case TKind::Image:
+		vkDestroyImage(Device, entry.Image, Allocator);
+		break;
+	case TKind::ImageView:
+		vkDestroyImageView(Device, entry.View, Allocator);
+		break;
+	case TKind::Pipeline:
+		vkDestroyPipeline(Device, entry.Pipeline, Allocator);
+		break;
+	case TKind::DescriptorSet:
+	{
+		VkResult result = vkFreeDescriptorSets(Device, entry.Pool, 1, &entry.DescriptorSet);
+		ASSERT(result == VK_SUCCESS);
+		break;
+	}
+	}
+	MemoryManager->Free(entry.Memory);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// References:
+// https://www.khronos.org/registry/vulkan/specs/1.0/html/vkspec.html#fundamentals-objectmodel-lifetime
+// https://github.com/KhronosGroup/Vulkan-Docs/wiki/Synchronization-Examples
+
+// Objects released while the GPU may still be using them. Each one is retired with the index of the last frame
+// that can reference it and destroyed by the Collect that sees that frame complete, so nothing has to wait for
+// the device to go idle. Thread safe.
+class TVulkanDeletionQueue
+{
+public:
+	void Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager);
+	// Destroys everything still queued, the GPU must be idle.
+	void Done();
+
+	// The memory is freed along with the object, pass an empty allocation when it owns none.
+	void Release(VkBuffer buffer, const TVulkanAllocation &memory, uint64 frame);
+	void Release(VkImage image, const TVulkanAllocation &memory, uint64 frame);
+	void Release(VkImageView view, uint64 frame);
+	void Release(VkPipeline pipeline, uint64 frame);
+	// The pool needs VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT.
+	void Release(VkDescriptorPool pool, VkDescriptorSet set, uint64 frame);
+
+	// Destroys what was retired with completedFrame or earlier.
+	void Collect(uint64 completedFrame);
+
+	uint32 GetPendingCount() const;
+
+private:
+	enum class TKind : uint8
+	{
+		Buffer,
+		Image,
+		ImageView,
+		Pipeline,
+		DescriptorSet,
+	};
+
+	struct TEntry
+	{
+		uint64 Frame;
+		TKind Kind;
+		union
+		{
+			VkBuffer Buffer;
+			VkImage Image;
+			VkImageView View;
+			VkPipeline Pipeline;
+			VkDescriptorSet DescriptorSet;
+		};
+		VkDescriptorPool Pool;
+		TVulkanAllocation Memory;
+	};
+
+	void Add(const TEntry &entry);
+	void Destroy(TEntry &entry);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	TVulkanMemoryManager *MemoryManager = nullptr;
+
+	mutable SRWLOCK Lock = SRWLOCK_INIT;
+	TVarArray<TEntry> Entries;
+};
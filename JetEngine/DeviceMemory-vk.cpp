@@ -0,0 +1,406 @@
+#include "Precompiled.h"
+
+#include "RenderDevice-vk.h"
+
+void TVulkanBufferSharing::Add(uint32 queueFamilyIndex)
+{
+	for (uint32 i = 0; i < QueueFamilyCount; ++i)
+	{
+		if (QueueFamilies[i] == queueFamilyIndex)
+			return;
+	}
+	ASSERT(QueueFamilyCount < ArrayLength(QueueFamilies));
+	QueueFamilies[QueueFamilyCount++] = queueFamilyIndex;
+}
+
+void TVulkanBufferSharing::Apply(VkBufferCreateInfo &bufferCreateInfo) const
+{
+	if (QueueFamilyCount <= 1u)
+	{
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.queueFamilyIndexCount = 0;
+		bufferCreateInfo.pQueueFamilyIndices = nullptr;
+	}
+	else
+	{
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferCreateInfo.queueFamilyIndexCount = QueueFamilyCount;
+		bufferCreateInfo.pQueueFamilyIndices = QueueFamilies;
+	}
+}
+
+struct TVulkanMemoryBlock
+{
+	VkDeviceMemory Memory = VK_NULL_HANDLE;
+	uint8 *Mapped = nullptr;
+	uint32 MemoryType = 0u;
+	TVulkanResourceKind Kind = TVulkanResourceKind::Linear;
+	uint32 AllocationCount = 0u;
+	TBuddyAllocator Allocator;
+};
+
+void TVulkanMemoryManager::Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator)
+{
+	Device = device;
+	Allocator = allocator;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &MemoryProperties);
+
+	VkPhysicalDeviceProperties physicalDeviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+	NonCoherentAtomSize = Max(physicalDeviceProperties.limits.nonCoherentAtomSize, VkDeviceSize(1u));
+	MaxDeviceAllocationCount = physicalDeviceProperties.limits.maxMemoryAllocationCount;
+
+	// Small heaps (like the 256MB host visible device local window) get smaller blocks, so one block never takes the whole heap.
+	for (uint32 i = 0; i < MemoryProperties.memoryHeapCount; ++i)
+	{
+		const VkDeviceSize eighth = MemoryProperties.memoryHeaps[i].size / 8u;
+		BlockSizes[i] = eighth >= MaxBlockSize ? MaxBlockSize : Max(VkDeviceSize(1u) << FloorLog2(eighth), MinAllocationSize);
+		Statistics[i] = TVulkanMemoryStatistics();
+	}
+}
+
+void TVulkanMemoryManager::Done()
+{
+	const auto total = GetTotalStatistics();
+	if (total.AllocationCount > 0u)
+		DebugPrint("Vulkan memory: %u allocations (%llu bytes) leaked\n", total.AllocationCount, total.UsedBytes);
+
+	for (uint32 type = 0; type < MemoryProperties.memoryTypeCount; ++type)
+	{
+		for (auto &blocks : Blocks[type])
+		{
+			for (size_t i = 0; i < blocks.size(); ++i)
+			{
+				FreeDeviceMemory(blocks[i]->Memory, blocks[i]->Allocator.GetSize(), type);
+				delete blocks[i];
+			}
+			blocks.resize(0);
+		}
+	}
+	Device = VK_NULL_HANDLE;
+}
+
+uint32 TVulkanMemoryManager::FindMemoryType(uint32 typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const
+{
+	for (const auto flags : { required | preferred, required })
+	{
+		for (uint32 i = 0; i < MemoryProperties.memoryTypeCount; ++i)
+		{
+			if ((typeBits & (1u << i)) && (MemoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+				return i;
+		}
+	}
+	return TNumericLimits<uint32>::Max();
+}
+
+VkDeviceMemory TVulkanMemoryManager::AllocateDeviceMemory(VkDeviceSize size, uint32 memoryType, uint8 *&mapped)
+{
+	auto &statistics = Statistics[GetHeapIndex(memoryType)];
+	if (GetTotalStatistics().DeviceAllocationCount >= MaxDeviceAllocationCount)
+		return VK_NULL_HANDLE;
+
+	VkMemoryAllocateInfo memoryAllocateInfo = {};
+	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocateInfo.pNext = nullptr;
+	memoryAllocateInfo.allocationSize = size;
+	memoryAllocateInfo.memoryTypeIndex = memoryType;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkResult result = vkAllocateMemory(Device, &memoryAllocateInfo, Allocator, &memory);
+	if (result != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+
+	mapped = nullptr;
+	if (MemoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		void *data = nullptr;
+		result = vkMapMemory(Device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+		ASSERT(result == VK_SUCCESS);
+		mapped = static_cast<uint8 *>(data);
+	}
+
+	++statistics.DeviceAllocationCount;
+	statistics.ReservedBytes += size;
+	statistics.PeakReservedBytes = Max(statistics.PeakReservedBytes, statistics.ReservedBytes);
+	return memory;
+}
+
+void TVulkanMemoryManager::FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, uint32 memoryType)
+{
+	auto &statistics = Statistics[GetHeapIndex(memoryType)];
+	--statistics.DeviceAllocationCount;
+	statistics.ReservedBytes -= size;
+
+	// Freeing implicitly unmaps.
+	vkFreeMemory(Device, memory, Allocator);
+}
+
+TVulkanAllocation TVulkanMemoryManager::AllocateDedicated(VkDeviceSize size, uint32 memoryType)
+{
+	TVulkanAllocation allocation;
+	const VkDeviceSize reservedSize = AlignUp(size, NonCoherentAtomSize);
+	allocation.Memory = AllocateDeviceMemory(reservedSize, memoryType, allocation.Mapped);
+	if (!allocation.IsValid())
+		return allocation;
+
+	allocation.Offset = 0u;
+	allocation.Size = size;
+	allocation.MemoryType = memoryType;
+
+	auto &statistics = Statistics[GetHeapIndex(memoryType)];
+	++statistics.DedicatedAllocationCount;
+	++statistics.AllocationCount;
+	statistics.UsedBytes += size;
+	statistics.AllocatedBytes += reservedSize;
+	return allocation;
+}
+
+TVulkanAllocation TVulkanMemoryManager::AllocateFromType(const VkMemoryRequirements &requirements, uint32 memoryType, TVulkanResourceKind kind)
+{
+	const uint32 heapIndex = GetHeapIndex(memoryType);
+	const VkDeviceSize blockSize = BlockSizes[heapIndex];
+
+	// Anything above half a block would waste most of a fresh block to rounding anyway.
+	if (requirements.size > blockSize / 2u)
+		return AllocateDedicated(requirements.size, memoryType);
+
+	auto &blocks = Blocks[memoryType][uint32(kind)];
+	TVulkanMemoryBlock *block = nullptr;
+	uint64 offset = TBuddyAllocator::InvalidOffset;
+	uint64 usedBefore = 0u;
+	for (size_t i = 0; i < blocks.size() && offset == TBuddyAllocator::InvalidOffset; ++i)
+	{
+		block = blocks[i];
+		usedBefore = block->Allocator.GetUsedSize();
+		offset = block->Allocator.Allocate(requirements.size, requirements.alignment);
+	}
+
+	if (offset == TBuddyAllocator::InvalidOffset)
+	{
+		uint8 *mapped = nullptr;
+		VkDeviceMemory memory = AllocateDeviceMemory(blockSize, memoryType, mapped);
+		if (memory == VK_NULL_HANDLE)
+			return AllocateDedicated(requirements.size, memoryType);
+
+		block = new TVulkanMemoryBlock();
+		block->Memory = memory;
+		block->Mapped = mapped;
+		block->MemoryType = memoryType;
+		block->Kind = kind;
+		block->Allocator.Init(blockSize, MinAllocationSize);
+		blocks.push_back(block);
+		++Statistics[heapIndex].BlockCount;
+
+		usedBefore = 0u;
+		offset = block->Allocator.Allocate(requirements.size, requirements.alignment);
+		ASSERT(offset != TBuddyAllocator::InvalidOffset);
+	}
+
+	TVulkanAllocation allocation;
+	allocation.Memory = block->Memory;
+	allocation.Offset = offset;
+	allocation.Size = requirements.size;
+	allocation.Mapped = block->Mapped ? block->Mapped + offset : nullptr;
+	allocation.MemoryType = memoryType;
+	allocation.Block = block;
+
+	auto &statistics = Statistics[heapIndex];
+	++block->AllocationCount;
+	++statistics.AllocationCount;
+	statistics.UsedBytes += requirements.size;
+	statistics.AllocatedBytes += block->Allocator.GetUsedSize() - usedBefore;
+	return allocation;
+}
+
+TVulkanAllocation TVulkanMemoryManager::Allocate(const VkMemoryRequirements &requirements, TVulkanMemoryUsage usage, TVulkanResourceKind kind)
+{
+	VkMemoryPropertyFlags required = 0u;
+	VkMemoryPropertyFlags preferred = 0u;
+	switch (usage)
+	{
+	case TVulkanMemoryUsage::GpuOnly:
+		required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		break;
+	case TVulkanMemoryUsage::CpuToGpu:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		break;
+	case TVulkanMemoryUsage::GpuToCpu:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		break;
+	}
+
+	AcquireSRWLockExclusive(&Lock);
+
+	// Fall back to the other compatible types when the preferred heap runs out.
+	TVulkanAllocation allocation;
+	uint32 typeBits = requirements.memoryTypeBits;
+	while (!allocation.IsValid())
+	{
+		const uint32 memoryType = FindMemoryType(typeBits, required, preferred);
+		if (memoryType == TNumericLimits<uint32>::Max())
+			break;
+
+		allocation = AllocateFromType(requirements, memoryType, kind);
+		typeBits &= ~(1u << memoryType);
+	}
+
+	ReleaseSRWLockExclusive(&Lock);
+
+	ASSERT(allocation.IsValid());
+	return allocation;
+}
+
+TVulkanAllocation TVulkanMemoryManager::AllocateBuffer(VkBuffer buffer, TVulkanMemoryUsage usage)
+{
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(Device, buffer, &memoryRequirements);
+
+	TVulkanAllocation allocation = Allocate(memoryRequirements, usage, TVulkanResourceKind::Linear);
+	VkResult result = vkBindBufferMemory(Device, buffer, allocation.Memory, allocation.Offset);
+	ASSERT(result == VK_SUCCESS);
+	return allocation;
+}
+
+TVulkanAllocation TVulkanMemoryManager::AllocateImage(VkImage image, TVulkanMemoryUsage usage)
+{
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(Device, image, &memoryRequirements);
+
+	TVulkanAllocation allocation = Allocate(memoryRequirements, usage, TVulkanResourceKind::Optimal);
+	VkResult result = vkBindImageMemory(Device, image, allocation.Memory, allocation.Offset);
+	ASSERT(result == VK_SUCCESS);
+	return allocation;
+}
+
+void TVulkanMemoryManager::Free(TVulkanAllocation &allocation)
+{
+	if (!allocation.IsValid())
+		return;
+
+	AcquireSRWLockExclusive(&Lock);
+
+	auto &statistics = Statistics[GetHeapIndex(allocation.MemoryType)];
+	--statistics.AllocationCount;
+	statistics.UsedBytes -= allocation.Size;
+
+	if (auto *block = allocation.Block)
+	{
+		const uint64 usedBefore = block->Allocator.GetUsedSize();
+		block->Allocator.Free(allocation.Offset);
+		statistics.AllocatedBytes -= usedBefore - block->Allocator.GetUsedSize();
+		--block->AllocationCount;
+
+		// Keep one empty block around per pool, so a resource that is recreated every frame does not hit the driver.
+		if (block->AllocationCount == 0u)
+		{
+			auto &blocks = Blocks[block->MemoryType][uint32(block->Kind)];
+			bool hasOtherEmpty = false;
+			size_t index = 0u;
+			for (size_t i = 0; i < blocks.size(); ++i)
+			{
+				if (blocks[i] == block)
+					index = i;
+				else if (blocks[i]->AllocationCount == 0u)
+					hasOtherEmpty = true;
+			}
+
+			if (hasOtherEmpty)
+			{
+				FreeDeviceMemory(block->Memory, block->Allocator.GetSize(), block->MemoryType);
+				--statistics.BlockCount;
+				delete block;
+				blocks[index] = blocks.back();
+				blocks.pop_back();
+			}
+		}
+	}
+	else
+	{
+		const VkDeviceSize reservedSize = AlignUp(allocation.Size, NonCoherentAtomSize);
+		statistics.AllocatedBytes -= reservedSize;
+		--statistics.DedicatedAllocationCount;
+		FreeDeviceMemory(allocation.Memory, reservedSize, allocation.MemoryType);
+	}
+
+	ReleaseSRWLockExclusive(&Lock);
+
+	allocation = TVulkanAllocation();
+}
+
+bool TVulkanMemoryManager::IsCoherent(const TVulkanAllocation &allocation) const
+{
+	return MemoryProperties.memoryTypes[allocation.MemoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+void TVulkanMemoryManager::FlushOrInvalidate(const TVulkanAllocation &allocation, VkDeviceSize offset, VkDeviceSize size, bool flush)
+{
+	if (IsCoherent(allocation))
+		return;
+
+	// Ranges must be aligned to nonCoherentAtomSize, buddy blocks are at least MinAllocationSize aligned so rounding stays inside.
+	const VkDeviceSize begin = allocation.Offset + offset;
+	const VkDeviceSize end = allocation.Offset + (size == VK_WHOLE_SIZE ? allocation.Size : offset + size);
+
+	VkMappedMemoryRange mappedMemoryRange = {};
+	mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	mappedMemoryRange.pNext = nullptr;
+	mappedMemoryRange.memory = allocation.Memory;
+	mappedMemoryRange.offset = begin / NonCoherentAtomSize * NonCoherentAtomSize;
+	mappedMemoryRange.size = AlignUp(end, NonCoherentAtomSize) - mappedMemoryRange.offset;
+
+	VkResult result = flush ?
+		vkFlushMappedMemoryRanges(Device, 1, &mappedMemoryRange) :
+		vkInvalidateMappedMemoryRanges(Device, 1, &mappedMemoryRange);
+	ASSERT(result == VK_SUCCESS);
+}
+
+void TVulkanMemoryManager::Flush(const TVulkanAllocation &allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	FlushOrInvalidate(allocation, offset, size, true);
+}
+
+void TVulkanMemoryManager::Invalidate(const TVulkanAllocation &allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	FlushOrInvalidate(allocation, offset, size, false);
+}
+
+TVulkanMemoryStatistics TVulkanMemoryManager::GetStatistics(uint32 heapIndex) const
+{
+	return Statistics[heapIndex];
+}
+
+TVulkanMemoryStatistics TVulkanMemoryManager::GetTotalStatistics() const
+{
+	TVulkanMemoryStatistics total;
+	for (uint32 i = 0; i < MemoryProperties.memoryHeapCount; ++i)
+	{
+		const auto &heap = Statistics[i];
+		total.DeviceAllocationCount += heap.DeviceAllocationCount;
+		total.BlockCount += heap.BlockCount;
+		total.DedicatedAllocationCount += heap.DedicatedAllocationCount;
+		total.AllocationCount += heap.AllocationCount;
+		total.ReservedBytes += heap.ReservedBytes;
+		total.PeakReservedBytes += heap.PeakReservedBytes;
+		total.UsedBytes += heap.UsedBytes;
+		total.AllocatedBytes += heap.AllocatedBytes;
+	}
+	return total;
+}
+
+void TVulkanMemoryManager::PrintStatistics() const
+{
+	AcquireSRWLockShared(&Lock);
+	for (uint32 i = 0; i < MemoryProperties.memoryHeapCount; ++i)
+	{
+		const auto &heap = Statistics[i];
+		if (heap.DeviceAllocationCount == 0u)
+			continue;
+
+		DebugPrint("Vulkan heap %u: %u device allocations (%u blocks, %u dedicated), %u resources, %llu/%llu/%llu bytes used/allocated/reserved, peak %llu\n",
+			i, heap.DeviceAllocationCount, heap.BlockCount, heap.DedicatedAllocationCount, heap.AllocationCount,
+			heap.UsedBytes, heap.AllocatedBytes, heap.ReservedBytes, heap.PeakReservedBytes);
+	}
+	ReleaseSRWLockShared(&Lock);
+}
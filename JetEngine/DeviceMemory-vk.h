@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Core/Memory/BuddyAllocator.h"
+
+// References:
+// https://gpuopen.com/learn/vulkan-device-memory/
+// https://developer.nvidia.com/vulkan-memory-management
+
+enum class TVulkanMemoryUsage
+{
+	// Device local, written by transfers or by the GPU itself.
+	GpuOnly,
+	// Host visible, written once per frame or uploaded from.
+	CpuToGpu,
+	// Host visible and preferably cached, read back on the CPU.
+	GpuToCpu,
+};
+
+// Buffers and linear images never share a block with optimal tiling images, so bufferImageGranularity never applies.
+enum class TVulkanResourceKind
+{
+	Linear,
+	Optimal,
+};
+
+struct TVulkanMemoryBlock;
+
+struct TVulkanAllocation
+{
+	VkDeviceMemory Memory = VK_NULL_HANDLE;
+	VkDeviceSize Offset = 0u;
+	VkDeviceSize Size = 0u;
+	// Persistently mapped address of Offset, nullptr for memory the host cannot see.
+	uint8 *Mapped = nullptr;
+	uint32 MemoryType = 0u;
+	// nullptr for dedicated allocations.
+	TVulkanMemoryBlock *Block = nullptr;
+
+	bool IsValid() const {
+		return Memory != VK_NULL_HANDLE;
+	}
+};
+
+// Queue families that access a buffer without ownership transfers, CONCURRENT when there is more than one.
+struct TVulkanBufferSharing
+{
+	// Graphics, transfer and compute at most.
+	uint32 QueueFamilies[3] = {};
+	uint32 QueueFamilyCount = 0u;
+
+	// Families already there are ignored.
+	void Add(uint32 queueFamilyIndex);
+	// pQueueFamilyIndices points into the sharing, which has to outlive the create call.
+	void Apply(VkBufferCreateInfo &bufferCreateInfo) const;
+};
+
+struct TVulkanMemoryStatistics
+{
+	// Number of live vkAllocateMemory objects, the one counted against maxMemoryAllocationCount.
+	uint32 DeviceAllocationCount = 0u;
+	uint32 BlockCount = 0u;
+	uint32 DedicatedAllocationCount = 0u;
+	uint32 AllocationCount = 0u;
+	// Memory taken from the driver.
+	VkDeviceSize ReservedBytes = 0u;
+	VkDeviceSize PeakReservedBytes = 0u;
+	// Sizes requested by resources.
+	VkDeviceSize UsedBytes = 0u;
+	// Reserved by buddy blocks, the difference to UsedBytes is lost to rounding up to powers of two.
+	VkDeviceSize AllocatedBytes = 0u;
+};
+
+// Allocates large blocks per memory type and sub-allocates resources out of them with a buddy allocator.
+// Host visible blocks stay mapped for their whole lifetime. Thread safe.
+class TVulkanMemoryManager
+{
+public:
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator);
+	void Done();
+
+	TVulkanAllocation Allocate(const VkMemoryRequirements &requirements, TVulkanMemoryUsage usage, TVulkanResourceKind kind);
+	// Allocates and binds memory for the resource.
+	TVulkanAllocation AllocateBuffer(VkBuffer buffer, TVulkanMemoryUsage usage);
+	TVulkanAllocation AllocateImage(VkImage image, TVulkanMemoryUsage usage);
+	void Free(TVulkanAllocation &allocation);
+
+	// Makes host writes visible to the device, does nothing for coherent memory.
+	void Flush(const TVulkanAllocation &allocation, VkDeviceSize offset = 0u, VkDeviceSize size = VK_WHOLE_SIZE);
+	// Makes device writes visible to the host, does nothing for coherent memory.
+	void Invalidate(const TVulkanAllocation &allocation, VkDeviceSize offset = 0u, VkDeviceSize size = VK_WHOLE_SIZE);
+
+	bool IsCoherent(const TVulkanAllocation &allocation) const;
+	TVulkanMemoryStatistics GetStatistics(uint32 heapIndex) const;
+	TVulkanMemoryStatistics GetTotalStatistics() const;
+	void PrintStatistics() const;
+
+private:
+	static constexpr uint32 ResourceKindCount = 2u;
+	static constexpr VkDeviceSize MinAllocationSize = 256u;
+	static constexpr VkDeviceSize MaxBlockSize = 64u * 1024u * 1024u;
+
+	uint32 FindMemoryType(uint32 typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const;
+	TVulkanAllocation AllocateFromType(const VkMemoryRequirements &requirements, uint32 memoryType, TVulkanResourceKind kind);
+	TVulkanAllocation AllocateDedicated(VkDeviceSize size, uint32 memoryType);
+	VkDeviceMemory AllocateDeviceMemory(VkDeviceSize size, uint32 memoryType, uint8 *&mapped);
+	void FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, uint32 memoryType);
+	void FlushOrInvalidate(const TVulkanAllocation &allocation, VkDeviceSize offset, VkDeviceSize size, bool flush);
+
+	uint32 GetHeapIndex(uint32 memoryType) const {
+		return MemoryProperties.memoryTypes[memoryType].heapIndex;
+	}
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	VkPhysicalDeviceMemoryProperties MemoryProperties = {};
+	VkDeviceSize NonCoherentAtomSize = 1u;
+	uint32 MaxDeviceAllocationCount = 0u;
+	VkDeviceSize BlockSizes[VK_MAX_MEMORY_HEAPS] = {};
+
+	TVarArray<TVulkanMemoryBlock *> Blocks[VK_MAX_MEMORY_TYPES][ResourceKindCount];
+	TVulkanMemoryStatistics Statistics[VK_MAX_MEMORY_HEAPS];
+	mutable SRWLOCK Lock = SRWLOCK_INIT;
+};
@@ -52,4 +52,57 @@ namespace FS
 		CloseHandle(fileNT.Mapping);
 		CloseHandle(fileNT.Descriptor);
 	}
+
+	bool Exists(const char *path)
+	{
+		const DWORD attributes = GetFileAttributes(path);
+		return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+	}
+
+	bool MakeDirectory(const char *path)
+	{
+		return CreateDirectory(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+	}
+
+	bool Rename(const char *from, const char *to)
+	{
+		return MoveFileEx(from, to, MOVEFILE_REPLACE_EXISTING);
+	}
+
+	bool Remove(const char *path)
+	{
+		return DeleteFile(path);
+	}
+
+	bool WriteAtomic(const char *path, const void *data, uint64 size)
+	{
+		char temporaryPath[MAX_PATH];
+		const int32 length = snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+		if (length < 0 || length >= int32(sizeof(temporaryPath)))
+			return false;
+
+		HANDLE descriptor = CreateFile(temporaryPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (descriptor == INVALID_HANDLE_VALUE)
+			return false;
+
+		const auto *bytes = static_cast<const uint8 *>(data);
+		bool succeeded = true;
+		while (size > 0 && succeeded)
+		{
+			const DWORD chunkSize = DWORD(Min(size, uint64(1u << 30u)));
+			DWORD written = 0;
+			succeeded = WriteFile(descriptor, bytes, chunkSize, &written, NULL) && written == chunkSize;
+			bytes += written;
+			size -= written;
+		}
+
+		// The data has to be on disk before the rename, otherwise a crash can leave the new name pointing at garbage.
+		succeeded = succeeded && FlushFileBuffers(descriptor);
+		CloseHandle(descriptor);
+
+		succeeded = succeeded && MoveFileEx(temporaryPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+		if (!succeeded)
+			DeleteFile(temporaryPath);
+		return succeeded;
+	}
 }
\ No newline at end of file
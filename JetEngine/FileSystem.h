@@ -21,4 +21,14 @@ namespace FS
 
 	File Open(const char *path, AccessMode accessMode = AccessMode::None);
 	void Close(File file);
+
+	bool Exists(const char *path);
+	// True when the directory exists afterwards, whether or not this call created it. Parents must exist.
+	bool MakeDirectory(const char *path);
+	// Replaces the target if there is one.
+	bool Rename(const char *from, const char *to);
+	bool Remove(const char *path);
+	// Writes a temporary file next to the target and renames it over the target,
+	// so readers see either the old or the new contents but never a partial file.
+	bool WriteAtomic(const char *path, const void *data, uint64 size);
 }
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include "Precompiled.h"
+
+#include "RenderDevice-vk.h"
+
+static const char *ScopeNames[] = { "command", "object", "cache", "device", "instance" };
+
+// Every Init gets a new generation, so a thread never picks up an arena a previous allocator has freed.
+static volatile LONG GenerationCounter = 0;
+
+static uintptr_t AlignAddress(uintptr_t address, size_t alignment)
+{
+	return (address + alignment - 1u) & ~uintptr_t(alignment - 1u);
+}
+
+static void AddPeak(volatile LONG64 *peak, LONG64 value)
+{
+	LONG64 current = *peak;
+	while (value > current)
+	{
+		const LONG64 previous = InterlockedCompareExchange64(peak, value, current);
+		if (previous == current)
+			break;
+		current = previous;
+	}
+}
+
+void TVulkanHostAllocator::Init()
+{
+	Generation = uint32(InterlockedIncrement(&GenerationCounter));
+
+	Callbacks.pUserData = this;
+	Callbacks.pfnAllocation = Allocate;
+	Callbacks.pfnReallocation = Reallocate;
+	Callbacks.pfnFree = Free;
+	Callbacks.pfnInternalAllocation = InternalAllocate;
+	Callbacks.pfnInternalFree = InternalFree;
+}
+
+void TVulkanHostAllocator::Done()
+{
+	for (uint32 i = 0; i < ScopeCount; ++i)
+		if (Counters[i].AllocationCount != 0)
+			DebugPrint("Vulkan host allocator: %lld %s scope allocations were never freed\n", Counters[i].AllocationCount, ScopeNames[i]);
+
+	AcquireSRWLockExclusive(&Lock);
+	for (size_t i = 0; i < Arenas.size(); ++i)
+	{
+		free(Arenas[i]->Memory);
+		delete Arenas[i];
+	}
+	Arenas.resize(0);
+	for (size_t i = 0; i < Pages.size(); ++i)
+		free(Pages[i]);
+	Pages.resize(0);
+	for (uint32 i = 0; i < ClassCount; ++i)
+		FreeLists[i] = nullptr;
+	ReleaseSRWLockExclusive(&Lock);
+}
+
+TVulkanHostStatistics TVulkanHostAllocator::GetStatistics(VkSystemAllocationScope scope) const
+{
+	const TScopeCounters &counters = Counters[scope];
+	TVulkanHostStatistics statistics;
+	statistics.AllocationCount = counters.AllocationCount;
+	statistics.Bytes = counters.Bytes;
+	statistics.PeakBytes = counters.PeakBytes;
+	statistics.TotalAllocationCount = counters.TotalAllocationCount;
+	statistics.InternalBytes = counters.InternalBytes;
+	return statistics;
+}
+
+void TVulkanHostAllocator::PrintStatistics() const
+{
+	for (uint32 i = 0; i < ScopeCount; ++i)
+	{
+		const TVulkanHostStatistics statistics = GetStatistics(VkSystemAllocationScope(i));
+		if (statistics.TotalAllocationCount == 0 && statistics.InternalBytes == 0)
+			continue;
+
+		DebugPrint("Vulkan host %s scope: %lld allocations (%lld live), %lld bytes, peak %lld, %lld internal bytes\n",
+			ScopeNames[i], statistics.TotalAllocationCount, statistics.AllocationCount, statistics.Bytes, statistics.PeakBytes, statistics.InternalBytes);
+	}
+}
+
+void *VKAPI_PTR TVulkanHostAllocator::Allocate(void *userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<TVulkanHostAllocator *>(userData)->AllocateScoped(size, alignment, scope);
+}
+
+void *VKAPI_PTR TVulkanHostAllocator::Reallocate(void *userData, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	auto *allocator = static_cast<TVulkanHostAllocator *>(userData);
+	if (original == nullptr)
+		return allocator->AllocateScoped(size, alignment, scope);
+	if (size == 0)
+	{
+		allocator->FreeScoped(original);
+		return nullptr;
+	}
+
+	// On failure the original allocation has to stay valid.
+	void *memory = allocator->AllocateScoped(size, alignment, scope);
+	if (memory == nullptr)
+		return nullptr;
+
+	const THeader *header = reinterpret_cast<const THeader *>(original) - 1;
+	MemCopy(memory, original, int32(Min(header->Size, size)));
+	allocator->FreeScoped(original);
+	return memory;
+}
+
+void VKAPI_PTR TVulkanHostAllocator::Free(void *userData, void *memory)
+{
+	if (memory != nullptr)
+		static_cast<TVulkanHostAllocator *>(userData)->FreeScoped(memory);
+}
+
+void VKAPI_PTR TVulkanHostAllocator::InternalAllocate(void *userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	auto *allocator = static_cast<TVulkanHostAllocator *>(userData);
+	InterlockedExchangeAdd64(&allocator->Counters[scope].InternalBytes, LONG64(size));
+}
+
+void VKAPI_PTR TVulkanHostAllocator::InternalFree(void *userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	auto *allocator = static_cast<TVulkanHostAllocator *>(userData);
+	InterlockedExchangeAdd64(&allocator->Counters[scope].InternalBytes, -LONG64(size));
+}
+
+void *TVulkanHostAllocator::AllocateScoped(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (size == 0)
+		return nullptr;
+	ASSERT(alignment != 0 && (alignment & (alignment - 1)) == 0);
+	ASSERT(uint32(scope) < ScopeCount);
+	// The header sits right in front of the allocation and has to be aligned itself.
+	alignment = Max(alignment, alignof(THeader));
+
+	// Room for the header and for aligning wherever the block happens to start.
+	const size_t blockSize = sizeof(THeader) + size + alignment - 1u;
+
+	uint8 *block = nullptr;
+	TSource source = TSource::Heap;
+	uint8 sizeClass = 0u;
+	TArena *blockArena = nullptr;
+
+	if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND)
+	{
+		TArena &arena = GetThreadArena();
+		// Nothing live means nothing can be freed either, whichever thread did the last free, so the owner rewinds.
+		if (arena.LiveCount == 0)
+			arena.Head = 0u;
+
+		const uintptr_t start = uintptr_t(arena.Memory + arena.Head);
+		const uintptr_t end = AlignAddress(start + sizeof(THeader), alignment) + size;
+		if (end <= uintptr_t(arena.Memory + ArenaSize))
+		{
+			block = arena.Memory + arena.Head;
+			arena.Head = size_t(end - uintptr_t(arena.Memory));
+			InterlockedIncrement(&arena.LiveCount);
+			source = TSource::Arena;
+			blockArena = &arena;
+		}
+	}
+
+	if (block == nullptr && blockSize <= (size_t(1u) << (MinClassLog2 + ClassCount - 1u)))
+	{
+		sizeClass = uint8(blockSize <= (size_t(1u) << MinClassLog2) ? 0u : FloorLog2(blockSize - 1u) + 1u - MinClassLog2);
+		block = AllocateFromPool(sizeClass);
+		source = TSource::Pool;
+	}
+
+	if (block == nullptr)
+	{
+		block = static_cast<uint8 *>(malloc(blockSize));
+		if (block == nullptr)
+			return nullptr;
+		source = TSource::Heap;
+	}
+
+	uint8 *memory = reinterpret_cast<uint8 *>(AlignAddress(uintptr_t(block) + sizeof(THeader), alignment));
+	THeader *header = reinterpret_cast<THeader *>(memory) - 1;
+	header->Arena = blockArena;
+	header->Size = size;
+	header->Offset = uint32(memory - block);
+	header->Scope = uint8(scope);
+	header->Source = source;
+	header->Class = sizeClass;
+
+	TScopeCounters &counters = Counters[scope];
+	InterlockedIncrement64(&counters.AllocationCount);
+	InterlockedIncrement64(&counters.TotalAllocationCount);
+	AddPeak(&counters.PeakBytes, InterlockedExchangeAdd64(&counters.Bytes, LONG64(size)) + LONG64(size));
+	return memory;
+}
+
+void TVulkanHostAllocator::FreeScoped(void *memory)
+{
+	const THeader *header = static_cast<const THeader *>(memory) - 1;
+	uint8 *block = static_cast<uint8 *>(memory) - header->Offset;
+
+	TScopeCounters &counters = Counters[header->Scope];
+	InterlockedDecrement64(&counters.AllocationCount);
+	InterlockedExchangeAdd64(&counters.Bytes, -LONG64(header->Size));
+
+	switch (header->Source)
+	{
+	case TSource::Arena:
+	{
+		// Possibly on another thread than the one that allocated, the owner rewinds on its next allocation.
+		TArena *arena = header->Arena;
+		ASSERT(block >= arena->Memory && block < arena->Memory + ArenaSize);
+		const LONG liveCount = InterlockedDecrement(&arena->LiveCount);
+		ASSERT(liveCount >= 0);
+		break;
+	}
+	case TSource::Pool:
+		FreeToPool(block, header->Class);
+		break;
+	case TSource::Heap:
+		free(block);
+		break;
+	}
+}
+
+TVulkanHostAllocator::TArena &TVulkanHostAllocator::GetThreadArena()
+{
+	struct TThreadArena
+	{
+		TArena *Arena;
+		uint32 Generation;
+	};
+	static thread_local TThreadArena threadArena = { nullptr, 0u };
+
+	if (threadArena.Generation != Generation)
+	{
+		TArena *arena = new TArena();
+		arena->Memory = static_cast<uint8 *>(malloc(ArenaSize));
+		ASSERT(arena->Memory != nullptr);
+
+		AcquireSRWLockExclusive(&Lock);
+		Arenas.push_back(arena);
+		ReleaseSRWLockExclusive(&Lock);
+
+		threadArena.Arena = arena;
+		threadArena.Generation = Generation;
+	}
+	return *threadArena.Arena;
+}
+
+uint8 *TVulkanHostAllocator::AllocateFromPool(uint32 sizeClass)
+{
+	const size_t blockSize = size_t(1u) << (MinClassLog2 + sizeClass);
+
+	AcquireSRWLockExclusive(&Lock);
+	if (FreeLists[sizeClass] == nullptr)
+	{
+		uint8 *page = static_cast<uint8 *>(malloc(PageSize));
+		if (page == nullptr)
+		{
+			ReleaseSRWLockExclusive(&Lock);
+			return nullptr;
+		}
+		Pages.push_back(page);
+
+		// Carved back to front so the list hands the blocks out in address order.
+		for (size_t offset = PageSize; offset >= blockSize; offset -= blockSize)
+		{
+			auto *block = reinterpret_cast<TFreeBlock *>(page + offset - blockSize);
+			block->Next = FreeLists[sizeClass];
+			FreeLists[sizeClass] = block;
+		}
+	}
+
+	TFreeBlock *block = FreeLists[sizeClass];
+	FreeLists[sizeClass] = block->Next;
+	ReleaseSRWLockExclusive(&Lock);
+	return reinterpret_cast<uint8 *>(block);
+}
+
+void TVulkanHostAllocator::FreeToPool(uint8 *block, uint32 sizeClass)
+{
+	auto *freeBlock = reinterpret_cast<TFreeBlock *>(block);
+	AcquireSRWLockExclusive(&Lock);
+	freeBlock->Next = FreeLists[sizeClass];
+	FreeLists[sizeClass] = freeBlock;
+	ReleaseSRWLockExclusive(&Lock);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Core/Containers/String.h"
+
+// References:
+// https://www.khronos.org/registry/vulkan/specs/1.0/html/vkspec.html#memory-allocation
+
+struct TVulkanHostStatistics
+{
+	// Live allocations and the bytes the driver asked for.
+	int64 AllocationCount = 0;
+	int64 Bytes = 0;
+	int64 PeakBytes = 0;
+	// Every allocation since Init, freed or not.
+	int64 TotalAllocationCount = 0;
+	// Allocations the driver made on its own and only reported through pfnInternalAllocation.
+	int64 InternalBytes = 0;
+};
+
+// Host memory for the driver, routed by allocation scope. Command scope allocations never outlive the Vulkan call
+// that made them, so they come from a linear arena per thread that rewinds whenever it has nothing live. The driver
+// may still free them on another thread, so the arena only counts them down and its owner rewinds it. Longer
+// lived ones come from size class free lists, anything larger than the biggest class from malloc.
+// Every allocation honors the requested alignment. Thread safe.
+class TVulkanHostAllocator
+{
+public:
+	void Init();
+	// Every object created with the callbacks has to be destroyed by now.
+	void Done();
+
+	const VkAllocationCallbacks *GetCallbacks() const {
+		return &Callbacks;
+	}
+
+	TVulkanHostStatistics GetStatistics(VkSystemAllocationScope scope) const;
+	void PrintStatistics() const;
+
+private:
+	static constexpr uint32 ScopeCount = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1u;
+	static constexpr size_t ArenaSize = 256u * 1024u;
+	// Classes of 64 to 4096 bytes, carved out of pages of PageSize.
+	static constexpr uint32 MinClassLog2 = 6u;
+	static constexpr uint32 ClassCount = 7u;
+	static constexpr size_t PageSize = 64u * 1024u;
+
+	enum class TSource : uint8
+	{
+		Arena,
+		Pool,
+		Heap,
+	};
+
+	struct TArena;
+
+	// Right in front of every allocation.
+	struct THeader
+	{
+		// Of arena allocations, which may be freed by a thread other than the one the arena belongs to.
+		TArena *Arena;
+		size_t Size;
+		// From the start of the block to the allocation.
+		uint32 Offset;
+		uint8 Scope;
+		TSource Source;
+		uint8 Class;
+	};
+
+	struct TArena
+	{
+		uint8 *Memory = nullptr;
+		// Moved by the owning thread only.
+		size_t Head = 0u;
+		// Incremented by the owning thread, decremented by whichever thread frees.
+		volatile LONG LiveCount = 0;
+	};
+
+	struct TFreeBlock
+	{
+		TFreeBlock *Next;
+	};
+
+	struct TScopeCounters
+	{
+		volatile LONG64 AllocationCount = 0;
+		volatile LONG64 Bytes = 0;
+		volatile LONG64 PeakBytes = 0;
+		volatile LONG64 TotalAllocationCount = 0;
+		volatile LONG64 InternalBytes = 0;
+	};
+
+	static void *VKAPI_PTR Allocate(void *userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void *VKAPI_PTR Reallocate(void *userData, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void VKAPI_PTR Free(void *userData, void *memory);
+	static void VKAPI_PTR InternalAllocate(void *userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static void VKAPI_PTR InternalFree(void *userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+	void *AllocateScoped(size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void FreeScoped(void *memory);
+	TArena &GetThreadArena();
+	uint8 *AllocateFromPool(uint32 sizeClass);
+	void FreeToPool(uint8 *block, uint32 sizeClass);
+
+	VkAllocationCallbacks Callbacks = {};
+	// Tells the thread local arenas of an earlier Init apart from the current ones.
+	uint32 Generation = 0u;
+
+	mutable SRWLOCK Lock = SRWLOCK_INIT;
+	TFreeBlock *FreeLists[ClassCount] = {};
+	TVarArray<uint8 *> Pages;
+	TVarArray<TArena *> Arenas;
+	TScopeCounters Counters[ScopeCount];
+};
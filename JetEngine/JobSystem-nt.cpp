@@ -0,0 +1,170 @@
+#include "Precompiled.h"
+
+#include "JobSystem.h"
+
+namespace Jobs
+{
+	struct TJob
+	{
+		TJobFunction Function;
+		void *Data;
+		int32 Begin;
+		int32 End;
+		TCounter *Counter;
+	};
+
+	static constexpr uint32 QueueCapacity = 4096u;
+	static constexpr uint32 BackgroundQueueCapacity = 256u;
+
+	static TJob Queue[QueueCapacity];
+	static uint32 QueueHead = 0u;
+	static uint32 QueueTail = 0u;
+	static TJob BackgroundQueue[BackgroundQueueCapacity];
+	static uint32 BackgroundQueueHead = 0u;
+	static uint32 BackgroundQueueTail = 0u;
+	static SRWLOCK QueueLock = SRWLOCK_INIT;
+	static CONDITION_VARIABLE QueueNotEmpty = CONDITION_VARIABLE_INIT;
+
+	static HANDLE Workers[MaxWorkers];
+	static int32 WorkerCount = 0;
+	static bool Running = false;
+	static thread_local int32 ThreadIndex = 0;
+
+	static void Execute(const TJob &job)
+	{
+		job.Function(job.Data, job.Begin, job.End);
+		InterlockedDecrement(&job.Counter->Value);
+	}
+
+	static bool TryExecuteOne()
+	{
+		TJob job;
+		AcquireSRWLockExclusive(&QueueLock);
+		const bool found = QueueHead != QueueTail;
+		if (found)
+			job = Queue[QueueHead++ % QueueCapacity];
+		ReleaseSRWLockExclusive(&QueueLock);
+
+		if (found)
+			Execute(job);
+		return found;
+	}
+
+	static DWORD WINAPI WorkerMain(LPVOID parameter)
+	{
+		ThreadIndex = int32(reinterpret_cast<intptr_t>(parameter));
+
+		while (true)
+		{
+			AcquireSRWLockExclusive(&QueueLock);
+			while (Running && QueueHead == QueueTail && BackgroundQueueHead == BackgroundQueueTail)
+				SleepConditionVariableSRW(&QueueNotEmpty, &QueueLock, INFINITE, 0);
+
+			if (!Running)
+			{
+				ReleaseSRWLockExclusive(&QueueLock);
+				break;
+			}
+
+			const TJob job = QueueHead != QueueTail ? Queue[QueueHead++ % QueueCapacity] : BackgroundQueue[BackgroundQueueHead++ % BackgroundQueueCapacity];
+			ReleaseSRWLockExclusive(&QueueLock);
+			Execute(job);
+		}
+		return 0;
+	}
+
+	void Init(int32 workerCount)
+	{
+		if (workerCount < 0)
+		{
+			SYSTEM_INFO systemInfo;
+			GetSystemInfo(&systemInfo);
+			workerCount = int32(systemInfo.dwNumberOfProcessors) - 1;
+		}
+
+		Running = true;
+		WorkerCount = Clamp(workerCount, 0, MaxWorkers);
+		for (int32 i = 0; i < WorkerCount; ++i)
+		{
+			Workers[i] = CreateThread(nullptr, 0, WorkerMain, reinterpret_cast<LPVOID>(intptr_t(i + 1)), 0, nullptr);
+			ASSERT(Workers[i] != nullptr);
+		}
+	}
+
+	void Done()
+	{
+		AcquireSRWLockExclusive(&QueueLock);
+		Running = false;
+		ReleaseSRWLockExclusive(&QueueLock);
+		WakeAllConditionVariable(&QueueNotEmpty);
+
+		if (WorkerCount > 0)
+			WaitForMultipleObjects(DWORD(WorkerCount), Workers, TRUE, INFINITE);
+		for (int32 i = 0; i < WorkerCount; ++i)
+			CloseHandle(Workers[i]);
+		WorkerCount = 0;
+	}
+
+	int32 GetWorkerCount()
+	{
+		return WorkerCount;
+	}
+
+	int32 GetThreadIndex()
+	{
+		return ThreadIndex;
+	}
+
+	void Dispatch(TJobFunction function, void *data, int32 count, int32 batchSize, TCounter &counter)
+	{
+		batchSize = Max(batchSize, 1);
+		InterlockedExchangeAdd(&counter.Value, LONG(DivCeil(count, batchSize)));
+
+		for (int32 begin = 0; begin < count; begin += batchSize)
+		{
+			const TJob job = { function, data, begin, Min(begin + batchSize, count), &counter };
+
+			AcquireSRWLockExclusive(&QueueLock);
+			const bool full = QueueTail - QueueHead == QueueCapacity;
+			if (!full)
+				Queue[QueueTail++ % QueueCapacity] = job;
+			ReleaseSRWLockExclusive(&QueueLock);
+
+			// Nobody would pick it up any sooner, so run it inline instead of blocking on the queue.
+			if (full)
+				Execute(job);
+			else
+				WakeConditionVariable(&QueueNotEmpty);
+		}
+	}
+
+	void DispatchBackground(TJobFunction function, void *data, TCounter &counter)
+	{
+		InterlockedIncrement(&counter.Value);
+		const TJob job = { function, data, 0, 1, &counter };
+
+		bool queued = false;
+		if (WorkerCount > 0)
+		{
+			AcquireSRWLockExclusive(&QueueLock);
+			queued = BackgroundQueueTail - BackgroundQueueHead != BackgroundQueueCapacity;
+			if (queued)
+				BackgroundQueue[BackgroundQueueTail++ % BackgroundQueueCapacity] = job;
+			ReleaseSRWLockExclusive(&QueueLock);
+		}
+
+		if (queued)
+			WakeConditionVariable(&QueueNotEmpty);
+		else
+			Execute(job);
+	}
+
+	void Wait(TCounter &counter)
+	{
+		while (counter.Value > 0)
+		{
+			if (!TryExecuteOne())
+				YieldProcessor();
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+namespace Jobs
+{
+	using TJobFunction = void (*)(void *data, int32 begin, int32 end);
+
+	// Number of outstanding batches of a dispatch, reaches zero once all of them finished.
+	struct TCounter
+	{
+		volatile LONG Value = 0;
+	};
+
+	static constexpr int32 MaxWorkers = 64;
+
+	// Spawns the worker threads, negative count means one per hardware thread minus the calling one.
+	// Without workers every dispatched job runs on the thread that waits for it.
+	void Init(int32 workerCount = -1);
+	void Done();
+
+	int32 GetWorkerCount();
+	// 0 for the thread that called Init, 1..GetWorkerCount() for the workers.
+	int32 GetThreadIndex();
+
+	void Dispatch(TJobFunction function, void *data, int32 count, int32 batchSize, TCounter &counter);
+	// One call of function(data, 0, 1) that only workers pick up, and only when no dispatched batch is waiting.
+	// Wait never runs it, so a long job cannot stall a thread waiting on something else. Runs right away
+	// without workers. Has to be waited for before Done.
+	void DispatchBackground(TJobFunction function, void *data, TCounter &counter);
+	// Executes queued jobs on the calling thread until the counter drains.
+	void Wait(TCounter &counter);
+
+	inline bool IsDone(const TCounter &counter)
+	{
+		return counter.Value == 0;
+	}
+
+	template <typename TFunction>
+	void ParallelFor(int32 count, int32 batchSize, const TFunction &function)
+	{
+		const auto Invoke = [](void *data, int32 begin, int32 end) {
+			const auto &function = *static_cast<const TFunction *>(data);
+			for (int32 i = begin; i < end; ++i)
+				function(i);
+		};
+
+		TCounter counter;
+		Dispatch(Invoke, const_cast<TFunction *>(&function), count, batchSize, counter);
+		Wait(counter);
+	}
+}
@@ -5,6 +5,9 @@
 #include "WindowContext-nt.h"
 #include "FileSystem.h"
 #include "RenderDevice-vk.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "MeshBVH.h"
 #include "Core/Memory/Memory.h"
 #include "Core/Math/Math.h"
 #include "Core/Containers/String.h"
@@ -21,57 +24,44 @@ int main()
 
 #else
 
-struct TVertex
+// Reads the first index of an OBJ face corner, 1 based or negative from the end, into [0, count). False when it is
+// missing or out of range.
+static bool ParseObjIndex(const char *&line, int32 count, int32 &index)
 {
-	Vector3 Position;
-};
-
-struct TMesh
-{
-	TVarArray<TVertex> TVertexBuffer;
-	TVarArray<uint16> IndexBuffer;
-};
+	char *next = nullptr;
+	const long value = strtol(line, &next, 10);
+	if (next == line)
+		return false;
+	line = next;
+	index = value < 0 ? count + int32(value) : int32(value) - 1;
+	return index >= 0 && index < count;
+}
 
-void MainLoop(TVulkanAPI *graphicsAPI)
+// Triangulates polygons as fans. Every face corner becomes a vertex of its own, normals and texture coordinates the
+// file does not give are zero.
+static bool LoadObj(const char *path, TMesh &mesh)
 {
-	//TVertex vertexBuffer[] = {
-	//	{ { -1.0f, -1.0f, 0.0f } },
-	//	{ { -1.0f,  1.0f, 0.0f } },
-	//	{ {  1.0f,  1.0f, 0.0f } }
-	//};
-	//int32 indexBuffer[] = {
-	//	0, 1, 2
-	//};
-	//
-	//constexpr int32 width = 1024, height = 1024;
-	//
-	//float depthBuffer[width][height] = {};
-	//
-	//Vector2 pixelSize(1.0f / width, 1.0f / height);
-	//for (int32 i = 0; i < ArrayLength(indexBuffer); i += 3)
-	//{
-	//	const auto &v0 = vertexBuffer[indexBuffer[i + 0]].Position;
-	//	const auto &v1 = vertexBuffer[indexBuffer[i + 1]].Position;
-	//	const auto &v2 = vertexBuffer[indexBuffer[i + 2]].Position;
-	//
-	//	const auto [left, right] = MinMax(v0.x, v1.x, v2.x);
-	//	const auto [bottom, top] = MinMax(v0.y, v1.y, v2.y);
-	//}
+	if (!FS::Exists(path))
+	{
+		DebugPrint("Mesh %s not found\n", path);
+		return false;
+	}
 
-	auto objFile = FS::Open("Test/teapot.obj", FS::Read);
+	auto objFile = FS::Open(path, FS::Read);
 
 	TVarArray<Vector3> Positions;
 	TVarArray<Vector3> Normals;
 	TVarArray<Vector2> TextureCoords;
-	TVarArray<Vector3i> Faces;
 
 	const auto *line = reinterpret_cast<const char*>(objFile.Platform.Buffer);
+	const auto *end = line + objFile.Size;
 
 	const auto NextLine = [&]() {
-		while (*line++ != '\n');
+		while (line < end && *line++ != '\n');
 	};
 
-	for (; *line != '\0'; NextLine())
+	bool succeeded = true;
+	for (; line < end && *line != '\0' && succeeded; NextLine())
 	{
 		if (*line == '#' || *line == '\n' || *line == '\r')
 			continue;
@@ -100,26 +90,192 @@ void MainLoop(TVulkanAPI *graphicsAPI)
 		if (StringCompareN(line, STR_AND_LEN("f ")) == 0)
 		{
 			line += 2;
-			auto &face = Faces.push_back({});
-			while (*line != '\r' && *line != '\n')
+			const size_t firstVertex = mesh.TVertexBuffer.size();
+			while (line < end && *line != '\r' && *line != '\n' && succeeded)
 			{
-				int32 read = 0;
-				sscanf_s(line, "%d/%d/%d%n", &face.x, &face.y, &face.z, &read);
+				// v, v/vt, v//vn or v/vt/vn.
+				TVertex vertex = {};
+				int32 index = 0;
+				succeeded = ParseObjIndex(line, int32(Positions.size()), index);
+				if (succeeded)
+					vertex.Position = Positions[index];
+				if (succeeded && *line == '/' && *++line != '/')
+				{
+					succeeded = ParseObjIndex(line, int32(TextureCoords.size()), index);
+					if (succeeded)
+						vertex.TextureCoord = TextureCoords[index];
+				}
+				if (succeeded && *line == '/')
+				{
+					++line;
+					succeeded = ParseObjIndex(line, int32(Normals.size()), index);
+					if (succeeded)
+						vertex.Normal = Normals[index];
+				}
 
-				line += read;
-				while (*line == ' ')
+				const size_t vertexIndex = mesh.TVertexBuffer.size();
+				// TMesh has 16 bit indices.
+				succeeded = succeeded && vertexIndex <= 0xFFFFu;
+				if (succeeded)
+				{
+					mesh.TVertexBuffer.push_back(vertex);
+					if (vertexIndex >= firstVertex + 2u)
+					{
+						mesh.IndexBuffer.push_back(uint16(firstVertex));
+						mesh.IndexBuffer.push_back(uint16(vertexIndex - 1u));
+						mesh.IndexBuffer.push_back(uint16(vertexIndex));
+					}
+				}
+
+				while (line < end && (*line == ' ' || *line == '\t'))
 					++line;
 			}
 			continue;
 		}
 	}
-		
+
+	FS::Close(objFile);
+	if (!succeeded)
+		DebugPrint("Mesh %s has a face that does not fit or refers to missing data\n", path);
+	return succeeded && !mesh.IndexBuffer.empty();
+}
+
+void MainLoop(TVulkanAPI *graphicsAPI)
+{
+	//TVertex vertexBuffer[] = {
+	//	{ { -1.0f, -1.0f, 0.0f } },
+	//	{ { -1.0f,  1.0f, 0.0f } },
+	//	{ {  1.0f,  1.0f, 0.0f } }
+	//};
+	//int32 indexBuffer[] = {
+	//	0, 1, 2
+	//};
+	//
+	//constexpr int32 width = 1024, height = 1024;
+	//
+	//float depthBuffer[width][height] = {};
+	//
+	//Vector2 pixelSize(1.0f / width, 1.0f / height);
+	//for (int32 i = 0; i < ArrayLength(indexBuffer); i += 3)
+	//{
+	//	const auto &v0 = vertexBuffer[indexBuffer[i + 0]].Position;
+	//	const auto &v1 = vertexBuffer[indexBuffer[i + 1]].Position;
+	//	const auto &v2 = vertexBuffer[indexBuffer[i + 2]].Position;
+	//
+	//	const auto [left, right] = MinMax(v0.x, v1.x, v2.x);
+	//	const auto [bottom, top] = MinMax(v0.y, v1.y, v2.y);
+	//}
 
 	graphicsAPI->HelloWorld();
 }
 
+struct THeadlessResult
+{
+	bool Delivered = false;
+	uint8 Corner[4] = {};
+	uint8 Center[4] = {};
+};
+
+static void OnHeadlessReadback(void *userData, const TVulkanReadback &readback)
+{
+	THeadlessResult &result = *static_cast<THeadlessResult*>(userData);
+	result.Delivered = true;
+	MemCopy(result.Corner, readback.Pixels, sizeof(result.Corner));
+	MemCopy(result.Center, readback.Pixels + size_t(readback.Height / 2u) * readback.RowPitch + (readback.Width / 2u) * 4u, sizeof(result.Center));
+}
+
+static constexpr const char *HeadlessTexturePath = "HeadlessTexture.jtex";
+static constexpr uint32 HeadlessTextureSize = 256u;
+static constexpr uint32 MaxHeadlessFrames = 60u;
+
+// A full chain of RGBA8 levels, its bytes counting up.
+static bool WriteHeadlessTexture(const char *path)
+{
+	TTextureDesc desc;
+	desc.Width = HeadlessTextureSize;
+	desc.Height = HeadlessTextureSize;
+	desc.MipCount = GetTextureMipCount(desc.Width, desc.Height);
+	desc.Format = TTextureFormat::RGBA8;
+
+	uint64 size = 0u;
+	for (uint32 level = 0; level < desc.MipCount; ++level)
+		size += GetTextureLevelSize(desc, level);
+	TVarArray<uint8> levels;
+	levels.resize(size_t(size));
+	for (size_t i = 0; i < levels.size(); ++i)
+		levels[i] = uint8(i);
+	return WriteTextureFile(path, desc, levels.data());
+}
+
+// Renders frames of HelloWorld without a window and reads the last one back: the corner has to be the clear color and
+// the center covered by the quad. A texture is streamed meanwhile, asked for at full size every frame, and has to get
+// there within MaxHeadlessFrames. When the device culls on the GPU, the culled instances read back have to be the
+// ones in view and not behind the large sphere, within MaxHeadlessFrames as well. Exits with 0 when all of it holds,
+// for running on machines without a display.
+static INT RunHeadless()
+{
+	Jobs::Init();
+
+	THeadlessResult result;
+	TVulkanAPI vulkan;
+	vulkan.Init(nullptr);
+	vulkan.SetReadbackHandler(OnHeadlessReadback, &result);
+
+	TTextureStreamer &streamer = vulkan.GetTextureStreamer();
+	const uint32 texture = WriteHeadlessTexture(HeadlessTexturePath) ? streamer.Add(HeadlessTexturePath) : TTextureStreamer::InvalidTexture;
+	// The spheres are only drawn with the bindless heap, which the visible list has a slot in then.
+	const bool culling = vulkan.GetCulling().IsEnabled() && vulkan.GetCulling().GetVisibleSlot() != ~0u;
+	// Two at least, so the culling statistics of a frame are read back. Occlusion needs a frame's depth with the
+	// spheres in it, which waits for the mesh pipeline to compile.
+	uint32 frameCount = 0u;
+	while (frameCount < MaxHeadlessFrames && (frameCount < 2u ||
+		(texture != TTextureStreamer::InvalidTexture && streamer.GetResidentLevel(texture) != 0u) ||
+		(culling && vulkan.GetCulling().GetStatistics().VisibleInstanceCount != TVulkanAPI::HelloMeshVisibleCount)))
+	{
+		if (texture != TTextureStreamer::InvalidTexture)
+			streamer.ReportUsage(texture, HeadlessTextureSize);
+		vulkan.HelloWorld();
+		++frameCount;
+	}
+	vulkan.RequestReadback();
+	vulkan.HelloWorld();
+
+	const bool streamed = texture != TTextureStreamer::InvalidTexture && streamer.GetResidentLevel(texture) == 0u;
+	const TTextureStreamingStatistics streamingStatistics = streamer.GetStatistics();
+	const TVulkanCullStatistics cullStatistics = vulkan.GetCulling().GetStatistics();
+	// Delivers the readback of the frame still in flight.
+	vulkan.Done();
+
+	Jobs::Done();
+	FS::Remove(HeadlessTexturePath);
+
+	// B8G8R8A8, HelloWorld clears to blue.
+	const uint8 clearColor[4] = { 0xFF, 0x00, 0x00, 0xFF };
+	const bool cleared = result.Delivered && memcmp(result.Corner, clearColor, sizeof(clearColor)) == 0;
+	const bool drawn = result.Delivered && memcmp(result.Center, clearColor, sizeof(clearColor)) != 0;
+	DebugPrint("Headless: readback %s, corner %02x%02x%02x%02x, center %02x%02x%02x%02x\n", result.Delivered ? "delivered" : "missing",
+		result.Corner[0], result.Corner[1], result.Corner[2], result.Corner[3], result.Center[0], result.Center[1], result.Center[2], result.Center[3]);
+
+	DebugPrint("Headless: texture %s after %u frames, %u loads, %llu bytes resident\n", streamed ? "streamed" : "not streamed", frameCount,
+		uint32(streamingStatistics.LoadCount), (unsigned long long)streamingStatistics.ResidentBytes);
+
+	bool culled = true;
+	if (culling)
+	{
+		culled = cullStatistics.InstanceCount == TVulkanAPI::HelloMeshInstanceCount && cullStatistics.VisibleInstanceCount == TVulkanAPI::HelloMeshVisibleCount;
+		DebugPrint("Headless: culling kept %u of %u instances in %u draws, %u expected\n", cullStatistics.VisibleInstanceCount, cullStatistics.InstanceCount,
+			cullStatistics.VisibleDrawCount, TVulkanAPI::HelloMeshVisibleCount);
+	}
+	else
+		DebugPrint("Headless: no culled draws\n");
+	return cleared && drawn && streamed && culled ? 0 : 1;
+}
+
 INT WinMain(HINSTANCE instance, HINSTANCE prevInstance, PSTR cmdLine, INT nCmdShow)
 {
+	if (cmdLine != nullptr && strstr(cmdLine, "-headless") != nullptr)
+		return RunHeadless();
+
     // Register the window class.
 	char cwd[2048];
 	GetCurrentDirectory(sizeof(cwd), cwd);
@@ -143,6 +299,14 @@ INT WinMain(HINSTANCE instance, HINSTANCE prevInstance, PSTR cmdLine, INT nCmdSh
     if (!window.IsValid())
         return 0;
 
+	Jobs::Init();
+
+	TMesh mesh;
+	TMeshBVH meshBVH;
+	// For picking against the loaded mesh.
+	if (LoadObj("Test/teapot.obj", mesh))
+		meshBVH.Build(mesh);
+
 	TVulkanAPI vulkan;
 	vulkan.Init(&window);
 
@@ -161,6 +325,7 @@ INT WinMain(HINSTANCE instance, HINSTANCE prevInstance, PSTR cmdLine, INT nCmdSh
     }
 
 	vulkan.Done();
+	Jobs::Done();
     return 0;
 }
 
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Core/Math/Math.h"
+#include "Core/Containers/String.h"
+
+struct TVertex
+{
+	Vector3 Position;
+	Vector3 Normal;
+	Vector2 TextureCoord;
+};
+
+struct TMesh
+{
+	TVarArray<TVertex> TVertexBuffer;
+	TVarArray<uint16> IndexBuffer;
+};
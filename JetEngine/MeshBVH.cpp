@@ -0,0 +1,619 @@
+#include "Precompiled.h"
+
+#include "MeshBVH.h"
+#include "JobSystem.h"
+
+static constexpr int32 BinCount = 16;
+static constexpr uint32 MaxLeafSize = 4u;
+static constexpr uint32 ParallelBuildThreshold = 4096u;
+static constexpr int32 StackSize = 256;
+// Every level of the 4-wide tree leaves at most three siblings on the traversal stack, and collapsing never makes it
+// deeper than the binary build tree, so capping that depth keeps the stack from ever filling up.
+static constexpr uint32 MaxBuildDepth = uint32(StackSize - 1) / 3u;
+static constexpr float32 TraversalCost = 1.0f;
+static constexpr float32 IntersectionCost = 1.0f;
+
+struct TBounds
+{
+	Vector3 Min = Vector3(TNumericLimits<float32>::Max(), TNumericLimits<float32>::Max(), TNumericLimits<float32>::Max());
+	Vector3 Max = Vector3(-TNumericLimits<float32>::Max(), -TNumericLimits<float32>::Max(), -TNumericLimits<float32>::Max());
+
+	void Grow(const Vector3 &point)
+	{
+		Min = ComponentMin(Min, point);
+		Max = ComponentMax(Max, point);
+	}
+
+	void Grow(const TBounds &bounds)
+	{
+		Min = ComponentMin(Min, bounds.Min);
+		Max = ComponentMax(Max, bounds.Max);
+	}
+
+	float32 SurfaceArea() const
+	{
+		if (Min.x > Max.x)
+			return 0.0f;
+		const Vector3 extent = Max - Min;
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+};
+
+struct TBuildNode
+{
+	TBounds Bounds;
+	uint32 Left = 0u;
+	uint32 Right = 0u;
+	uint32 First = 0u;
+	// Zero for inner nodes.
+	uint32 Count = 0u;
+};
+
+struct TBVHBuildContext
+{
+	const TMesh *Mesh = nullptr;
+	TVarArray<TBounds> TriangleBounds;
+	TVarArray<Vector3> Centroids;
+	TVarArray<uint32> Indices;
+	// Preallocated for the worst case of 2N - 1 nodes, so parallel subtree builds never reallocate.
+	TVarArray<TBuildNode> Nodes;
+	volatile LONG NodeCount = 0;
+};
+
+struct TBuildTask
+{
+	TBVHBuildContext *Context;
+	uint32 NodeIndex;
+	uint32 Begin;
+	uint32 End;
+	uint32 Depth;
+};
+
+static void BuildRecursive(TBVHBuildContext &context, uint32 nodeIndex, uint32 begin, uint32 end, uint32 depth);
+
+static void BuildTask(void *data, int32, int32)
+{
+	const auto &task = *static_cast<const TBuildTask *>(data);
+	BuildRecursive(*task.Context, task.NodeIndex, task.Begin, task.End, task.Depth);
+}
+
+static void BuildRecursive(TBVHBuildContext &context, uint32 nodeIndex, uint32 begin, uint32 end, uint32 depth)
+{
+	auto &node = context.Nodes[nodeIndex];
+	const uint32 count = end - begin;
+
+	// Once halving is all the depth left allows for, lopsided SAH splits give way to median ones.
+	uint32 medianDepth = 0u;
+	for (uint32 size = count; size > MaxLeafSize; size = (size + 1u) / 2u)
+		++medianDepth;
+	const bool median = depth + medianDepth >= MaxBuildDepth;
+
+	TBounds centroidBounds;
+	for (uint32 i = begin; i < end; ++i)
+	{
+		node.Bounds.Grow(context.TriangleBounds[context.Indices[i]]);
+		centroidBounds.Grow(context.Centroids[context.Indices[i]]);
+	}
+
+	int32 bestAxis = -1;
+	int32 bestSplit = 0;
+	float32 bestScale = 0.0f;
+	float32 bestCost = TNumericLimits<float32>::Max();
+
+	for (int32 axis = 0; axis < 3 && count > 1 && !median; ++axis)
+	{
+		const float32 extent = centroidBounds.Max[axis] - centroidBounds.Min[axis];
+		if (extent <= 0.0f)
+			continue;
+
+		const float32 scale = BinCount / extent;
+		TBounds bins[BinCount];
+		uint32 binCounts[BinCount] = {};
+		for (uint32 i = begin; i < end; ++i)
+		{
+			const uint32 triangle = context.Indices[i];
+			const int32 bin = Min(int32((context.Centroids[triangle][axis] - centroidBounds.Min[axis]) * scale), BinCount - 1);
+			bins[bin].Grow(context.TriangleBounds[triangle]);
+			++binCounts[bin];
+		}
+
+		// Sweep from the left, then evaluate every split plane while sweeping back from the right.
+		float32 leftAreas[BinCount - 1];
+		uint32 leftCounts[BinCount - 1];
+		TBounds leftBounds;
+		uint32 leftCount = 0u;
+		for (int32 split = 0; split < BinCount - 1; ++split)
+		{
+			leftBounds.Grow(bins[split]);
+			leftCount += binCounts[split];
+			leftAreas[split] = leftBounds.SurfaceArea();
+			leftCounts[split] = leftCount;
+		}
+
+		TBounds rightBounds;
+		uint32 rightCount = 0u;
+		for (int32 split = BinCount - 2; split >= 0; --split)
+		{
+			rightBounds.Grow(bins[split + 1]);
+			rightCount += binCounts[split + 1];
+			if (leftCounts[split] == 0u || rightCount == 0u)
+				continue;
+
+			const float32 cost = leftAreas[split] * leftCounts[split] + rightBounds.SurfaceArea() * rightCount;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split + 1;
+				bestScale = scale;
+			}
+		}
+	}
+
+	const float32 leafCost = count * IntersectionCost;
+	const float32 splitCost = TraversalCost + bestCost / Max(node.Bounds.SurfaceArea(), TNumericLimits<float32>::Min()) * IntersectionCost;
+	if (count <= MaxLeafSize && (bestAxis < 0 || leafCost <= splitCost))
+	{
+		node.First = begin;
+		node.Count = count;
+		return;
+	}
+
+	uint32 middle = begin;
+	if (bestAxis >= 0)
+	{
+		uint32 last = end;
+		while (middle < last)
+		{
+			const uint32 triangle = context.Indices[middle];
+			const int32 bin = Min(int32((context.Centroids[triangle][bestAxis] - centroidBounds.Min[bestAxis]) * bestScale), BinCount - 1);
+			if (bin < bestSplit)
+				++middle;
+			else
+				Swap(context.Indices[middle], context.Indices[--last]);
+		}
+	}
+	// All centroids coincide or the depth is running out, any split is as good as the other.
+	if (middle == begin || middle == end)
+		middle = begin + (count + 1u) / 2u;
+
+	const uint32 left = uint32(InterlockedExchangeAdd(&context.NodeCount, 2));
+	node.Left = left;
+	node.Right = left + 1;
+	node.Count = 0u;
+
+	if (count >= ParallelBuildThreshold)
+	{
+		TBuildTask task = { &context, left, begin, middle, depth + 1u };
+		Jobs::TCounter counter;
+		Jobs::Dispatch(BuildTask, &task, 1, 1, counter);
+		BuildRecursive(context, left + 1, middle, end, depth + 1u);
+		Jobs::Wait(counter);
+	}
+	else
+	{
+		BuildRecursive(context, left, begin, middle, depth + 1u);
+		BuildRecursive(context, left + 1, middle, end, depth + 1u);
+	}
+}
+
+void TMeshBVH::Build(const TMesh &mesh)
+{
+	Nodes.resize(0);
+	Packets.resize(0);
+
+	const uint32 triangleCount = uint32(mesh.IndexBuffer.size() / 3);
+	if (triangleCount == 0u)
+		return;
+
+	TBVHBuildContext context;
+	context.Mesh = &mesh;
+	context.TriangleBounds.resize(triangleCount);
+	context.Centroids.resize(triangleCount);
+	context.Indices.resize(triangleCount);
+	context.Nodes.resize(2 * triangleCount);
+	context.NodeCount = 1;
+
+	Jobs::ParallelFor(int32(triangleCount), 1024, [&](int32 triangle) {
+		TBounds bounds;
+		for (int32 k = 0; k < 3; ++k)
+			bounds.Grow(mesh.TVertexBuffer[mesh.IndexBuffer[triangle * 3 + k]].Position);
+		context.TriangleBounds[triangle] = bounds;
+		context.Centroids[triangle] = (bounds.Min + bounds.Max) * 0.5f;
+		context.Indices[triangle] = uint32(triangle);
+	});
+
+	BuildRecursive(context, 0u, 0u, triangleCount, 0u);
+
+	Nodes.reserve(size_t(context.NodeCount) / 3 + 1);
+	Packets.reserve(DivCeil(triangleCount, MaxLeafSize) * 2);
+	EmitNode(context, 0u);
+}
+
+// Pulls grandchildren up into the node until it has four children, opening the largest inner child first.
+uint32 TMeshBVH::EmitNode(const TBVHBuildContext &context, uint32 buildIndex)
+{
+	const auto &build = context.Nodes[buildIndex];
+
+	uint32 children[4];
+	int32 childCount = 0;
+	if (build.Count > 0u)
+	{
+		children[childCount++] = buildIndex;
+	}
+	else
+	{
+		children[childCount++] = build.Left;
+		children[childCount++] = build.Right;
+	}
+
+	while (childCount < 4)
+	{
+		int32 widest = -1;
+		float32 widestArea = -1.0f;
+		for (int32 c = 0; c < childCount; ++c)
+		{
+			const auto &child = context.Nodes[children[c]];
+			if (child.Count == 0u && child.Bounds.SurfaceArea() > widestArea)
+			{
+				widest = c;
+				widestArea = child.Bounds.SurfaceArea();
+			}
+		}
+		if (widest < 0)
+			break;
+
+		const auto &opened = context.Nodes[children[widest]];
+		children[widest] = opened.Left;
+		children[childCount++] = opened.Right;
+	}
+
+	// Children are emitted after the parent slot is reserved, the array may grow meanwhile.
+	const uint32 nodeIndex = uint32(Nodes.size());
+	Nodes.push_back(TNode());
+
+	TNode node;
+	for (int32 lane = 0; lane < 4; ++lane)
+	{
+		if (lane >= childCount)
+		{
+			for (int32 axis = 0; axis < 3; ++axis)
+			{
+				node.Min[axis][lane] = TNumericLimits<float32>::Max();
+				node.Max[axis][lane] = -TNumericLimits<float32>::Max();
+			}
+			node.Children[lane] = EmptyChild;
+			continue;
+		}
+
+		const auto &child = context.Nodes[children[lane]];
+		for (int32 axis = 0; axis < 3; ++axis)
+		{
+			node.Min[axis][lane] = child.Bounds.Min[axis];
+			node.Max[axis][lane] = child.Bounds.Max[axis];
+		}
+		node.Children[lane] = child.Count > 0u ? EmitLeaf(context, children[lane]) : EmitNode(context, children[lane]);
+	}
+
+	Nodes[nodeIndex] = node;
+	return nodeIndex;
+}
+
+uint32 TMeshBVH::EmitLeaf(const TBVHBuildContext &context, uint32 buildIndex)
+{
+	const auto &build = context.Nodes[buildIndex];
+	const auto &mesh = *context.Mesh;
+
+	// Unused lanes keep zero edges, which makes the determinant zero and the lane never reports a hit.
+	TTrianglePacket packet;
+	MemorySet(&packet, 0, sizeof(packet));
+	for (uint32 lane = 0; lane < 4u; ++lane)
+	{
+		if (lane >= build.Count)
+		{
+			packet.TriangleIndex[lane] = TRayHit::InvalidTriangle;
+			continue;
+		}
+
+		const uint32 triangle = context.Indices[build.First + lane];
+		const Vector3 &p0 = mesh.TVertexBuffer[mesh.IndexBuffer[triangle * 3 + 0]].Position;
+		const Vector3 &p1 = mesh.TVertexBuffer[mesh.IndexBuffer[triangle * 3 + 1]].Position;
+		const Vector3 &p2 = mesh.TVertexBuffer[mesh.IndexBuffer[triangle * 3 + 2]].Position;
+		for (int32 axis = 0; axis < 3; ++axis)
+		{
+			packet.V0[axis][lane] = p0[axis];
+			packet.E1[axis][lane] = p1[axis] - p0[axis];
+			packet.E2[axis][lane] = p2[axis] - p0[axis];
+		}
+		packet.TriangleIndex[lane] = triangle;
+	}
+
+	Packets.push_back(packet);
+	return LeafBit | uint32(Packets.size() - 1);
+}
+
+// Slab test of four boxes against four rays, either operand may be a broadcast.
+static inline void IntersectBoxes(const __m128 boxMin[3], const __m128 boxMax[3], const __m128 origin[3], const __m128 inverseDirection[3], __m128 &tNear, __m128 &tFar)
+{
+	for (int32 axis = 0; axis < 3; ++axis)
+	{
+		const __m128 t0 = _mm_mul_ps(_mm_sub_ps(boxMin[axis], origin[axis]), inverseDirection[axis]);
+		const __m128 t1 = _mm_mul_ps(_mm_sub_ps(boxMax[axis], origin[axis]), inverseDirection[axis]);
+		tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+		tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+	}
+}
+
+// Moller-Trumbore on four lanes, either the triangle or the ray operands may be broadcasts. Returns the lane hit mask.
+static inline int32 IntersectTriangles(const __m128 v0[3], const __m128 e1[3], const __m128 e2[3], const __m128 origin[3], const __m128 direction[3], __m128 minT, __m128 maxT, __m128 &t, __m128 &u, __m128 &v)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	const __m128 p[3] = {
+		_mm_sub_ps(_mm_mul_ps(direction[1], e2[2]), _mm_mul_ps(direction[2], e2[1])),
+		_mm_sub_ps(_mm_mul_ps(direction[2], e2[0]), _mm_mul_ps(direction[0], e2[2])),
+		_mm_sub_ps(_mm_mul_ps(direction[0], e2[1]), _mm_mul_ps(direction[1], e2[0])),
+	};
+	const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], p[0]), _mm_mul_ps(e1[1], p[1])), _mm_mul_ps(e1[2], p[2]));
+	const __m128 inverseDeterminant = _mm_div_ps(one, determinant);
+
+	const __m128 s[3] = {
+		_mm_sub_ps(origin[0], v0[0]),
+		_mm_sub_ps(origin[1], v0[1]),
+		_mm_sub_ps(origin[2], v0[2]),
+	};
+	u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s[0], p[0]), _mm_mul_ps(s[1], p[1])), _mm_mul_ps(s[2], p[2])), inverseDeterminant);
+
+	const __m128 q[3] = {
+		_mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1])),
+		_mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2])),
+		_mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0])),
+	};
+	v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(direction[0], q[0]), _mm_mul_ps(direction[1], q[1])), _mm_mul_ps(direction[2], q[2])), inverseDeterminant);
+	t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], q[0]), _mm_mul_ps(e2[1], q[1])), _mm_mul_ps(e2[2], q[2])), inverseDeterminant);
+
+	__m128 mask = _mm_cmpneq_ps(determinant, zero);
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+	mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, minT));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(t, maxT));
+	return _mm_movemask_ps(mask);
+}
+
+// Lanes of b where mask is set, of a elsewhere. SSE2 only, _mm_blendv_ps would need SSE4.1.
+static inline __m128 Select(__m128 a, __m128 b, __m128 mask)
+{
+	return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+// Orders the hit children so the nearest one ends up on top of the stack.
+static inline void PushChildren(const uint32 children[4], const float32 distances[4], int32 mask, uint32 *stack, int32 &stackSize)
+{
+	int32 order[4];
+	int32 orderCount = 0;
+	for (; mask != 0; mask &= mask - 1)
+	{
+		const int32 lane = int32(CountTrailingZeros(uint32(mask)));
+		int32 slot = orderCount++;
+		for (; slot > 0 && distances[order[slot - 1]] < distances[lane]; --slot)
+			order[slot] = order[slot - 1];
+		order[slot] = lane;
+	}
+
+	ASSERT(stackSize + orderCount <= StackSize);
+	for (int32 i = 0; i < orderCount; ++i)
+		stack[stackSize++] = children[order[i]];
+}
+
+template <bool AnyHit>
+bool TMeshBVH::Traverse(const TRay &ray, TRayHit &hit) const
+{
+	if (Nodes.empty())
+		return false;
+
+	const __m128 origin[3] = { _mm_set1_ps(ray.Origin.x), _mm_set1_ps(ray.Origin.y), _mm_set1_ps(ray.Origin.z) };
+	const __m128 direction[3] = { _mm_set1_ps(ray.Direction.x), _mm_set1_ps(ray.Direction.y), _mm_set1_ps(ray.Direction.z) };
+	const __m128 inverseDirection[3] = { _mm_set1_ps(1.0f / ray.Direction.x), _mm_set1_ps(1.0f / ray.Direction.y), _mm_set1_ps(1.0f / ray.Direction.z) };
+	const __m128 minT = _mm_set1_ps(ray.MinT);
+	float32 closestT = ray.MaxT;
+
+	uint32 stack[StackSize];
+	int32 stackSize = 0;
+	stack[stackSize++] = 0u;
+
+	while (stackSize > 0)
+	{
+		const uint32 reference = stack[--stackSize];
+		if (reference & LeafBit)
+		{
+			const auto &packet = Packets[reference & ~LeafBit];
+			const __m128 v0[3] = { _mm_loadu_ps(packet.V0[0]), _mm_loadu_ps(packet.V0[1]), _mm_loadu_ps(packet.V0[2]) };
+			const __m128 e1[3] = { _mm_loadu_ps(packet.E1[0]), _mm_loadu_ps(packet.E1[1]), _mm_loadu_ps(packet.E1[2]) };
+			const __m128 e2[3] = { _mm_loadu_ps(packet.E2[0]), _mm_loadu_ps(packet.E2[1]), _mm_loadu_ps(packet.E2[2]) };
+
+			__m128 t, u, v;
+			int32 mask = IntersectTriangles(v0, e1, e2, origin, direction, minT, _mm_set1_ps(closestT), t, u, v);
+			if (mask == 0)
+				continue;
+			if constexpr (AnyHit)
+				return true;
+
+			alignas(16) float32 ts[4], us[4], vs[4];
+			_mm_store_ps(ts, t);
+			_mm_store_ps(us, u);
+			_mm_store_ps(vs, v);
+			for (; mask != 0; mask &= mask - 1)
+			{
+				const int32 lane = int32(CountTrailingZeros(uint32(mask)));
+				if (ts[lane] < closestT)
+				{
+					closestT = ts[lane];
+					hit.T = ts[lane];
+					hit.U = us[lane];
+					hit.V = vs[lane];
+					hit.TriangleIndex = packet.TriangleIndex[lane];
+				}
+			}
+			continue;
+		}
+
+		const auto &node = Nodes[reference];
+		const __m128 boxMin[3] = { _mm_loadu_ps(node.Min[0]), _mm_loadu_ps(node.Min[1]), _mm_loadu_ps(node.Min[2]) };
+		const __m128 boxMax[3] = { _mm_loadu_ps(node.Max[0]), _mm_loadu_ps(node.Max[1]), _mm_loadu_ps(node.Max[2]) };
+
+		__m128 tNear = minT;
+		__m128 tFar = _mm_set1_ps(closestT);
+		IntersectBoxes(boxMin, boxMax, origin, inverseDirection, tNear, tFar);
+
+		int32 mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+		for (int32 lane = 0; lane < 4; ++lane)
+			if (node.Children[lane] == EmptyChild)
+				mask &= ~(1 << lane);
+
+		alignas(16) float32 distances[4];
+		_mm_store_ps(distances, tNear);
+		PushChildren(node.Children, distances, mask, stack, stackSize);
+	}
+
+	return hit.IsHit();
+}
+
+bool TMeshBVH::Intersect(const TRay &ray, TRayHit &hit) const
+{
+	hit = TRayHit();
+	return Traverse<false>(ray, hit);
+}
+
+bool TMeshBVH::Occluded(const TRay &ray) const
+{
+	TRayHit hit;
+	return Traverse<true>(ray, hit);
+}
+
+void TMeshBVH::Intersect(const TRayPacket4 &packet, TRayHit4 &hits) const
+{
+	for (int32 lane = 0; lane < 4; ++lane)
+		hits.TriangleIndex[lane] = TRayHit::InvalidTriangle;
+
+	const __m128 origin[3] = { _mm_loadu_ps(packet.Origin[0]), _mm_loadu_ps(packet.Origin[1]), _mm_loadu_ps(packet.Origin[2]) };
+	const __m128 direction[3] = { _mm_loadu_ps(packet.Direction[0]), _mm_loadu_ps(packet.Direction[1]), _mm_loadu_ps(packet.Direction[2]) };
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 inverseDirection[3] = { _mm_div_ps(one, direction[0]), _mm_div_ps(one, direction[1]), _mm_div_ps(one, direction[2]) };
+	const __m128 minT = _mm_loadu_ps(packet.MinT);
+	__m128 closestT = _mm_loadu_ps(packet.MaxT);
+	__m128 closestU = _mm_setzero_ps();
+	__m128 closestV = _mm_setzero_ps();
+
+	uint32 stack[StackSize];
+	int32 stackSize = 0;
+	if (!Nodes.empty())
+		stack[stackSize++] = 0u;
+
+	while (stackSize > 0)
+	{
+		const uint32 reference = stack[--stackSize];
+		if (reference & LeafBit)
+		{
+			const auto &triangles = Packets[reference & ~LeafBit];
+			for (int32 k = 0; k < 4 && triangles.TriangleIndex[k] != TRayHit::InvalidTriangle; ++k)
+			{
+				const __m128 v0[3] = { _mm_set1_ps(triangles.V0[0][k]), _mm_set1_ps(triangles.V0[1][k]), _mm_set1_ps(triangles.V0[2][k]) };
+				const __m128 e1[3] = { _mm_set1_ps(triangles.E1[0][k]), _mm_set1_ps(triangles.E1[1][k]), _mm_set1_ps(triangles.E1[2][k]) };
+				const __m128 e2[3] = { _mm_set1_ps(triangles.E2[0][k]), _mm_set1_ps(triangles.E2[1][k]), _mm_set1_ps(triangles.E2[2][k]) };
+
+				__m128 t, u, v;
+				const int32 mask = IntersectTriangles(v0, e1, e2, origin, direction, minT, closestT, t, u, v);
+				if (mask == 0)
+					continue;
+
+				const __m128 select = _mm_castsi128_ps(_mm_set_epi32(
+					(mask & 8) ? -1 : 0, (mask & 4) ? -1 : 0, (mask & 2) ? -1 : 0, (mask & 1) ? -1 : 0));
+				closestT = Select(closestT, t, select);
+				closestU = Select(closestU, u, select);
+				closestV = Select(closestV, v, select);
+				for (int32 lane = 0; lane < 4; ++lane)
+					if (mask & (1 << lane))
+						hits.TriangleIndex[lane] = triangles.TriangleIndex[k];
+			}
+			continue;
+		}
+
+		const auto &node = Nodes[reference];
+		alignas(16) float32 distances[4];
+		int32 childMask = 0;
+		for (int32 lane = 0; lane < 4; ++lane)
+		{
+			if (node.Children[lane] == EmptyChild)
+				continue;
+
+			const __m128 boxMin[3] = { _mm_set1_ps(node.Min[0][lane]), _mm_set1_ps(node.Min[1][lane]), _mm_set1_ps(node.Min[2][lane]) };
+			const __m128 boxMax[3] = { _mm_set1_ps(node.Max[0][lane]), _mm_set1_ps(node.Max[1][lane]), _mm_set1_ps(node.Max[2][lane]) };
+
+			__m128 tNear = minT;
+			__m128 tFar = closestT;
+			IntersectBoxes(boxMin, boxMax, origin, inverseDirection, tNear, tFar);
+
+			// The child is visited if any ray of the packet still reaches it, ordered by its nearest entry.
+			const int32 rayMask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+			if (rayMask == 0)
+				continue;
+
+			alignas(16) float32 entries[4];
+			_mm_store_ps(entries, tNear);
+			distances[lane] = TNumericLimits<float32>::Max();
+			for (int32 ray = 0; ray < 4; ++ray)
+				if (rayMask & (1 << ray))
+					distances[lane] = Min(distances[lane], entries[ray]);
+			childMask |= 1 << lane;
+		}
+
+		PushChildren(node.Children, distances, childMask, stack, stackSize);
+	}
+
+	_mm_storeu_ps(hits.T, closestT);
+	_mm_storeu_ps(hits.U, closestU);
+	_mm_storeu_ps(hits.V, closestV);
+}
+
+void TMeshBVH::Intersect(const TRay *rays, TRayHit *hits, int32 count) const
+{
+	Jobs::ParallelFor(DivCeil(count, 4), 64, [&](int32 packetIndex) {
+		const int32 first = packetIndex * 4;
+		if (first + 4 > count)
+		{
+			for (int32 i = first; i < count; ++i)
+				Intersect(rays[i], hits[i]);
+			return;
+		}
+
+		TRayPacket4 packet;
+		for (int32 lane = 0; lane < 4; ++lane)
+		{
+			const auto &ray = rays[first + lane];
+			for (int32 axis = 0; axis < 3; ++axis)
+			{
+				packet.Origin[axis][lane] = ray.Origin[axis];
+				packet.Direction[axis][lane] = ray.Direction[axis];
+			}
+			packet.MinT[lane] = ray.MinT;
+			packet.MaxT[lane] = ray.MaxT;
+		}
+
+		TRayHit4 packetHits;
+		Intersect(packet, packetHits);
+
+		for (int32 lane = 0; lane < 4; ++lane)
+		{
+			auto &hit = hits[first + lane];
+			hit = TRayHit();
+			if (packetHits.TriangleIndex[lane] == TRayHit::InvalidTriangle)
+				continue;
+			hit.T = packetHits.T[lane];
+			hit.U = packetHits.U[lane];
+			hit.V = packetHits.V[lane];
+			hit.TriangleIndex = packetHits.TriangleIndex[lane];
+		}
+	});
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Mesh.h"
+
+// References:
+// https://www.sci.utah.edu/~wald/Publications/2007/ParallelBVHBuild/fastbuild.pdf
+// https://www.embree.org/papers/2008-HPG-Stackless.pdf
+// http://www.graphics.cornell.edu/pubs/1997/MT97.pdf
+
+struct TRay
+{
+	Vector3 Origin;
+	Vector3 Direction;
+	float32 MinT = 0.0f;
+	float32 MaxT = TNumericLimits<float32>::Max();
+};
+
+struct TRayHit
+{
+	static constexpr uint32 InvalidTriangle = ~0u;
+
+	float32 T = TNumericLimits<float32>::Max();
+	// Barycentric weights of the second and third vertex of the triangle.
+	float32 U = 0.0f;
+	float32 V = 0.0f;
+	uint32 TriangleIndex = InvalidTriangle;
+
+	bool IsHit() const {
+		return TriangleIndex != InvalidTriangle;
+	}
+};
+
+// Four rays in structure of arrays layout, traversed together. Pays off for coherent rays (picking, shadow rays towards one light).
+struct alignas(16) TRayPacket4
+{
+	float32 Origin[3][4];
+	float32 Direction[3][4];
+	float32 MinT[4];
+	float32 MaxT[4];
+};
+
+struct alignas(16) TRayHit4
+{
+	float32 T[4];
+	float32 U[4];
+	float32 V[4];
+	uint32 TriangleIndex[4];
+};
+
+struct TBVHBuildContext;
+
+// 4-wide bounding volume hierarchy over the triangles of a TMesh. Nodes and leaves are stored in
+// structure of arrays layout so one SSE instruction tests a ray against four boxes or four triangles.
+class TMeshBVH
+{
+public:
+	// Binned SAH build, large subtrees are built in parallel on the job system.
+	void Build(const TMesh &mesh);
+
+	bool Intersect(const TRay &ray, TRayHit &hit) const;
+	// Any hit query, stops at the first triangle between MinT and MaxT (line of sight, shadow rays).
+	bool Occluded(const TRay &ray) const;
+	void Intersect(const TRayPacket4 &packet, TRayHit4 &hits) const;
+	// Spreads the rays over the job system, consecutive groups of four go through packet traversal.
+	void Intersect(const TRay *rays, TRayHit *hits, int32 count) const;
+
+	bool IsEmpty() const {
+		return Nodes.empty();
+	}
+
+private:
+	static constexpr uint32 LeafBit = 0x80000000u;
+	static constexpr uint32 EmptyChild = ~0u;
+
+	struct alignas(16) TNode
+	{
+		float32 Min[3][4];
+		float32 Max[3][4];
+		// Node index, LeafBit | packet index or EmptyChild.
+		uint32 Children[4];
+	};
+
+	struct alignas(16) TTrianglePacket
+	{
+		float32 V0[3][4];
+		float32 E1[3][4];
+		float32 E2[3][4];
+		uint32 TriangleIndex[4];
+	};
+
+	uint32 EmitNode(const TBVHBuildContext &context, uint32 buildIndex);
+	uint32 EmitLeaf(const TBVHBuildContext &context, uint32 buildIndex);
+
+	template <bool AnyHit>
+	bool Traverse(const TRay &ray, TRayHit &hit) const;
+
+	TVarArray<TNode> Nodes;
+	TVarArray<TTrianglePacket> Packets;
+};
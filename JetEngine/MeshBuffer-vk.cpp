@@ -0,0 +1,290 @@
+#include "Precompiled.h"
+
+#include "RenderDevice-vk.h"
+
+VkBuffer TVulkanMeshBuffer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, TVulkanMemoryUsage memoryUsage, TVulkanAllocation &memory)
+{
+	VkBufferCreateInfo bufferCreateInfo = {};
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = nullptr;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = size;
+	bufferCreateInfo.usage = usage;
+	// Filled in by the staging ring, which may copy on a queue of another family.
+	if (usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+		StagingRing->SetDestinationSharing(bufferCreateInfo);
+	else
+		Sharing.Apply(bufferCreateInfo);
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkResult result = vkCreateBuffer(Device, &bufferCreateInfo, Allocator, &buffer);
+	ASSERT(result == VK_SUCCESS);
+	memory = MemoryManager->AllocateBuffer(buffer, memoryUsage);
+	return buffer;
+}
+
+void TVulkanMeshBuffer::Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, TVulkanStagingRing *stagingRing,
+	TVulkanBindlessHeap *bindless, const TFeatures &features, uint32 maxInstances, const TVulkanBufferSharing &sharing)
+{
+	Device = device;
+	Allocator = allocator;
+	MemoryManager = memoryManager;
+	StagingRing = stagingRing;
+	Sharing = sharing;
+	Bindless = bindless;
+	Features = features;
+	MaxInstances = maxInstances;
+
+	// Storage as well, for compute passes that read the meshes.
+	VertexBuffer = CreateBuffer(VkDeviceSize(MaxVertices) * sizeof(TVertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		TVulkanMemoryUsage::GpuOnly, VertexMemory);
+	IndexBuffer = CreateBuffer(VkDeviceSize(MaxIndices) * sizeof(uint16), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		TVulkanMemoryUsage::GpuOnly, IndexMemory);
+	BoundsBuffer = CreateBuffer(VkDeviceSize(MaxMeshes) * sizeof(Vector4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		TVulkanMemoryUsage::GpuOnly, BoundsMemory);
+	VertexRanges.Init(MaxVertices, MinRange);
+	IndexRanges.Init(MaxIndices, MinRange);
+
+	for (TFrame &frame : Frames)
+	{
+		frame.Instances = CreateBuffer(VkDeviceSize(MaxInstances) * sizeof(TVulkanInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			TVulkanMemoryUsage::CpuToGpu, frame.InstanceMemory);
+		ASSERT(frame.InstanceMemory.Mapped != nullptr);
+		frame.Commands = CreateBuffer(GetCountOffset() + sizeof(uint32), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			TVulkanMemoryUsage::CpuToGpu, frame.CommandMemory);
+		ASSERT(frame.CommandMemory.Mapped != nullptr);
+		frame.InstanceSlot = Bindless->IsEnabled() ? Bindless->AddBuffer(frame.Instances) : ~0u;
+	}
+	FrameSlot = 0u;
+	Statistics = TVulkanDrawStatistics();
+}
+
+void TVulkanMeshBuffer::Done()
+{
+	for (TFrame &frame : Frames)
+	{
+		if (frame.InstanceSlot != ~0u)
+			Bindless->Release(TBindlessKind::Buffer, frame.InstanceSlot, 0u);
+		vkDestroyBuffer(Device, frame.Instances, Allocator);
+		MemoryManager->Free(frame.InstanceMemory);
+		vkDestroyBuffer(Device, frame.Commands, Allocator);
+		MemoryManager->Free(frame.CommandMemory);
+		frame = TFrame();
+	}
+
+	vkDestroyBuffer(Device, VertexBuffer, Allocator);
+	MemoryManager->Free(VertexMemory);
+	vkDestroyBuffer(Device, IndexBuffer, Allocator);
+	MemoryManager->Free(IndexMemory);
+	vkDestroyBuffer(Device, BoundsBuffer, Allocator);
+	MemoryManager->Free(BoundsMemory);
+	VertexBuffer = VK_NULL_HANDLE;
+	IndexBuffer = VK_NULL_HANDLE;
+	BoundsBuffer = VK_NULL_HANDLE;
+
+	Meshes = TVarArray<TVulkanMeshRange>();
+	FreeMeshes = TVarArray<uint32>();
+	RetiredMeshes = TVarArray<TRetiredMesh>();
+	PendingInstances = TVarArray<TVulkanInstance>();
+}
+
+uint32 TVulkanMeshBuffer::AddMesh(const TMesh &mesh)
+{
+	const uint32 vertexCount = uint32(mesh.TVertexBuffer.size());
+	const uint32 indexCount = uint32(mesh.IndexBuffer.size());
+	ASSERT(vertexCount > 0u && indexCount > 0u);
+
+	if (FreeMeshes.empty() && Meshes.size() == MaxMeshes)
+		return InvalidMesh;
+
+	const uint64 firstVertex = VertexRanges.Allocate(vertexCount);
+	if (firstVertex == TBuddyAllocator::InvalidOffset)
+		return InvalidMesh;
+	const uint64 firstIndex = IndexRanges.Allocate(indexCount);
+	if (firstIndex == TBuddyAllocator::InvalidOffset)
+	{
+		VertexRanges.Free(firstVertex);
+		return InvalidMesh;
+	}
+
+	uint32 index;
+	if (!FreeMeshes.empty())
+	{
+		index = FreeMeshes.back();
+		FreeMeshes.pop_back();
+	}
+	else
+	{
+		index = uint32(Meshes.size());
+		Meshes.push_back(TVulkanMeshRange());
+	}
+
+	TVulkanMeshRange &range = Meshes[index];
+	range.FirstVertex = uint32(firstVertex);
+	range.VertexCount = vertexCount;
+	range.FirstIndex = uint32(firstIndex);
+	range.IndexCount = indexCount;
+
+	// Around the center of the bounding box, not the smallest sphere but close enough for culling.
+	Vector3 minimum = mesh.TVertexBuffer[0].Position, maximum = minimum;
+	for (uint32 i = 1; i < vertexCount; ++i)
+	{
+		minimum = ComponentMin(minimum, mesh.TVertexBuffer[i].Position);
+		maximum = ComponentMax(maximum, mesh.TVertexBuffer[i].Position);
+	}
+	range.Center = (minimum + maximum) * 0.5f;
+	float32 radiusSquared = 0.0f;
+	for (uint32 i = 0; i < vertexCount; ++i)
+		radiusSquared = Max(radiusSquared, LengthSquared(mesh.TVertexBuffer[i].Position - range.Center));
+	range.Radius = sqrtf(radiusSquared);
+
+	const Vector4 bounds(range.Center.x, range.Center.y, range.Center.z, range.Radius);
+	StagingRing->Upload(BoundsBuffer, VkDeviceSize(index) * sizeof(Vector4), &bounds, sizeof(bounds));
+	StagingRing->Upload(VertexBuffer, firstVertex * sizeof(TVertex), mesh.TVertexBuffer.data(), VkDeviceSize(vertexCount) * sizeof(TVertex));
+	StagingRing->Upload(IndexBuffer, firstIndex * sizeof(uint16), mesh.IndexBuffer.data(), VkDeviceSize(indexCount) * sizeof(uint16));
+	return index;
+}
+
+void TVulkanMeshBuffer::RemoveMesh(uint32 mesh, uint64 frame)
+{
+	ASSERT(mesh < Meshes.size() && Meshes[mesh].IndexCount > 0u);
+	// Retired twice, Collect would free its ranges twice.
+	for (size_t i = 0; i < RetiredMeshes.size(); ++i)
+	{
+		if (RetiredMeshes[i].Mesh == mesh)
+		{
+			ASSERT(false);
+			return;
+		}
+	}
+	TRetiredMesh &retired = RetiredMeshes.push_back(TRetiredMesh());
+	retired.Frame = frame;
+	retired.Mesh = mesh;
+}
+
+void TVulkanMeshBuffer::Collect(uint64 completedFrame)
+{
+	size_t kept = 0u;
+	for (size_t i = 0; i < RetiredMeshes.size(); ++i)
+	{
+		const TRetiredMesh retired = RetiredMeshes[i];
+		if (retired.Frame <= completedFrame)
+		{
+			TVulkanMeshRange &range = Meshes[retired.Mesh];
+			VertexRanges.Free(range.FirstVertex);
+			IndexRanges.Free(range.FirstIndex);
+			range = TVulkanMeshRange();
+			FreeMeshes.push_back(retired.Mesh);
+		}
+		else
+		{
+			RetiredMeshes[kept++] = retired;
+		}
+	}
+	RetiredMeshes.resize(kept);
+}
+
+void TVulkanMeshBuffer::BeginFrame(uint32 frame)
+{
+	ASSERT(frame < MaxFrames);
+	FrameSlot = frame;
+	PendingInstances.resize(0);
+	Draws.resize(0);
+}
+
+void TVulkanMeshBuffer::AddInstance(const TVulkanInstance &instance)
+{
+	ASSERT(instance.Mesh < Meshes.size() && Meshes[instance.Mesh].IndexCount > 0u);
+	ASSERT(PendingInstances.size() < MaxInstances);
+	PendingInstances.push_back(instance);
+}
+
+void TVulkanMeshBuffer::Build()
+{
+	TFrame &frame = Frames[FrameSlot];
+
+	// Counting sort by mesh, every mesh's instances end up next to each other as one instance range.
+	MeshInstances.resize(Meshes.size());
+	MeshDraws.resize(Meshes.size());
+	for (size_t i = 0; i < MeshInstances.size(); ++i)
+		MeshInstances[i] = 0u;
+	for (size_t i = 0; i < PendingInstances.size(); ++i)
+		++MeshInstances[PendingInstances[i].Mesh];
+
+	Draws.resize(0);
+	uint32 firstInstance = 0u;
+	for (size_t mesh = 0; mesh < MeshInstances.size(); ++mesh)
+	{
+		const uint32 instanceCount = MeshInstances[mesh];
+		MeshInstances[mesh] = firstInstance;
+		if (instanceCount == 0u)
+			continue;
+
+		const TVulkanMeshRange &range = Meshes[mesh];
+		MeshDraws[mesh] = uint32(Draws.size());
+		VkDrawIndexedIndirectCommand &draw = Draws.push_back(VkDrawIndexedIndirectCommand());
+		draw.indexCount = range.IndexCount;
+		draw.instanceCount = instanceCount;
+		draw.firstIndex = range.FirstIndex;
+		draw.vertexOffset = int32(range.FirstVertex);
+		draw.firstInstance = firstInstance;
+		firstInstance += instanceCount;
+	}
+
+	// Written in order, the memory is likely write combined.
+	auto *instances = reinterpret_cast<TVulkanInstance *>(frame.InstanceMemory.Mapped);
+	for (size_t i = 0; i < PendingInstances.size(); ++i)
+	{
+		TVulkanInstance instance = PendingInstances[i];
+		instance.Draw = MeshDraws[instance.Mesh];
+		instances[MeshInstances[instance.Mesh]++] = instance;
+	}
+
+	const uint32 drawCount = uint32(Draws.size());
+	const VkDeviceSize commandBytes = VkDeviceSize(drawCount) * sizeof(VkDrawIndexedIndirectCommand);
+	if (drawCount > 0u)
+		MemCopy(frame.CommandMemory.Mapped, Draws.data(), int32(commandBytes));
+	MemCopy(frame.CommandMemory.Mapped + GetCountOffset(), &drawCount, sizeof(drawCount));
+
+	if (!PendingInstances.empty())
+		MemoryManager->Flush(frame.InstanceMemory, 0u, VkDeviceSize(PendingInstances.size()) * sizeof(TVulkanInstance));
+	if (drawCount > 0u)
+		MemoryManager->Flush(frame.CommandMemory, 0u, commandBytes);
+	MemoryManager->Flush(frame.CommandMemory, GetCountOffset(), sizeof(drawCount));
+
+	Statistics.InstanceCount = uint32(PendingInstances.size());
+	Statistics.DrawCount = drawCount;
+	Statistics.CallCount = Features.MultiDrawIndirect ? Min(drawCount, 1u) : drawCount;
+}
+
+void TVulkanMeshBuffer::Draw(VkCommandBuffer commandBuffer)
+{
+	const TFrame &frame = Frames[FrameSlot];
+	const uint32 drawCount = uint32(Draws.size());
+	if (drawCount == 0u)
+		return;
+
+	const VkDeviceSize offset = 0u;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &VertexBuffer, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, IndexBuffer, 0u, VK_INDEX_TYPE_UINT16);
+
+	const uint32 stride = sizeof(VkDrawIndexedIndirectCommand);
+	if (Features.MultiDrawIndirect && Features.DrawIndirectCount)
+	{
+		// The count in the buffer is what is drawn, whoever wrote the commands.
+		vkCmdDrawIndexedIndirectCount(commandBuffer, frame.Commands, 0u, frame.Commands, GetCountOffset(), MaxMeshes, stride);
+	}
+	else if (Features.MultiDrawIndirect)
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, frame.Commands, 0u, drawCount, stride);
+	}
+	else
+	{
+		// Indirect draws could not start past instance 0, direct ones can.
+		for (uint32 i = 0; i < drawCount; ++i)
+		{
+			const VkDrawIndexedIndirectCommand &draw = Draws[i];
+			vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+		}
+	}
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "Core/Memory/BuddyAllocator.h"
+#include "Mesh.h"
+
+// References:
+// https://vkguide.dev/docs/gpudriven/gpu_driven_engines/
+// https://www.khronos.org/registry/vulkan/specs/1.2/html/vkspec.html#drawing-vkCmdDrawIndexedIndirectCount
+// https://developer.nvidia.com/content/how-modern-opengl-can-radically-reduce-driver-overhead-0
+
+// Per instance data, shaders find their instance at SV_InstanceID in GetInstanceBuffer().
+struct TVulkanInstance
+{
+	// Object to world, rows of a 3x4 matrix.
+	float32 Transform[3][4];
+	uint32 Mesh;
+	uint32 Material;
+	// Index of the mesh's draw in the frame, filled in by Build.
+	uint32 Draw;
+	uint32 Padding;
+};
+
+static_assert(sizeof(TVulkanInstance) == 64u);
+
+// In vertices and indices, the mesh's indices are relative to FirstVertex.
+struct TVulkanMeshRange
+{
+	uint32 FirstVertex;
+	uint32 VertexCount;
+	uint32 FirstIndex;
+	uint32 IndexCount;
+	// Bounding sphere in object space.
+	Vector3 Center;
+	float32 Radius;
+};
+
+struct TVulkanDrawStatistics
+{
+	uint32 InstanceCount = 0u;
+	// Indirect draws, one per mesh with instances.
+	uint32 DrawCount = 0u;
+	// Draw calls recorded, one for all of the frame's draws unless the device lacks multiDrawIndirect.
+	uint32 CallCount = 0u;
+};
+
+// Vertices and indices of every mesh in one vertex and one index buffer, so drawing never switches buffers.
+// Each frame the instances added are grouped by mesh and turned into one indirect draw per mesh, and all of
+// them are issued with a single vkCmdDrawIndexedIndirectCount or vkCmdDrawIndexedIndirect. Vertices are TVertex,
+// indices 16 bit. Not thread safe.
+class TVulkanMeshBuffer
+{
+public:
+	static constexpr uint32 MaxFrames = 2u;
+	static constexpr uint32 MaxMeshes = 4096u;
+	static constexpr uint32 InvalidMesh = ~0u;
+
+	struct TFeatures
+	{
+		// Several draws per indirect call, with instance ranges of their own, multiDrawIndirect and drawIndirectFirstInstance.
+		bool MultiDrawIndirect = false;
+		bool DrawIndirectCount = false;
+	};
+
+	// sharing holds the queue families that read the frames' instances and draws, the uploaded buffers are shared as
+	// the staging ring's destinations are.
+	void Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, TVulkanStagingRing *stagingRing,
+		TVulkanBindlessHeap *bindless, const TFeatures &features, uint32 maxInstances, const TVulkanBufferSharing &sharing);
+	// The GPU must be idle.
+	void Done();
+
+	// Uploads the mesh through the staging ring, InvalidMesh when there is no room left for it.
+	uint32 AddMesh(const TMesh &mesh);
+	// frame is the last frame that may draw the mesh.
+	void RemoveMesh(uint32 mesh, uint64 frame);
+	// Frees the ranges of meshes removed with completedFrame or earlier.
+	void Collect(uint64 completedFrame);
+
+	const TVulkanMeshRange &GetMesh(uint32 mesh) const {
+		return Meshes[mesh];
+	}
+
+	// The GPU has to be done with the frame's buffers.
+	void BeginFrame(uint32 frame);
+	void AddInstance(const TVulkanInstance &instance);
+	// Writes the frame's instances and draws, once after the last AddInstance and before any Draw is recorded.
+	void Build();
+	// Binds the vertex and index buffers and records the frame's draws, inside a render pass with a pipeline
+	// whose vertex input is TVertex.
+	void Draw(VkCommandBuffer commandBuffer);
+
+	VkBuffer GetVertexBuffer() const {
+		return VertexBuffer;
+	}
+	VkBuffer GetIndexBuffer() const {
+		return IndexBuffer;
+	}
+	// Bounding sphere of every mesh as float4(center, radius), indexed by mesh.
+	VkBuffer GetBoundsBuffer() const {
+		return BoundsBuffer;
+	}
+	uint32 GetMaxInstances() const {
+		return MaxInstances;
+	}
+	// Number of draws written by the last Build.
+	uint32 GetDrawCount() const {
+		return uint32(Draws.size());
+	}
+	const TFeatures &GetFeatures() const {
+		return Features;
+	}
+	// Host visible, holds the frame's instances sorted by mesh.
+	VkBuffer GetInstanceBuffer(uint32 frame) const {
+		return Frames[frame].Instances;
+	}
+	VkBuffer GetInstanceBuffer() const {
+		return GetInstanceBuffer(FrameSlot);
+	}
+	// Slot of GetInstanceBuffer() in the bindless heap, ~0u when the heap is disabled.
+	uint32 GetInstanceSlot() const {
+		return Frames[FrameSlot].InstanceSlot;
+	}
+	// The frame's VkDrawIndexedIndirectCommands, followed by their count at GetCountOffset().
+	VkBuffer GetCommandBuffer(uint32 frame) const {
+		return Frames[frame].Commands;
+	}
+	VkBuffer GetCommandBuffer() const {
+		return GetCommandBuffer(FrameSlot);
+	}
+	uint32 GetFrameSlot() const {
+		return FrameSlot;
+	}
+	VkDeviceSize GetCountOffset() const {
+		return VkDeviceSize(MaxMeshes) * sizeof(VkDrawIndexedIndirectCommand);
+	}
+
+	const TVulkanDrawStatistics &GetStatistics() const {
+		return Statistics;
+	}
+
+private:
+	// Powers of two for the buddy allocators, 32 MB of vertices and 8 MB of indices.
+	static constexpr uint32 MaxVertices = 1u << 20;
+	static constexpr uint32 MaxIndices = 1u << 22;
+	static constexpr uint32 MinRange = 64u;
+
+	struct TFrame
+	{
+		VkBuffer Instances = VK_NULL_HANDLE;
+		TVulkanAllocation InstanceMemory;
+		uint32 InstanceSlot = ~0u;
+		VkBuffer Commands = VK_NULL_HANDLE;
+		TVulkanAllocation CommandMemory;
+	};
+
+	struct TRetiredMesh
+	{
+		uint64 Frame;
+		uint32 Mesh;
+	};
+
+	VkBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, TVulkanMemoryUsage memoryUsage, TVulkanAllocation &memory);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	TVulkanMemoryManager *MemoryManager = nullptr;
+	TVulkanStagingRing *StagingRing = nullptr;
+	TVulkanBufferSharing Sharing;
+	TVulkanBindlessHeap *Bindless = nullptr;
+	TFeatures Features;
+	uint32 MaxInstances = 0u;
+
+	VkBuffer VertexBuffer = VK_NULL_HANDLE;
+	TVulkanAllocation VertexMemory;
+	VkBuffer IndexBuffer = VK_NULL_HANDLE;
+	TVulkanAllocation IndexMemory;
+	VkBuffer BoundsBuffer = VK_NULL_HANDLE;
+	TVulkanAllocation BoundsMemory;
+	TBuddyAllocator VertexRanges;
+	TBuddyAllocator IndexRanges;
+
+	TVarArray<TVulkanMeshRange> Meshes;
+	TVarArray<uint32> FreeMeshes;
+	TVarArray<TRetiredMesh> RetiredMeshes;
+
+	TFrame Frames[MaxFrames];
+	uint32 FrameSlot = 0u;
+	TVarArray<TVulkanInstance> PendingInstances;
+	// Instances per mesh, then the first instance of each mesh.
+	TVarArray<uint32> MeshInstances;
+	TVarArray<uint32> MeshDraws;
+	// Copy of the frame's draws for devices that issue them one by one.
+	TVarArray<VkDrawIndexedIndirectCommand> Draws;
+	TVulkanDrawStatistics Statistics;
+};
@@ -0,0 +1,469 @@
+#include "Precompiled.h"
+
+#include "MeshSimplifier.h"
+
+static constexpr float32 BorderWeight = 10.0f;
+static constexpr uint32 InvalidIndex = ~0u;
+
+enum EVertexFlags : uint8
+{
+	vfNone   = 0u,
+	vfBorder = 1u << 0u,
+	vfSeam   = 1u << 1u,
+};
+
+// Symmetric 4x4 matrix of the weighted sum of squared distances to a set of planes, and the sum of the weights.
+struct TQuadric
+{
+	float32 A2 = 0.0f, AB = 0.0f, AC = 0.0f, AD = 0.0f;
+	float32 B2 = 0.0f, BC = 0.0f, BD = 0.0f;
+	float32 C2 = 0.0f, CD = 0.0f;
+	float32 D2 = 0.0f;
+	float32 Weight = 0.0f;
+
+	void AddPlane(const Vector3 &normal, float32 distance, float32 weight)
+	{
+		A2 += weight * normal.x * normal.x;
+		AB += weight * normal.x * normal.y;
+		AC += weight * normal.x * normal.z;
+		AD += weight * normal.x * distance;
+		B2 += weight * normal.y * normal.y;
+		BC += weight * normal.y * normal.z;
+		BD += weight * normal.y * distance;
+		C2 += weight * normal.z * normal.z;
+		CD += weight * normal.z * distance;
+		D2 += weight * distance * distance;
+		Weight += weight;
+	}
+
+	TQuadric &operator+=(const TQuadric &rhs)
+	{
+		A2 += rhs.A2; AB += rhs.AB; AC += rhs.AC; AD += rhs.AD;
+		B2 += rhs.B2; BC += rhs.BC; BD += rhs.BD;
+		C2 += rhs.C2; CD += rhs.CD;
+		D2 += rhs.D2;
+		Weight += rhs.Weight;
+		return *this;
+	}
+
+	// Weighted mean of the squared distances, so it is in squared object space units whatever the triangle areas.
+	float32 Evaluate(const Vector3 &p) const
+	{
+		const float32 result =
+			A2 * p.x * p.x + 2.0f * AB * p.x * p.y + 2.0f * AC * p.x * p.z + 2.0f * AD * p.x +
+			B2 * p.y * p.y + 2.0f * BC * p.y * p.z + 2.0f * BD * p.y +
+			C2 * p.z * p.z + 2.0f * CD * p.z +
+			D2;
+		return Weight > 0.0f ? Max(result / Weight, 0.0f) : 0.0f;
+	}
+};
+
+struct TCollapse
+{
+	uint32 From;
+	uint32 To;
+	float32 Cost;
+	float32 Error;
+};
+
+static uint64 MakeEdgeKey(uint32 a, uint32 b)
+{
+	return a < b ? (uint64(a) << 32u) | b : (uint64(b) << 32u) | a;
+}
+
+static bool ContainsKey(const TVarArray<uint64> &sortedKeys, uint64 key)
+{
+	size_t lo = 0, hi = sortedKeys.size();
+	while (lo < hi)
+	{
+		const size_t middle = (lo + hi) / 2;
+		if (sortedKeys[middle] < key)
+			lo = middle + 1;
+		else
+			hi = middle;
+	}
+	return lo < sortedKeys.size() && sortedKeys[lo] == key;
+}
+
+// Maps every vertex to the lowest index vertex with the same position, or with the same position and attributes.
+// By position attribute seams do not split the topology, by position and attributes the copies meshes with a
+// vertex per face corner carry are welded.
+static void BuildVertexRemap(const TVarArray<TVertex> &vertices, bool attributes, TVarArray<uint32> &remap)
+{
+	const uint32 vertexCount = uint32(vertices.size());
+
+	// The position, then the normal and texture coordinates.
+	const auto GetKey = [&](uint32 v, float32 *key) {
+		const TVertex &vertex = vertices[v];
+		const float32 values[8] = {
+			vertex.Position.x, vertex.Position.y, vertex.Position.z,
+			vertex.Normal.x, vertex.Normal.y, vertex.Normal.z,
+			vertex.TextureCoord.x, vertex.TextureCoord.y,
+		};
+		MemCopy(key, values, sizeof(values));
+	};
+	const uint32 keySize = attributes ? 8u : 3u;
+	const auto Compare = [&](uint32 lhs, uint32 rhs) -> int32 {
+		float32 a[8], b[8];
+		GetKey(lhs, a);
+		GetKey(rhs, b);
+		for (uint32 i = 0; i < keySize; ++i)
+			if (a[i] != b[i])
+				return a[i] < b[i] ? -1 : 1;
+		return 0;
+	};
+
+	TVarArray<uint32> order;
+	order.resize(vertexCount);
+	for (uint32 i = 0; i < vertexCount; ++i)
+		order[i] = i;
+
+	Sort(order.data(), order.data() + vertexCount, [&](uint32 lhs, uint32 rhs) {
+		const int32 result = Compare(lhs, rhs);
+		return result != 0 ? result < 0 : lhs < rhs;
+	});
+
+	remap.resize(vertexCount);
+	for (uint32 i = 0; i < vertexCount; ++i)
+	{
+		const bool sameAsPrevious = i > 0 && Compare(order[i], order[i - 1]) == 0;
+		remap[order[i]] = sameAsPrevious ? remap[order[i - 1]] : order[i];
+	}
+}
+
+// Vertex to triangle adjacency in compressed rows: triangles of vertex v are in [offsets[v], offsets[v + 1]).
+static void BuildAdjacency(const TVarArray<uint32> &indices, size_t indexCount, uint32 vertexCount, TVarArray<uint32> &offsets, TVarArray<uint32> &triangles)
+{
+	offsets.resize(0);
+	offsets.resize(vertexCount + 1);
+	for (size_t i = 0; i < indexCount; ++i)
+		++offsets[indices[i] + 1];
+	for (uint32 v = 0; v < vertexCount; ++v)
+		offsets[v + 1] += offsets[v];
+
+	TVarArray<uint32> cursor(offsets);
+	triangles.resize(indexCount);
+	for (size_t i = 0; i < indexCount; ++i)
+		triangles[cursor[indices[i]]++] = uint32(i / 3);
+}
+
+static bool FlipsTriangle(const TVarArray<TVertex> &vertices, const TVarArray<uint32> &indices, const TVarArray<uint32> &offsets, const TVarArray<uint32> &triangles, uint32 from, uint32 to)
+{
+	for (uint32 i = offsets[from]; i < offsets[from + 1]; ++i)
+	{
+		const uint32 *triangle = &indices[triangles[i] * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			continue;
+
+		Vector3 before[3], after[3];
+		for (int32 k = 0; k < 3; ++k)
+		{
+			before[k] = vertices[triangle[k]].Position;
+			after[k] = triangle[k] == from ? vertices[to].Position : before[k];
+		}
+
+		const Vector3 normalBefore = Cross(before[1] - before[0], before[2] - before[0]);
+		const Vector3 normalAfter = Cross(after[1] - after[0], after[2] - after[0]);
+		if (Dot(normalBefore, normalAfter) <= 0.0f)
+			return true;
+	}
+	return false;
+}
+
+TMesh SimplifyMesh(const TMesh &mesh, const TSimplifyOptions &options, float32 *resultError)
+{
+	const auto &vertices = mesh.TVertexBuffer;
+	const uint32 vertexCount = uint32(vertices.size());
+
+	// Indices go to the welded vertices only, the copies are left unreferenced and dropped from the result.
+	TVarArray<uint32> welded;
+	BuildVertexRemap(vertices, true, welded);
+	TVarArray<uint32> indices;
+	indices.resize(mesh.IndexBuffer.size());
+	for (size_t i = 0; i < indices.size(); ++i)
+		indices[i] = welded[mesh.IndexBuffer[i]];
+	size_t indexCount = indices.size();
+
+	TVarArray<uint32> canonical;
+	BuildVertexRemap(vertices, false, canonical);
+
+	// Positions with welded vertices of different attributes are seams, they keep their wedges where they are.
+	TVarArray<uint8> flags;
+	flags.resize(vertexCount);
+	{
+		TVarArray<uint32> wedgeCount;
+		wedgeCount.resize(vertexCount);
+		for (uint32 v = 0; v < vertexCount; ++v)
+			if (welded[v] == v)
+				++wedgeCount[canonical[v]];
+		for (uint32 v = 0; v < vertexCount; ++v)
+			if (wedgeCount[canonical[v]] > 1)
+				flags[v] |= vfSeam;
+	}
+
+	// An edge referenced by a single triangle lies on the border of the mesh.
+	TVarArray<uint64> borderEdges;
+	{
+		TVarArray<uint64> edges;
+		edges.reserve(indexCount);
+		for (size_t i = 0; i < indexCount; i += 3)
+			for (int32 k = 0; k < 3; ++k)
+				edges.push_back(MakeEdgeKey(canonical[indices[i + k]], canonical[indices[i + (k + 1) % 3]]));
+		Sort(edges.data(), edges.data() + edges.size());
+
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t run = i + 1;
+			while (run < edges.size() && edges[run] == edges[i])
+				++run;
+			if (run - i == 1)
+				borderEdges.push_back(edges[i]);
+			i = run;
+		}
+	}
+
+	TVarArray<uint8> canonicalBorder;
+	canonicalBorder.resize(vertexCount);
+	for (size_t i = 0; i < borderEdges.size(); ++i)
+	{
+		canonicalBorder[uint32(borderEdges[i] >> 32u)] = 1;
+		canonicalBorder[uint32(borderEdges[i] & 0xFFFFFFFFull)] = 1;
+	}
+	for (uint32 v = 0; v < vertexCount; ++v)
+		if (canonicalBorder[canonical[v]])
+			flags[v] |= vfBorder;
+
+	// Quadrics live on the canonical vertex so all wedges of a position share them.
+	TVarArray<TQuadric> quadrics;
+	quadrics.resize(vertexCount);
+	for (size_t i = 0; i < indexCount; i += 3)
+	{
+		const uint32 triangle[3] = { canonical[indices[i + 0]], canonical[indices[i + 1]], canonical[indices[i + 2]] };
+		const Vector3 &p0 = vertices[triangle[0]].Position;
+		const Vector3 &p1 = vertices[triangle[1]].Position;
+		const Vector3 &p2 = vertices[triangle[2]].Position;
+
+		Vector3 normal = Cross(p1 - p0, p2 - p0);
+		const float32 doubleArea = Length(normal);
+		if (doubleArea == 0.0f)
+			continue;
+		normal = normal / doubleArea;
+
+		TQuadric quadric;
+		quadric.AddPlane(normal, -Dot(normal, p0), doubleArea * 0.5f);
+		for (int32 k = 0; k < 3; ++k)
+			quadrics[triangle[k]] += quadric;
+
+		// Unlocked borders get a plane perpendicular to the face so they resist sliding inwards.
+		if (options.LockBorders)
+			continue;
+		for (int32 k = 0; k < 3; ++k)
+		{
+			const uint32 a = triangle[k], b = triangle[(k + 1) % 3];
+			if (!ContainsKey(borderEdges, MakeEdgeKey(a, b)))
+				continue;
+
+			const Vector3 edge = vertices[b].Position - vertices[a].Position;
+			const Vector3 borderNormal = Normalize(Cross(edge, normal));
+
+			TQuadric borderQuadric;
+			borderQuadric.AddPlane(borderNormal, -Dot(borderNormal, vertices[a].Position), LengthSquared(edge) * BorderWeight);
+			quadrics[a] += borderQuadric;
+			quadrics[b] += borderQuadric;
+		}
+	}
+
+	const uint8 lockedFrom = options.LockBorders ? uint8(vfSeam | vfBorder) : uint8(vfSeam);
+	const size_t targetIndexCount = size_t(Max(options.TargetIndexCount, 0));
+	const float32 errorLimit = options.MaxError * options.MaxError;
+	float32 maxError = 0.0f;
+
+	const auto CollapseCost = [&](uint32 from, uint32 to, float32 &error) -> float32 {
+		TQuadric quadric = quadrics[canonical[from]];
+		quadric += quadrics[canonical[to]];
+		error = quadric.Evaluate(vertices[to].Position);
+
+		const float32 attributeError =
+			LengthSquared(vertices[from].Normal - vertices[to].Normal) +
+			LengthSquared(vertices[from].TextureCoord - vertices[to].TextureCoord);
+		return error + attributeError * options.AttributeWeight;
+	};
+
+	TVarArray<uint32> remap;
+	remap.resize(vertexCount);
+	TVarArray<uint8> touched;
+	TVarArray<uint32> offsets, triangles;
+	TVarArray<TCollapse> collapses;
+
+	// Each pass collapses a batch of independent edges in cost order, then rebuilds the adjacency.
+	while (indexCount > targetIndexCount)
+	{
+		BuildAdjacency(indices, indexCount, vertexCount, offsets, triangles);
+
+		collapses.resize(0);
+		for (size_t i = 0; i < indexCount; i += 3)
+		{
+			for (int32 k = 0; k < 3; ++k)
+			{
+				const uint32 a = indices[i + k], b = indices[i + (k + 1) % 3];
+				const uint32 directions[2][2] = { { a, b }, { b, a } };
+				for (const auto &direction : directions)
+				{
+					const uint32 from = direction[0], to = direction[1];
+					if ((flags[from] & lockedFrom) || (flags[to] & vfSeam))
+						continue;
+
+					TCollapse collapse;
+					collapse.From = from;
+					collapse.To = to;
+					collapse.Cost = CollapseCost(from, to, collapse.Error);
+					collapses.push_back(collapse);
+				}
+			}
+		}
+
+		Sort(collapses.data(), collapses.data() + collapses.size(), [](const TCollapse &lhs, const TCollapse &rhs) {
+			return lhs.Cost < rhs.Cost;
+		});
+
+		for (uint32 v = 0; v < vertexCount; ++v)
+			remap[v] = v;
+		touched.resize(0);
+		touched.resize(vertexCount);
+
+		size_t removedIndices = 0;
+		for (size_t i = 0; i < collapses.size(); ++i)
+		{
+			const auto &collapse = collapses[i];
+			if (collapse.Error > errorLimit || indexCount - removedIndices <= targetIndexCount)
+				break;
+			if (touched[collapse.From] || touched[collapse.To])
+				continue;
+			if (FlipsTriangle(vertices, indices, offsets, triangles, collapse.From, collapse.To))
+				continue;
+
+			remap[collapse.From] = collapse.To;
+			quadrics[canonical[collapse.To]] += quadrics[canonical[collapse.From]];
+			maxError = Max(maxError, collapse.Error);
+
+			// Everything around the collapsed vertex is frozen until the next pass rebuilds the adjacency.
+			touched[collapse.To] = 1;
+			for (uint32 t = offsets[collapse.From]; t < offsets[collapse.From + 1]; ++t)
+			{
+				const uint32 *triangle = &indices[triangles[t] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+				if (triangle[0] == collapse.To || triangle[1] == collapse.To || triangle[2] == collapse.To)
+					removedIndices += 3;
+			}
+		}
+
+		if (removedIndices == 0)
+			break;
+
+		size_t writeIndex = 0;
+		for (size_t i = 0; i < indexCount; i += 3)
+		{
+			const uint32 a = remap[indices[i + 0]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			indices[writeIndex++] = a;
+			indices[writeIndex++] = b;
+			indices[writeIndex++] = c;
+		}
+		indexCount = writeIndex;
+	}
+
+	TMesh result;
+	TVarArray<uint32> newIndex;
+	newIndex.resize(vertexCount);
+	for (uint32 v = 0; v < vertexCount; ++v)
+		newIndex[v] = InvalidIndex;
+
+	result.IndexBuffer.reserve(indexCount);
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		const uint32 v = indices[i];
+		if (newIndex[v] == InvalidIndex)
+		{
+			newIndex[v] = uint32(result.TVertexBuffer.size());
+			result.TVertexBuffer.push_back(vertices[v]);
+		}
+		result.IndexBuffer.push_back(uint16(newIndex[v]));
+	}
+
+	if (resultError != nullptr)
+		*resultError = sqrtf(maxError);
+	return result;
+}
+
+TMeshLodChain BuildLodChain(const TMesh &mesh, int32 maxLevels, float32 reduction, float32 attributeWeight)
+{
+	TMeshLodChain chain;
+
+	const auto &vertices = mesh.TVertexBuffer;
+	if (vertices.empty())
+		return chain;
+
+	Vector3 boundsMin = vertices[0].Position, boundsMax = vertices[0].Position;
+	for (size_t i = 1; i < vertices.size(); ++i)
+	{
+		boundsMin = ComponentMin(boundsMin, vertices[i].Position);
+		boundsMax = ComponentMax(boundsMax, vertices[i].Position);
+	}
+	chain.BoundsCenter = (boundsMin + boundsMax) * 0.5f;
+	for (size_t i = 0; i < vertices.size(); ++i)
+		chain.BoundsRadius = Max(chain.BoundsRadius, Length(vertices[i].Position - chain.BoundsCenter));
+
+	chain.Levels.reserve(maxLevels);
+	chain.Levels.push_back({ mesh, 0.0f });
+
+	while (int32(chain.Levels.size()) < maxLevels)
+	{
+		const auto &previous = chain.Levels.back();
+		const size_t previousIndexCount = previous.Mesh.IndexBuffer.size();
+
+		TSimplifyOptions options;
+		options.TargetIndexCount = int32(float32(previousIndexCount) * reduction) / 3 * 3;
+		options.AttributeWeight = attributeWeight;
+
+		TMeshLod lod;
+		float32 error = 0.0f;
+		lod.Mesh = SimplifyMesh(previous.Mesh, options, &error);
+		lod.Error = previous.Error + error;
+
+		// Stop once the simplifier is stuck on locked vertices, further levels would just duplicate this one.
+		const size_t indexCount = lod.Mesh.IndexBuffer.size();
+		if (indexCount == 0 || float32(indexCount) > float32(previousIndexCount) * 0.95f)
+			break;
+
+		chain.Levels.push_back(Move(lod));
+	}
+
+	return chain;
+}
+
+int32 SelectLod(const TMeshLodChain &chain, const Matrix4x4 &modelViewProjection, float32 viewportHeight, float32 maxPixelError)
+{
+	const int32 levelCount = int32(chain.Levels.size());
+	if (levelCount <= 1)
+		return 0;
+
+	// For a perspective projection clip space w is the view depth of the point.
+	const Vector4 center(chain.BoundsCenter.x, chain.BoundsCenter.y, chain.BoundsCenter.z, 1.0f);
+	const float32 distance = Dot(modelViewProjection[3], center) - chain.BoundsRadius;
+	if (distance <= 0.0f)
+		return 0;
+
+	// Length of the y row is the vertical projection scale (including any uniform model scale).
+	const Vector3 rowY(modelViewProjection[1][0], modelViewProjection[1][1], modelViewProjection[1][2]);
+	const float32 pixelsPerUnit = Length(rowY) * viewportHeight * 0.5f / distance;
+
+	int32 selected = 0;
+	for (int32 level = 1; level < levelCount; ++level)
+	{
+		if (chain.Levels[level].Error * pixelsPerUnit > maxPixelError)
+			break;
+		selected = level;
+	}
+	return selected;
+}
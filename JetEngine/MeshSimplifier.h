@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Core/Misc/Limits.h"
+#include "Mesh.h"
+
+// References:
+// https://www.cs.cmu.edu/~./garland/Papers/quadrics.pdf
+// https://github.com/zeux/meshoptimizer
+
+struct TSimplifyOptions
+{
+	int32 TargetIndexCount = 0;
+	// Maximum geometric deviation allowed, in object space units.
+	float32 MaxError = TNumericLimits<float32>::Max();
+	// Scales the normal/texture coordinate difference added to the collapse cost.
+	float32 AttributeWeight = 1.0f;
+	// Border vertices (edges with a single triangle) never move, so open meshes keep their silhouette.
+	bool LockBorders = true;
+};
+
+struct TMeshLod
+{
+	TMesh Mesh;
+	// Object space error of this level relative to the full detail mesh.
+	float32 Error = 0.0f;
+};
+
+struct TMeshLodChain
+{
+	TVarArray<TMeshLod> Levels;
+	Vector3 BoundsCenter;
+	float32 BoundsRadius = 0.0f;
+};
+
+// Collapses edges of the mesh in quadric error order until TargetIndexCount or MaxError is reached.
+// Vertices are only ever collapsed onto existing vertices, so attributes never need interpolation.
+TMesh SimplifyMesh(const TMesh &mesh, const TSimplifyOptions &options, float32 *resultError = nullptr);
+
+// Builds successive LODs, each reducing the triangle count of the previous one by the given ratio.
+TMeshLodChain BuildLodChain(const TMesh &mesh, int32 maxLevels = 6, float32 reduction = 0.5f, float32 attributeWeight = 1.0f);
+
+// Picks the coarsest level whose projected error stays under maxPixelError.
+// modelViewProjection follows the column vector convention of Math.h.
+int32 SelectLod(const TMeshLodChain &chain, const Matrix4x4 &modelViewProjection, float32 viewportHeight, float32 maxPixelError = 1.0f);
@@ -0,0 +1,124 @@
+#include "Precompiled.h"
+
+#include "FileSystem.h"
+#include "RenderDevice-vk.h"
+#include "Core/Misc/Hash.h"
+
+void TVulkanPipelineCache::Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, const char *path)
+{
+	Device = device;
+	Allocator = allocator;
+	Path = path;
+	LoadedHash = 0u;
+	vkGetPhysicalDeviceProperties(physicalDevice, &Properties);
+
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCreateInfo.pNext = nullptr;
+	pipelineCacheCreateInfo.flags = 0;
+	pipelineCacheCreateInfo.initialDataSize = 0;
+	pipelineCacheCreateInfo.pInitialData = nullptr;
+
+	FS::File file;
+	const bool exists = FS::Exists(path);
+	if (exists)
+	{
+		file = FS::Open(path, FS::Read);
+		const auto *bytes = static_cast<const uint8 *>(file.Platform.Buffer);
+		if (IsValid(bytes, file.Size))
+		{
+			TFileHeader header;
+			MemCopy(&header, bytes, sizeof(header));
+			LoadedHash = header.DataHash;
+			pipelineCacheCreateInfo.initialDataSize = size_t(header.DataSize);
+			pipelineCacheCreateInfo.pInitialData = bytes + sizeof(TFileHeader);
+		}
+		else
+		{
+			DebugPrint("Pipeline cache %s was written by another device or driver or is corrupt, starting empty\n", path);
+		}
+	}
+
+	VkResult result = vkCreatePipelineCache(Device, &pipelineCacheCreateInfo, Allocator, &Handle);
+	ASSERT(result == VK_SUCCESS);
+
+	if (exists)
+		FS::Close(file);
+}
+
+void TVulkanPipelineCache::Done()
+{
+	Save();
+	vkDestroyPipelineCache(Device, Handle, Allocator);
+	Handle = VK_NULL_HANDLE;
+}
+
+TVulkanPipelineCache::TFileHeader TVulkanPipelineCache::MakeHeader() const
+{
+	// Zeroes the padding as well, the header is hashed and compared as raw bytes.
+	TFileHeader header;
+	MemorySet(&header, 0, sizeof(header));
+	header.Magic = Magic;
+	header.Version = Version;
+	header.VendorID = Properties.vendorID;
+	header.DeviceID = Properties.deviceID;
+	header.DriverVersion = Properties.driverVersion;
+	MemCopy(header.PipelineCacheUUID, Properties.pipelineCacheUUID, VK_UUID_SIZE);
+	return header;
+}
+
+bool TVulkanPipelineCache::IsValid(const uint8 *file, uint64 fileSize) const
+{
+	if (fileSize < sizeof(TFileHeader))
+		return false;
+
+	TFileHeader header;
+	MemCopy(&header, file, sizeof(header));
+	const TFileHeader expected = MakeHeader();
+	if (header.Magic != expected.Magic || header.Version != expected.Version ||
+		header.VendorID != expected.VendorID || header.DeviceID != expected.DeviceID || header.DriverVersion != expected.DriverVersion ||
+		memcmp(header.PipelineCacheUUID, expected.PipelineCacheUUID, VK_UUID_SIZE) != 0)
+		return false;
+
+	// Catches truncated and partially overwritten files.
+	const uint8 *data = file + sizeof(TFileHeader);
+	if (header.DataSize != fileSize - sizeof(TFileHeader) || header.DataHash != HashBytes(data, size_t(header.DataSize)))
+		return false;
+
+	// The driver's own header: length, version, vendor, device and cache UUID.
+	uint32 driverHeader[4];
+	if (header.DataSize < sizeof(driverHeader) + VK_UUID_SIZE)
+		return false;
+	MemCopy(driverHeader, data, sizeof(driverHeader));
+	return
+		driverHeader[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		driverHeader[2] == Properties.vendorID &&
+		driverHeader[3] == Properties.deviceID &&
+		memcmp(data + sizeof(driverHeader), Properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void TVulkanPipelineCache::Save()
+{
+	size_t dataSize = 0;
+	VkResult result = vkGetPipelineCacheData(Device, Handle, &dataSize, nullptr);
+	ASSERT(result == VK_SUCCESS);
+	if (dataSize == 0)
+		return;
+
+	TVarArray<uint8> file;
+	file.resize(sizeof(TFileHeader) + dataSize);
+	result = vkGetPipelineCacheData(Device, Handle, &dataSize, file.data() + sizeof(TFileHeader));
+	ASSERT(result == VK_SUCCESS);
+
+	TFileHeader header = MakeHeader();
+	header.DataSize = dataSize;
+	header.DataHash = HashBytes(file.data() + sizeof(TFileHeader), dataSize);
+
+	// Nothing new was compiled, keep the file as it is.
+	if (header.DataHash == LoadedHash)
+		return;
+
+	MemCopy(file.data(), &header, sizeof(header));
+	if (!FS::WriteAtomic(Path, file.data(), sizeof(TFileHeader) + dataSize))
+		DebugPrint("Failed to write pipeline cache %s\n", Path);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// References:
+// https://zeux.io/2019/07/17/serializing-pipeline-cache/
+// https://www.khronos.org/registry/vulkan/specs/1.0/html/vkspec.html#pipelines-cache
+
+// VkPipelineCache persisted between runs. The file is only trusted when it comes from the same device and
+// driver, drivers are known to crash on caches from other versions instead of rejecting them.
+// VkPipelineCache is internally synchronized, so the handle can be used by several threads at once.
+class TVulkanPipelineCache
+{
+public:
+	// Seeds the cache from the file when it passes validation, otherwise starts empty.
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, const char *path);
+	// Writes the cache back when pipelines were added since it was loaded, then destroys it.
+	void Done();
+
+	VkPipelineCache GetHandle() const {
+		return Handle;
+	}
+
+private:
+	static constexpr uint32 Magic = 0x4843504Au; // "JPCH"
+	static constexpr uint32 Version = 1u;
+
+	// Precedes the driver's data in the file. driverVersion is not part of the driver's own header.
+	struct TFileHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 VendorID;
+		uint32 DeviceID;
+		uint32 DriverVersion;
+		uint8 PipelineCacheUUID[VK_UUID_SIZE];
+		uint64 DataSize;
+		uint64 DataHash;
+	};
+
+	TFileHeader MakeHeader() const;
+	bool IsValid(const uint8 *file, uint64 fileSize) const;
+	void Save();
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	VkPipelineCache Handle = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties Properties = {};
+	const char *Path = nullptr;
+	uint64 LoadedHash = 0u;
+};
@@ -0,0 +1,371 @@
+#include "Precompiled.h"
+
+#include "FileSystem.h"
+#include "RenderDevice-vk.h"
+
+// Results come back in bit order, names match TProfilerEvent::Statistics.
+static const VkQueryPipelineStatisticFlags PipelineStatisticFlags =
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+static const char *PipelineStatisticNames[] = {
+	"vertices", "primitives", "vertex invocations", "clipped primitives", "fragment invocations", "compute invocations",
+};
+
+static constexpr uint32 StatisticCount = ArrayLength(PipelineStatisticNames);
+
+static void AppendFormat(TVarArray<char> &text, const char *format, ...)
+{
+	char buffer[512];
+	va_list argList;
+	va_start(argList, format);
+	const int32 length = vsnprintf(buffer, sizeof(buffer), format, argList);
+	va_end(argList);
+	ASSERT(length >= 0 && length < int32(sizeof(buffer)));
+
+	const size_t size = text.size();
+	text.resize(size + size_t(length));
+	MemCopy(text.data() + size, buffer, length);
+}
+
+void TVulkanProfiler::Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, VkQueue queue, uint32 queueFamilyIndex, bool pipelineStatistics)
+{
+	Device = device;
+	Allocator = allocator;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	CpuFrequency = frequency.QuadPart;
+	CpuStart = 0;
+	CpuStart = GetCpuTime();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	TimestampPeriod = properties.limits.timestampPeriod;
+
+	uint32 queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	VkQueueFamilyProperties *queueFamilies = ALLOCA(VkQueueFamilyProperties, queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies);
+	ASSERT(queueFamilyIndex < queueFamilyCount);
+
+	// Without timestamps on the queue only CPU scopes are recorded.
+	const uint32 validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+	Enabled = validBits != 0u;
+	if (!Enabled)
+	{
+		DebugPrint("Queue family %u has no timestamps, GPU profiling is disabled\n", queueFamilyIndex);
+		return;
+	}
+	TimestampMask = validBits >= 64u ? ~uint64(0u) : (uint64(1u) << validBits) - 1u;
+	PipelineStatistics = pipelineStatistics;
+
+	for (auto &frame : Frames)
+	{
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.pNext = nullptr;
+		queryPoolCreateInfo.flags = 0;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = MaxScopesPerFrame * 2u;
+		queryPoolCreateInfo.pipelineStatistics = 0;
+
+		VkResult result = vkCreateQueryPool(Device, &queryPoolCreateInfo, Allocator, &frame.Timestamps);
+		ASSERT(result == VK_SUCCESS);
+
+		if (PipelineStatistics)
+		{
+			queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			queryPoolCreateInfo.queryCount = MaxScopesPerFrame;
+			queryPoolCreateInfo.pipelineStatistics = PipelineStatisticFlags;
+
+			result = vkCreateQueryPool(Device, &queryPoolCreateInfo, Allocator, &frame.Statistics);
+			ASSERT(result == VK_SUCCESS);
+		}
+	}
+
+	Calibrate(queue, queueFamilyIndex);
+}
+
+void TVulkanProfiler::Done()
+{
+	for (auto &frame : Frames)
+	{
+		if (frame.Pending)
+			Resolve(frame);
+		vkDestroyQueryPool(Device, frame.Timestamps, Allocator);
+		vkDestroyQueryPool(Device, frame.Statistics, Allocator);
+		frame = TFrameQueries();
+	}
+	Enabled = false;
+}
+
+void TVulkanProfiler::Calibrate(VkQueue queue, uint32 queueFamilyIndex)
+{
+	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.pNext = nullptr;
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkResult result = vkCreateCommandPool(Device, &commandPoolCreateInfo, Allocator, &commandPool);
+	ASSERT(result == VK_SUCCESS);
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = nullptr;
+	commandBufferAllocateInfo.commandPool = commandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	result = vkAllocateCommandBuffers(Device, &commandBufferAllocateInfo, &commandBuffer);
+	ASSERT(result == VK_SUCCESS);
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = nullptr;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = nullptr;
+
+	result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	ASSERT(result == VK_SUCCESS);
+	// Frame 0 resets the query again before it is used.
+	vkCmdResetQueryPool(commandBuffer, Frames[0].Timestamps, 0, 1);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, Frames[0].Timestamps, 0);
+	result = vkEndCommandBuffer(commandBuffer);
+	ASSERT(result == VK_SUCCESS);
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.pNext = nullptr;
+	fenceCreateInfo.flags = 0;
+
+	VkFence fence = VK_NULL_HANDLE;
+	result = vkCreateFence(Device, &fenceCreateInfo, Allocator, &fence);
+	ASSERT(result == VK_SUCCESS);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = nullptr;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	// The timestamp is taken somewhere between the submit and the fence, the middle is as close as it gets
+	// without VK_EXT_calibrated_timestamps.
+	const int64 submitTime = GetCpuTime();
+	result = vkQueueSubmit(queue, 1, &submitInfo, fence);
+	ASSERT(result == VK_SUCCESS);
+	result = vkWaitForFences(Device, 1, &fence, VK_TRUE, TNumericLimits<uint64>::Max());
+	ASSERT(result == VK_SUCCESS);
+	const int64 signalTime = GetCpuTime();
+
+	uint64 timestamp = 0u;
+	result = vkGetQueryPoolResults(Device, Frames[0].Timestamps, 0, 1, sizeof(timestamp), &timestamp, sizeof(timestamp), VK_QUERY_RESULT_64_BIT);
+	ASSERT(result == VK_SUCCESS);
+
+	CalibrationTimestamp = timestamp & TimestampMask;
+	CalibrationTime = (submitTime + signalTime) / 2;
+
+	vkDestroyFence(Device, fence, Allocator);
+	vkDestroyCommandPool(Device, commandPool, Allocator);
+}
+
+void TVulkanProfiler::BeginFrame(uint32 frameSlot, VkCommandBuffer commandBuffer)
+{
+	ASSERT(frameSlot < MaxFrames);
+	CurrentFrame = frameSlot;
+	if (!Enabled)
+		return;
+
+	TFrameQueries &frame = Frames[frameSlot];
+	if (frame.Pending)
+		Resolve(frame);
+
+	frame.Scopes.resize(0);
+	frame.TimestampCount = 0u;
+	frame.StatisticsCount = 0u;
+	vkCmdResetQueryPool(commandBuffer, frame.Timestamps, 0, MaxScopesPerFrame * 2u);
+	if (PipelineStatistics)
+		vkCmdResetQueryPool(commandBuffer, frame.Statistics, 0, MaxScopesPerFrame);
+
+	// Statistics are left to the scopes in the frame.
+	FrameScope = BeginGpuScope(commandBuffer, "Frame", false);
+}
+
+void TVulkanProfiler::EndFrame(VkCommandBuffer commandBuffer)
+{
+	if (!Enabled)
+		return;
+
+	EndGpuScope(commandBuffer, FrameScope);
+	FrameScope = -1;
+	Frames[CurrentFrame].Pending = true;
+}
+
+int32 TVulkanProfiler::BeginGpuScope(VkCommandBuffer commandBuffer, const char *name, bool statistics)
+{
+	if (!Enabled)
+		return -1;
+
+	TFrameQueries &frame = Frames[CurrentFrame];
+	if (frame.Scopes.size() == MaxScopesPerFrame)
+		return -1;
+
+	TScope &scope = frame.Scopes.push_back(TScope());
+	scope.Name = name;
+	scope.BeginQuery = frame.TimestampCount++;
+	scope.EndQuery = frame.TimestampCount++;
+	scope.StatisticsQuery = -1;
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.Timestamps, scope.BeginQuery);
+	if (statistics && PipelineStatistics && !StatisticsActive)
+	{
+		scope.StatisticsQuery = int32(frame.StatisticsCount++);
+		vkCmdBeginQuery(commandBuffer, frame.Statistics, uint32(scope.StatisticsQuery), 0);
+		StatisticsActive = true;
+	}
+	return int32(frame.Scopes.size() - 1);
+}
+
+void TVulkanProfiler::EndGpuScope(VkCommandBuffer commandBuffer, int32 scopeIndex)
+{
+	if (scopeIndex < 0)
+		return;
+
+	TFrameQueries &frame = Frames[CurrentFrame];
+	const TScope &scope = frame.Scopes[scopeIndex];
+	if (scope.StatisticsQuery >= 0)
+	{
+		vkCmdEndQuery(commandBuffer, frame.Statistics, uint32(scope.StatisticsQuery));
+		StatisticsActive = false;
+	}
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.Timestamps, scope.EndQuery);
+}
+
+VkQueryPipelineStatisticFlags TVulkanProfiler::GetInheritedStatistics() const
+{
+	return PipelineStatistics ? PipelineStatisticFlags : 0u;
+}
+
+void TVulkanProfiler::Resolve(TFrameQueries &frame)
+{
+	frame.Pending = false;
+	if (frame.Scopes.empty())
+		return;
+
+	// No WAIT bit, the frame's fence has signaled. A frame that is not complete anyway is dropped rather than waited for.
+	uint64 *timestamps = ALLOCA(uint64, frame.TimestampCount);
+	VkResult result = vkGetQueryPoolResults(Device, frame.Timestamps, 0, frame.TimestampCount, sizeof(uint64) * frame.TimestampCount,
+		timestamps, sizeof(uint64), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS)
+		return;
+
+	uint64 *statistics = nullptr;
+	if (frame.StatisticsCount != 0u)
+	{
+		const uint32 count = frame.StatisticsCount * StatisticCount;
+		statistics = ALLOCA(uint64, count);
+		result = vkGetQueryPoolResults(Device, frame.Statistics, 0, frame.StatisticsCount, sizeof(uint64) * count,
+			statistics, sizeof(uint64) * StatisticCount, VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS)
+			statistics = nullptr;
+	}
+
+	for (size_t i = 0; i < frame.Scopes.size(); ++i)
+	{
+		const TScope &scope = frame.Scopes[i];
+
+		TProfilerEvent event = {};
+		event.Name = scope.Name;
+		event.Begin = ToCpuTime(timestamps[scope.BeginQuery]);
+		event.Duration = Max(ToCpuTime(timestamps[scope.EndQuery]) - event.Begin, int64(0));
+		event.Thread = GpuThread;
+		event.HasStatistics = statistics != nullptr && scope.StatisticsQuery >= 0;
+		if (event.HasStatistics)
+			MemCopy(event.Statistics, statistics + scope.StatisticsQuery * StatisticCount, int32(sizeof(event.Statistics)));
+		AddEvent(event);
+	}
+}
+
+int64 TVulkanProfiler::ToCpuTime(uint64 timestamp) const
+{
+	// Counters with fewer than 64 valid bits wrap around, differences of more than half the range are negative.
+	const uint64 ticks = ((timestamp & TimestampMask) - CalibrationTimestamp) & TimestampMask;
+	const int64 signedTicks = ticks > (TimestampMask >> 1u) ? int64(ticks - TimestampMask - 1u) : int64(ticks);
+	return CalibrationTime + int64(float64(signedTicks) * TimestampPeriod);
+}
+
+int64 TVulkanProfiler::GetCpuTime() const
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	// Split up so the nanoseconds do not overflow for counters that run for a long time.
+	const int64 ticks = counter.QuadPart;
+	const int64 seconds = ticks / CpuFrequency;
+	const int64 remainder = ticks % CpuFrequency;
+	return seconds * 1000000000ll + remainder * 1000000000ll / CpuFrequency - CpuStart;
+}
+
+void TVulkanProfiler::AddCpuEvent(const char *name, int64 begin, int64 end)
+{
+	TProfilerEvent event = {};
+	event.Name = name;
+	event.Begin = begin;
+	event.Duration = end - begin;
+	event.Thread = Jobs::GetThreadIndex();
+	event.HasStatistics = false;
+	AddEvent(event);
+}
+
+void TVulkanProfiler::AddEvent(const TProfilerEvent &event)
+{
+	AcquireSRWLockExclusive(&Lock);
+	if (Events.size() < MaxEvents)
+		Events.push_back(event);
+	else if (!Full)
+	{
+		Full = true;
+		DebugPrint("Profiler is full after %u events, export to keep capturing\n", MaxEvents);
+	}
+	ReleaseSRWLockExclusive(&Lock);
+}
+
+bool TVulkanProfiler::Export(const char *path)
+{
+	AcquireSRWLockExclusive(&Lock);
+
+	TVarArray<char> text;
+	AppendFormat(text, "{\"traceEvents\":[\n");
+	AppendFormat(text, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", GpuThread);
+	for (size_t i = 0; i < Events.size(); ++i)
+	{
+		const TProfilerEvent &event = Events[i];
+		// Microseconds, the unit of the format.
+		AppendFormat(text, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+			event.Name, event.Thread, float64(event.Begin) / 1000.0, float64(event.Duration) / 1000.0);
+		if (event.HasStatistics)
+		{
+			AppendFormat(text, ",\"args\":{");
+			for (uint32 j = 0; j < StatisticCount; ++j)
+				AppendFormat(text, "%s\"%s\":%llu", j == 0 ? "" : ",", PipelineStatisticNames[j], (unsigned long long)event.Statistics[j]);
+			AppendFormat(text, "}");
+		}
+		AppendFormat(text, "}");
+	}
+	AppendFormat(text, "\n]}\n");
+
+	Events.resize(0);
+	Full = false;
+	ReleaseSRWLockExclusive(&Lock);
+
+	const bool written = FS::WriteAtomic(path, text.data(), text.size());
+	if (!written)
+		DebugPrint("Failed to write profile %s\n", path);
+	return written;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Core/Containers/String.h"
+
+// References:
+// https://www.khronos.org/registry/vulkan/specs/1.0/html/vkspec.html#queries
+// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+
+// One profiled range on the CPU or GPU timeline, in nanoseconds since Init.
+struct TProfilerEvent
+{
+	// String literals, the profiler keeps the pointers.
+	const char *Name;
+	int64 Begin;
+	int64 Duration;
+	// Jobs::GetThreadIndex() for CPU events, GpuThread for GPU ones.
+	int32 Thread;
+	bool HasStatistics;
+	// In the order of PipelineStatisticFlags.
+	uint64 Statistics[6];
+};
+
+// GPU scopes write timestamps into query pools of their frame, which are read back once the frame's slot comes
+// around again and its fence has signaled, so resolving never waits for the GPU. Scopes that are not nested in
+// another scope with statistics also count pipeline statistics when the device supports them. GPU timestamps
+// are mapped to the CPU clock with a calibration made at Init, so both end up on one timeline.
+// CPU scopes can be recorded from any thread, GPU scopes only go into the frame's primary command buffer.
+class TVulkanProfiler
+{
+public:
+	static constexpr int32 GpuThread = 1000;
+	static constexpr uint32 MaxFrames = 2u;
+	static constexpr uint32 MaxScopesPerFrame = 256u;
+	// Capturing stops once this many events are stored, Export makes room again.
+	static constexpr uint32 MaxEvents = 1u << 18u;
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, VkQueue queue, uint32 queueFamilyIndex, bool pipelineStatistics);
+	// The GPU must be done with every frame. Resolves what is left, the events stay around for Export.
+	void Done();
+
+	// Resolves what the frame's slot recorded last time around and resets its queries. Its fence must have signaled.
+	void BeginFrame(uint32 frameSlot, VkCommandBuffer commandBuffer);
+	void EndFrame(VkCommandBuffer commandBuffer);
+
+	// Outside of render passes, or begun and ended within the same subpass. -1 when the frame is out of queries.
+	// Without statistics the scope leaves them to the scopes nested in it.
+	int32 BeginGpuScope(VkCommandBuffer commandBuffer, const char *name, bool statistics = true);
+	void EndGpuScope(VkCommandBuffer commandBuffer, int32 scope);
+	// For the inheritance info of secondary command buffers executed within GPU scopes. Constant after Init, so
+	// secondary command buffers can be begun from any thread.
+	VkQueryPipelineStatisticFlags GetInheritedStatistics() const;
+
+	int64 GetCpuTime() const;
+	void AddCpuEvent(const char *name, int64 begin, int64 end);
+
+	// Writes every event so far in the Chrome trace event format and forgets them.
+	bool Export(const char *path);
+
+private:
+	struct TScope
+	{
+		const char *Name;
+		uint32 BeginQuery;
+		uint32 EndQuery;
+		int32 StatisticsQuery;
+	};
+
+	struct TFrameQueries
+	{
+		VkQueryPool Timestamps = VK_NULL_HANDLE;
+		VkQueryPool Statistics = VK_NULL_HANDLE;
+		TVarArray<TScope> Scopes;
+		uint32 TimestampCount = 0u;
+		uint32 StatisticsCount = 0u;
+		bool Pending = false;
+	};
+
+	void Calibrate(VkQueue queue, uint32 queueFamilyIndex);
+	void Resolve(TFrameQueries &frame);
+	int64 ToCpuTime(uint64 timestamp) const;
+	void AddEvent(const TProfilerEvent &event);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	bool Enabled = false;
+	bool PipelineStatistics = false;
+	float64 TimestampPeriod = 1.0;
+	uint64 TimestampMask = 0u;
+	int64 CpuFrequency = 1;
+	int64 CpuStart = 0;
+	// A timestamp and the CPU time it was taken at.
+	uint64 CalibrationTimestamp = 0u;
+	int64 CalibrationTime = 0;
+
+	TFrameQueries Frames[MaxFrames];
+	uint32 CurrentFrame = 0u;
+	int32 FrameScope = -1;
+	// Statistics queries of one pool cannot be active at the same time, nested scopes go without.
+	bool StatisticsActive = false;
+
+	mutable SRWLOCK Lock = SRWLOCK_INIT;
+	TVarArray<TProfilerEvent> Events;
+	bool Full = false;
+};
+
+// Scopes that end with the C++ scope they are declared in.
+class TCpuProfileScope
+{
+public:
+	TCpuProfileScope(TVulkanProfiler &profiler, const char *name) :
+		Profiler(profiler), Name(name), Begin(profiler.GetCpuTime()) {}
+	~TCpuProfileScope() {
+		Profiler.AddCpuEvent(Name, Begin, Profiler.GetCpuTime());
+	}
+
+private:
+	TVulkanProfiler &Profiler;
+	const char *Name;
+	int64 Begin;
+};
+
+class TGpuProfileScope
+{
+public:
+	TGpuProfileScope(TVulkanProfiler &profiler, VkCommandBuffer commandBuffer, const char *name) :
+		Profiler(profiler), CommandBuffer(commandBuffer), Scope(profiler.BeginGpuScope(commandBuffer, name)) {}
+	~TGpuProfileScope() {
+		Profiler.EndGpuScope(CommandBuffer, Scope);
+	}
+
+private:
+	TVulkanProfiler &Profiler;
+	VkCommandBuffer CommandBuffer;
+	int32 Scope;
+};
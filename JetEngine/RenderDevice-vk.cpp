@@ -1,12 +1,30 @@
 #include "Precompiled.h"
 
 #include "FileSystem.h"
-#include "WindowContext-nt.h"
+#if defined(_WIN32)
+#	include "WindowContext-nt.h"
+#endif
 #include "RenderDevice.h"
 #include "RenderDevice-vk.h"
 
+#if !defined(_WIN32)
+#	include <dlfcn.h>
+#endif
+
 static constexpr uint32 WindowWidth = 1000u;
 static constexpr uint32 WindowHeight = 800u;
+static constexpr VkDeviceSize StagingRingSize = 32u * 1024u * 1024u;
+static constexpr VkDeviceSize UniformRingSize = 4u * 1024u * 1024u;
+static constexpr uint64 TextureBudget = 512u * 1024u * 1024u;
+static constexpr uint32 MaxInstances = 64u * 1024u;
+static constexpr const char *PipelineCachePath = "PipelineCache.bin";
+static constexpr const char *ProfilePath = "Profile.json";
+static constexpr const char *ShaderCachePath = "ShaderCache";
+#if defined(_WIN32)
+static constexpr const char *ShaderCompilerPath = "Test/dxc.exe";
+#else
+static constexpr const char *ShaderCompilerPath = "/usr/bin/dxc";
+#endif
 
 // Resources:
 // https://software.intel.com/en-us/articles/api-without-secrets-introduction-to-vulkan-preface
@@ -14,56 +32,69 @@ static constexpr uint32 WindowHeight = 800u;
 enum QueueType
 {
 	Graphics,
-	Present
+	Present,
+	Transfer,
+	Compute,
+	QueueTypeCount
 };
 
-void TVulkanAPI::InitLib()
-{
-    Library = LoadLibrary("vulkan-1.dll");
-    ASSERT(Library != nullptr);
+#define VK_DEFINE_FUNCTION(name) PFN_##name name = nullptr
+#define VK_EXPORTED_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_GLOBAL_LEVEL_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_INSTANCE_LEVEL_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_SURFACE_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_DEVICE_LEVEL_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_DEVICE_1_2_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_SWAPCHAIN_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#	include "VulkanFunctions.h"
+#undef VK_DEFINE_FUNCTION
 
-    PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(GetProcAddress(Library, "vkGetInstanceProcAddr"));
+#if defined(_WIN32)
+static const char *VulkanLibraryName = "vulkan-1.dll";
 
-#define VK_GLOBAL_LEVEL_FUNCTION(name) PFN_##name name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(nullptr, #name)); ASSERT(name != nullptr)
-#	include "VulkanFunctions.h"
-#undef VK_GLOBAL_LEVEL_FUNCTION
+static LibraryType OpenLibrary(const char *name)
+{
+	return LoadLibrary(name);
 }
 
-void *VulkanAllocate(void *pUserData, size_t size, size_t aligment, VkSystemAllocationScope allocationScope)
+static void *GetLibraryFunction(LibraryType library, const char *name)
 {
-    // DebugPrint("%s: alloc(%d, %d)", static_cast<const char*>(pUserData), size, aligment);
-    return malloc(size);
+	return reinterpret_cast<void *>(GetProcAddress(library, name));
 }
 
-void *VulkanReallocate(void *pUserData, void *pOriginal, size_t size, size_t aligment, VkSystemAllocationScope allocationScope)
+static void CloseLibrary(LibraryType library)
 {
-    // DebugPrint("%s: realloc(%d, %d)", static_cast<const char*>(pUserData), size, aligment);
-    return realloc(pOriginal, size);
+	FreeLibrary(library);
 }
+#else
+static const char *VulkanLibraryName = "libvulkan.so.1";
 
-void VulkanFree(void *pUserData, void *pMemory)
+static LibraryType OpenLibrary(const char *name)
 {
-    // DebugPrint("%s: free()", static_cast<const char*>(pUserData));
-    free(pMemory);
+	return dlopen(name, RTLD_NOW | RTLD_LOCAL);
 }
 
-void VulkanInternalAllocate(void* pUserData, size_t size, VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope)
+static void *GetLibraryFunction(LibraryType library, const char *name)
 {
+	return dlsym(library, name);
 }
 
-void VulkanInternalFree(void* pUserData, size_t size, VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope)
+static void CloseLibrary(LibraryType library)
 {
+	dlclose(library);
 }
+#endif
 
-VkAllocationCallbacks GetVulkanAllocator()
+void TVulkanAPI::InitLib()
 {
-	VkAllocationCallbacks allocationCallbacks;
-	allocationCallbacks.pfnAllocation = VulkanAllocate;
-	allocationCallbacks.pfnReallocation = VulkanReallocate;
-	allocationCallbacks.pfnFree = VulkanFree;
-	allocationCallbacks.pfnInternalAllocation = VulkanInternalAllocate;
-	allocationCallbacks.pfnInternalFree = VulkanInternalFree;
-	return allocationCallbacks;
+    Library = OpenLibrary(VulkanLibraryName);
+    ASSERT(Library != nullptr);
+
+#define VK_EXPORTED_FUNCTION(name) name = reinterpret_cast<PFN_##name>(GetLibraryFunction(Library, #name)); ASSERT(name != nullptr)
+#define VK_GLOBAL_LEVEL_FUNCTION(name) name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(nullptr, #name)); ASSERT(name != nullptr)
+#	include "VulkanFunctions.h"
+#undef VK_GLOBAL_LEVEL_FUNCTION
+#undef VK_EXPORTED_FUNCTION
 }
 
 void TVulkanAPI::InitInstance()
@@ -92,7 +123,9 @@ void TVulkanAPI::InitInstance()
 
 	const char* needed[] = {
 		VK_KHR_SURFACE_EXTENSION_NAME,
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
 		VK_KHR_WIN32_SURFACE_EXTENSION_NAME
+#endif
 	};
 
 	// TODO: check availability
@@ -103,7 +136,8 @@ void TVulkanAPI::InitInstance()
 	applicationInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	applicationInfo.pEngineName = "JetEngine";
 	applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	applicationInfo.apiVersion = VK_MAKE_VERSION(1, 0, 0);
+	// The highest version the engine uses, older devices still work but go without bindless descriptors.
+	applicationInfo.apiVersion = VK_API_VERSION_1_2;
 
 	const char* layerNames[] = {
 		"VK_LAYER_KHRONOS_validation",
@@ -116,19 +150,28 @@ void TVulkanAPI::InitInstance()
 	instanceCreateInfo.pApplicationInfo = &applicationInfo;
 	instanceCreateInfo.enabledLayerCount = ArrayLength(layerNames);
 	instanceCreateInfo.ppEnabledLayerNames = layerNames;
-	instanceCreateInfo.enabledExtensionCount = ArrayLength(needed);
+	// Headless rendering needs no surface.
+	instanceCreateInfo.enabledExtensionCount = Headless ? 0 : ArrayLength(needed);
 	instanceCreateInfo.ppEnabledExtensionNames = needed;
 
 	result = vkCreateInstance(&instanceCreateInfo, Allocator, &Instance);
 	ASSERT(result == VK_SUCCESS);
 
-#define VK_INSTANCE_LEVEL_FUNCTION(name) PFN_##name name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(Instance, #name)); ASSERT(name != nullptr)
+#define VK_INSTANCE_LEVEL_FUNCTION(name) name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(Instance, #name)); ASSERT(name != nullptr)
 #	include "VulkanFunctions.h"
 #undef VK_INSTANCE_LEVEL_FUNCTION
+
+	if (Headless)
+		return;
+
+#define VK_SURFACE_FUNCTION(name) name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(Instance, #name)); ASSERT(name != nullptr)
+#	include "VulkanFunctions.h"
+#undef VK_SURFACE_FUNCTION
 }
 
 void TVulkanAPI::InitBackBuffer(const IWindow *baseWindow)
 {
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
 	VkWin32SurfaceCreateInfoKHR win32SurfaceCreateInfo;
 	win32SurfaceCreateInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 	win32SurfaceCreateInfo.pNext = nullptr;
@@ -140,6 +183,10 @@ void TVulkanAPI::InitBackBuffer(const IWindow *baseWindow)
 
 	VkResult result = vkCreateWin32SurfaceKHR(Instance, &win32SurfaceCreateInfo, Allocator, &BackBuffer);
 	ASSERT(result == VK_SUCCESS);
+#else
+	// Windows only come from WindowContext-nt so far.
+	ASSERT(false);
+#endif
 }
 
 void TVulkanAPI::InitDevice()
@@ -207,9 +254,12 @@ void TVulkanAPI::InitDevice()
 		{
 			const auto &queueFamily = queueFamilyProperties[familyIndex];
 
-			VkBool32 presentQueueSupport;
-			result = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, familyIndex, BackBuffer, &presentQueueSupport);
-			ASSERT(result == VK_SUCCESS);
+			VkBool32 presentQueueSupport = VK_TRUE;
+			if (!Headless)
+			{
+				result = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, familyIndex, BackBuffer, &presentQueueSupport);
+				ASSERT(result == VK_SUCCESS);
+			}
 
 			DebugPrint<logVerbose>("Queue %d: \n", familyIndex);
 			DebugPrint<logVerbose>("queueFlags = {\n");
@@ -238,15 +288,62 @@ void TVulkanAPI::InitDevice()
 	
 	ASSERT(physicalDeviceIndex != -1 && graphicsQueueIndex != -1 && presentQueueIndex != -1);
 
+	// Uploads and async compute get queues of their own when the device has families without graphics, those run
+	// beside the graphics queue: a transfer only family is the copy engine, a compute family without graphics the
+	// async compute one. Both fall back to the graphics family, their work then shares the graphics queue.
+	int32 transferQueueIndex = graphicsQueueIndex;
+	int32 computeQueueIndex = graphicsQueueIndex;
+	{
+		uint32 queueCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[physicalDeviceIndex], &queueCount, nullptr);
+
+		VkQueueFamilyProperties *queueFamilyProperties = ALLOCA(VkQueueFamilyProperties, queueCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[physicalDeviceIndex], &queueCount, queueFamilyProperties);
+
+		for (uint32 familyIndex = 0; familyIndex < queueCount; ++familyIndex)
+		{
+			const auto &queueFamily = queueFamilyProperties[familyIndex];
+			if (queueFamily.queueCount == 0 || (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+				continue;
+
+			if ((queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && computeQueueIndex == graphicsQueueIndex)
+				computeQueueIndex = familyIndex;
+			// Texture uploads are split into rows of texel blocks, which needs a granularity of single texels.
+			const VkExtent3D &granularity = queueFamily.minImageTransferGranularity;
+			if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && transferQueueIndex == graphicsQueueIndex &&
+				granularity.width == 1 && granularity.height == 1 && granularity.depth == 1)
+				transferQueueIndex = familyIndex;
+		}
+	}
+	DebugPrint("Queue families: graphics %d, transfer %d, compute %d\n", graphicsQueueIndex, transferQueueIndex, computeQueueIndex);
+
+	QueueFamilies[Graphics] = uint32(graphicsQueueIndex);
+	QueueFamilies[Present] = uint32(presentQueueIndex);
+	QueueFamilies[Transfer] = uint32(transferQueueIndex);
+	QueueFamilies[Compute] = uint32(computeQueueIndex);
+
 	float32 queuePriorities[] = { 1.0f };
 
-	VkDeviceQueueCreateInfo deviceQueueCreateInfo = {};
-	deviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	deviceQueueCreateInfo.pNext = nullptr;
-	deviceQueueCreateInfo.flags = 0;
-	deviceQueueCreateInfo.queueFamilyIndex = graphicsQueueIndex;
-	deviceQueueCreateInfo.queueCount = ArrayLength(queuePriorities);
-	deviceQueueCreateInfo.pQueuePriorities = queuePriorities;
+	// One queue per distinct family.
+	VkDeviceQueueCreateInfo deviceQueueCreateInfos[QueueTypeCount];
+	uint32 queueCreateInfoCount = 0;
+	for (uint32 queueType = 0; queueType < QueueTypeCount; ++queueType)
+	{
+		bool created = false;
+		for (uint32 i = 0; i < queueCreateInfoCount && !created; ++i)
+			created = deviceQueueCreateInfos[i].queueFamilyIndex == QueueFamilies[queueType];
+		if (created)
+			continue;
+
+		VkDeviceQueueCreateInfo &deviceQueueCreateInfo = deviceQueueCreateInfos[queueCreateInfoCount++];
+		deviceQueueCreateInfo = {};
+		deviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		deviceQueueCreateInfo.pNext = nullptr;
+		deviceQueueCreateInfo.flags = 0;
+		deviceQueueCreateInfo.queueFamilyIndex = QueueFamilies[queueType];
+		deviceQueueCreateInfo.queueCount = ArrayLength(queuePriorities);
+		deviceQueueCreateInfo.pQueuePriorities = queuePriorities;
+	}
 
 	const char *extensions[] = {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -255,16 +352,73 @@ void TVulkanAPI::InitDevice()
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.pNext = nullptr;
-	deviceCreateInfo.queueCreateInfoCount = 1;
-	deviceCreateInfo.pQueueCreateInfos = &deviceQueueCreateInfo;
+	deviceCreateInfo.queueCreateInfoCount = queueCreateInfoCount;
+	deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfos;
 	deviceCreateInfo.enabledLayerCount = 0;
 	deviceCreateInfo.ppEnabledLayerNames = nullptr;
-	deviceCreateInfo.enabledExtensionCount = ArrayLength(extensions);
+	deviceCreateInfo.enabledExtensionCount = Headless ? 0 : ArrayLength(extensions);
 	deviceCreateInfo.ppEnabledExtensionNames = extensions;
 	deviceCreateInfo.pEnabledFeatures = nullptr;
 
 	PhysicalDevice = physicalDevices[physicalDeviceIndex];
 
+	// Only what is used, some features cost performance just by being enabled.
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(PhysicalDevice, &supportedFeatures);
+	EnabledFeatures = {};
+	EnabledFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+	// Secondary command buffers executed in a profiler scope count towards its pipeline statistics query.
+	EnabledFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+	// Indirect draws of several meshes, each with its own range of instances.
+	EnabledFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	EnabledFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	EnabledFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+	deviceCreateInfo.pEnabledFeatures = &EnabledFeatures;
+
+	// The 1.2 features are chained behind the 1.0 ones, all in one structure since it must not be chained
+	// together with the structures of the extensions it promoted.
+	VkPhysicalDeviceProperties physicalDeviceProperties;
+	vkGetPhysicalDeviceProperties(PhysicalDevice, &physicalDeviceProperties);
+
+	VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+	supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	if (physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_2)
+	{
+		VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+		supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures2.pNext = &supportedFeatures12;
+		vkGetPhysicalDeviceFeatures2(PhysicalDevice, &supportedFeatures2);
+	}
+
+	EnabledFeatures12 = {};
+	EnabledFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	BindlessSupported = TVulkanBindlessHeap::GetRequiredFeatures(supportedFeatures12, EnabledFeatures12);
+	if (!BindlessSupported)
+	{
+		DebugPrint("Descriptor indexing is not supported, bindless descriptors are disabled\n");
+		EnabledFeatures12 = {};
+		EnabledFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	}
+	EnabledFeatures12.drawIndirectCount = supportedFeatures12.drawIndirectCount;
+
+	VkPhysicalDeviceFeatures2 enabledFeatures2 = {};
+	enabledFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	if (physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_2)
+	{
+		enabledFeatures2.pNext = &EnabledFeatures12;
+		enabledFeatures2.features = EnabledFeatures;
+		deviceCreateInfo.pNext = &enabledFeatures2;
+		deviceCreateInfo.pEnabledFeatures = nullptr;
+	}
+
+	if (Headless)
+	{
+		result = vkCreateDevice(PhysicalDevice, &deviceCreateInfo, Allocator, &Device);
+		ASSERT(result == VK_SUCCESS);
+		LoadDeviceFunctions();
+		return;
+	}
+
 	VkSurfaceCapabilitiesKHR surfaceCapabilities;
 	result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(PhysicalDevice, BackBuffer, &surfaceCapabilities);
 	ASSERT(result == VK_SUCCESS);
@@ -282,25 +436,41 @@ void TVulkanAPI::InitDevice()
 
 	result = vkCreateDevice(PhysicalDevice, &deviceCreateInfo, Allocator, &Device);
 	ASSERT(result == VK_SUCCESS);
+	LoadDeviceFunctions();
+}
 
-#define VK_DEVICE_LEVEL_FUNCTION(name) PFN_##name name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(Device, #name)); ASSERT(name != nullptr)
+void TVulkanAPI::LoadDeviceFunctions()
+{
+	// Straight into the driver, calls through vkGetInstanceProcAddr pointers go through the loader's dispatch first.
+	// The engine creates a single device, so its functions replace the global ones.
+#define VK_DEVICE_LEVEL_FUNCTION(name) name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(Device, #name)); ASSERT(name != nullptr)
+#define VK_DEVICE_1_2_FUNCTION(name) name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(Device, #name))
 #	include "VulkanFunctions.h"
 #undef VK_DEVICE_LEVEL_FUNCTION
+#undef VK_DEVICE_1_2_FUNCTION
+
+	if (Headless)
+		return;
+
+#define VK_SWAPCHAIN_FUNCTION(name) name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(Device, #name)); ASSERT(name != nullptr)
+#	include "VulkanFunctions.h"
+#undef VK_SWAPCHAIN_FUNCTION
 }
 
 void TVulkanAPI::InitSwapChain()
 {
 	vkDeviceWaitIdle(Device);
 
-	for (int32 i = 0; i < ArrayLength(SwapChain.Images); ++i) 
+	// Framebuffers hold the old views and pipelines the old extent.
+	EvictStateObjects();
+
+	for (uint32 i = 0; i < SwapChain.ImageCount; ++i) 
 	{
-		if (SwapChain.Images[i] != VK_NULL_HANDLE) 
-		{
-			vkDestroyImageView(Device, SwapChain.Views[i], Allocator);
-			SwapChain.Images[i] = VK_NULL_HANDLE;
-			SwapChain.Views[i] = VK_NULL_HANDLE;
-		}
+		vkDestroyImageView(Device, SwapChain.Views[i], Allocator);
+		SwapChain.Images[i] = VK_NULL_HANDLE;
+		SwapChain.Views[i] = VK_NULL_HANDLE;
 	}
+	SwapChain.ImageCount = 0u;
 
 	const auto &GetSwapChainFormat = [&]() -> VkSurfaceFormatKHR {
 		uint32 surfaceFormatsCount;
@@ -368,27 +538,41 @@ void TVulkanAPI::InitSwapChain()
 		result = vkGetPhysicalDeviceSurfacePresentModesKHR(PhysicalDevice, BackBuffer, &presentModesCount, presentModes);
 		ASSERT(result == VK_SUCCESS);
 
-		// MAILBOX is the lowest latency V-Sync enabled mode (something like triple-buffering) so use it if available
-		for (uint32 i = 0; i < presentModesCount; ++i) {
-			if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-				return presentModes[i];
-			}
-		}
-		// IMMEDIATE mode allows us to display frames in a V-Sync independent manner so it can introduce screen tearing
-		// But this mode is the best for benchmarking purposes if we want to check the real number of FPS
-		for (uint32 i = 0; i < presentModesCount; ++i) {
-			if (presentModes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-				return presentModes[i];
-			}
+		const auto &IsSupported = [&](VkPresentModeKHR mode) {
+			for (uint32 i = 0; i < presentModesCount; ++i)
+				if (presentModes[i] == mode)
+					return true;
+			return false;
+		};
+
+		if (PresentPolicy == TVulkanPresentPolicy::LowLatency)
+		{
+			// MAILBOX is the lowest latency V-Sync enabled mode, the newest frame replaces the one waiting for vblank.
+			if (IsSupported(VK_PRESENT_MODE_MAILBOX_KHR))
+				return VK_PRESENT_MODE_MAILBOX_KHR;
+			// IMMEDIATE shows frames right away, at the cost of tearing.
+			if (IsSupported(VK_PRESENT_MODE_IMMEDIATE_KHR))
+				return VK_PRESENT_MODE_IMMEDIATE_KHR;
 		}
 		// FIFO present mode is always available
-		for (uint32 i = 0; i < presentModesCount; ++i) {
-			if (presentModes[i] == VK_PRESENT_MODE_FIFO_KHR) {
-				return presentModes[i];
-			}
-		}
-		ASSERT(!"Unsupported present mode!");
-		return static_cast<VkPresentModeKHR>(-1);
+		ASSERT(IsSupported(VK_PRESENT_MODE_FIFO_KHR));
+		return VK_PRESENT_MODE_FIFO_KHR;
+	};
+
+	const auto &GetSwapChainImageCount = [&](VkPresentModeKHR presentMode) -> uint32 {
+		VkSurfaceCapabilitiesKHR surfaceCapabilities;
+		VkResult result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(PhysicalDevice, BackBuffer, &surfaceCapabilities);
+		ASSERT(result == VK_SUCCESS);
+
+		// MAILBOX needs one image on screen, one queued and one to render to. FIFO gets one more than double
+		// buffering for throughput, IMMEDIATE and low latency FIFO do with two.
+		const bool tripleBuffered = presentMode == VK_PRESENT_MODE_MAILBOX_KHR || PresentPolicy == TVulkanPresentPolicy::Throughput;
+		uint32 imageCount = Max(tripleBuffered ? 3u : 2u, surfaceCapabilities.minImageCount);
+		// 0 means there is no maximum.
+		if (surfaceCapabilities.maxImageCount != 0u)
+			imageCount = Min(imageCount, surfaceCapabilities.maxImageCount);
+		ASSERT(imageCount <= TVulkanSwapChain::MaxImages);
+		return imageCount;
 	};
 
 	auto surfaceFormat = GetSwapChainFormat();
@@ -396,10 +580,10 @@ void TVulkanAPI::InitSwapChain()
 	auto imageUsageFlags = GetSwapChainUsageFlags();
 	auto surfaceTransformFlagBits = GetSwapChainTransform();
 	auto presentMode = GetSwapChainPresentMode();
+	auto minImageCount = GetSwapChainImageCount(presentMode);
 	auto prevSwapchain = SwapChain.Handle;
 
 	ASSERT(static_cast<int32>(imageUsageFlags) != -1);
-	ASSERT(static_cast<int32>(presentMode) != -1);
 	ASSERT(extent2D.width != 0 || extent2D.height != 0);
 
 	VkSwapchainCreateInfoKHR swapchainCreateInfo = {};
@@ -407,7 +591,7 @@ void TVulkanAPI::InitSwapChain()
 	swapchainCreateInfo.pNext = nullptr;
 	swapchainCreateInfo.flags = 0;
 	swapchainCreateInfo.surface = BackBuffer;
-	swapchainCreateInfo.minImageCount = 2;
+	swapchainCreateInfo.minImageCount = minImageCount;
 	swapchainCreateInfo.imageFormat = surfaceFormat.format;
 	swapchainCreateInfo.imageColorSpace = surfaceFormat.colorSpace;
 	swapchainCreateInfo.imageExtent = extent2D;
@@ -428,14 +612,18 @@ void TVulkanAPI::InitSwapChain()
 	if (prevSwapchain != VK_NULL_HANDLE)
 		vkDestroySwapchainKHR(Device, prevSwapchain, Allocator);
 
+	// The driver is free to create more images than asked for.
 	uint32 imageCount = 0;
 	result = vkGetSwapchainImagesKHR(Device, SwapChain.Handle, &imageCount, nullptr);
-	ASSERT(result == VK_SUCCESS && imageCount == ArrayLength(SwapChain.Images));
+	ASSERT(result == VK_SUCCESS && imageCount >= minImageCount && imageCount <= TVulkanSwapChain::MaxImages);
 
 	result = vkGetSwapchainImagesKHR(Device, SwapChain.Handle, &imageCount, SwapChain.Images);
 	ASSERT(result == VK_SUCCESS);
+	SwapChain.ImageCount = imageCount;
+	SwapChain.PresentMode = presentMode;
+	SwapChain.Format = surfaceFormat.format;
 
-	for (int32 i = 0; i < ArrayLength(SwapChain.Images); ++i) {
+	for (uint32 i = 0; i < imageCount; ++i) {
 		VkImageViewCreateInfo imageViewCreateInfo;
 		imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		imageViewCreateInfo.pNext = nullptr;
@@ -458,25 +646,152 @@ void TVulkanAPI::InitSwapChain()
 	}
 }
 
-void TVulkanAPI::InitCommandPool()
+void TVulkanAPI::InitOffscreen()
 {
-	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
-	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	commandPoolCreateInfo.pNext = nullptr;
-	commandPoolCreateInfo.flags = 0;
-	commandPoolCreateInfo.queueFamilyIndex = 0;
+	// Stands in for the swap chain, one image per frame in flight so a frame never waits for the previous one.
+	static_assert(MaxFramesInFlight <= TVulkanSwapChain::MaxImages);
+	SwapChain.ImageCount = MaxFramesInFlight;
+	SwapChain.Format = VK_FORMAT_B8G8R8A8_UNORM;
+
+	for (uint32 i = 0; i < SwapChain.ImageCount; ++i)
+	{
+		VkImageCreateInfo imageCreateInfo = {};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.pNext = nullptr;
+		imageCreateInfo.flags = 0;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = SwapChain.Format;
+		imageCreateInfo.extent.width = WindowWidth;
+		imageCreateInfo.extent.height = WindowHeight;
+		imageCreateInfo.extent.depth = 1;
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.queueFamilyIndexCount = 0;
+		imageCreateInfo.pQueueFamilyIndices = nullptr;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VkResult result = vkCreateImage(Device, &imageCreateInfo, Allocator, &SwapChain.Images[i]);
+		ASSERT(result == VK_SUCCESS);
+		SwapChain.Memory[i] = MemoryManager.AllocateImage(SwapChain.Images[i], TVulkanMemoryUsage::GpuOnly);
 
-	VkResult result = vkCreateCommandPool(Device, &commandPoolCreateInfo, nullptr, &Pool);
+		VkImageViewCreateInfo imageViewCreateInfo;
+		imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		imageViewCreateInfo.pNext = nullptr;
+		imageViewCreateInfo.flags = 0;
+		imageViewCreateInfo.image = SwapChain.Images[i];
+		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageViewCreateInfo.format = SwapChain.Format;
+		imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+		imageViewCreateInfo.subresourceRange.levelCount = 1;
+		imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+		imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+		result = vkCreateImageView(Device, &imageViewCreateInfo, Allocator, &SwapChain.Views[i]);
+		ASSERT(result == VK_SUCCESS);
+	}
+}
+
+void TVulkanAPI::InitDepth()
+{
+	// Rendered by the mesh pass and read by the next frame's depth pyramid, without the features the mesh pass
+	// renders without depth and culling without occlusion.
+	VkFormatProperties formatProperties = {};
+	vkGetPhysicalDeviceFormatProperties(PhysicalDevice, VK_FORMAT_D32_SFLOAT, &formatProperties);
+	const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	if ((formatProperties.optimalTilingFeatures & features) != features)
+		return;
+	DepthFormat = VK_FORMAT_D32_SFLOAT;
+
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.pNext = nullptr;
+	imageCreateInfo.flags = 0;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = DepthFormat;
+	imageCreateInfo.extent.width = WindowWidth;
+	imageCreateInfo.extent.height = WindowHeight;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.queueFamilyIndexCount = 0;
+	imageCreateInfo.pQueueFamilyIndices = nullptr;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkResult result = vkCreateImage(Device, &imageCreateInfo, Allocator, &DepthImage);
+	ASSERT(result == VK_SUCCESS);
+	DepthMemory = MemoryManager.AllocateImage(DepthImage, TVulkanMemoryUsage::GpuOnly);
+
+	VkImageViewCreateInfo imageViewCreateInfo;
+	imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewCreateInfo.pNext = nullptr;
+	imageViewCreateInfo.flags = 0;
+	imageViewCreateInfo.image = DepthImage;
+	imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewCreateInfo.format = DepthFormat;
+	imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+	imageViewCreateInfo.subresourceRange.levelCount = 1;
+	imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(Device, &imageViewCreateInfo, Allocator, &DepthView);
 	ASSERT(result == VK_SUCCESS);
 }
 
-VkCommandBuffer TVulkanAPI::CreateCommandBuffer()
+void TVulkanAPI::InitFrames()
+{
+	// The job system has to be running by now, its threads are the ones that record.
+	const int32 threadCount = Jobs::GetWorkerCount() + 1;
+
+	for (auto &frame : Frames)
+	{
+		frame.Threads.resize(threadCount);
+		for (int32 i = 0; i < threadCount; ++i)
+		{
+			VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+			commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			commandPoolCreateInfo.pNext = nullptr;
+			commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			commandPoolCreateInfo.queueFamilyIndex = QueueFamilies[Graphics];
+
+			VkResult result = vkCreateCommandPool(Device, &commandPoolCreateInfo, Allocator, &frame.Threads[i].Pool);
+			ASSERT(result == VK_SUCCESS);
+		}
+
+		frame.CommandBuffer = CreateCommandBuffer(frame.Threads[0].Pool);
+		frame.ImageAvailable = CreateSemaphore();
+		frame.RenderingFinished = CreateSemaphore();
+		// Signaled, so the first BeginFrame on each frame does not wait.
+		frame.Fence = CreateFence(true);
+		frame.Graph.Init(Device, Allocator, &MemoryManager);
+	}
+	FrameIndex = 0u;
+}
+
+VkCommandBuffer TVulkanAPI::CreateCommandBuffer(VkCommandPool pool, VkCommandBufferLevel level)
 {
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo;
 	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	commandBufferAllocateInfo.pNext = nullptr;
-	commandBufferAllocateInfo.commandPool = Pool;
-	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandPool = pool;
+	commandBufferAllocateInfo.level = level;
 	commandBufferAllocateInfo.commandBufferCount = 1;
 
 	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
@@ -486,28 +801,226 @@ VkCommandBuffer TVulkanAPI::CreateCommandBuffer()
 	return commandBuffer;
 }
 
-void TVulkanAPI::DestroyCommandBuffer(VkCommandBuffer commandBuffer)
+VkCommandBuffer TVulkanAPI::BeginSecondaryCommandBuffer(TVulkanFrame &frame, VkRenderPass renderPass, uint32 subpass, VkFramebuffer framebuffer)
 {
-	vkFreeCommandBuffers(Device, Pool, 1, &commandBuffer);
+	const int32 threadIndex = Jobs::GetThreadIndex();
+	ASSERT(threadIndex < int32(frame.Threads.size()));
+
+	// Only this thread touches its slot, no locking needed.
+	auto &thread = frame.Threads[threadIndex];
+	if (thread.SecondaryUsed == thread.SecondaryBuffers.size())
+		thread.SecondaryBuffers.push_back(CreateCommandBuffer(thread.Pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+	VkCommandBuffer commandBuffer = thread.SecondaryBuffers[thread.SecondaryUsed++];
+
+	VkCommandBufferInheritanceInfo commandBufferInheritanceInfo = {};
+	commandBufferInheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	commandBufferInheritanceInfo.pNext = nullptr;
+	commandBufferInheritanceInfo.renderPass = renderPass;
+	commandBufferInheritanceInfo.subpass = subpass;
+	commandBufferInheritanceInfo.framebuffer = framebuffer;
+	commandBufferInheritanceInfo.occlusionQueryEnable = VK_FALSE;
+	commandBufferInheritanceInfo.queryFlags = 0;
+	// Secondary command buffers are executed within the statistics query of the pass, whether or not it is active.
+	commandBufferInheritanceInfo.pipelineStatistics = Profiler.GetInheritedStatistics();
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = nullptr;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = &commandBufferInheritanceInfo;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	ASSERT(result == VK_SUCCESS);
+	// Secondary command buffers inherit no bindings.
+	if (Bindless.IsEnabled())
+		Bindless.Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout);
+	return commandBuffer;
 }
 
-VkRenderPass TVulkanAPI::CreateRenderPass()
+void TVulkanAPI::EndSecondaryCommandBuffer(VkCommandBuffer commandBuffer)
+{
+	VkResult result = vkEndCommandBuffer(commandBuffer);
+	ASSERT(result == VK_SUCCESS);
+}
+
+VkRenderPass TVulkanAPI::GetRenderPass(const TVulkanRenderPassKey &key)
+{
+	if (VkRenderPass *renderPass = RenderPasses.Find(key))
+		return *renderPass;
+	return RenderPasses.Add(key, CreateRenderPass(key));
+}
+
+VkFramebuffer TVulkanAPI::GetFramebuffer(VkRenderPass renderPass, VkImageView imageView, VkImageView depthView)
+{
+	TVulkanFramebufferKey key = {};
+	key.RenderPass = renderPass;
+	key.View = imageView;
+	key.DepthView = depthView;
+	key.Width = WindowWidth;
+	key.Height = WindowHeight;
+
+	if (VkFramebuffer *framebuffer = Framebuffers.Find(key))
+		return *framebuffer;
+	return Framebuffers.Add(key, CreateFramebuffer(imageView, depthView, renderPass));
+}
+
+// Flat shaded from the checked in SPIR-V, so it is there even without a shader compiler.
+static const TVulkanPipelineDesc FallbackPipelineDesc = {
+	"Test/HelloTriangle.vs.hlsl", "Test/HelloTriangle.ps.hlsl", VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP, sizeof(float32[2]), VK_FORMAT_R32G32_SFLOAT
+};
+
+// TVertex, as the mesh buffer holds them.
+static const VkVertexInputAttributeDescription MeshVertexAttributes[] = {
+	{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(TVertex, Position) },
+	{ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(TVertex, Normal) },
+	{ 2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(TVertex, TextureCoord) },
+};
+
+static const TVulkanPipelineDesc MeshPipelineDesc = {
+	"Test/Mesh.vs.hlsl", "Test/Mesh.ps.hlsl", VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(TVertex), VK_FORMAT_UNDEFINED, nullptr, nullptr,
+	MeshVertexAttributes, ArrayLength(MeshVertexAttributes), VK_COMPARE_OP_LESS, true
+};
+
+TVulkanPipelineKey TVulkanAPI::GetPipelineKey(VkRenderPass renderPass, const TVulkanPipelineDesc &desc) const
+{
+	TVulkanPipelineKey key = {};
+	key.RenderPass = renderPass;
+	const uint64 definesHash = desc.Defines != nullptr ? HashBytes(desc.Defines, strlen(desc.Defines)) : HashSeed;
+	key.VertexShaderHash = HashBytes(desc.VertexShader, strlen(desc.VertexShader), definesHash);
+	key.PixelShaderHash = HashBytes(desc.PixelShader, strlen(desc.PixelShader), definesHash);
+	key.Topology = desc.Topology;
+	key.VertexStride = desc.VertexStride;
+	key.VertexFormat = desc.VertexFormat;
+	key.VertexAttributesHash = desc.VertexAttributes != nullptr ? HashBytes(desc.VertexAttributes, desc.VertexAttributeCount * sizeof(VkVertexInputAttributeDescription)) : 0u;
+	key.Subpass = 0u;
+	key.Width = WindowWidth;
+	key.Height = WindowHeight;
+	key.DepthCompareOp = desc.DepthCompareOp;
+	key.DepthWrite = desc.DepthWrite ? 1u : 0u;
+	return key;
+}
+
+VkPipeline TVulkanAPI::GetPipeline(VkRenderPass renderPass, const TVulkanPipelineDesc &desc)
+{
+	const TVulkanPipelineKey key = GetPipelineKey(renderPass, desc);
+
+	AcquireSRWLockExclusive(&PipelinesLock);
+	TVulkanPipelineRequest *request = nullptr;
+	if (TVulkanPipelineRequest **found = Pipelines.Find(key))
+	{
+		request = *found;
+	}
+	else
+	{
+		request = new TVulkanPipelineRequest();
+		request->API = this;
+		request->RenderPass = renderPass;
+		request->Desc = desc;
+		request->Pipeline = VK_NULL_HANDLE;
+		request->Ready = 0;
+		Pipelines.Add(key, request);
+		Jobs::DispatchBackground(CompilePipeline, request, PipelineCompiles);
+	}
+	ReleaseSRWLockExclusive(&PipelinesLock);
+
+	if (request->Ready != 0)
+		return request->Pipeline;
+	if (desc.Fallback == nullptr)
+		return VK_NULL_HANDLE;
+
+	// Compiled up front by CompileFallbackPipelines, never on demand.
+	// The requests outlive the table's storage, which another thread can grow as soon as the lock is released.
+	const TVulkanPipelineKey fallbackKey = GetPipelineKey(renderPass, *desc.Fallback);
+	AcquireSRWLockShared(&PipelinesLock);
+	TVulkanPipelineRequest **found = Pipelines.Find(fallbackKey);
+	TVulkanPipelineRequest *fallback = found != nullptr ? *found : nullptr;
+	ReleaseSRWLockShared(&PipelinesLock);
+	ASSERT(fallback != nullptr && fallback->Ready != 0);
+	return fallback != nullptr ? fallback->Pipeline : VK_NULL_HANDLE;
+}
+
+void TVulkanAPI::CompileFallbackPipelines()
+{
+	const VkAttachmentLoadOp loadOps[] = { VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_LOAD_OP_LOAD };
+	for (uint32 i = 0; i < ArrayLength(loadOps); ++i)
+	{
+		VkRenderPass renderPass = GetBackBufferRenderPass(loadOps[i]);
+		const TVulkanPipelineKey key = GetPipelineKey(renderPass, FallbackPipelineDesc);
+		if (Pipelines.Find(key) != nullptr)
+			continue;
+
+		auto *request = new TVulkanPipelineRequest();
+		request->API = this;
+		request->RenderPass = renderPass;
+		request->Desc = FallbackPipelineDesc;
+		request->Pipeline = CreatePipeline(renderPass, FallbackPipelineDesc);
+		request->Ready = 1;
+		Pipelines.Add(key, request);
+	}
+}
+
+void TVulkanAPI::CompilePipeline(void *data, int32 begin, int32 end)
+{
+	auto *request = static_cast<TVulkanPipelineRequest *>(data);
+	TCpuProfileScope scope(request->API->Profiler, "CompilePipeline");
+	request->Pipeline = request->API->CreatePipeline(request->RenderPass, request->Desc);
+	// Publishes the pipeline, the interlocked write keeps it from being reordered after Ready.
+	InterlockedExchange(&request->Ready, 1);
+}
+
+void TVulkanAPI::EvictStateObjects()
+{
+	// Compiles in flight still use their render pass.
+	Jobs::Wait(PipelineCompiles);
+
+	// Pipelines and framebuffers reference render passes, so they go first.
+	Pipelines.ForEach([&](const TVulkanPipelineKey &, TVulkanPipelineRequest *request) {
+		DestroyPipeline(request->Pipeline);
+		delete request;
+	});
+	Framebuffers.ForEach([&](const TVulkanFramebufferKey &, VkFramebuffer framebuffer) { DestroyFramebuffer(framebuffer); });
+	RenderPasses.ForEach([&](const TVulkanRenderPassKey &, VkRenderPass renderPass) { DestroyRenderPass(renderPass); });
+	Pipelines.Clear();
+	Framebuffers.Clear();
+	RenderPasses.Clear();
+}
+
+VkRenderPass TVulkanAPI::CreateRenderPass(const TVulkanRenderPassKey &key)
 {
 	VkAttachmentDescription attachmentDescription = {};
 	attachmentDescription.flags = 0;
-	attachmentDescription.format = VK_FORMAT_B8G8R8A8_UNORM;
+	attachmentDescription.format = key.ColorFormat;
 	attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-	attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachmentDescription.loadOp = key.LoadOp;
 	attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// Loading needs the contents, which the render graph left in the attachment layout.
+	attachmentDescription.initialLayout = key.LoadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	attachmentDescription.finalLayout = key.FinalLayout;
 
 	VkAttachmentReference attachmentReference = {};
 	attachmentReference.attachment = 0;
 	attachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	// Cleared, the graph moves the image into the attachment layout and out of it again for readers.
+	const bool depth = key.DepthFormat != VK_FORMAT_UNDEFINED;
+	VkAttachmentDescription depthAttachmentDescription = {};
+	depthAttachmentDescription.flags = 0;
+	depthAttachmentDescription.format = key.DepthFormat;
+	depthAttachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachmentDescription.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	const VkAttachmentDescription attachmentDescriptions[] = { attachmentDescription, depthAttachmentDescription };
+
+	VkAttachmentReference depthAttachmentReference = {};
+	depthAttachmentReference.attachment = 1;
+	depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
 	VkSubpassDescription subpassDescription = {};
 	subpassDescription.flags = 0;
 	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -516,7 +1029,7 @@ VkRenderPass TVulkanAPI::CreateRenderPass()
 	subpassDescription.colorAttachmentCount = 1;
 	subpassDescription.pColorAttachments = &attachmentReference;
 	subpassDescription.pResolveAttachments = nullptr;
-	subpassDescription.pDepthStencilAttachment = nullptr;
+	subpassDescription.pDepthStencilAttachment = depth ? &depthAttachmentReference : nullptr;
 	subpassDescription.preserveAttachmentCount = 0;
 	subpassDescription.pPreserveAttachments = nullptr;
 
@@ -524,8 +1037,8 @@ VkRenderPass TVulkanAPI::CreateRenderPass()
 	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassCreateInfo.pNext = nullptr;
 	renderPassCreateInfo.flags = 0;
-	renderPassCreateInfo.attachmentCount = 1;
-	renderPassCreateInfo.pAttachments = &attachmentDescription;
+	renderPassCreateInfo.attachmentCount = depth ? 2 : 1;
+	renderPassCreateInfo.pAttachments = attachmentDescriptions;
 	renderPassCreateInfo.subpassCount = 1;
 	renderPassCreateInfo.pSubpasses = &subpassDescription;
 	renderPassCreateInfo.dependencyCount = 0;
@@ -542,15 +1055,17 @@ void TVulkanAPI::DestroyRenderPass(VkRenderPass renderPass)
 	vkDestroyRenderPass(Device, renderPass, Allocator);
 }
 
-VkFramebuffer TVulkanAPI::CreateFramebuffer(VkImageView imageView, VkRenderPass renderPass)
+VkFramebuffer TVulkanAPI::CreateFramebuffer(VkImageView imageView, VkImageView depthView, VkRenderPass renderPass)
 {
+	const VkImageView attachments[] = { imageView, depthView };
+
 	VkFramebufferCreateInfo framebufferCreateInfo = {};
 	framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 	framebufferCreateInfo.pNext = nullptr;
 	framebufferCreateInfo.flags = 0;
 	framebufferCreateInfo.renderPass = renderPass;
-	framebufferCreateInfo.attachmentCount = 1;
-	framebufferCreateInfo.pAttachments = &imageView;
+	framebufferCreateInfo.attachmentCount = depthView != VK_NULL_HANDLE ? 2 : 1;
+	framebufferCreateInfo.pAttachments = attachments;
 	framebufferCreateInfo.width = WindowWidth;
 	framebufferCreateInfo.height = WindowHeight;
 	framebufferCreateInfo.layers = 1;
@@ -573,24 +1088,9 @@ static const float32 VertexData[][2] = {
 	{  0.5,  0.5 }
 };
 
-void TVulkanAPI::UploadVertexData(VkDeviceMemory deviceMemory)
+void TVulkanAPI::UploadVertexData(const TVulkanBuffer *buffer)
 {
-	void *mappedMemory = nullptr;
-	VkResult result = vkMapMemory(Device, deviceMemory, 0, sizeof(VertexData), 0, &mappedMemory);
-	ASSERT(result == VK_SUCCESS);
-	MemCopy(mappedMemory, &VertexData, sizeof(VertexData));
-
-	VkMappedMemoryRange mappedMemoryRange = {};
-	mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	mappedMemoryRange.pNext = nullptr;
-	mappedMemoryRange.memory = deviceMemory;
-	mappedMemoryRange.offset = 0;
-	mappedMemoryRange.size = VK_WHOLE_SIZE;
-
-	result = vkFlushMappedMemoryRanges(Device, 1, &mappedMemoryRange);
-	ASSERT(result == VK_SUCCESS);
-
-	vkUnmapMemory(Device, deviceMemory);
+	StagingRing.Upload(buffer->ResourceHandle, 0u, &VertexData, sizeof(VertexData));
 }
 
 IGraphicsBuffer* TVulkanAPI::CreateBuffer(int32 size)
@@ -600,49 +1100,181 @@ IGraphicsBuffer* TVulkanAPI::CreateBuffer(int32 size)
 	bufferCreateInfo.pNext = nullptr;
 	bufferCreateInfo.flags = 0;
 	bufferCreateInfo.size = size;
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	bufferCreateInfo.queueFamilyIndexCount = 0;
-	bufferCreateInfo.pQueueFamilyIndices = nullptr;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	StagingRing.SetDestinationSharing(bufferCreateInfo);
 
 	VkBuffer resourceHandle = VK_NULL_HANDLE;
 	VkResult result = vkCreateBuffer(Device, &bufferCreateInfo, Allocator, &resourceHandle);
 	ASSERT(result == VK_SUCCESS);
 
-	VkMemoryRequirements memoryRequirements;
-	vkGetBufferMemoryRequirements(Device, resourceHandle, &memoryRequirements);
+	auto *buffer = new TVulkanBuffer(this);
+	buffer->ResourceHandle = resourceHandle;
+	buffer->Memory = MemoryManager.AllocateBuffer(resourceHandle, TVulkanMemoryUsage::GpuOnly);
+	return buffer;
+}
 
-	VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
-	vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &physicalDeviceMemoryProperties);
+TVulkanBuffer::~TVulkanBuffer()
+{
+	// Frames still in flight may read the buffer.
+	auto *vulkanDevice = static_cast<TVulkanAPI *>(ParentDevice);
+	vulkanDevice->DeletionQueue.Release(ResourceHandle, Memory, vulkanDevice->FrameIndex);
+}
 
-	VkDeviceMemory memoryHandle = VK_NULL_HANDLE;
-	for (uint32 i = 0; i < physicalDeviceMemoryProperties.memoryTypeCount; ++i)
+static VkFormat GetFormat(TTextureFormat format)
+{
+	switch (format)
 	{
-		if (physicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
-		{
-			VkMemoryAllocateInfo memoryAllocateInfo = {};
-			memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			memoryAllocateInfo.pNext = nullptr;
-			memoryAllocateInfo.allocationSize = memoryRequirements.size;
-			memoryAllocateInfo.memoryTypeIndex = i;
-
-			VkResult result = vkAllocateMemory(Device, &memoryAllocateInfo, Allocator, &memoryHandle);
-			if (result == VK_SUCCESS)
-				break;
-		}
+	case TTextureFormat::RGBA8:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	case TTextureFormat::RGBA8Srgb:
+		return VK_FORMAT_R8G8B8A8_SRGB;
+	case TTextureFormat::BC1:
+		return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case TTextureFormat::BC1Srgb:
+		return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+	case TTextureFormat::BC3:
+		return VK_FORMAT_BC3_UNORM_BLOCK;
+	case TTextureFormat::BC3Srgb:
+		return VK_FORMAT_BC3_SRGB_BLOCK;
+	case TTextureFormat::BC5:
+		return VK_FORMAT_BC5_UNORM_BLOCK;
+	case TTextureFormat::BC7:
+		return VK_FORMAT_BC7_UNORM_BLOCK;
+	case TTextureFormat::BC7Srgb:
+		return VK_FORMAT_BC7_SRGB_BLOCK;
 	}
+	ASSERT(false);
+	return VK_FORMAT_UNDEFINED;
+}
 
-	auto *buffer = new TVulkanBuffer(this);
-	buffer->ResourceHandle = resourceHandle;
-	buffer->MemoryHandle = memoryHandle;
-	return buffer;
+IGraphicsTexture *TVulkanAPI::CreateTexture(const TTextureDesc &desc, const void *data, uint32 levelCount)
+{
+	TTextureDesc textureDesc = desc;
+	if (textureDesc.MipCount == 0u)
+		textureDesc.MipCount = GetTextureMipCount(desc.Width, desc.Height);
+	ASSERT(levelCount >= 1u && levelCount <= textureDesc.MipCount);
+	ASSERT(GetTextureBlockSize(desc.Format) == 1u || EnabledFeatures.textureCompressionBC);
+
+	const VkFormat format = GetFormat(desc.Format);
+	const bool generateLevels = levelCount < textureDesc.MipCount;
+	if (generateLevels)
+	{
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(PhysicalDevice, format, &formatProperties);
+		const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		ASSERT((formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures);
+	}
+
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.pNext = nullptr;
+	imageCreateInfo.flags = 0;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = format;
+	imageCreateInfo.extent.width = textureDesc.Width;
+	imageCreateInfo.extent.height = textureDesc.Height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = textureDesc.MipCount;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | (generateLevels ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0);
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.queueFamilyIndexCount = 0;
+	imageCreateInfo.pQueueFamilyIndices = nullptr;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	auto *texture = new TVulkanTexture(this, textureDesc);
+	VkResult result = vkCreateImage(Device, &imageCreateInfo, Allocator, &texture->ResourceHandle);
+	ASSERT(result == VK_SUCCESS);
+	// Shares the optimal tiling blocks with every other image.
+	texture->Memory = MemoryManager.AllocateImage(texture->ResourceHandle, TVulkanMemoryUsage::GpuOnly);
+
+	VkImageViewCreateInfo imageViewCreateInfo;
+	imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewCreateInfo.pNext = nullptr;
+	imageViewCreateInfo.flags = 0;
+	imageViewCreateInfo.image = texture->ResourceHandle;
+	imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewCreateInfo.format = format;
+	imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+	imageViewCreateInfo.subresourceRange.levelCount = textureDesc.MipCount;
+	imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(Device, &imageViewCreateInfo, Allocator, &texture->View);
+	ASSERT(result == VK_SUCCESS);
+
+	if (Bindless.IsEnabled())
+		texture->BindlessSlot = Bindless.AddImage(texture->View);
+
+	TVulkanImageUpload upload;
+	upload.Image = texture->ResourceHandle;
+	upload.Width = textureDesc.Width;
+	upload.Height = textureDesc.Height;
+	upload.LevelCount = textureDesc.MipCount;
+	upload.UploadedLevelCount = levelCount;
+	upload.BlockSize = GetTextureBlockSize(desc.Format);
+	upload.BlockBytes = GetTextureBlockBytes(desc.Format);
+	StagingRing.UploadImage(upload, data);
+
+	return texture;
 }
 
-TVulkanBuffer::~TVulkanBuffer()
+TVulkanTexture::~TVulkanTexture()
 {
+	// Frames still in flight may sample the texture.
 	auto *vulkanDevice = static_cast<TVulkanAPI *>(ParentDevice);
-	vkFreeMemory(vulkanDevice->Device, MemoryHandle, vulkanDevice->Allocator);
-	vkDestroyBuffer(vulkanDevice->Device, ResourceHandle, vulkanDevice->Allocator);
+	if (BindlessSlot != ~0u)
+		vulkanDevice->Bindless.Release(TBindlessKind::Image, BindlessSlot, vulkanDevice->FrameIndex);
+	vulkanDevice->DeletionQueue.Release(View, vulkanDevice->FrameIndex);
+	vulkanDevice->DeletionQueue.Release(ResourceHandle, Memory, vulkanDevice->FrameIndex);
+}
+
+static VkPrimitiveTopology GetTopology(TPrimitiveTopology topology)
+{
+	switch (topology)
+	{
+	case TPrimitiveTopology::TriangleStrip:
+		return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+	case TPrimitiveTopology::LineList:
+		return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+	default:
+		return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	}
+}
+
+static VkFormat GetFormat(TVertexFormat format)
+{
+	switch (format)
+	{
+	case TVertexFormat::Float2:
+		return VK_FORMAT_R32G32_SFLOAT;
+	case TVertexFormat::Float4:
+		return VK_FORMAT_R32G32B32A32_SFLOAT;
+	default:
+		return VK_FORMAT_R32G32B32_SFLOAT;
+	}
+}
+
+IGraphicsPipeline *TVulkanAPI::CreatePipeline(const TPipelineDesc &desc)
+{
+	auto *pipeline = new TVulkanPipeline(this, desc);
+	pipeline->VulkanDesc.VertexShader = desc.VertexShader;
+	pipeline->VulkanDesc.PixelShader = desc.PixelShader;
+	pipeline->VulkanDesc.Topology = GetTopology(desc.Topology);
+	pipeline->VulkanDesc.VertexStride = desc.VertexStride;
+	pipeline->VulkanDesc.VertexFormat = GetFormat(desc.VertexFormat);
+	pipeline->VulkanDesc.Defines = desc.Defines;
+	// Anything drawing from the same vertex input can stand in.
+	if (pipeline->VulkanDesc.VertexStride == FallbackPipelineDesc.VertexStride && pipeline->VulkanDesc.VertexFormat == FallbackPipelineDesc.VertexFormat)
+		pipeline->VulkanDesc.Fallback = &FallbackPipelineDesc;
+	return pipeline;
 }
 
 VkPipelineLayout TVulkanAPI::CreatePipelineLayout()
@@ -651,10 +1283,18 @@ VkPipelineLayout TVulkanAPI::CreatePipelineLayout()
 	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutCreateInfo.pNext = nullptr;
 	pipelineLayoutCreateInfo.flags = 0;
-	pipelineLayoutCreateInfo.setLayoutCount = 0;
-	pipelineLayoutCreateInfo.pSetLayouts = nullptr;
-	pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-	pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+	VkDescriptorSetLayout setLayouts[2];
+	setLayouts[TVulkanUniformRing::SetIndex] = UniformRing.GetSetLayout();
+	setLayouts[TVulkanBindlessHeap::SetIndex] = Bindless.GetSetLayout();
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_ALL;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = TVulkanBindlessHeap::PushConstantSize;
+
+	pipelineLayoutCreateInfo.setLayoutCount = Bindless.IsEnabled() ? 2 : 1;
+	pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = Bindless.IsEnabled() ? 1 : 0;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 
 	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
 	VkResult result = vkCreatePipelineLayout(Device, &pipelineLayoutCreateInfo, Allocator, &pipelineLayout);
@@ -667,9 +1307,6 @@ void TVulkanAPI::DestroyPipelineLayout(VkPipelineLayout pipelineLayout)
 	vkDestroyPipelineLayout(Device, pipelineLayout, Allocator);
 }
 
-//dxc.exe -spirv -fspv-target-env=vulkan1.1 -T vs_6_0 -E VS_main HelloTriangle.vs.hlsl -Fo HelloTriangle.vs.spirv
-//dxc.exe -spirv -fspv-target-env=vulkan1.1 -T ps_6_0 -E PS_main HelloTriangle.ps.hlsl -Fo HelloTriangle.ps.spirv
-
 VkShaderModule TVulkanAPI::CreateShaderModule(const uint32 *shader, uint32 size)
 {
 	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
@@ -690,14 +1327,15 @@ void TVulkanAPI::DestroyShaderModule(VkShaderModule shaderModule)
 	vkDestroyShaderModule(Device, shaderModule, Allocator);
 }
 
-VkPipeline TVulkanAPI::CreatePipeline(VkRenderPass renderPass)
+VkPipeline TVulkanAPI::CreatePipeline(VkRenderPass renderPass, const TVulkanPipelineDesc &desc)
 {
-	auto ps = FS::Open("Test/HelloTriangle.ps.spirv", FS::Read);
-	auto vs = FS::Open("Test/HelloTriangle.vs.spirv", FS::Read);
-	auto vertexShaderModule = CreateShaderModule(reinterpret_cast<const uint32*>(vs.Platform.Buffer), uint32(vs.Size));
-	auto pixelShaderModule = CreateShaderModule(reinterpret_cast<const uint32*>(ps.Platform.Buffer), uint32(ps.Size));
-	FS::Close(ps);
-	FS::Close(vs);
+	TShaderBinary vs = ShaderCache.Load(desc.VertexShader, TShaderStage::Vertex, "VS_main", desc.Defines);
+	TShaderBinary ps = ShaderCache.Load(desc.PixelShader, TShaderStage::Pixel, "PS_main", desc.Defines);
+	ASSERT(vs.Code != nullptr && ps.Code != nullptr);
+	auto vertexShaderModule = CreateShaderModule(vs.Code, vs.Size);
+	auto pixelShaderModule = CreateShaderModule(ps.Code, ps.Size);
+	ShaderCache.Release(ps);
+	ShaderCache.Release(vs);
 
 	VkPipelineShaderStageCreateInfo shaderStageCreateInfo[2];
 	shaderStageCreateInfo[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -718,13 +1356,13 @@ VkPipeline TVulkanAPI::CreatePipeline(VkRenderPass renderPass)
 
 	VkVertexInputBindingDescription vertexInputBindingDescription = {};
 	vertexInputBindingDescription.binding = 0;
-	vertexInputBindingDescription.stride = sizeof(float32[2]);
+	vertexInputBindingDescription.stride = desc.VertexStride;
 	vertexInputBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 	VkVertexInputAttributeDescription vertexInputAttributeDescription = {};
 	vertexInputAttributeDescription.location = 0;
 	vertexInputAttributeDescription.binding = 0;
-	vertexInputAttributeDescription.format = VK_FORMAT_R32G32_SFLOAT;
+	vertexInputAttributeDescription.format = desc.VertexFormat;
 	vertexInputAttributeDescription.offset = 0;
 	
 	VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {};
@@ -733,14 +1371,14 @@ VkPipeline TVulkanAPI::CreatePipeline(VkRenderPass renderPass)
 	vertexInputStateCreateInfo.flags = 0;
 	vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
 	vertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexInputBindingDescription;
-	vertexInputStateCreateInfo.vertexAttributeDescriptionCount = 1;
-	vertexInputStateCreateInfo.pVertexAttributeDescriptions = &vertexInputAttributeDescription;
+	vertexInputStateCreateInfo.vertexAttributeDescriptionCount = desc.VertexAttributes != nullptr ? desc.VertexAttributeCount : 1;
+	vertexInputStateCreateInfo.pVertexAttributeDescriptions = desc.VertexAttributes != nullptr ? desc.VertexAttributes : &vertexInputAttributeDescription;
 
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {};
 	inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 	inputAssemblyStateCreateInfo.pNext = nullptr;
 	inputAssemblyStateCreateInfo.flags = 0;
-	inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+	inputAssemblyStateCreateInfo.topology = desc.Topology;
 	inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
 
 	VkViewport viewport = {};
@@ -749,7 +1387,7 @@ VkPipeline TVulkanAPI::CreatePipeline(VkRenderPass renderPass)
 	viewport.width = WindowWidth;
 	viewport.height = WindowHeight;
 	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
 
 	VkRect2D scissor = {};
 	scissor.offset.x = 0u;
@@ -819,9 +1457,9 @@ VkPipeline TVulkanAPI::CreatePipeline(VkRenderPass renderPass)
 	depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	depthStencilStateCreateInfo.pNext = nullptr;
 	depthStencilStateCreateInfo.flags = 0;
-	depthStencilStateCreateInfo.depthTestEnable = VK_FALSE;
-	depthStencilStateCreateInfo.depthWriteEnable = VK_FALSE;
-	depthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+	depthStencilStateCreateInfo.depthTestEnable = desc.DepthCompareOp != VK_COMPARE_OP_ALWAYS || desc.DepthWrite ? VK_TRUE : VK_FALSE;
+	depthStencilStateCreateInfo.depthWriteEnable = desc.DepthWrite ? VK_TRUE : VK_FALSE;
+	depthStencilStateCreateInfo.depthCompareOp = desc.DepthCompareOp;
 	depthStencilStateCreateInfo.depthBoundsTestEnable = VK_FALSE;
 	depthStencilStateCreateInfo.stencilTestEnable = VK_FALSE;
 
@@ -844,8 +1482,6 @@ VkPipeline TVulkanAPI::CreatePipeline(VkRenderPass renderPass)
 	depthStencilStateCreateInfo.minDepthBounds = 0.0f;
 	depthStencilStateCreateInfo.maxDepthBounds = 1.0f;
 
-	VkPipelineLayout pipelineLayout = CreatePipelineLayout();
-
 	VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {};
 	graphicsPipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	graphicsPipelineCreateInfo.pNext = nullptr;
@@ -861,19 +1497,18 @@ VkPipeline TVulkanAPI::CreatePipeline(VkRenderPass renderPass)
 	graphicsPipelineCreateInfo.pDepthStencilState = &depthStencilStateCreateInfo;
 	graphicsPipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
 	graphicsPipelineCreateInfo.pDynamicState = nullptr;
-	graphicsPipelineCreateInfo.layout = pipelineLayout;
+	graphicsPipelineCreateInfo.layout = PipelineLayout;
 	graphicsPipelineCreateInfo.renderPass = renderPass;
 	graphicsPipelineCreateInfo.subpass = 0;
 	graphicsPipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
 	graphicsPipelineCreateInfo.basePipelineIndex = -1;
 
 	VkPipeline graphicsPipeline = VK_NULL_HANDLE;
-	VkResult result = vkCreateGraphicsPipelines(Device, VK_NULL_HANDLE, 1, &graphicsPipelineCreateInfo, Allocator, &graphicsPipeline);
+	VkResult result = vkCreateGraphicsPipelines(Device, PipelineCache.GetHandle(), 1, &graphicsPipelineCreateInfo, Allocator, &graphicsPipeline);
 	ASSERT(result == VK_SUCCESS);
 
 	DestroyShaderModule(vertexShaderModule);
 	DestroyShaderModule(pixelShaderModule);
-	DestroyPipelineLayout(pipelineLayout);
 	return graphicsPipeline;
 }
 
@@ -895,307 +1530,761 @@ VkSemaphore TVulkanAPI::CreateSemaphore()
 	return semaphore;
 }
 
-static VkSemaphore renderingFinishedSemaphore = VK_NULL_HANDLE;
-static VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
-
-void TVulkanAPI::HelloWorld()
+VkFence TVulkanAPI::CreateFence(bool signaled)
 {
-	uint32_t i;
-	VkResult result = vkAcquireNextImageKHR(Device, SwapChain.Handle, TNumericLimits<uint64>::Max(), imageAvailableSemaphore, VK_NULL_HANDLE, &i);
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.pNext = nullptr;
+	fenceCreateInfo.flags = signaled ? VK_FENCE_CREATE_SIGNALED_BIT : 0;
+
+	VkFence fence = VK_NULL_HANDLE;
+	VkResult result = vkCreateFence(Device, &fenceCreateInfo, Allocator, &fence);
 	ASSERT(result == VK_SUCCESS);
+	return fence;
+}
 
-	VkRenderPass renderPass = CreateRenderPass();
-	VkFramebuffer framebuffer = CreateFramebuffer(SwapChain.Views[i], renderPass);
-	auto *buffer = static_cast<TVulkanBuffer*>(CreateBuffer(sizeof(VertexData)));
+void TVulkanAPI::RecycleFrame(TVulkanFrame &frame)
+{
+	frame.Graph.Reset();
 
-	UploadVertexData(buffer->MemoryHandle);
-	result = vkBindBufferMemory(Device, buffer->ResourceHandle, buffer->MemoryHandle, 0);
-	ASSERT(result == VK_SUCCESS);
+	for (size_t i = 0; i < frame.Threads.size(); ++i)
+	{
+		VkResult result = vkResetCommandPool(Device, frame.Threads[i].Pool, 0);
+		ASSERT(result == VK_SUCCESS);
+		frame.Threads[i].SecondaryUsed = 0u;
+	}
+}
 
-	VkPipeline pipeline = CreatePipeline(renderPass);
-	VkCommandBuffer commandBuffer = CreateCommandBuffer();
+TVulkanFrame &TVulkanAPI::BeginFrame()
+{
+	TVulkanFrame &frame = Frames[FrameIndex % MaxFramesInFlight];
+	FrameBeginTime = Profiler.GetCpuTime();
 
-	VkImageSubresourceRange imageSubresourceRange = {};
-	imageSubresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	imageSubresourceRange.baseMipLevel = 0;
-	imageSubresourceRange.levelCount = 1;
-	imageSubresourceRange.baseArrayLayer = 0;
-	imageSubresourceRange.layerCount = 1;
+	// Only blocks when the CPU is MaxFramesInFlight frames ahead of the GPU.
+	VkResult result = vkWaitForFences(Device, 1, &frame.Fence, VK_TRUE, TNumericLimits<uint64>::Max());
+	ASSERT(result == VK_SUCCESS);
+	result = vkResetFences(Device, 1, &frame.Fence);
+	ASSERT(result == VK_SUCCESS);
 
+	DeliverReadback(frame);
+	if (Culling.IsEnabled())
+		Culling.ReadStatistics(uint32(FrameIndex % MaxFramesInFlight));
+	RecycleFrame(frame);
+	// The fence belongs to the frame MaxFramesInFlight back, it and every frame before it are done.
+	if (FrameIndex >= MaxFramesInFlight)
 	{
-		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		commandBufferBeginInfo.pNext = nullptr;
-		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		commandBufferBeginInfo.pInheritanceInfo = nullptr;
+		DeletionQueue.Collect(FrameIndex - MaxFramesInFlight);
+		Bindless.Collect(FrameIndex - MaxFramesInFlight);
+		MeshBuffer.Collect(FrameIndex - MaxFramesInFlight);
+	}
+	StagingRing.Retire();
+	UniformRing.BeginFrame(uint32(FrameIndex % MaxFramesInFlight));
+	MeshBuffer.BeginFrame(uint32(FrameIndex % MaxFramesInFlight));
+	TextureStreamer.Update();
 
-		vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	if (Headless)
+	{
+		// The frame's own image, its fence says the GPU is done with it.
+		frame.ImageIndex = uint32(FrameIndex % MaxFramesInFlight);
 	}
+	else
+	{
+		const int64 acquireBegin = Profiler.GetCpuTime();
+		result = vkAcquireNextImageKHR(Device, SwapChain.Handle, TNumericLimits<uint64>::Max(), frame.ImageAvailable, VK_NULL_HANDLE, &frame.ImageIndex);
+		ASSERT(result == VK_SUCCESS);
+		frame.AcquireTime = Profiler.GetCpuTime();
+		Profiler.AddCpuEvent("Acquire", acquireBegin, frame.AcquireTime);
 
+		PresentStatistics.LastAcquireWait = frame.AcquireTime - acquireBegin;
+		PresentStatistics.TotalAcquireWait += PresentStatistics.LastAcquireWait;
+	}
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = nullptr;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = nullptr;
+
+	result = vkBeginCommandBuffer(frame.CommandBuffer, &commandBufferBeginInfo);
+	ASSERT(result == VK_SUCCESS);
+	Profiler.BeginFrame(uint32(FrameIndex % MaxFramesInFlight), frame.CommandBuffer);
+	// Once for the whole frame, binding the uniform ring's set per draw leaves it bound.
+	if (Bindless.IsEnabled())
 	{
-		VkImageMemoryBarrier imageMemoryBarrier = {};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.pNext = nullptr;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-		imageMemoryBarrier.srcQueueFamilyIndex = 0;
-		imageMemoryBarrier.dstQueueFamilyIndex = 0;
-		imageMemoryBarrier.image = SwapChain.Images[i];
-		imageMemoryBarrier.subresourceRange = imageSubresourceRange;
-
-		vkCmdPipelineBarrier(
-			commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			0,
-			0, nullptr,
-			0, nullptr,
-			1, &imageMemoryBarrier
-		);
+		Bindless.Bind(frame.CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout);
+		Bindless.Bind(frame.CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout);
 	}
 
+	// Offscreen images start out undefined like acquired ones and are left ready to be copied from.
+	frame.BackBuffer = frame.Graph.ImportImage("BackBuffer", SwapChain.Images[frame.ImageIndex], SwapChain.Views[frame.ImageIndex],
+		SwapChain.Format, TRenderGraphUsage::Acquire, Headless ? TRenderGraphUsage::TransferSource : TRenderGraphUsage::Present);
+	return frame;
+}
+
+void TVulkanAPI::EndFrame()
+{
+	TVulkanFrame &frame = Frames[FrameIndex % MaxFramesInFlight];
+
+	if (ReadbackRequested)
 	{
-		VkClearValue clearValue = {};
-		clearValue.color.float32[0] = 0.0f;
-		clearValue.color.float32[1] = 0.0f;
-		clearValue.color.float32[2] = 1.0f;
-		clearValue.color.float32[3] = 1.0f;
-		clearValue.depthStencil.depth = 0.0f;
-		clearValue.depthStencil.stencil = 0u;
-
-		VkRenderPassBeginInfo renderPassBeginInfo = {};
-		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.pNext = nullptr;
-		renderPassBeginInfo.renderPass = renderPass;
-		renderPassBeginInfo.framebuffer = framebuffer;
-		renderPassBeginInfo.renderArea.offset.x = 0u;
-		renderPassBeginInfo.renderArea.offset.y = 0u;
-		renderPassBeginInfo.renderArea.extent.width = WindowWidth;
-		renderPassBeginInfo.renderArea.extent.height = WindowHeight;
-		renderPassBeginInfo.clearValueCount = 1;
-		renderPassBeginInfo.pClearValues = &clearValue;
-
-		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		AddReadbackPass(frame);
+		ReadbackRequested = false;
 	}
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer->ResourceHandle, &offset);
-	vkCmdDraw(commandBuffer, 4, 1, 0, 0);
-	vkCmdEndRenderPass(commandBuffer);
+	MeshBuffer.Build();
+	// Once the mesh buffer's counts are final, the culling's constants go into the uniform ring.
+	if (Culling.IsEnabled())
+		Culling.Record();
 
 	{
-		VkImageMemoryBarrier imageMemoryBarrier = {};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.pNext = nullptr;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.image = SwapChain.Images[i];
-		imageMemoryBarrier.subresourceRange = imageSubresourceRange;
-
-		vkCmdPipelineBarrier(
-			commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-			0,
-			0, nullptr,
-			0, nullptr,
-			1, &imageMemoryBarrier
-		);
+		TCpuProfileScope scope(Profiler, "RenderGraph");
+		frame.Graph.Compile();
+		frame.Graph.Execute(frame.CommandBuffer, &Profiler);
 	}
+	Profiler.EndFrame(frame.CommandBuffer);
 
-	vkEndCommandBuffer(commandBuffer);
+	VkResult result = vkEndCommandBuffer(frame.CommandBuffer);
+	ASSERT(result == VK_SUCCESS);
+
+	// Uploads recorded during the frame go first, the ring's barrier covers the frame's reads. The culling's compute
+	// work follows them and holds back the frame's graphics work until its output is ready.
+	StagingRing.Submit();
+	UniformRing.EndFrame();
+	if (Culling.IsEnabled())
+		Culling.Submit();
 
 	{
-		VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		// Matches the stages of TRenderGraphUsage::Acquire, the graph's first barrier on the image waits for them.
+		VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		VkSubmitInfo submitInfo = {};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		submitInfo.pNext = nullptr;
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = &imageAvailableSemaphore;
+		submitInfo.waitSemaphoreCount = Headless ? 0 : 1;
+		submitInfo.pWaitSemaphores = &frame.ImageAvailable;
 		submitInfo.pWaitDstStageMask = &wait_dst_stage_mask;
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &renderingFinishedSemaphore;
+		submitInfo.pCommandBuffers = &frame.CommandBuffer;
+		submitInfo.signalSemaphoreCount = Headless ? 0 : 1;
+		submitInfo.pSignalSemaphores = &frame.RenderingFinished;
 
-		result = vkQueueSubmit(Queues[Present], 1, &submitInfo, VK_NULL_HANDLE);
+		result = vkQueueSubmit(Queues[Graphics], 1, &submitInfo, frame.Fence);
 		ASSERT(result == VK_SUCCESS);
 	}
-	
+
+	if (!Headless)
 	{
 		VkPresentInfoKHR presentInfoKHR = {};
 		presentInfoKHR.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 		presentInfoKHR.pNext = nullptr;
 		presentInfoKHR.waitSemaphoreCount = 1;
-		presentInfoKHR.pWaitSemaphores = &renderingFinishedSemaphore;
+		presentInfoKHR.pWaitSemaphores = &frame.RenderingFinished;
 		presentInfoKHR.swapchainCount = 1;
 		presentInfoKHR.pSwapchains = &SwapChain.Handle;
-		presentInfoKHR.pImageIndices = &i;
+		presentInfoKHR.pImageIndices = &frame.ImageIndex;
 		presentInfoKHR.pResults = nullptr;
 
+		const int64 latency = Profiler.GetCpuTime() - frame.AcquireTime;
+		PresentStatistics.LastLatency = latency;
+		PresentStatistics.MaxLatency = Max(PresentStatistics.MaxLatency, latency);
+		PresentStatistics.TotalLatency += latency;
+		++PresentStatistics.FrameCount;
+
 		result = vkQueuePresentKHR(Queues[Present], &presentInfoKHR);
 		ASSERT(result == VK_SUCCESS);
 	}
 
-	DestroyCommandBuffer(commandBuffer);
-	DestroyPipeline(pipeline);
-	delete buffer;
-	DestroyFramebuffer(framebuffer);
-	DestroyRenderPass(renderPass);
+	Profiler.AddCpuEvent("Frame", FrameBeginTime, Profiler.GetCpuTime());
+	++FrameIndex;
 }
 
-void TVulkanAPI::ClearColor()
+void TVulkanAPI::SetPresentPolicy(TVulkanPresentPolicy policy)
 {
-	uint32_t i;
-	VkResult result = vkAcquireNextImageKHR(Device, SwapChain.Handle, TNumericLimits<uint64>::Max(), imageAvailableSemaphore, VK_NULL_HANDLE, &i);
-
-	static VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
-	if (commandBuffer != VK_NULL_HANDLE)
-		DestroyCommandBuffer(commandBuffer);
-	commandBuffer = CreateCommandBuffer();
-		
-	VkImageSubresourceRange imageSubresourceRange = {};
-	imageSubresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	imageSubresourceRange.baseMipLevel = 0;
-	imageSubresourceRange.levelCount = 1;
-	imageSubresourceRange.baseArrayLayer = 0;
-	imageSubresourceRange.layerCount = 1;
-	
+	if (policy == PresentPolicy)
+		return;
+	PresentPolicy = policy;
+	if (!Headless)
 	{
-		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		commandBufferBeginInfo.pNext = nullptr;
-		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		commandBufferBeginInfo.pInheritanceInfo = nullptr;
+		InitSwapChain();
+		CompileFallbackPipelines();
+	}
+}
+
+void TVulkanAPI::RequestReadback()
+{
+	ASSERT(Headless);
+	ReadbackRequested = true;
+}
+
+void TVulkanAPI::SetReadbackHandler(TVulkanReadbackHandler handler, void *userData)
+{
+	ReadbackHandler = handler;
+	ReadbackUserData = userData;
+}
 
-		vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+void TVulkanAPI::AddReadbackPass(TVulkanFrame &frame)
+{
+	if (frame.Readback == VK_NULL_HANDLE)
+	{
+		VkBufferCreateInfo bufferCreateInfo = {};
+		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferCreateInfo.pNext = nullptr;
+		bufferCreateInfo.flags = 0;
+		bufferCreateInfo.size = VkDeviceSize(WindowWidth) * WindowHeight * sizeof(uint32);
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.queueFamilyIndexCount = 0;
+		bufferCreateInfo.pQueueFamilyIndices = nullptr;
+
+		VkResult result = vkCreateBuffer(Device, &bufferCreateInfo, Allocator, &frame.Readback);
+		ASSERT(result == VK_SUCCESS);
+		frame.ReadbackMemory = MemoryManager.AllocateBuffer(frame.Readback, TVulkanMemoryUsage::GpuToCpu);
 	}
 
+	TRenderGraph &graph = frame.Graph;
+	VkImage image = graph.GetImage(frame.BackBuffer);
+	VkBuffer buffer = frame.Readback;
+	// Imported, so the pass is never culled, and left to the host, which makes the copy visible once the fence signals.
+	const TRenderGraphResource readback = graph.ImportBuffer("Readback", buffer, TRenderGraphUsage::HostRead, TRenderGraphUsage::HostRead);
+
+	const int32 pass = graph.AddPass("Readback", [=](VkCommandBuffer commandBuffer) {
+		VkBufferImageCopy bufferImageCopy = {};
+		bufferImageCopy.bufferOffset = 0;
+		bufferImageCopy.bufferRowLength = 0;
+		bufferImageCopy.bufferImageHeight = 0;
+		bufferImageCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		bufferImageCopy.imageSubresource.mipLevel = 0;
+		bufferImageCopy.imageSubresource.baseArrayLayer = 0;
+		bufferImageCopy.imageSubresource.layerCount = 1;
+		bufferImageCopy.imageOffset = { 0, 0, 0 };
+		bufferImageCopy.imageExtent = { WindowWidth, WindowHeight, 1u };
+
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &bufferImageCopy);
+	});
+	graph.Read(pass, frame.BackBuffer, TRenderGraphUsage::TransferSource);
+	graph.Write(pass, readback, TRenderGraphUsage::TransferDestination);
+
+	frame.ReadbackPending = true;
+	frame.ReadbackFrameIndex = FrameIndex;
+}
+
+void TVulkanAPI::DeliverReadback(TVulkanFrame &frame)
+{
+	if (!frame.ReadbackPending)
+		return;
+	frame.ReadbackPending = false;
+
+	if (ReadbackHandler == nullptr)
+		return;
+
+	MemoryManager.Invalidate(frame.ReadbackMemory);
+
+	TVulkanReadback readback;
+	readback.Pixels = frame.ReadbackMemory.Mapped;
+	readback.Format = SwapChain.Format;
+	readback.Width = WindowWidth;
+	readback.Height = WindowHeight;
+	readback.RowPitch = WindowWidth * sizeof(uint32);
+	readback.FrameIndex = frame.ReadbackFrameIndex;
+	ReadbackHandler(ReadbackUserData, readback);
+}
+
+static void GetBarrierScope(TResourceState state, VkPipelineStageFlags &stages, VkAccessFlags &access)
+{
+	switch (state)
 	{
-		VkImageMemoryBarrier imageMemoryBarrier = {};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.pNext = nullptr;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-		imageMemoryBarrier.srcQueueFamilyIndex = 0;
-		imageMemoryBarrier.dstQueueFamilyIndex = 0;
-		imageMemoryBarrier.image = SwapChain.Images[i];
-		imageMemoryBarrier.subresourceRange = imageSubresourceRange;
-
-		vkCmdPipelineBarrier(
-			commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			0,
-			0, nullptr,
-			0, nullptr, 
-			1, &imageMemoryBarrier
-		);
+	case TResourceState::VertexBuffer:
+		stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		break;
+	case TResourceState::IndexBuffer:
+		stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		access = VK_ACCESS_INDEX_READ_BIT;
+		break;
+	case TResourceState::IndirectBuffer:
+		stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		break;
+	case TResourceState::ShaderRead:
+		stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		access = VK_ACCESS_SHADER_READ_BIT;
+		break;
+	case TResourceState::ShaderWrite:
+		stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		break;
+	case TResourceState::TransferSource:
+		stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		access = VK_ACCESS_TRANSFER_READ_BIT;
+		break;
+	case TResourceState::TransferDestination:
+		stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		access = VK_ACCESS_TRANSFER_WRITE_BIT;
+		break;
 	}
+}
+
+void TVulkanAPI::Submit(const TCommandList &list)
+{
+	TVulkanFrame &frame = Frames[FrameIndex % MaxFramesInFlight];
+	const TCommandList *commands = &list;
+	VkImageView view = SwapChain.Views[frame.ImageIndex];
+	const int32 pass = frame.Graph.AddPass("CommandList", [=](VkCommandBuffer commandBuffer) {
+		ExecuteCommandList(commandBuffer, *commands, view, VK_NULL_HANDLE);
+	});
+	frame.Graph.Write(pass, frame.BackBuffer, TRenderGraphUsage::ColorAttachment);
+}
 
+void TVulkanAPI::Submit(const float32 *clearColor, const TCommandList *const *lists, int32 count)
+{
+	TVulkanFrame &frame = Frames[FrameIndex % MaxFramesInFlight];
+	TBeginRenderPassCommand beginCommand = {};
+	beginCommand.Clear = clearColor != nullptr;
+	if (beginCommand.Clear)
+		MemCopy(beginCommand.ClearColor, clearColor, sizeof(beginCommand.ClearColor));
+
+	TVarArray<const TCommandList *> commands;
+	commands.resize(Max(count, 0));
+	for (int32 i = 0; i < count; ++i)
+		commands[i] = lists[i];
+
+	TVulkanFrame *recordingFrame = &frame;
+	VkImageView view = SwapChain.Views[frame.ImageIndex];
+	const int32 pass = frame.Graph.AddPass("CommandLists", [=](VkCommandBuffer commandBuffer) {
+		VkRenderPass renderPass = BeginRenderPass(commandBuffer, beginCommand, view, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		RecordParallel(*recordingFrame, renderPass, 0u, GetFramebuffer(renderPass, view), int32(commands.size()), 1, [&](VkCommandBuffer secondary, int32 begin, int32 end) {
+			for (int32 i = begin; i < end; ++i)
+				ExecuteCommandList(secondary, *commands[i], view, renderPass);
+		});
+		vkCmdEndRenderPass(commandBuffer);
+	});
+	frame.Graph.Write(pass, frame.BackBuffer, TRenderGraphUsage::ColorAttachment);
+}
+
+VkRenderPass TVulkanAPI::GetBackBufferRenderPass(VkAttachmentLoadOp loadOp, bool depth)
+{
+	// The graph moves the image into and out of the attachment layout, the render pass leaves it alone.
+	TVulkanRenderPassKey renderPassKey = {};
+	renderPassKey.ColorFormat = SwapChain.Format;
+	renderPassKey.LoadOp = loadOp;
+	renderPassKey.FinalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	renderPassKey.DepthFormat = depth ? DepthFormat : VK_FORMAT_UNDEFINED;
+	return GetRenderPass(renderPassKey);
+}
+
+VkRenderPass TVulkanAPI::BeginRenderPass(VkCommandBuffer commandBuffer, const TBeginRenderPassCommand &command, VkImageView view, VkSubpassContents contents,
+	VkImageView depthView)
+{
+	const bool depth = depthView != VK_NULL_HANDLE;
+	VkRenderPass renderPass = GetBackBufferRenderPass(command.Clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD, depth);
+
+	// Depth is cleared to the far plane.
+	VkClearValue clearValues[2] = {};
+	MemCopy(clearValues[0].color.float32, command.ClearColor, sizeof(command.ClearColor));
+	clearValues[1].depthStencil.depth = 1.0f;
+	clearValues[1].depthStencil.stencil = 0u;
+
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.pNext = nullptr;
+	renderPassBeginInfo.renderPass = renderPass;
+	renderPassBeginInfo.framebuffer = GetFramebuffer(renderPass, view, depthView);
+	renderPassBeginInfo.renderArea.offset.x = 0u;
+	renderPassBeginInfo.renderArea.offset.y = 0u;
+	renderPassBeginInfo.renderArea.extent.width = WindowWidth;
+	renderPassBeginInfo.renderArea.extent.height = WindowHeight;
+	renderPassBeginInfo.clearValueCount = depth ? 2 : command.Clear ? 1 : 0;
+	renderPassBeginInfo.pClearValues = depth || command.Clear ? clearValues : nullptr;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, contents);
+	return renderPass;
+}
+
+void TVulkanAPI::ExecuteCommandList(VkCommandBuffer commandBuffer, const TCommandList &list, VkImageView view, VkRenderPass renderPass)
+{
+	// VK_NULL_HANDLE while the pipeline bound is compiling, its draws are skipped until then.
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	TCommandReader reader(list);
+	TCommandType type;
+	while (reader.Next(type))
 	{
-		VkClearColorValue clearColorValue = {};
-		clearColorValue.float32[0] = 0.0f;
-		clearColorValue.float32[1] = i ? 1.0f : 0.0f;
-		clearColorValue.float32[2] = 1.0f;
-		clearColorValue.float32[3] = 1.0f;
+		switch (type)
+		{
+		case TCommandType::BeginRenderPass:
+			ASSERT(renderPass == VK_NULL_HANDLE);
+			renderPass = BeginRenderPass(commandBuffer, reader.Read<TBeginRenderPassCommand>(), view, VK_SUBPASS_CONTENTS_INLINE);
+			pipeline = VK_NULL_HANDLE;
+			break;
+		case TCommandType::EndRenderPass:
+			vkCmdEndRenderPass(commandBuffer);
+			renderPass = VK_NULL_HANDLE;
+			break;
+		case TCommandType::BindPipeline:
+		{
+			const auto command = reader.Read<TBindPipelineCommand>();
+			pipeline = GetPipeline(renderPass, static_cast<const TVulkanPipeline *>(command.Pipeline)->VulkanDesc);
+			if (pipeline != VK_NULL_HANDLE)
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			break;
+		}
+		case TCommandType::BindVertexBuffer:
+		{
+			const auto command = reader.Read<TBindVertexBufferCommand>();
+			VkBuffer buffer = static_cast<const TVulkanBuffer *>(command.Buffer)->ResourceHandle;
+			const VkDeviceSize offset = command.Offset;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, &offset);
+			break;
+		}
+		case TCommandType::BindIndexBuffer:
+		{
+			const auto command = reader.Read<TBindIndexBufferCommand>();
+			VkBuffer buffer = static_cast<const TVulkanBuffer *>(command.Buffer)->ResourceHandle;
+			vkCmdBindIndexBuffer(commandBuffer, buffer, command.Offset, command.Type == TIndexType::Uint16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+			break;
+		}
+		case TCommandType::PushConstants:
+		{
+			const auto command = reader.Read<TPushConstantsCommand>();
+			const uint8 *data = reader.ReadBytes(command.Size);
+			ASSERT(Bindless.IsEnabled());
+			vkCmdPushConstants(commandBuffer, PipelineLayout, VK_SHADER_STAGE_ALL, 0, command.Size, data);
+			break;
+		}
+		case TCommandType::Draw:
+		{
+			const auto command = reader.Read<TDrawCommand>();
+			if (pipeline != VK_NULL_HANDLE)
+				vkCmdDraw(commandBuffer, command.VertexCount, command.InstanceCount, command.FirstVertex, command.FirstInstance);
+			break;
+		}
+		case TCommandType::DrawIndexed:
+		{
+			const auto command = reader.Read<TDrawIndexedCommand>();
+			if (pipeline != VK_NULL_HANDLE)
+				vkCmdDrawIndexed(commandBuffer, command.IndexCount, command.InstanceCount, command.FirstIndex, command.VertexOffset, command.FirstInstance);
+			break;
+		}
+		case TCommandType::Barrier:
+		{
+			const auto command = reader.Read<TBarrierCommand>();
+			// Buffer barriers are not allowed inside a render pass, which lists submitted together run in throughout.
+			ASSERT(renderPass == VK_NULL_HANDLE);
+			if (renderPass != VK_NULL_HANDLE)
+				break;
+			VkPipelineStageFlags srcStageMask, dstStageMask;
+			VkBufferMemoryBarrier bufferMemoryBarrier = {};
+			bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferMemoryBarrier.pNext = nullptr;
+			GetBarrierScope(command.Before, srcStageMask, bufferMemoryBarrier.srcAccessMask);
+			GetBarrierScope(command.After, dstStageMask, bufferMemoryBarrier.dstAccessMask);
+			bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.buffer = static_cast<const TVulkanBuffer *>(command.Buffer)->ResourceHandle;
+			bufferMemoryBarrier.offset = 0;
+			bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+			break;
+		}
+		}
+	}
+}
 
-		vkCmdClearColorImage(
-			commandBuffer, 
-			SwapChain.Images[i], 
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-			&clearColorValue,
-			1, &imageSubresourceRange
-		);
+static TPipelineDesc GetHelloTriangleDesc()
+{
+	TPipelineDesc desc;
+	desc.VertexShader = "Test/HelloTriangle.vs.hlsl";
+	desc.PixelShader = "Test/HelloTriangle.ps.hlsl";
+	desc.Topology = TPrimitiveTopology::TriangleStrip;
+	desc.VertexStride = sizeof(float32[2]);
+	desc.VertexFormat = TVertexFormat::Float2;
+	return desc;
+}
+
+// Rings from pole to pole, triangles wound counter-clockwise seen from outside. The first and last column of vertices
+// share their positions, as do the vertices of a pole, with texture coordinates of their own.
+static void BuildSphereMesh(TMesh &mesh, float32 radius, uint32 rings, uint32 segments)
+{
+	const float32 pi = 3.14159265f;
+	for (uint32 ring = 0; ring <= rings; ++ring)
+	{
+		const float32 theta = pi * float32(ring) / float32(rings);
+		for (uint32 segment = 0; segment <= segments; ++segment)
+		{
+			const float32 phi = 2.0f * pi * float32(segment) / float32(segments);
+			TVertex vertex;
+			vertex.Normal = Vector3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+			vertex.Position = vertex.Normal * radius;
+			vertex.TextureCoord = Vector2(float32(segment) / float32(segments), float32(ring) / float32(rings));
+			mesh.TVertexBuffer.push_back(vertex);
+		}
 	}
 
+	for (uint32 ring = 0; ring < rings; ++ring)
 	{
-		VkImageMemoryBarrier imageMemoryBarrier = {};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.pNext = nullptr;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.image = SwapChain.Images[i];
-		imageMemoryBarrier.subresourceRange = imageSubresourceRange;
-
-		vkCmdPipelineBarrier(
-			commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-			0, 
-			0, nullptr, 
-			0, nullptr,
-			1, &imageMemoryBarrier
-		);
+		for (uint32 segment = 0; segment < segments; ++segment)
+		{
+			const uint16 a = uint16(ring * (segments + 1u) + segment);
+			const uint16 b = uint16(a + 1u);
+			const uint16 c = uint16(a + segments + 1u);
+			const uint16 d = uint16(c + 1u);
+			// The triangle touching a pole with two of its corners is left out.
+			if (ring != 0u)
+			{
+				mesh.IndexBuffer.push_back(a);
+				mesh.IndexBuffer.push_back(b);
+				mesh.IndexBuffer.push_back(c);
+			}
+			if (ring != rings - 1u)
+			{
+				mesh.IndexBuffer.push_back(b);
+				mesh.IndexBuffer.push_back(d);
+				mesh.IndexBuffer.push_back(c);
+			}
+		}
 	}
+}
 
-	result = vkEndCommandBuffer(commandBuffer);
-	ASSERT(result == VK_SUCCESS);
-	
+// The view projection of a mesh scaled uniformly and moved to position, without a full matrix product since nothing
+// rotates.
+static Matrix4x4 PlaceViewProjection(const Matrix4x4 &viewProjection, const Vector3 &position, float32 scale)
+{
+	Matrix4x4 result = viewProjection;
+	const Vector4 column(position.x, position.y, position.z, 1.0f);
+	for (int32 i = 0; i < 4; ++i)
 	{
-		VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		VkSubmitInfo submitInfo = {};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.pNext = nullptr;
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = &imageAvailableSemaphore;
-		submitInfo.pWaitDstStageMask = &wait_dst_stage_mask;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &renderingFinishedSemaphore;
+		for (int32 j = 0; j < 3; ++j)
+			result[i][j] = viewProjection[i][j] * scale;
+		result[i][3] = Dot(viewProjection[i], column);
+	}
+	return result;
+}
 
-		result = vkQueueSubmit(Queues[Present], 1, &submitInfo, VK_NULL_HANDLE);
-		ASSERT(result == VK_SUCCESS);
+// Where HelloWorld puts its spheres, scale in w: a row along the top, two off either side of the view, a large one
+// below the row and one right behind it, which the large one's depth hides from the next frame on.
+static const Vector4 HelloMeshPlacements[] = {
+	Vector4(-0.75f, 0.75f, 0.5f, 1.0f), Vector4(-0.25f, 0.75f, 0.5f, 1.0f), Vector4(0.25f, 0.75f, 0.5f, 1.0f), Vector4(0.75f, 0.75f, 0.5f, 1.0f),
+	Vector4(-2.0f, 0.75f, 0.5f, 1.0f), Vector4(2.0f, 0.75f, 0.5f, 1.0f),
+	Vector4(0.0f, -0.35f, 0.65f, 6.0f), Vector4(0.0f, -0.35f, 0.85f, 1.0f),
+};
+static_assert(ArrayLength(HelloMeshPlacements) == TVulkanAPI::HelloMeshInstanceCount);
+
+// Push constants of Mesh.vs.hlsl.
+struct TMeshDrawIndices
+{
+	uint32 InstanceSlot;
+	// ~0u draws every instance, otherwise the instances are looked up in the culling's visible list.
+	uint32 VisibleSlot;
+};
+
+void TVulkanAPI::AddMeshPass(TVulkanFrame &frame, const Matrix4x4 &viewProjection)
+{
+	VkImageView view = SwapChain.Views[frame.ImageIndex];
+	const bool depth = DepthFormat != VK_FORMAT_UNDEFINED;
+	VkImageView depthView = depth ? DepthView : VK_NULL_HANDLE;
+	TRenderGraphResource depthImage;
+	// Left in the attachment layout, where the last frame's mesh pass put it.
+	if (depth)
+		depthImage = frame.Graph.ImportImage("Depth", DepthImage, DepthView, DepthFormat,
+			DepthRendered ? TRenderGraphUsage::DepthAttachment : TRenderGraphUsage::Acquire, TRenderGraphUsage::DepthAttachment);
+
+	const bool culled = Culling.IsEnabled();
+	TVulkanCullOutput cullOutput;
+	if (culled)
+	{
+		TVulkanCullView cullView;
+		cullView.ViewProjection = viewProjection;
+		// The pyramid is built from the last frame's depth before this frame's mesh pass clears it.
+		if (DepthRendered)
+		{
+			cullView.Depth = DepthImage;
+			cullView.DepthView = DepthView;
+			cullView.PreviousViewProjection = DepthViewProjection;
+		}
+		cullOutput = Culling.AddPasses(frame.Graph, cullView);
 	}
 
+	const int32 pass = frame.Graph.AddPass("Meshes", [=](VkCommandBuffer commandBuffer) {
+		const TBeginRenderPassCommand beginCommand = {};
+		VkRenderPass renderPass = BeginRenderPass(commandBuffer, beginCommand, view, VK_SUBPASS_CONTENTS_INLINE, depthView);
+		// Skipped until the pipeline is compiled, no fallback reads TVertex.
+		VkPipeline pipeline = GetPipeline(renderPass, MeshPipelineDesc);
+		if (pipeline != VK_NULL_HANDLE)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			UniformRing.Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout, UniformRing.Upload(&viewProjection, sizeof(viewProjection)));
+			const TMeshDrawIndices drawIndices = { MeshBuffer.GetInstanceSlot(), culled ? Culling.GetVisibleSlot() : ~0u };
+			Bindless.Push(commandBuffer, PipelineLayout, &drawIndices, sizeof(drawIndices));
+			if (culled)
+				Culling.Draw(commandBuffer);
+			else
+				MeshBuffer.Draw(commandBuffer);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+	});
+	if (culled)
 	{
-		VkPresentInfoKHR presentInfoKHR = {};
-		presentInfoKHR.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-		presentInfoKHR.pNext = nullptr;
-		presentInfoKHR.waitSemaphoreCount = 1;
-		presentInfoKHR.pWaitSemaphores = &renderingFinishedSemaphore;
-		presentInfoKHR.swapchainCount = 1;
-		presentInfoKHR.pSwapchains = &SwapChain.Handle;
-		presentInfoKHR.pImageIndices = &i;
-		presentInfoKHR.pResults = nullptr;
+		frame.Graph.Read(pass, cullOutput.Commands, TRenderGraphUsage::IndirectBuffer);
+		frame.Graph.Read(pass, cullOutput.Counters, TRenderGraphUsage::IndirectBuffer);
+		frame.Graph.Read(pass, cullOutput.Visible, TRenderGraphUsage::ShaderRead);
+	}
+	frame.Graph.Write(pass, frame.BackBuffer, TRenderGraphUsage::ColorAttachment);
+	if (depth)
+	{
+		frame.Graph.Write(pass, depthImage, TRenderGraphUsage::DepthAttachment);
+		DepthRendered = true;
+		DepthViewProjection = viewProjection;
+	}
+}
 
-		result = vkQueuePresentKHR(Queues[Present], &presentInfoKHR);
-		ASSERT(result == VK_SUCCESS);
+void TVulkanAPI::HelloWorld()
+{
+	TVulkanFrame &frame = BeginFrame();
+
+	// Device local and uploaded once, the copy is submitted ahead of the first frame that draws with it. The staging
+	// ring's barrier makes it visible to vertex input.
+	if (VertexBuffer == nullptr)
+	{
+		VertexBuffer = static_cast<TVulkanBuffer*>(CreateBuffer(sizeof(VertexData)));
+		UploadVertexData(VertexBuffer);
+		HelloTrianglePipeline = CreatePipeline(GetHelloTriangleDesc());
 	}
+
+	// Translated into a secondary command buffer on a worker, as every list of a frame recorded by several threads would be.
+	HelloTriangleCommands.Reset();
+	HelloTriangleCommands.ContinueRenderPass();
+	HelloTriangleCommands.BindPipeline(HelloTrianglePipeline);
+	HelloTriangleCommands.BindVertexBuffer(VertexBuffer);
+	HelloTriangleCommands.Draw(4);
+	HelloTriangleCommands.EndRenderPass();
+
+	const float32 clearColor[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+	const TCommandList *lists[] = { &HelloTriangleCommands };
+	Submit(clearColor, lists, ArrayLength(lists));
+
+	// Spheres along the top and a large one below, the shaders find their instances in the bindless heap. Each is
+	// drawn at the level of detail whose error stays under a pixel on screen. With culling only the ones in view and
+	// not behind the previous frame's depth are drawn, the statistics it reads back count them.
+	if (Bindless.IsEnabled())
+	{
+		const Matrix4x4 viewProjection = Matrix4x4::Identity();
+		if (HelloMeshes.empty())
+		{
+			TMesh sphere;
+			BuildSphereMesh(sphere, 0.1f, 16u, 32u);
+			HelloMeshLods = BuildLodChain(sphere);
+			for (size_t level = 0; level < HelloMeshLods.Levels.size(); ++level)
+			{
+				const uint32 mesh = MeshBuffer.AddMesh(HelloMeshLods.Levels[level].Mesh);
+				if (mesh == TVulkanMeshBuffer::InvalidMesh)
+					break;
+				HelloMeshes.push_back(mesh);
+			}
+			// Levels the mesh buffer had no room for are never selected.
+			HelloMeshLods.Levels.resize(HelloMeshes.size());
+		}
+		for (uint32 i = 0; i < HelloMeshInstanceCount && !HelloMeshes.empty(); ++i)
+		{
+			TVulkanInstance instance = {};
+			const Vector4 &placement = HelloMeshPlacements[i];
+			instance.Transform[0][0] = placement.w;
+			instance.Transform[1][1] = placement.w;
+			instance.Transform[2][2] = placement.w;
+			instance.Transform[0][3] = placement.x;
+			instance.Transform[1][3] = placement.y;
+			instance.Transform[2][3] = placement.z;
+			const Matrix4x4 modelViewProjection = PlaceViewProjection(viewProjection, Vector3(placement.x, placement.y, placement.z), placement.w);
+			instance.Mesh = HelloMeshes[SelectLod(HelloMeshLods, modelViewProjection, float32(WindowHeight))];
+			MeshBuffer.AddInstance(instance);
+		}
+		AddMeshPass(frame, viewProjection);
+	}
+
+	EndFrame();
+}
+
+void TVulkanAPI::ClearColor()
+{
+	TVulkanFrame &frame = BeginFrame();
+	TRenderGraph &graph = frame.Graph;
+	VkImage image = graph.GetImage(frame.BackBuffer);
+	const uint32 i = frame.ImageIndex;
+
+	const int32 pass = graph.AddPass("ClearColor", [=](VkCommandBuffer commandBuffer) {
+		VkImageSubresourceRange imageSubresourceRange = {};
+		imageSubresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageSubresourceRange.baseMipLevel = 0;
+		imageSubresourceRange.levelCount = 1;
+		imageSubresourceRange.baseArrayLayer = 0;
+		imageSubresourceRange.layerCount = 1;
+
+		VkClearColorValue clearColorValue = {};
+		clearColorValue.float32[0] = 0.0f;
+		clearColorValue.float32[1] = i ? 1.0f : 0.0f;
+		clearColorValue.float32[2] = 1.0f;
+		clearColorValue.float32[3] = 1.0f;
+
+		vkCmdClearColorImage(
+			commandBuffer, 
+			image, 
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+			&clearColorValue,
+			1, &imageSubresourceRange
+		);
+	});
+	graph.Write(pass, frame.BackBuffer, TRenderGraphUsage::TransferDestination);
+
+	EndFrame();
 }
 
 void TVulkanAPI::Init(const IWindow *window)
 {
+	HostAllocator.Init();
+	Allocator = HostAllocator.GetCallbacks();
+	Headless = window == nullptr;
 	InitLib();
 	InitInstance();
-	InitBackBuffer(window);
+	if (!Headless)
+		InitBackBuffer(window);
 	InitDevice();
-	InitSwapChain();
-	vkGetDeviceQueue(Device, 0, 0, &Queues[Graphics]);
-	vkGetDeviceQueue(Device, 0, 0, &Queues[Present]);
-	InitCommandPool();
-
-	renderingFinishedSemaphore = CreateSemaphore();
-	imageAvailableSemaphore = CreateSemaphore();
+	MemoryManager.Init(PhysicalDevice, Device, Allocator);
+	DeletionQueue.Init(Device, Allocator, &MemoryManager);
+	if (BindlessSupported)
+		Bindless.Init(PhysicalDevice, Device, Allocator);
+	// Constants, instances and draws are read by the culling on the compute queue as well.
+	TVulkanBufferSharing computeSharing;
+	computeSharing.Add(QueueFamilies[Graphics]);
+	computeSharing.Add(QueueFamilies[Compute]);
+	UniformRing.Init(PhysicalDevice, Device, Allocator, &MemoryManager, UniformRingSize, computeSharing);
+	PipelineLayout = CreatePipelineLayout();
+	PipelineCache.Init(PhysicalDevice, Device, Allocator, PipelineCachePath);
+	ShaderCache.Init(ShaderCachePath, ShaderCompilerPath);
+	if (Headless)
+		InitOffscreen();
+	else
+		InitSwapChain();
+	InitDepth();
+	CompileFallbackPipelines();
+	for (uint32 queueType = 0; queueType < QueueTypeCount; ++queueType)
+		vkGetDeviceQueue(Device, QueueFamilies[queueType], 0, &Queues[queueType]);
+	// Without inherited queries, executing the command lists' secondary command buffers in a pass would be invalid
+	// while its statistics query is active.
+	Profiler.Init(PhysicalDevice, Device, Allocator, Queues[Graphics], QueueFamilies[Graphics],
+		EnabledFeatures.pipelineStatisticsQuery == VK_TRUE && EnabledFeatures.inheritedQueries == VK_TRUE);
+	InitFrames();
+	StagingRing.Init(Device, Allocator, &MemoryManager, Queues[Transfer], QueueFamilies[Transfer], Queues[Graphics], QueueFamilies[Graphics], StagingRingSize);
+	StagingRing.ShareDestinations(QueueFamilies[Compute]);
+
+	TVulkanMeshBuffer::TFeatures meshFeatures;
+	meshFeatures.MultiDrawIndirect = EnabledFeatures.multiDrawIndirect && EnabledFeatures.drawIndirectFirstInstance;
+	meshFeatures.DrawIndirectCount = EnabledFeatures12.drawIndirectCount == VK_TRUE;
+	MeshBuffer.Init(Device, Allocator, &MemoryManager, &StagingRing, &Bindless, meshFeatures, MaxInstances, computeSharing);
+	Culling.Init(Device, Allocator, &MemoryManager, Queues[Compute], QueueFamilies[Compute], Queues[Graphics], QueueFamilies[Graphics], &ShaderCache,
+		PipelineCache.GetHandle(), &UniformRing, &Bindless, &MeshBuffer, WindowWidth, WindowHeight);
+	TextureStreamer.Init(this, TextureBudget, MaxFramesInFlight);
 }	
 
 void TVulkanAPI::DoneLib()
 {
-	FreeLibrary(Library);
+	CloseLibrary(Library);
 	Library = nullptr;
 }
 
@@ -1219,20 +2308,104 @@ void TVulkanAPI::DoneDevice()
 
 void TVulkanAPI::DoneSwapChain()
 {
-	// TODO: Move from DoneVulkanSwapChain
+	for (uint32 i = 0; i < SwapChain.ImageCount; ++i)
+	{
+		vkDestroyImageView(Device, SwapChain.Views[i], Allocator);
+		// Swap chain images go with the swap chain.
+		if (Headless)
+		{
+			vkDestroyImage(Device, SwapChain.Images[i], Allocator);
+			MemoryManager.Free(SwapChain.Memory[i]);
+		}
+	}
+	if (!Headless)
+		vkDestroySwapchainKHR(Device, SwapChain.Handle, Allocator);
+	SwapChain = TVulkanSwapChain();
+}
+
+void TVulkanAPI::DoneDepth()
+{
+	if (DepthFormat == VK_FORMAT_UNDEFINED)
+		return;
+	vkDestroyImageView(Device, DepthView, Allocator);
+	vkDestroyImage(Device, DepthImage, Allocator);
+	MemoryManager.Free(DepthMemory);
+	DepthFormat = VK_FORMAT_UNDEFINED;
+	DepthRendered = false;
 }
 
-void TVulkanAPI::DoneCommandPool()
+void TVulkanAPI::DoneFrames()
 {
-	vkDestroyCommandPool(Device, Pool, Allocator);
+	for (auto &frame : Frames)
+	{
+		RecycleFrame(frame);
+		vkDestroyFence(Device, frame.Fence, Allocator);
+		vkDestroySemaphore(Device, frame.ImageAvailable, Allocator);
+		vkDestroySemaphore(Device, frame.RenderingFinished, Allocator);
+		frame.Graph.Done();
+		if (frame.Readback != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(Device, frame.Readback, Allocator);
+			MemoryManager.Free(frame.ReadbackMemory);
+		}
+		// Frees the command buffers as well.
+		for (size_t i = 0; i < frame.Threads.size(); ++i)
+			vkDestroyCommandPool(Device, frame.Threads[i].Pool, Allocator);
+		frame = TVulkanFrame();
+	}
 }
 
 void TVulkanAPI::Done()
 {
-	DoneCommandPool();
+	vkDeviceWaitIdle(Device);
+
+	// The frames still in flight, oldest first.
+	for (uint32 i = 0; i < MaxFramesInFlight; ++i)
+	{
+		DeliverReadback(Frames[(FrameIndex + i) % MaxFramesInFlight]);
+		if (Culling.IsEnabled())
+			Culling.ReadStatistics(uint32((FrameIndex + i) % MaxFramesInFlight));
+	}
+
+	Profiler.Done();
+	Profiler.Export(ProfilePath);
+
+	if (PresentStatistics.FrameCount != 0u)
+	{
+		const float64 frameCount = float64(PresentStatistics.FrameCount);
+		DebugPrint("Present: %u images, %llu frames, acquire to present %.3f ms average, %.3f ms max, %.3f ms average acquire wait\n",
+			SwapChain.ImageCount, (unsigned long long)PresentStatistics.FrameCount, float64(PresentStatistics.TotalLatency) / frameCount * 1e-6,
+			float64(PresentStatistics.MaxLatency) * 1e-6, float64(PresentStatistics.TotalAcquireWait) / frameCount * 1e-6);
+	}
+
+	delete VertexBuffer;
+	VertexBuffer = nullptr;
+	delete HelloTrianglePipeline;
+	HelloTrianglePipeline = nullptr;
+
+	TextureStreamer.Done();
+	Culling.Done();
+	MeshBuffer.Done();
+	StagingRing.Done();
+	EvictStateObjects();
+	DoneFrames();
+	DoneDepth();
 	DoneSwapChain();
+	ShaderCache.Done();
+	PipelineCache.Done();
+	DestroyPipelineLayout(PipelineLayout);
+	PipelineLayout = VK_NULL_HANDLE;
+	UniformRing.Done();
+	if (Bindless.IsEnabled())
+		Bindless.Done();
+	DeletionQueue.Done();
+	MemoryManager.Done();
 	DoneDevice();
-	DoneBackBuffer();
+	if (!Headless)
+		DoneBackBuffer();
 	DoneInstance();
     DoneLib();
+	HostAllocator.PrintStatistics();
+	HostAllocator.Done();
+	Allocator = nullptr;
 }
\ No newline at end of file
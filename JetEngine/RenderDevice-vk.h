@@ -1,33 +1,110 @@
 #pragma once
 
-#define VK_USE_PLATFORM_WIN32_KHR
+#if defined(_WIN32)
+#	define VK_USE_PLATFORM_WIN32_KHR
+#endif
+// Every entry point is loaded at runtime, device level ones straight from the driver without the loader's dispatch.
+#define VK_NO_PROTOTYPES
 #include <vulkan/vulkan.h>
 
-//#define VK_DEFINE_FUNCTION(name) extern PFN_##name name
-//#define VK_GLOBAL_LEVEL_FUNCTION(name) VK_DEFINE_FUNCTION(name)
-//#define VK_INSTANCE_LEVEL_FUNCTION(name) VK_DEFINE_FUNCTION(name)
-//#define VK_DEVICE_LEVEL_FUNCTION(name) VK_DEFINE_FUNCTION(name)
-//
-//#include "VulkanFunctions.h"
+#define VK_DEFINE_FUNCTION(name) extern PFN_##name name
+#define VK_EXPORTED_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_GLOBAL_LEVEL_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_INSTANCE_LEVEL_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_SURFACE_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_DEVICE_LEVEL_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_DEVICE_1_2_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+#define VK_SWAPCHAIN_FUNCTION(name) VK_DEFINE_FUNCTION(name)
+
+#include "VulkanFunctions.h"
 
 #undef VK_DEFINE_FUNCTION
 
 #include "RenderDevice.h"
+#include "JobSystem.h"
+#include "HostAllocator-vk.h"
+#include "DeviceMemory-vk.h"
+#include "StagingRing-vk.h"
+#include "DeletionQueue-vk.h"
+#include "BindlessHeap-vk.h"
+#include "UniformRing-vk.h"
+#include "MeshBuffer-vk.h"
+#include "MeshSimplifier.h"
+#include "PipelineCache-vk.h"
+#include "ShaderCache-vk.h"
+#include "Profiler-vk.h"
+#include "RenderGraph.h"
+#include "Culling-vk.h"
+#include "TextureStreamer.h"
+#include "CommandList.h"
+#include "Core/Containers/HashMap.h"
+
+// How the swap chain's present mode and image count are picked.
+enum class TVulkanPresentPolicy : uint8
+{
+	// MAILBOX, else IMMEDIATE, else FIFO, with as few images as the mode gets by with.
+	LowLatency,
+	// FIFO with three images, so a frame that runs long does not hold the CPU behind the GPU and vsync.
+	Throughput,
+};
 
 class TVulkanSwapChain final : public ISwapChain
 {
 private:
 	friend class TVulkanAPI;
 
+	static constexpr uint32 MaxImages = 8u;
+
 	VkSwapchainKHR Handle = VK_NULL_HANDLE;
-	VkImage Images[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
-	VkImageView Views[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	VkPresentModeKHR PresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	// Of the images, the surface's or the offscreen one's.
+	VkFormat Format = VK_FORMAT_UNDEFINED;
+	uint32 ImageCount = 0u;
+	VkImage Images[MaxImages] = {};
+	VkImageView Views[MaxImages] = {};
+	// Headless only, the images are offscreen ones owned by the engine instead of the swap chain's.
+	TVulkanAllocation Memory[MaxImages];
 };
 
+// CPU side, in nanoseconds. The driver's own queueing after vkQueuePresentKHR is not visible without
+// present timing extensions.
+struct TVulkanPresentStatistics
+{
+	uint64 FrameCount = 0u;
+	// From vkAcquireNextImageKHR returning to vkQueuePresentKHR being called.
+	int64 LastLatency = 0;
+	int64 MaxLatency = 0;
+	int64 TotalLatency = 0;
+	// Blocked in vkAcquireNextImageKHR waiting for an image.
+	int64 LastAcquireWait = 0;
+	int64 TotalAcquireWait = 0;
+};
+
+// Pixels of a headless frame, only valid during the call to the readback handler.
+struct TVulkanReadback
+{
+	const uint8 *Pixels = nullptr;
+	VkFormat Format = VK_FORMAT_UNDEFINED;
+	uint32 Width = 0u;
+	uint32 Height = 0u;
+	uint32 RowPitch = 0u;
+	uint64 FrameIndex = 0u;
+};
+
+using TVulkanReadbackHandler = void (*)(void *userData, const TVulkanReadback &readback);
+
+// Device local, optimal tiling image with every level of the texture, sampled in SHADER_READ_ONLY_OPTIMAL.
 class TVulkanTexture final : public IGraphicsTexture
 {
 public:
+	using IGraphicsTexture::IGraphicsTexture;
+	~TVulkanTexture();
 
+	VkImage ResourceHandle = VK_NULL_HANDLE;
+	VkImageView View = VK_NULL_HANDLE;
+	TVulkanAllocation Memory;
+	// Slot of View in the bindless heap, ~0u when the heap is disabled.
+	uint32 BindlessSlot = ~0u;
 };
 
 class TVulkanBuffer final : public IGraphicsBuffer
@@ -36,48 +113,318 @@ public:
 	using IGraphicsBuffer::IGraphicsBuffer;
 	~TVulkanBuffer();
 
-	VkBuffer ResourceHandle;
-	VkDeviceMemory MemoryHandle;
+	VkBuffer ResourceHandle = VK_NULL_HANDLE;
+	TVulkanAllocation Memory;
+};
+
+// Command pools are externally synchronized, so every thread records from a pool of its own.
+struct TVulkanThreadCommands
+{
+	// Reset as a whole when the frame is recycled instead of freeing command buffers one by one.
+	VkCommandPool Pool = VK_NULL_HANDLE;
+	// Allocated on demand and reused by later frames, the pool reset resets them as well.
+	TVarArray<VkCommandBuffer> SecondaryBuffers;
+	uint32 SecondaryUsed = 0u;
+};
+
+// Keys of the state object caches. They are hashed and compared as raw bytes, so they are laid out without padding
+// and zero initialized before they are filled in all the same.
+struct TVulkanRenderPassKey
+{
+	VkFormat ColorFormat;
+	VkAttachmentLoadOp LoadOp;
+	VkImageLayout FinalLayout;
+	// VK_FORMAT_UNDEFINED without a depth attachment. It is cleared and stored, left in the attachment layout.
+	VkFormat DepthFormat;
+};
+
+struct TVulkanFramebufferKey
+{
+	VkRenderPass RenderPass;
+	VkImageView View;
+	VkImageView DepthView;
+	uint32 Width;
+	uint32 Height;
+};
+
+// Shaders are HLSL sources named by path, with VS_main and PS_main as entry points. They only go through the
+// shader cache when the pipeline is not in the cache yet.
+struct TVulkanPipelineDesc
+{
+	const char *VertexShader;
+	const char *PixelShader;
+	VkPrimitiveTopology Topology;
+	uint32 VertexStride;
+	VkFormat VertexFormat;
+	// For both shaders, see TShaderCache::Load.
+	const char *Defines = nullptr;
+	// Drawn with while this pipeline compiles, it has to work with the same render pass and vertex input and be
+	// compiled up front, see CompileFallbackPipelines.
+	const TVulkanPipelineDesc *Fallback = nullptr;
+	// Of binding 0, VertexStride apart. When null, a single attribute of VertexFormat at offset 0.
+	const VkVertexInputAttributeDescription *VertexAttributes = nullptr;
+	uint32 VertexAttributeCount = 0u;
+	// Depth is neither tested nor written with the defaults, anything else needs a render pass with depth.
+	VkCompareOp DepthCompareOp = VK_COMPARE_OP_ALWAYS;
+	bool DepthWrite = false;
+};
+
+// Looked up in the pipeline cache with the render pass of each draw.
+class TVulkanPipeline final : public IGraphicsPipeline
+{
+public:
+	using IGraphicsPipeline::IGraphicsPipeline;
+
+	TVulkanPipelineDesc VulkanDesc = {};
+};
+
+struct TVulkanPipelineKey
+{
+	VkRenderPass RenderPass;
+	uint64 VertexShaderHash;
+	uint64 PixelShaderHash;
+	uint64 VertexAttributesHash;
+	VkPrimitiveTopology Topology;
+	uint32 VertexStride;
+	VkFormat VertexFormat;
+	uint32 Subpass;
+	// Viewport and scissor are baked into the pipeline.
+	uint32 Width;
+	uint32 Height;
+	VkCompareOp DepthCompareOp;
+	uint32 DepthWrite;
+};
+
+static_assert(sizeof(TVulkanRenderPassKey) == 4 * sizeof(uint32));
+static_assert(sizeof(TVulkanFramebufferKey) == sizeof(VkRenderPass) + 2 * sizeof(VkImageView) + 2 * sizeof(uint32));
+static_assert(sizeof(TVulkanPipelineKey) == sizeof(VkRenderPass) + 3 * sizeof(uint64) + 8 * sizeof(uint32));
+
+class TVulkanAPI;
+
+// Pipeline compiled by a background job. Pipeline is written before Ready is set, so whoever sees Ready
+// can use it without taking a lock.
+struct TVulkanPipelineRequest
+{
+	TVulkanAPI *API;
+	VkRenderPass RenderPass;
+	TVulkanPipelineDesc Desc;
+	VkPipeline Pipeline;
+	volatile LONG Ready;
+};
+
+// Everything one frame needs until the GPU is done with it, recycled once Fence signals.
+struct TVulkanFrame
+{
+	VkFence Fence = VK_NULL_HANDLE;
+	VkSemaphore ImageAvailable = VK_NULL_HANDLE;
+	VkSemaphore RenderingFinished = VK_NULL_HANDLE;
+	// Indexed by Jobs::GetThreadIndex().
+	TVarArray<TVulkanThreadCommands> Threads;
+	// Primary command buffer, allocated from the pool of the thread that called Init.
+	VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+	uint32 ImageIndex = 0u;
+	// Profiler time vkAcquireNextImageKHR returned at.
+	int64 AcquireTime = 0;
+
+	// Passes added during the frame are recorded by EndFrame, after whatever went into CommandBuffer directly.
+	TRenderGraph Graph;
+	// The acquired swap chain image, imported into Graph and left ready for present.
+	TRenderGraphResource BackBuffer;
+
+	// Headless only, host visible copy of the frame's image, created on the first readback.
+	VkBuffer Readback = VK_NULL_HANDLE;
+	TVulkanAllocation ReadbackMemory;
+	bool ReadbackPending = false;
+	uint64 ReadbackFrameIndex = 0u;
 };
 
 class TVulkanAPI final : public IGraphicsAPI
 {
 public:
+	static constexpr uint32 MaxFramesInFlight = 2u;
+	static_assert(TVulkanProfiler::MaxFrames == MaxFramesInFlight);
+	static_assert(TVulkanUniformRing::MaxFrames == MaxFramesInFlight);
+	static_assert(TVulkanMeshBuffer::MaxFrames == MaxFramesInFlight);
+	static_assert(TVulkanCulling::MaxFrames == MaxFramesInFlight);
+	static_assert(TCommandList::MaxPushConstantSize == TVulkanBindlessHeap::PushConstantSize);
+
+	// Without a window the device renders headless, into offscreen images instead of a swap chain, and frames
+	// are not presented. Nothing but a graphics queue is needed then, which software drivers have as well.
 	void Init(const IWindow*) override;
 	void Done() override;
 
 	IGraphicsBuffer *CreateBuffer(int32 size) override;
+	// Uploaded through the staging ring, ready for everything submitted after the frame being recorded. Generated
+	// levels need a format with linear filtering and blits, the BC formats need textureCompressionBC.
+	IGraphicsTexture *CreateTexture(const TTextureDesc &desc, const void *data, uint32 levelCount) override;
+	IGraphicsPipeline *CreatePipeline(const TPipelineDesc &desc) override;
+	// Adds a render graph pass that writes the back buffer and translates the list into its command buffer. The
+	// buffers the list uses are left to its own barriers. Push constants need the bindless heap's pipeline layout.
+	// The pass runs in EndFrame and reads the list then, it has to be alive until EndFrame returns.
+	void Submit(const TCommandList &list) override;
+	// One pass as well, each list is translated into a secondary command buffer of its own by RecordParallel.
+	void Submit(const float32 *clearColor, const TCommandList *const *lists, int32 count) override;
+
+	// Waits until the GPU is done with the frame MaxFramesInFlight frames back, recycles its resources,
+	// acquires the next swap chain image and begins the frame's command buffer.
+	TVulkanFrame &BeginFrame();
+	// Records the frame's render graph, submits the command buffer, signaling the fence, and presents.
+	void EndFrame();
+
+	bool IsHeadless() const {
+		return Headless;
+	}
+
+	// Recreates the swap chain when the policy changes, LowLatency until then. Does nothing headless.
+	void SetPresentPolicy(TVulkanPresentPolicy policy);
+
+	const TVulkanPresentStatistics &GetPresentStatistics() const {
+		return PresentStatistics;
+	}
+
+	// Objects released here with GetFrameIndex() are destroyed once the GPU has finished the current frame.
+	TVulkanDeletionQueue &GetDeletionQueue() {
+		return DeletionQueue;
+	}
+
+	// Only enabled on devices with descriptor indexing. Bound to every frame and secondary command buffer, and
+	// part of every pipeline layout.
+	TVulkanBindlessHeap &GetBindlessHeap() {
+		return Bindless;
+	}
+
+	// Per draw constants of the frame being recorded, bound with GetPipelineLayout().
+	TVulkanUniformRing &GetUniformRing() {
+		return UniformRing;
+	}
+
+	// Meshes are added once, instances every frame. The frame's draws are built by EndFrame before its render
+	// graph executes, so passes call Draw.
+	TVulkanMeshBuffer &GetMeshBuffer() {
+		return MeshBuffer;
+	}
+
+	// GPU culling of the mesh buffer's instances, for frames whose depth is the size of the back buffer. Disabled
+	// without multiDrawIndirect, draw with the mesh buffer then.
+	TVulkanCulling &GetCulling() {
+		return Culling;
+	}
+	// Spheres HelloWorld draws through the mesh buffer when the bindless heap is enabled, and how many of them are
+	// inside the view and not hidden behind the large one, which is what culling them leaves once a frame's depth
+	// is there to test against.
+	static constexpr uint32 HelloMeshInstanceCount = 8u;
+	static constexpr uint32 HelloMeshVisibleCount = 5u;
+
+	// Textures streamed from files under a budget of device memory. Updated by BeginFrame, so the usage reported
+	// while a frame is recorded picks the levels loaded for the frames after it.
+	TTextureStreamer &GetTextureStreamer() {
+		return TextureStreamer;
+	}
+
+	// Shared by every pipeline: the uniform ring's set, the bindless heap's set and the push constant range.
+	VkPipelineLayout GetPipelineLayout() const {
+		return PipelineLayout;
+	}
+
+	// The frame being recorded, or the next one between EndFrame and BeginFrame.
+	uint64 GetFrameIndex() const {
+		return FrameIndex;
+	}
+
+	// Frames and render graph passes are profiled already, the timeline is exported on Done.
+	TVulkanProfiler &GetProfiler() {
+		return Profiler;
+	}
+
+	// Headless only. The next frame to end copies its image to host memory. The copy is handed to the readback
+	// handler once the GPU is done with the frame, from the BeginFrame that recycles it or from Done, never stalling.
+	void RequestReadback();
+	void SetReadbackHandler(TVulkanReadbackHandler handler, void *userData);
+
+	// Records [0, count) into one secondary command buffer per batch of batchSize, spread over the job system,
+	// and executes them from the frame's command buffer in batch order. The render pass has to be begun with
+	// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. record(commandBuffer, begin, end) runs on worker threads.
+	template <typename TFunction>
+	void RecordParallel(TVulkanFrame &frame, VkRenderPass renderPass, uint32 subpass, VkFramebuffer framebuffer, int32 count, int32 batchSize, const TFunction &record)
+	{
+		if (count <= 0)
+			return;
+
+		const int32 batchCount = DivCeil(count, batchSize);
+		VkCommandBuffer *commandBuffers = ALLOCA(VkCommandBuffer, batchCount);
+		Jobs::ParallelFor(batchCount, 1, [&](int32 batch) {
+			const int32 begin = batch * batchSize;
+			VkCommandBuffer commandBuffer = BeginSecondaryCommandBuffer(frame, renderPass, subpass, framebuffer);
+			record(commandBuffer, begin, Min(begin + batchSize, count));
+			EndSecondaryCommandBuffer(commandBuffer);
+			commandBuffers[batch] = commandBuffer;
+		});
+		vkCmdExecuteCommands(frame.CommandBuffer, uint32(batchCount), commandBuffers);
+	}
 
 	void HelloWorld();
 
 private:
 	friend TVulkanBuffer;
+	friend TVulkanTexture;
 
 	void InitLib();
 	void InitInstance();
 	void InitDevice();
+	void LoadDeviceFunctions();
 	void InitBackBuffer(const IWindow*);
 	void InitSwapChain();
-	void InitCommandPool();
+	void InitOffscreen();
+	void InitFrames();
+	void InitDepth();
 
 	void DoneLib();
 	void DoneBackBuffer();
 	void DoneInstance();
 	void DoneDevice();
 	void DoneSwapChain();
-	void DoneCommandPool();
+	void DoneFrames();
+	void DoneDepth();
 
 	void ClearColor();
 	VkSemaphore CreateSemaphore();
+	VkFence CreateFence(bool signaled);
+	void RecycleFrame(TVulkanFrame &frame);
+	void AddReadbackPass(TVulkanFrame &frame);
+	// Render passes draw into view, an image of the back buffer's format and size.
+	// Draws into an image of the back buffer's format, LoadOp as given, and into a cleared DepthFormat image with depth.
+	VkRenderPass GetBackBufferRenderPass(VkAttachmentLoadOp loadOp, bool depth = false);
+	// With depthView, a view of DepthImage, the render pass has the depth attachment.
+	VkRenderPass BeginRenderPass(VkCommandBuffer commandBuffer, const TBeginRenderPassCommand &command, VkImageView view, VkSubpassContents contents,
+		VkImageView depthView = VK_NULL_HANDLE);
+	// renderPass is the one a continued list draws into, VK_NULL_HANDLE for lists that begin their own.
+	void ExecuteCommandList(VkCommandBuffer commandBuffer, const TCommandList &list, VkImageView view, VkRenderPass renderPass);
+	void DeliverReadback(TVulkanFrame &frame);
+	// Draws the mesh buffer's instances into the back buffer, after what the frame drew so far.
+	void AddMeshPass(TVulkanFrame &frame, const Matrix4x4 &viewProjection);
+	// Created on first use and kept until the swap chain is recreated.
+	VkRenderPass GetRenderPass(const TVulkanRenderPassKey &key);
+	VkFramebuffer GetFramebuffer(VkRenderPass renderPass, VkImageView imageView, VkImageView depthView = VK_NULL_HANDLE);
+	TVulkanPipelineKey GetPipelineKey(VkRenderPass renderPass, const TVulkanPipelineDesc &desc) const;
+	// Compiled on a worker the first time it is asked for. Until it is ready this returns the fallback's pipeline,
+	// or VK_NULL_HANDLE and the draw has to be skipped.
+	VkPipeline GetPipeline(VkRenderPass renderPass, const TVulkanPipelineDesc &desc);
+	// On the calling thread, for both back buffer render passes. Again whenever the state objects were evicted.
+	void CompileFallbackPipelines();
+	static void CompilePipeline(void *data, int32 begin, int32 end);
+	// Waits for the pipelines still compiling and destroys every cached state object, the GPU must not be using any of them.
+	void EvictStateObjects();
 	void DestroyPipeline(VkPipeline pipeline);
-	VkPipeline CreatePipeline(VkRenderPass renderPass);
-	VkCommandBuffer CreateCommandBuffer();
-	void DestroyCommandBuffer(VkCommandBuffer commandBuffer);
-	VkRenderPass CreateRenderPass();
+	VkPipeline CreatePipeline(VkRenderPass renderPass, const TVulkanPipelineDesc &desc);
+	VkCommandBuffer CreateCommandBuffer(VkCommandPool pool, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	// Takes a secondary command buffer from the calling thread's pool and begins it inside the render pass.
+	VkCommandBuffer BeginSecondaryCommandBuffer(TVulkanFrame &frame, VkRenderPass renderPass, uint32 subpass, VkFramebuffer framebuffer);
+	void EndSecondaryCommandBuffer(VkCommandBuffer commandBuffer);
+	VkRenderPass CreateRenderPass(const TVulkanRenderPassKey &key);
 	void DestroyRenderPass(VkRenderPass renderPass);
-	VkFramebuffer CreateFramebuffer(VkImageView imageView, VkRenderPass renderPass);
+	VkFramebuffer CreateFramebuffer(VkImageView imageView, VkImageView depthView, VkRenderPass renderPass);
 	void DestroyFramebuffer(VkFramebuffer framebuffer);
-	void UploadVertexData(VkDeviceMemory deviceMemory);
+	void UploadVertexData(const TVulkanBuffer *buffer);
 	VkPipelineLayout CreatePipelineLayout();
 	void DestroyPipelineLayout(VkPipelineLayout pipelineLayout);
 	VkShaderModule CreateShaderModule(const uint32 *shader, uint32 size);
@@ -87,10 +434,63 @@ private:
 	VkInstance Instance = VK_NULL_HANDLE;
 	VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
 	VkDevice Device = VK_NULL_HANDLE;
-	VkAllocationCallbacks *Allocator = nullptr;
+	TVulkanHostAllocator HostAllocator;
+	const VkAllocationCallbacks *Allocator = nullptr;
 	VkSurfaceKHR BackBuffer = VK_NULL_HANDLE;
 	TVulkanSwapChain SwapChain;
+	TVulkanMemoryManager MemoryManager;
+	TVulkanStagingRing StagingRing;
+	TVulkanDeletionQueue DeletionQueue;
+	TVulkanBindlessHeap Bindless;
+	bool BindlessSupported = false;
+	TVulkanUniformRing UniformRing;
+	TVulkanMeshBuffer MeshBuffer;
+	TVulkanCulling Culling;
+	TTextureStreamer TextureStreamer;
+	VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+	TVulkanPipelineCache PipelineCache;
+	TShaderCache ShaderCache;
+	TVulkanProfiler Profiler;
+	VkPhysicalDeviceFeatures EnabledFeatures = {};
+	// All false on devices before 1.2.
+	VkPhysicalDeviceVulkan12Features EnabledFeatures12 = {};
+	int64 FrameBeginTime = 0;
 
-	VkQueue Queues[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
-	VkCommandPool Pool = VK_NULL_HANDLE;
+	// Indexed by QueueType, transfer and compute share the graphics queue on devices without families for them.
+	VkQueue Queues[4] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+	uint32 QueueFamilies[4] = {};
+	TVulkanFrame Frames[MaxFramesInFlight];
+	uint64 FrameIndex = 0u;
+
+	// Depth of the mesh pass, the size of the back buffer and shared by the frames as their graphs order the accesses.
+	// The next frame builds the culling's depth pyramid from it. VK_FORMAT_UNDEFINED when the device cannot sample it.
+	VkFormat DepthFormat = VK_FORMAT_UNDEFINED;
+	VkImage DepthImage = VK_NULL_HANDLE;
+	TVulkanAllocation DepthMemory;
+	VkImageView DepthView = VK_NULL_HANDLE;
+	// Whether a frame drew into DepthImage yet, and with which matrix the last one did.
+	bool DepthRendered = false;
+	Matrix4x4 DepthViewProjection;
+
+	THashMap<TVulkanRenderPassKey, VkRenderPass> RenderPasses;
+	THashMap<TVulkanFramebufferKey, VkFramebuffer> Framebuffers;
+	// Requests are added by the threads translating command lists, under PipelinesLock, and removed by the render
+	// thread. Compile jobs just fill them in.
+	THashMap<TVulkanPipelineKey, TVulkanPipelineRequest *> Pipelines;
+	SRWLOCK PipelinesLock = SRWLOCK_INIT;
+	Jobs::TCounter PipelineCompiles;
+
+	TVulkanBuffer *VertexBuffer = nullptr;
+	IGraphicsPipeline *HelloTrianglePipeline = nullptr;
+	TCommandList HelloTriangleCommands;
+	// Drawn through the mesh buffer, a mesh per level of the chain, empty until the first HelloWorld adds them.
+	TMeshLodChain HelloMeshLods;
+	TVarArray<uint32> HelloMeshes;
+
+	bool Headless = false;
+	TVulkanPresentPolicy PresentPolicy = TVulkanPresentPolicy::LowLatency;
+	TVulkanPresentStatistics PresentStatistics;
+	bool ReadbackRequested = false;
+	TVulkanReadbackHandler ReadbackHandler = nullptr;
+	void *ReadbackUserData = nullptr;
 };
\ No newline at end of file
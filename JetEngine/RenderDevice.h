@@ -9,9 +9,148 @@ class ISwapChain
 
 };
 
+enum class TTextureFormat : uint8
+{
+	RGBA8,
+	RGBA8Srgb,
+	// Block compressed, 4x4 texels per block.
+	BC1,
+	BC1Srgb,
+	BC3,
+	BC3Srgb,
+	BC5,
+	BC7,
+	BC7Srgb,
+};
+
+struct TTextureDesc
+{
+	uint32 Width = 1u;
+	uint32 Height = 1u;
+	// 0 for the whole chain down to 1x1.
+	uint32 MipCount = 0u;
+	TTextureFormat Format = TTextureFormat::RGBA8;
+};
+
+// Width and height in texels of the format's blocks.
+inline uint32 GetTextureBlockSize(TTextureFormat format)
+{
+	return format >= TTextureFormat::BC1 ? 4u : 1u;
+}
+
+inline uint32 GetTextureBlockBytes(TTextureFormat format)
+{
+	switch (format)
+	{
+	case TTextureFormat::BC1:
+	case TTextureFormat::BC1Srgb:
+		return 8u;
+	case TTextureFormat::BC3:
+	case TTextureFormat::BC3Srgb:
+	case TTextureFormat::BC5:
+	case TTextureFormat::BC7:
+	case TTextureFormat::BC7Srgb:
+		return 16u;
+	default:
+		return 4u;
+	}
+}
+
+inline uint32 GetTextureMipCount(uint32 width, uint32 height)
+{
+	uint32 mipCount = 1u;
+	while ((Max(width, height) >> mipCount) != 0u)
+		++mipCount;
+	return mipCount;
+}
+
+// Bytes of a level, its rows of blocks tightly packed.
+inline uint64 GetTextureLevelSize(const TTextureDesc &desc, uint32 level)
+{
+	const uint32 blockSize = GetTextureBlockSize(desc.Format);
+	const uint64 blocksX = DivCeil(Max(desc.Width >> level, 1u), blockSize);
+	const uint64 blocksY = DivCeil(Max(desc.Height >> level, 1u), blockSize);
+	return blocksX * blocksY * GetTextureBlockBytes(desc.Format);
+}
+
 class IGraphicsTexture
 {
+public:
+	IGraphicsTexture(IGraphicsAPI *parentDevice, const TTextureDesc &desc) :
+		ParentDevice(parentDevice), Desc(desc) {}
+	virtual ~IGraphicsTexture() = default;
+
+	// MipCount is never 0.
+	const TTextureDesc &GetDesc() const {
+		return Desc;
+	}
+
+protected:
+	IGraphicsAPI *ParentDevice;
+	TTextureDesc Desc;
+};
+
+enum class TPrimitiveTopology : uint8
+{
+	TriangleList,
+	TriangleStrip,
+	LineList,
+};
+
+// Of the single vertex attribute, at location 0.
+enum class TVertexFormat : uint8
+{
+	Float2,
+	Float3,
+	Float4,
+};
 
+enum class TIndexType : uint8
+{
+	Uint16,
+	Uint32,
+};
+
+// How a buffer is accessed on either side of a barrier.
+enum class TResourceState : uint8
+{
+	VertexBuffer,
+	IndexBuffer,
+	IndirectBuffer,
+	// Storage buffers read by vertex, fragment and compute shaders.
+	ShaderRead,
+	// Storage buffers written by compute shaders.
+	ShaderWrite,
+	TransferSource,
+	TransferDestination,
+};
+
+// Shaders are HLSL sources named by path, with VS_main and PS_main as entry points. The strings have to outlive
+// the pipeline.
+struct TPipelineDesc
+{
+	const char *VertexShader = nullptr;
+	const char *PixelShader = nullptr;
+	TPrimitiveTopology Topology = TPrimitiveTopology::TriangleList;
+	uint32 VertexStride = 0u;
+	TVertexFormat VertexFormat = TVertexFormat::Float3;
+	const char *Defines = nullptr;
+};
+
+class IGraphicsPipeline
+{
+public:
+	IGraphicsPipeline(IGraphicsAPI *parentDevice, const TPipelineDesc &desc) :
+		ParentDevice(parentDevice), Desc(desc) {}
+	virtual ~IGraphicsPipeline() = default;
+
+	const TPipelineDesc &GetDesc() const {
+		return Desc;
+	}
+
+protected:
+	IGraphicsAPI *ParentDevice;
+	TPipelineDesc Desc;
 };
 
 class IGraphicsBuffer
@@ -24,6 +163,8 @@ protected:
 	IGraphicsAPI *ParentDevice;
 };
 
+class TCommandList;
+
 class IGraphicsAPI
 {
 public:
@@ -31,4 +172,18 @@ public:
 	virtual void Done() = 0;
 
 	virtual IGraphicsBuffer *CreateBuffer(int32 size) = 0;
+	// data holds levelCount levels, from level 0 on, each tightly packed as GetTextureLevelSize says. Levels past
+	// them are generated from the last one where the format allows it, otherwise levelCount has to cover the chain.
+	virtual IGraphicsTexture *CreateTexture(const TTextureDesc &desc, const void *data, uint32 levelCount) = 0;
+	// Compiled for each render pass that draws with it, the first time one does.
+	virtual IGraphicsPipeline *CreatePipeline(const TPipelineDesc &desc) = 0;
+	// Queues the list for the frame being recorded, lists execute in the order they are submitted. Only a pointer to
+	// it is kept and the commands are read when the frame is submitted, so the list has to outlive the frame's end and
+	// stay unchanged until then.
+	virtual void Submit(const TCommandList &list) = 0;
+	// Draws the lists into one render pass of the back buffer, cleared to clearColor or, when it is null, keeping
+	// what is there. Each list is recorded between ContinueRenderPass and EndRenderPass, typically one per thread,
+	// and they execute in the order given. The array is copied, the lists are not, so the same rules as for a single
+	// list apply to them. Barriers have to be submitted in a list of their own, they are skipped in these.
+	virtual void Submit(const float32 *clearColor, const TCommandList *const *lists, int32 count) = 0;
 }; // class IGraphicsAPI
\ No newline at end of file
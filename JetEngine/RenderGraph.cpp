@@ -0,0 +1,753 @@
+#include "Precompiled.h"
+
+#include "RenderDevice-vk.h"
+
+struct TUsageInfo
+{
+	VkPipelineStageFlags Stages;
+	VkAccessFlags Access;
+	// Ignored for buffers.
+	VkImageLayout Layout;
+	bool Write;
+	VkImageUsageFlags ImageUsage;
+	VkBufferUsageFlags BufferUsage;
+};
+
+// Indexed by TRenderGraphUsage.
+static const TUsageInfo UsageInfos[] = {
+	// Acquire
+	{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0u, VK_IMAGE_LAYOUT_UNDEFINED, false, 0u, 0u },
+	// Present
+	{ VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0u, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false, 0u, 0u },
+	// ColorAttachment
+	{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0u },
+	// DepthAttachment
+	{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0u },
+	// TransferSource
+	{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
+	// TransferDestination
+	{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true, VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+	// VertexBuffer
+	{ VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, 0u, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT },
+	// IndexBuffer
+	{ VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, 0u, VK_BUFFER_USAGE_INDEX_BUFFER_BIT },
+	// IndirectBuffer
+	{ VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, 0u, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT },
+	// UniformBuffer
+	{ VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_UNIFORM_READ_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, false, 0u, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT },
+	// ShaderRead
+	{ VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_SAMPLED_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+	// ShaderWrite
+	{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, true, VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+	// HostRead
+	{ VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, 0u, 0u },
+};
+static_assert(ArrayLength(UsageInfos) == size_t(TRenderGraphUsage::Count));
+
+static const TUsageInfo &GetUsageInfo(TRenderGraphUsage usage)
+{
+	return UsageInfos[size_t(usage)];
+}
+
+static VkImageAspectFlags GetAspectMask(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT;
+	case VK_FORMAT_S8_UINT:
+		return VK_IMAGE_ASPECT_STENCIL_BIT;
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	default:
+		return VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+}
+
+static bool Overlaps(VkDeviceSize beginA, VkDeviceSize endA, VkDeviceSize beginB, VkDeviceSize endB)
+{
+	return beginA < endB && beginB < endA;
+}
+
+void TRenderGraph::Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager)
+{
+	Device = device;
+	Allocator = allocator;
+	MemoryManager = memoryManager;
+}
+
+void TRenderGraph::Done()
+{
+	Reset();
+	for (size_t i = 0; i < Physicals.size(); ++i)
+		DestroyPhysical(Physicals[i]);
+	Physicals.resize(0);
+	for (auto &heap : Heaps)
+		if (heap.IsValid())
+			MemoryManager->Free(heap);
+}
+
+void TRenderGraph::Reset()
+{
+	for (size_t i = 0; i < Passes.size(); ++i)
+		Passes[i].Destroy(Passes[i].Data);
+	Passes.resize(0);
+	Accesses.resize(0);
+	Resources.resize(0);
+	ImageBarriers.resize(0);
+	BufferBarriers.resize(0);
+	FinalBarriers = TBarrierBatch();
+	Statistics = TRenderGraphStatistics();
+}
+
+TRenderGraphResource TRenderGraph::AddResource(const char *name)
+{
+	TResource &resource = Resources.push_back(TResource());
+	resource.Name = name;
+	resource.FirstPass = -1;
+	resource.LastPass = -1;
+	resource.Physical = -1;
+
+	TRenderGraphResource handle;
+	handle.Index = int32(Resources.size() - 1);
+	return handle;
+}
+
+TRenderGraphResource TRenderGraph::CreateImage(const char *name, const TRenderGraphImageDesc &desc)
+{
+	const TRenderGraphResource handle = AddResource(name);
+	TResource &resource = Resources[handle.Index];
+	resource.IsImage = true;
+	resource.Desc = desc;
+	return handle;
+}
+
+TRenderGraphResource TRenderGraph::CreateBuffer(const char *name, VkDeviceSize size)
+{
+	const TRenderGraphResource handle = AddResource(name);
+	TResource &resource = Resources[handle.Index];
+	resource.Size = size;
+	return handle;
+}
+
+TRenderGraphResource TRenderGraph::ImportImage(const char *name, VkImage image, VkImageView view, VkFormat format, TRenderGraphUsage initialUsage, TRenderGraphUsage finalUsage)
+{
+	const TRenderGraphResource handle = AddResource(name);
+	TResource &resource = Resources[handle.Index];
+	resource.IsImage = true;
+	resource.Imported = true;
+	resource.Desc.Format = format;
+	resource.InitialUsage = initialUsage;
+	resource.FinalUsage = finalUsage;
+	resource.Image = image;
+	resource.View = view;
+	return handle;
+}
+
+TRenderGraphResource TRenderGraph::ImportBuffer(const char *name, VkBuffer buffer, TRenderGraphUsage initialUsage, TRenderGraphUsage finalUsage)
+{
+	const TRenderGraphResource handle = AddResource(name);
+	TResource &resource = Resources[handle.Index];
+	resource.Imported = true;
+	resource.InitialUsage = initialUsage;
+	resource.FinalUsage = finalUsage;
+	resource.Buffer = buffer;
+	return handle;
+}
+
+void TRenderGraph::AddAccess(int32 pass, TRenderGraphResource resource, TRenderGraphUsage usage)
+{
+	ASSERT(pass >= 0 && pass < int32(Passes.size()));
+	ASSERT(resource.IsValid() && resource.Index < int32(Resources.size()));
+
+	TAccess &access = Accesses.push_back(TAccess());
+	access.Pass = pass;
+	access.Resource = resource.Index;
+	access.Sequence = uint32(Accesses.size() - 1);
+	access.Usage = usage;
+}
+
+void TRenderGraph::Read(int32 pass, TRenderGraphResource resource, TRenderGraphUsage usage)
+{
+	ASSERT(!GetUsageInfo(usage).Write);
+	AddAccess(pass, resource, usage);
+}
+
+void TRenderGraph::Write(int32 pass, TRenderGraphResource resource, TRenderGraphUsage usage)
+{
+	ASSERT(GetUsageInfo(usage).Write);
+	AddAccess(pass, resource, usage);
+}
+
+void TRenderGraph::Compile()
+{
+	// Groups the accesses by pass, and within a pass the accesses to the same resource.
+	Sort(Accesses.data(), Accesses.data() + Accesses.size(), [](const TAccess &lhs, const TAccess &rhs) {
+		if (lhs.Pass != rhs.Pass)
+			return lhs.Pass < rhs.Pass;
+		if (lhs.Resource != rhs.Resource)
+			return lhs.Resource < rhs.Resource;
+		return lhs.Sequence < rhs.Sequence;
+	});
+
+	uint32 access = 0u;
+	for (size_t i = 0; i < Passes.size(); ++i)
+	{
+		Passes[i].AccessBegin = access;
+		while (access < Accesses.size() && Accesses[access].Pass == int32(i))
+			++access;
+		Passes[i].AccessEnd = access;
+	}
+
+	Statistics.PassCount = uint32(Passes.size());
+	Cull();
+	ComputeLifetimes();
+	AllocateTransients();
+	BuildBarriers();
+}
+
+void TRenderGraph::Cull()
+{
+	// Walks back from the passes with side effects, a pass stays alive when a live pass needs something it writes.
+	TVarArray<bool> needed;
+	needed.resize(Resources.size());
+
+	for (int32 i = int32(Passes.size()) - 1; i >= 0; --i)
+	{
+		TPass &pass = Passes[i];
+		pass.Live = false;
+		for (uint32 j = pass.AccessBegin; j < pass.AccessEnd; ++j)
+		{
+			const TAccess &access = Accesses[j];
+			if (GetUsageInfo(access.Usage).Write && (Resources[access.Resource].Imported || needed[access.Resource]))
+				pass.Live = true;
+		}
+
+		if (!pass.Live)
+		{
+			++Statistics.CulledPassCount;
+			continue;
+		}
+
+		for (uint32 j = pass.AccessBegin; j < pass.AccessEnd; ++j)
+			needed[Accesses[j].Resource] = true;
+	}
+}
+
+void TRenderGraph::ComputeLifetimes()
+{
+	for (size_t i = 0; i < Passes.size(); ++i)
+	{
+		const TPass &pass = Passes[i];
+		if (!pass.Live)
+			continue;
+
+		for (uint32 j = pass.AccessBegin; j < pass.AccessEnd; ++j)
+		{
+			const TAccess &access = Accesses[j];
+			const TUsageInfo &info = GetUsageInfo(access.Usage);
+			TResource &resource = Resources[access.Resource];
+			if (resource.Imported)
+				continue;
+
+			if (resource.FirstPass < 0)
+				resource.FirstPass = int32(i);
+			if (resource.LastPass != int32(i))
+			{
+				resource.LastPass = int32(i);
+				resource.LastStages = 0u;
+				resource.LastWriteAccess = 0u;
+			}
+			resource.LastStages |= info.Stages;
+			resource.LastWriteAccess |= info.Write ? info.Access : 0u;
+			resource.UsageFlags |= resource.IsImage ? info.ImageUsage : info.BufferUsage;
+		}
+	}
+}
+
+void TRenderGraph::CreatePhysical(TPhysical &physical)
+{
+	if (physical.IsImage)
+	{
+		VkImageCreateInfo imageCreateInfo = {};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.pNext = nullptr;
+		imageCreateInfo.flags = 0;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = physical.Desc.Format;
+		imageCreateInfo.extent.width = physical.Desc.Width;
+		imageCreateInfo.extent.height = physical.Desc.Height;
+		imageCreateInfo.extent.depth = 1u;
+		imageCreateInfo.mipLevels = 1u;
+		imageCreateInfo.arrayLayers = 1u;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = physical.UsageFlags;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.queueFamilyIndexCount = 0;
+		imageCreateInfo.pQueueFamilyIndices = nullptr;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VkResult result = vkCreateImage(Device, &imageCreateInfo, Allocator, &physical.Image);
+		ASSERT(result == VK_SUCCESS);
+		vkGetImageMemoryRequirements(Device, physical.Image, &physical.Requirements);
+	}
+	else
+	{
+		VkBufferCreateInfo bufferCreateInfo = {};
+		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferCreateInfo.pNext = nullptr;
+		bufferCreateInfo.flags = 0;
+		bufferCreateInfo.size = physical.Size;
+		bufferCreateInfo.usage = physical.UsageFlags;
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.queueFamilyIndexCount = 0;
+		bufferCreateInfo.pQueueFamilyIndices = nullptr;
+
+		VkResult result = vkCreateBuffer(Device, &bufferCreateInfo, Allocator, &physical.Buffer);
+		ASSERT(result == VK_SUCCESS);
+		vkGetBufferMemoryRequirements(Device, physical.Buffer, &physical.Requirements);
+	}
+	physical.Bound = false;
+}
+
+void TRenderGraph::DestroyPhysical(TPhysical &physical)
+{
+	if (physical.View != VK_NULL_HANDLE)
+		vkDestroyImageView(Device, physical.View, Allocator);
+	if (physical.Image != VK_NULL_HANDLE)
+		vkDestroyImage(Device, physical.Image, Allocator);
+	if (physical.Buffer != VK_NULL_HANDLE)
+		vkDestroyBuffer(Device, physical.Buffer, Allocator);
+	physical.View = VK_NULL_HANDLE;
+	physical.Image = VK_NULL_HANDLE;
+	physical.Buffer = VK_NULL_HANDLE;
+	physical.Bound = false;
+}
+
+void TRenderGraph::PlaceTransients(bool images, VkMemoryRequirements &heapRequirements)
+{
+	heapRequirements.size = 0u;
+	heapRequirements.alignment = 1u;
+	heapRequirements.memoryTypeBits = ~0u;
+
+	TVarArray<int32> order;
+	for (size_t i = 0; i < Resources.size(); ++i)
+		if (Resources[i].Physical >= 0 && Resources[i].IsImage == images)
+			order.push_back(int32(i));
+	if (order.empty())
+		return;
+
+	// Largest first, smaller resources then fill the gaps between them.
+	Sort(order.data(), order.data() + order.size(), [&](int32 lhs, int32 rhs) {
+		const VkDeviceSize lhsSize = Physicals[Resources[lhs].Physical].Requirements.size;
+		const VkDeviceSize rhsSize = Physicals[Resources[rhs].Physical].Requirements.size;
+		return lhsSize != rhsSize ? lhsSize > rhsSize : lhs < rhs;
+	});
+
+	// First fit: the lowest offset that does not overlap a resource placed before whose lifetime overlaps.
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		TResource &resource = Resources[order[i]];
+		const VkMemoryRequirements &requirements = Physicals[resource.Physical].Requirements;
+
+		VkDeviceSize offset = 0u;
+		for (bool moved = true; moved;)
+		{
+			moved = false;
+			for (size_t j = 0; j < i; ++j)
+			{
+				const TResource &placed = Resources[order[j]];
+				const VkDeviceSize placedSize = Physicals[placed.Physical].Requirements.size;
+				const bool lifetimesOverlap = resource.FirstPass <= placed.LastPass && placed.FirstPass <= resource.LastPass;
+				if (lifetimesOverlap && Overlaps(offset, offset + requirements.size, placed.Offset, placed.Offset + placedSize))
+				{
+					offset = AlignUp(placed.Offset + placedSize, requirements.alignment);
+					moved = true;
+				}
+			}
+		}
+
+		resource.Offset = offset;
+		heapRequirements.size = Max(heapRequirements.size, offset + requirements.size);
+		heapRequirements.alignment = Max(heapRequirements.alignment, requirements.alignment);
+		heapRequirements.memoryTypeBits &= requirements.memoryTypeBits;
+	}
+	ASSERT(heapRequirements.memoryTypeBits != 0u);
+
+	// The first barrier of a resource waits for whatever used the memory before it during the frame.
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		TResource &resource = Resources[order[i]];
+		const VkDeviceSize size = Physicals[resource.Physical].Requirements.size;
+		for (size_t j = 0; j < order.size(); ++j)
+		{
+			const TResource &previous = Resources[order[j]];
+			const VkDeviceSize previousSize = Physicals[previous.Physical].Requirements.size;
+			if (previous.LastPass < resource.FirstPass && Overlaps(resource.Offset, resource.Offset + size, previous.Offset, previous.Offset + previousSize))
+			{
+				resource.AliasStages |= previous.LastStages;
+				resource.AliasAccess |= previous.LastWriteAccess;
+			}
+		}
+	}
+}
+
+void TRenderGraph::AllocateTransients()
+{
+	for (size_t i = 0; i < Physicals.size(); ++i)
+		Physicals[i].Resource = -1;
+
+	// Hands out the objects of the previous frames again when they match, creates the rest.
+	for (size_t i = 0; i < Resources.size(); ++i)
+	{
+		TResource &resource = Resources[i];
+		if (resource.Imported || resource.FirstPass < 0)
+			continue;
+
+		for (size_t j = 0; j < Physicals.size() && resource.Physical < 0; ++j)
+		{
+			const TPhysical &physical = Physicals[j];
+			const bool matches = physical.Resource < 0 && physical.IsImage == resource.IsImage && physical.UsageFlags == resource.UsageFlags &&
+				(resource.IsImage ?
+					physical.Desc.Format == resource.Desc.Format && physical.Desc.Width == resource.Desc.Width && physical.Desc.Height == resource.Desc.Height :
+					physical.Size == resource.Size);
+			if (matches)
+				resource.Physical = int32(j);
+		}
+
+		if (resource.Physical < 0)
+		{
+			TPhysical &physical = Physicals.push_back(TPhysical());
+			physical.IsImage = resource.IsImage;
+			physical.Desc = resource.Desc;
+			physical.Size = resource.Size;
+			physical.UsageFlags = resource.UsageFlags;
+			CreatePhysical(physical);
+			resource.Physical = int32(Physicals.size() - 1);
+		}
+		Physicals[resource.Physical].Resource = int32(i);
+
+		++Statistics.TransientCount;
+		Statistics.TransientBytes += Physicals[resource.Physical].Requirements.size;
+	}
+
+	for (uint32 kind = 0; kind < HeapCount; ++kind)
+	{
+		const bool images = kind == uint32(TVulkanResourceKind::Optimal);
+		VkMemoryRequirements heapRequirements;
+		PlaceTransients(images, heapRequirements);
+		if (heapRequirements.size == 0u)
+			continue;
+		Statistics.AliasedBytes += heapRequirements.size;
+
+		// Grows only, objects bound to the old memory have to be created again.
+		TVulkanAllocation &heap = Heaps[kind];
+		const bool fits = heap.IsValid() && heap.Size >= heapRequirements.size &&
+			heap.Offset % heapRequirements.alignment == 0u && (heapRequirements.memoryTypeBits & (1u << heap.MemoryType)) != 0u;
+		if (!fits)
+		{
+			for (size_t i = 0; i < Physicals.size(); ++i)
+			{
+				if (Physicals[i].IsImage == images && Physicals[i].Bound && Physicals[i].Resource >= 0)
+				{
+					DestroyPhysical(Physicals[i]);
+					CreatePhysical(Physicals[i]);
+				}
+			}
+			if (heap.IsValid())
+				MemoryManager->Free(heap);
+			heap = MemoryManager->Allocate(heapRequirements, TVulkanMemoryUsage::GpuOnly, TVulkanResourceKind(kind));
+			ASSERT(heap.IsValid());
+		}
+
+		for (size_t i = 0; i < Resources.size(); ++i)
+		{
+			TResource &resource = Resources[i];
+			if (resource.Physical < 0 || resource.IsImage != images)
+				continue;
+
+			// Memory can be bound only once, an object that moved within the heap is created again.
+			TPhysical &physical = Physicals[resource.Physical];
+			if (physical.Bound && physical.Offset != resource.Offset)
+			{
+				DestroyPhysical(physical);
+				CreatePhysical(physical);
+			}
+
+			if (!physical.Bound)
+			{
+				physical.Offset = resource.Offset;
+				physical.Bound = true;
+				if (images)
+				{
+					VkResult result = vkBindImageMemory(Device, physical.Image, heap.Memory, heap.Offset + physical.Offset);
+					ASSERT(result == VK_SUCCESS);
+
+					VkImageViewCreateInfo imageViewCreateInfo = {};
+					imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+					imageViewCreateInfo.pNext = nullptr;
+					imageViewCreateInfo.flags = 0;
+					imageViewCreateInfo.image = physical.Image;
+					imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+					imageViewCreateInfo.format = physical.Desc.Format;
+					imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+					imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+					imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+					imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+					imageViewCreateInfo.subresourceRange.aspectMask = GetAspectMask(physical.Desc.Format);
+					imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+					imageViewCreateInfo.subresourceRange.levelCount = 1;
+					imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+					imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+					result = vkCreateImageView(Device, &imageViewCreateInfo, Allocator, &physical.View);
+					ASSERT(result == VK_SUCCESS);
+				}
+				else
+				{
+					VkResult result = vkBindBufferMemory(Device, physical.Buffer, heap.Memory, heap.Offset + physical.Offset);
+					ASSERT(result == VK_SUCCESS);
+				}
+			}
+
+			resource.Image = physical.Image;
+			resource.View = physical.View;
+			resource.Buffer = physical.Buffer;
+		}
+	}
+
+	// Objects this frame did not ask for. The GPU is done with the frame that used them last.
+	size_t kept = 0u;
+	for (size_t i = 0; i < Physicals.size(); ++i)
+	{
+		if (Physicals[i].Resource < 0)
+		{
+			DestroyPhysical(Physicals[i]);
+			continue;
+		}
+		Resources[Physicals[i].Resource].Physical = int32(kept);
+		Physicals[kept++] = Physicals[i];
+	}
+	Physicals.resize(kept);
+}
+
+void TRenderGraph::AddBarrier(TBarrierBatch &batch, TResource &resource, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout, bool write)
+{
+	const bool layoutChange = resource.IsImage && resource.Layout != layout;
+
+	VkPipelineStageFlags srcStages = 0u;
+	VkAccessFlags srcAccess = 0u;
+	if (layoutChange || write)
+	{
+		// Transitions and writes wait for every access since the last write, and make that write available.
+		srcStages = resource.WriteStages | resource.ReadStages;
+		srcAccess = resource.WriteAccess;
+	}
+	else if (resource.WriteAccess != 0u && ((stages & ~resource.VisibleStages) != 0u || (access & ~resource.VisibleAccess) != 0u))
+	{
+		// Reads only need a barrier when the last write is not visible to them yet.
+		srcStages = resource.WriteStages;
+		srcAccess = resource.WriteAccess;
+	}
+
+	if (srcStages != 0u || layoutChange)
+	{
+		batch.SrcStages |= srcStages;
+		batch.DstStages |= stages;
+
+		if (resource.IsImage)
+		{
+			VkImageMemoryBarrier &imageMemoryBarrier = ImageBarriers.push_back(VkImageMemoryBarrier());
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.pNext = nullptr;
+			imageMemoryBarrier.srcAccessMask = srcAccess;
+			imageMemoryBarrier.dstAccessMask = access;
+			imageMemoryBarrier.oldLayout = resource.Layout;
+			imageMemoryBarrier.newLayout = layout;
+			imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.image = resource.Image;
+			imageMemoryBarrier.subresourceRange.aspectMask = GetAspectMask(resource.Desc.Format);
+			imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+			imageMemoryBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+			imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+			imageMemoryBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+			++batch.ImageCount;
+			++Statistics.ImageBarrierCount;
+		}
+		else
+		{
+			VkBufferMemoryBarrier &bufferMemoryBarrier = BufferBarriers.push_back(VkBufferMemoryBarrier());
+			bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferMemoryBarrier.pNext = nullptr;
+			bufferMemoryBarrier.srcAccessMask = srcAccess;
+			bufferMemoryBarrier.dstAccessMask = access;
+			bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.buffer = resource.Buffer;
+			bufferMemoryBarrier.offset = 0u;
+			bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+			++batch.BufferCount;
+			++Statistics.BufferBarrierCount;
+		}
+	}
+
+	if (write)
+	{
+		resource.WriteStages = stages;
+		resource.WriteAccess = access;
+		resource.ReadStages = 0u;
+		resource.VisibleStages = 0u;
+		resource.VisibleAccess = 0u;
+	}
+	else
+	{
+		resource.ReadStages |= stages;
+		if (srcStages != 0u || layoutChange)
+		{
+			resource.VisibleStages |= stages;
+			resource.VisibleAccess |= access;
+		}
+	}
+	resource.Layout = layout;
+}
+
+void TRenderGraph::BuildBarriers()
+{
+	for (size_t i = 0; i < Resources.size(); ++i)
+	{
+		TResource &resource = Resources[i];
+		if (resource.Imported)
+		{
+			// As if the initial usage was the last one and its results are visible to it.
+			const TUsageInfo &info = GetUsageInfo(resource.InitialUsage);
+			resource.Layout = info.Layout;
+			resource.WriteStages = info.Write ? info.Stages : 0u;
+			resource.WriteAccess = info.Write ? info.Access : 0u;
+			resource.ReadStages = info.Write ? 0u : info.Stages;
+			resource.VisibleStages = info.Write ? 0u : info.Stages;
+			resource.VisibleAccess = info.Write ? 0u : info.Access;
+		}
+		else
+		{
+			// Contents are undefined on first use, only the previous occupant of the memory is waited for.
+			resource.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			resource.WriteStages = resource.AliasStages;
+			resource.WriteAccess = resource.AliasAccess;
+			resource.ReadStages = 0u;
+			resource.VisibleStages = 0u;
+			resource.VisibleAccess = 0u;
+		}
+	}
+
+	for (size_t i = 0; i < Passes.size(); ++i)
+	{
+		TPass &pass = Passes[i];
+		if (!pass.Live)
+			continue;
+
+		pass.Barriers = TBarrierBatch();
+		pass.Barriers.ImageBegin = uint32(ImageBarriers.size());
+		pass.Barriers.BufferBegin = uint32(BufferBarriers.size());
+
+		// Accesses of a pass to the same resource are adjacent and merged into one.
+		for (uint32 j = pass.AccessBegin; j < pass.AccessEnd;)
+		{
+			const int32 resourceIndex = Accesses[j].Resource;
+			VkPipelineStageFlags stages = 0u;
+			VkAccessFlags access = 0u;
+			bool write = false;
+			const VkImageLayout layout = GetUsageInfo(Accesses[j].Usage).Layout;
+			for (; j < pass.AccessEnd && Accesses[j].Resource == resourceIndex; ++j)
+			{
+				const TUsageInfo &info = GetUsageInfo(Accesses[j].Usage);
+				ASSERT(!Resources[resourceIndex].IsImage || info.Layout == layout);
+				stages |= info.Stages;
+				access |= info.Access;
+				write |= info.Write;
+			}
+			AddBarrier(pass.Barriers, Resources[resourceIndex], stages, access, layout, write);
+		}
+
+		if (pass.Barriers.ImageCount + pass.Barriers.BufferCount != 0u)
+			++Statistics.BarrierBatchCount;
+	}
+
+	FinalBarriers = TBarrierBatch();
+	FinalBarriers.ImageBegin = uint32(ImageBarriers.size());
+	FinalBarriers.BufferBegin = uint32(BufferBarriers.size());
+	for (size_t i = 0; i < Resources.size(); ++i)
+	{
+		TResource &resource = Resources[i];
+		if (!resource.Imported)
+			continue;
+
+		const TUsageInfo &info = GetUsageInfo(resource.FinalUsage);
+		AddBarrier(FinalBarriers, resource, info.Stages, info.Access, info.Layout, info.Write);
+	}
+	if (FinalBarriers.ImageCount + FinalBarriers.BufferCount != 0u)
+		++Statistics.BarrierBatchCount;
+}
+
+void TRenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, const TBarrierBatch &batch)
+{
+	if (batch.ImageCount + batch.BufferCount == 0u)
+		return;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		// Nothing to wait for when the batch only moves untouched images out of the undefined layout.
+		batch.SrcStages != 0u ? batch.SrcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		batch.DstStages,
+		0,
+		0, nullptr,
+		batch.BufferCount, batch.BufferCount != 0u ? &BufferBarriers[batch.BufferBegin] : nullptr,
+		batch.ImageCount, batch.ImageCount != 0u ? &ImageBarriers[batch.ImageBegin] : nullptr
+	);
+}
+
+void TRenderGraph::Execute(VkCommandBuffer commandBuffer, TVulkanProfiler *profiler)
+{
+	for (size_t i = 0; i < Passes.size(); ++i)
+	{
+		const TPass &pass = Passes[i];
+		if (!pass.Live)
+			continue;
+
+		// The barriers count towards the pass that needs them.
+		const int32 scope = profiler != nullptr ? profiler->BeginGpuScope(commandBuffer, pass.Name) : -1;
+		RecordBarriers(commandBuffer, pass.Barriers);
+		pass.Invoke(pass.Data, commandBuffer);
+		if (profiler != nullptr)
+			profiler->EndGpuScope(commandBuffer, scope);
+	}
+	RecordBarriers(commandBuffer, FinalBarriers);
+}
+
+VkImage TRenderGraph::GetImage(TRenderGraphResource resource) const
+{
+	ASSERT(resource.IsValid() && Resources[resource.Index].IsImage);
+	return Resources[resource.Index].Image;
+}
+
+VkImageView TRenderGraph::GetImageView(TRenderGraphResource resource) const
+{
+	ASSERT(resource.IsValid() && Resources[resource.Index].IsImage);
+	return Resources[resource.Index].View;
+}
+
+VkBuffer TRenderGraph::GetBuffer(TRenderGraphResource resource) const
+{
+	ASSERT(resource.IsValid() && !Resources[resource.Index].IsImage);
+	return Resources[resource.Index].Buffer;
+}
@@ -1 +1,230 @@
-#pragma once
\ No newline at end of file
+#pragma once
+
+// References:
+// https://www.gdcvault.com/play/1024612/FrameGraph-Extensible-Rendering-Architecture-in
+// https://themaister.net/blog/2017/08/15/render-graphs-and-vulkan-a-deep-dive/
+// https://github.com/KhronosGroup/Vulkan-Docs/wiki/Synchronization-Examples
+
+class TVulkanProfiler;
+
+// How a pass touches a resource, each usage stands for a set of pipeline stages, access flags and an image layout.
+enum class TRenderGraphUsage : uint8
+{
+	// Swap chain image right after acquire. The acquire semaphore is waited for at color output and transfer.
+	Acquire,
+	Present,
+	ColorAttachment,
+	DepthAttachment,
+	TransferSource,
+	TransferDestination,
+	VertexBuffer,
+	IndexBuffer,
+	IndirectBuffer,
+	UniformBuffer,
+	// Sampled images and storage buffers read by vertex, fragment and compute shaders.
+	ShaderRead,
+	// Storage images and buffers written by compute shaders.
+	ShaderWrite,
+	// Buffers the CPU reads once the frame's fence signals.
+	HostRead,
+	Count,
+};
+
+struct TRenderGraphResource
+{
+	int32 Index = -1;
+
+	bool IsValid() const {
+		return Index >= 0;
+	}
+};
+
+struct TRenderGraphImageDesc
+{
+	VkFormat Format = VK_FORMAT_UNDEFINED;
+	uint32 Width = 0u;
+	uint32 Height = 0u;
+};
+
+struct TRenderGraphStatistics
+{
+	uint32 PassCount = 0u;
+	uint32 CulledPassCount = 0u;
+	// vkCmdPipelineBarrier calls, a pass gets at most one with all of its barriers.
+	uint32 BarrierBatchCount = 0u;
+	uint32 ImageBarrierCount = 0u;
+	uint32 BufferBarrierCount = 0u;
+	uint32 TransientCount = 0u;
+	// Sizes of the transient resources used by live passes, and the memory they share after aliasing.
+	VkDeviceSize TransientBytes = 0u;
+	VkDeviceSize AliasedBytes = 0u;
+};
+
+// Frame graph. Passes declare what they read and write, Compile culls the passes nothing depends on, places
+// transient resources in shared memory wherever their lifetimes do not overlap and works out the barriers.
+// Execute records the live passes in the order they were added, each preceded by one batched barrier.
+// One graph per frame in flight, reset once the GPU is done with the frame. Not thread safe.
+class TRenderGraph
+{
+public:
+	void Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager);
+	void Done();
+	// Forgets passes and resources. Transient images and buffers and their memory are kept for the next frame,
+	// which gets the same objects back when it declares the same resources.
+	void Reset();
+
+	TRenderGraphResource CreateImage(const char *name, const TRenderGraphImageDesc &desc);
+	TRenderGraphResource CreateBuffer(const char *name, VkDeviceSize size);
+	// Resources owned outside the graph. They start out in initialUsage and are left in finalUsage,
+	// passes that write them are never culled.
+	TRenderGraphResource ImportImage(const char *name, VkImage image, VkImageView view, VkFormat format, TRenderGraphUsage initialUsage, TRenderGraphUsage finalUsage);
+	TRenderGraphResource ImportBuffer(const char *name, VkBuffer buffer, TRenderGraphUsage initialUsage, TRenderGraphUsage finalUsage);
+
+	// The graph keeps a copy of execute and calls execute(commandBuffer) from Execute.
+	template <typename TFunction>
+	int32 AddPass(const char *name, const TFunction &execute)
+	{
+		TPass &pass = Passes.push_back(TPass());
+		pass.Name = name;
+		pass.Data = new TFunction(execute);
+		pass.Invoke = [](void *data, VkCommandBuffer commandBuffer) {
+			(*static_cast<TFunction *>(data))(commandBuffer);
+		};
+		pass.Destroy = [](void *data) {
+			delete static_cast<TFunction *>(data);
+		};
+		return int32(Passes.size() - 1);
+	}
+
+	void Read(int32 pass, TRenderGraphResource resource, TRenderGraphUsage usage);
+	// Writes are assumed to keep whatever they do not overwrite, so earlier writers of the resource stay alive.
+	void Write(int32 pass, TRenderGraphResource resource, TRenderGraphUsage usage);
+
+	void Compile();
+	// With a profiler every live pass gets a GPU scope of its own.
+	void Execute(VkCommandBuffer commandBuffer, TVulkanProfiler *profiler = nullptr);
+
+	// Imported resources are valid right away, transient ones after Compile. VK_NULL_HANDLE when no live pass uses them.
+	VkImage GetImage(TRenderGraphResource resource) const;
+	VkImageView GetImageView(TRenderGraphResource resource) const;
+	VkBuffer GetBuffer(TRenderGraphResource resource) const;
+
+	const TRenderGraphStatistics &GetStatistics() const {
+		return Statistics;
+	}
+
+private:
+	// Buffers and images are aliased in separate memory, so bufferImageGranularity never applies.
+	static constexpr uint32 HeapCount = 2u;
+
+	// The nested structs are value initialized, members that do not start out as zero are set where they are added.
+	struct TBarrierBatch
+	{
+		VkPipelineStageFlags SrcStages;
+		VkPipelineStageFlags DstStages;
+		uint32 ImageBegin;
+		uint32 ImageCount;
+		uint32 BufferBegin;
+		uint32 BufferCount;
+	};
+
+	// The function copy is released by Reset.
+	struct TPass
+	{
+		const char *Name;
+		void *Data;
+		void (*Invoke)(void *data, VkCommandBuffer commandBuffer);
+		void (*Destroy)(void *data);
+		uint32 AccessBegin;
+		uint32 AccessEnd;
+		bool Live;
+		TBarrierBatch Barriers;
+	};
+
+	struct TAccess
+	{
+		int32 Pass;
+		int32 Resource;
+		uint32 Sequence;
+		TRenderGraphUsage Usage;
+	};
+
+	struct TResource
+	{
+		const char *Name;
+		bool IsImage;
+		bool Imported;
+		TRenderGraphImageDesc Desc;
+		VkDeviceSize Size;
+		TRenderGraphUsage InitialUsage;
+		TRenderGraphUsage FinalUsage;
+		VkImage Image;
+		VkImageView View;
+		VkBuffer Buffer;
+
+		// Transient resources: live range, the usage flags they are created with and where they sit in the heap.
+		int32 FirstPass;
+		int32 LastPass;
+		VkPipelineStageFlags LastStages;
+		VkAccessFlags LastWriteAccess;
+		VkFlags UsageFlags;
+		int32 Physical;
+		VkDeviceSize Offset;
+		// What the previous occupant of the memory did last, the first barrier waits for it.
+		VkPipelineStageFlags AliasStages;
+		VkAccessFlags AliasAccess;
+
+		// Barrier tracking, the writes since the last barrier and the reads made visible since the last write.
+		VkImageLayout Layout;
+		VkPipelineStageFlags WriteStages;
+		VkAccessFlags WriteAccess;
+		VkPipelineStageFlags ReadStages;
+		VkPipelineStageFlags VisibleStages;
+		VkAccessFlags VisibleAccess;
+	};
+
+	// Transient image or buffer bound to one of the heaps, reused by later frames that declare the same resource.
+	struct TPhysical
+	{
+		bool IsImage;
+		TRenderGraphImageDesc Desc;
+		VkDeviceSize Size;
+		VkFlags UsageFlags;
+		VkImage Image;
+		VkImageView View;
+		VkBuffer Buffer;
+		VkMemoryRequirements Requirements;
+		VkDeviceSize Offset;
+		bool Bound;
+		int32 Resource;
+	};
+
+	TRenderGraphResource AddResource(const char *name);
+	void AddAccess(int32 pass, TRenderGraphResource resource, TRenderGraphUsage usage);
+	void Cull();
+	void ComputeLifetimes();
+	void AllocateTransients();
+	void PlaceTransients(bool images, VkMemoryRequirements &heapRequirements);
+	void BuildBarriers();
+	void AddBarrier(TBarrierBatch &batch, TResource &resource, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout, bool write);
+	void RecordBarriers(VkCommandBuffer commandBuffer, const TBarrierBatch &batch);
+	void CreatePhysical(TPhysical &physical);
+	void DestroyPhysical(TPhysical &physical);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	TVulkanMemoryManager *MemoryManager = nullptr;
+
+	TVarArray<TPass> Passes;
+	TVarArray<TAccess> Accesses;
+	TVarArray<TResource> Resources;
+	TVarArray<TPhysical> Physicals;
+	// Indexed by TVulkanResourceKind, Linear for buffers and Optimal for images.
+	TVulkanAllocation Heaps[HeapCount];
+
+	TVarArray<VkImageMemoryBarrier> ImageBarriers;
+	TVarArray<VkBufferMemoryBarrier> BufferBarriers;
+	// Leaves the imported resources in their final usage.
+	TBarrierBatch FinalBarriers;
+	TRenderGraphStatistics Statistics;
+};
@@ -0,0 +1,277 @@
+#include "Precompiled.h"
+
+#include "FileSystem.h"
+#include "RenderDevice-vk.h"
+#include "Core/Misc/Hash.h"
+
+#if !defined(_WIN32)
+#	include <sys/wait.h>
+#endif
+
+static constexpr uint32 SpirvMagic = 0x07230203u;
+static constexpr uint32 MaxCommandLength = 4096u;
+
+static const char *DxcProfiles[] = { "vs_6_0", "ps_6_0", "cs_6_0" };
+static const char *GlslangStages[] = { "vert", "frag", "comp" };
+
+#if defined(_WIN32)
+static bool RunProcess(char *commandLine)
+{
+	STARTUPINFO startupInfo = {};
+	startupInfo.cb = sizeof(startupInfo);
+	PROCESS_INFORMATION processInformation = {};
+	if (!CreateProcess(NULL, commandLine, NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &startupInfo, &processInformation))
+		return false;
+
+	WaitForSingleObject(processInformation.hProcess, INFINITE);
+	DWORD exitCode = 1;
+	GetExitCodeProcess(processInformation.hProcess, &exitCode);
+	CloseHandle(processInformation.hThread);
+	CloseHandle(processInformation.hProcess);
+	return exitCode == 0;
+}
+#else
+static bool RunProcess(char *commandLine)
+{
+	const int status = system(commandLine);
+	return status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+#endif
+
+static uint64 HashString(const char *string, uint64 hash)
+{
+	// The length goes in too, so "A" followed by "B" differs from "AB" followed by "".
+	const size_t length = string != nullptr ? strlen(string) : 0u;
+	hash = HashBytes(&length, sizeof(length), hash);
+	return HashBytes(string, length, hash);
+}
+
+// Appends to the command line, false once it does not fit.
+static bool Append(char *commandLine, uint32 &length, const char *format, const char *argument, uint32 argumentLength)
+{
+	const int32 written = snprintf(commandLine + length, MaxCommandLength - length, format, int32(argumentLength), argument);
+	if (written < 0 || uint32(written) >= MaxCommandLength - length)
+		return false;
+	length += uint32(written);
+	return true;
+}
+
+void TShaderCache::Init(const char *directory, const char *compilerPath)
+{
+	snprintf(Directory, sizeof(Directory), "%s", directory);
+	snprintf(CompilerPath, sizeof(CompilerPath), "%s", compilerPath);
+	if (!FS::MakeDirectory(Directory))
+		DebugPrint("Failed to create shader cache directory %s\n", Directory);
+
+	// Hashing the binary tells compiler versions apart without asking the compiler.
+	CompilerHash = 0u;
+	if (FS::Exists(CompilerPath))
+	{
+		FS::File compiler = FS::Open(CompilerPath, FS::Read);
+		CompilerHash = HashBytes(compiler.Platform.Buffer, size_t(compiler.Size));
+		FS::Close(compiler);
+	}
+	else
+	{
+		DebugPrint("Shader compiler %s not found, falling back to precompiled shaders\n", CompilerPath);
+	}
+	Glslang = strstr(CompilerPath, "glslang") != nullptr;
+}
+
+void TShaderCache::Done()
+{
+	DebugPrint("Shader cache: %ld hits, %ld misses, %ld precompiled fallbacks\n", long(HitCount), long(MissCount), long(FallbackCount));
+}
+
+uint64 TShaderCache::ComputeKey(const char *path, TShaderStage stage, const char *entryPoint, const char *defines) const
+{
+	uint64 hash = HashBytes(&Version, sizeof(Version));
+	hash = HashBytes(&CompilerHash, sizeof(CompilerHash), hash);
+	hash = HashBytes(&stage, sizeof(stage), hash);
+	hash = HashString(entryPoint, hash);
+	hash = HashString(defines, hash);
+	if (!HashSource(path, 0u, hash))
+		return 0u;
+	// 0 means no key.
+	return hash != 0u ? hash : 1u;
+}
+
+bool TShaderCache::HashSource(const char *path, uint32 depth, uint64 &hash) const
+{
+	if (depth > MaxIncludeDepth || !FS::Exists(path))
+	{
+		DebugPrint("Shader source %s not found or included too deep\n", path);
+		return false;
+	}
+
+	FS::File file = FS::Open(path, FS::Read);
+	const auto *source = static_cast<const char *>(file.Platform.Buffer);
+	const size_t size = size_t(file.Size);
+	hash = HashBytes(source, size, hash);
+
+	// Quoted includes are relative to the including file, angle bracket ones belong to the compiler.
+	const char *separator = Max(strrchr(path, '/'), strrchr(path, '\\'));
+	const uint32 directoryLength = separator != nullptr ? uint32(separator - path + 1) : 0u;
+
+	static constexpr char Directive[] = "#include";
+	static constexpr size_t DirectiveLength = sizeof(Directive) - 1u;
+
+	bool succeeded = true;
+	size_t position = 0u;
+	while (position < size && succeeded)
+	{
+		while (position < size && (source[position] == ' ' || source[position] == '\t'))
+			++position;
+
+		if (size - position > DirectiveLength && memcmp(source + position, Directive, DirectiveLength) == 0)
+		{
+			position += DirectiveLength;
+			while (position < size && (source[position] == ' ' || source[position] == '\t'))
+				++position;
+
+			if (position < size && source[position] == '"')
+			{
+				const size_t nameBegin = ++position;
+				while (position < size && source[position] != '"' && source[position] != '\n')
+					++position;
+
+				char includePath[MaxPathLength];
+				const int32 length = snprintf(includePath, sizeof(includePath), "%.*s%.*s",
+					int32(directoryLength), path, int32(position - nameBegin), source + nameBegin);
+				succeeded = length > 0 && length < int32(sizeof(includePath)) && HashSource(includePath, depth + 1u, hash);
+			}
+		}
+
+		while (position < size && source[position] != '\n')
+			++position;
+		++position;
+	}
+
+	FS::Close(file);
+	return succeeded;
+}
+
+bool TShaderCache::Compile(const char *path, TShaderStage stage, const char *entryPoint, const char *defines, const char *outputPath) const
+{
+	char commandLine[MaxCommandLength];
+	uint32 length = 0u;
+	bool fits = Append(commandLine, length, "\"%.*s\"", CompilerPath, uint32(strlen(CompilerPath)));
+	if (Glslang)
+	{
+		fits = fits && Append(commandLine, length, " -V -D --target-env vulkan1.1 -S %.*s", GlslangStages[uint32(stage)], uint32(strlen(GlslangStages[uint32(stage)])));
+		fits = fits && Append(commandLine, length, " -e %.*s", entryPoint, uint32(strlen(entryPoint)));
+	}
+	else
+	{
+		fits = fits && Append(commandLine, length, " -spirv -fspv-target-env=vulkan1.1 -T %.*s", DxcProfiles[uint32(stage)], uint32(strlen(DxcProfiles[uint32(stage)])));
+		fits = fits && Append(commandLine, length, " -E %.*s", entryPoint, uint32(strlen(entryPoint)));
+	}
+
+	for (const char *define = defines; define != nullptr && *define != '\0' && fits;)
+	{
+		const char *end = strchr(define, ';');
+		const uint32 defineLength = end != nullptr ? uint32(end - define) : uint32(strlen(define));
+		if (defineLength > 0u)
+			fits = Append(commandLine, length, Glslang ? " \"-D%.*s\"" : " -D \"%.*s\"", define, defineLength);
+		define = end != nullptr ? end + 1 : nullptr;
+	}
+
+	fits = fits && Append(commandLine, length, " \"%.*s\"", path, uint32(strlen(path)));
+	fits = fits && Append(commandLine, length, Glslang ? " -o \"%.*s\"" : " -Fo \"%.*s\"", outputPath, uint32(strlen(outputPath)));
+	if (!fits)
+	{
+		DebugPrint("Command line for shader %s is too long\n", path);
+		return false;
+	}
+
+	if (!RunProcess(commandLine))
+	{
+		DebugPrint("Failed to compile shader %s (%s)\n", path, entryPoint);
+		return false;
+	}
+	return true;
+}
+
+bool TShaderCache::Map(const char *path, TShaderBinary &binary) const
+{
+	if (!FS::Exists(path))
+		return false;
+
+	FS::File file = FS::Open(path, FS::Read);
+	const auto *code = static_cast<const uint32 *>(file.Platform.Buffer);
+	// The header alone is five words. Anything else is a write that never finished or a foreign file.
+	if (file.Size < 5u * sizeof(uint32) || file.Size % sizeof(uint32) != 0u || file.Size > TNumericLimits<uint32>::Max() || code[0] != SpirvMagic)
+	{
+		FS::Close(file);
+		return false;
+	}
+
+	binary.Code = code;
+	binary.Size = uint32(file.Size);
+	binary.File = file;
+	return true;
+}
+
+TShaderBinary TShaderCache::Load(const char *path, TShaderStage stage, const char *entryPoint, const char *defines)
+{
+	TShaderBinary binary;
+	const uint64 key = ComputeKey(path, stage, entryPoint, defines);
+	if (key == 0u)
+		return binary;
+
+	char cachePath[MaxPathLength];
+	const int32 length = snprintf(cachePath, sizeof(cachePath), "%s/%016llx.spirv", Directory, (unsigned long long)key);
+	ASSERT(length > 0 && length < int32(sizeof(cachePath)));
+
+	if (Map(cachePath, binary))
+	{
+		InterlockedIncrement(&HitCount);
+		return binary;
+	}
+	InterlockedIncrement(&MissCount);
+
+	if (CompilerHash != 0u)
+	{
+		// Threads missing on the same key compile into files of their own, whichever renames last wins.
+		char temporaryPath[MaxPathLength];
+		const int32 temporaryLength = snprintf(temporaryPath, sizeof(temporaryPath), "%s.%ld.tmp", cachePath, long(InterlockedIncrement(&TemporaryCounter)));
+		ASSERT(temporaryLength > 0 && temporaryLength < int32(sizeof(temporaryPath)));
+
+		if (Compile(path, stage, entryPoint, defines, temporaryPath))
+		{
+			// Renaming fails while another thread has the file mapped, which means its copy is already in place.
+			if (!FS::Rename(temporaryPath, cachePath))
+				FS::Remove(temporaryPath);
+			if (Map(cachePath, binary))
+				return binary;
+		}
+		else
+		{
+			FS::Remove(temporaryPath);
+		}
+	}
+
+	// The checked in binaries are built without defines, they cannot stand in for a permutation.
+	if (defines == nullptr || *defines == '\0')
+	{
+		const char *extension = strrchr(path, '.');
+		const uint32 stemLength = extension != nullptr ? uint32(extension - path) : uint32(strlen(path));
+		char precompiledPath[MaxPathLength];
+		const int32 precompiledLength = snprintf(precompiledPath, sizeof(precompiledPath), "%.*s.spirv", int32(stemLength), path);
+		if (precompiledLength > 0 && precompiledLength < int32(sizeof(precompiledPath)) && Map(precompiledPath, binary))
+		{
+			InterlockedIncrement(&FallbackCount);
+			return binary;
+		}
+	}
+
+	DebugPrint("No SPIR-V for shader %s (%s)\n", path, entryPoint);
+	return binary;
+}
+
+void TShaderCache::Release(TShaderBinary &binary)
+{
+	if (binary.Code != nullptr)
+		FS::Close(binary.File);
+	binary = TShaderBinary();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "FileSystem.h"
+
+// References:
+// https://github.com/microsoft/DirectXShaderCompiler/blob/main/docs/SPIR-V.rst
+// https://github.com/KhronosGroup/glslang#hlsl
+
+enum class TShaderStage : uint8
+{
+	Vertex,
+	Pixel,
+	Compute,
+};
+
+// SPIR-V from the cache, mapped straight from its file. Valid until TShaderCache::Release.
+struct TShaderBinary
+{
+	const uint32 *Code = nullptr;
+	// In bytes, a multiple of 4.
+	uint32 Size = 0u;
+	FS::File File;
+};
+
+// Compiles HLSL to SPIR-V on demand and keeps the results in a content addressed directory. A shader's key hashes
+// its source and every file it includes, the stage, entry point, defines and the compiler binary itself, so an
+// edit or a compiler update gives a new file and stale ones are never picked up. Hits are mapped, not copied.
+// The compiler is dxc, or glslangValidator when its file name says so. Without a working compiler, or when it
+// fails, the .spirv checked in next to the source is used instead. Thread safe.
+class TShaderCache
+{
+public:
+	void Init(const char *directory, const char *compilerPath);
+	void Done();
+
+	// defines is a ';' separated list of NAME or NAME=VALUE, or nullptr. Code is nullptr when there is nothing to load.
+	TShaderBinary Load(const char *path, TShaderStage stage, const char *entryPoint, const char *defines = nullptr);
+	void Release(TShaderBinary &binary);
+
+	// 0 when the source or one of its includes is missing.
+	uint64 ComputeKey(const char *path, TShaderStage stage, const char *entryPoint, const char *defines) const;
+
+private:
+	static constexpr uint32 Version = 1u;
+	static constexpr uint32 MaxPathLength = 260u;
+	// Deeper include chains are a cycle or a mistake.
+	static constexpr uint32 MaxIncludeDepth = 16u;
+
+	bool HashSource(const char *path, uint32 depth, uint64 &hash) const;
+	bool Compile(const char *path, TShaderStage stage, const char *entryPoint, const char *defines, const char *outputPath) const;
+	bool Map(const char *path, TShaderBinary &binary) const;
+
+	char Directory[MaxPathLength] = {};
+	char CompilerPath[MaxPathLength] = {};
+	// 0 when there is no compiler.
+	uint64 CompilerHash = 0u;
+	bool Glslang = false;
+
+	volatile LONG HitCount = 0;
+	volatile LONG MissCount = 0;
+	volatile LONG FallbackCount = 0;
+	volatile LONG TemporaryCounter = 0;
+};
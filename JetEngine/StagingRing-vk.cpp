@@ -0,0 +1,620 @@
+#include "Precompiled.h"
+
+#include "RenderDevice-vk.h"
+
+static void RecordMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+{
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = nullptr;
+	memoryBarrier.srcAccessMask = srcAccessMask;
+	memoryBarrier.dstAccessMask = dstAccessMask;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		srcStageMask,
+		dstStageMask,
+		0,
+		1, &memoryBarrier,
+		0, nullptr,
+		0, nullptr
+	);
+}
+
+// Everything that reads uploaded data.
+static constexpr VkPipelineStageFlags ReadStageMask = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+	VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+static constexpr VkAccessFlags ReadAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT |
+	VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+// The graphics queue waits for a batch copied on the transfer queue here, mip generation blits included.
+static constexpr VkPipelineStageFlags AcquireStageMask = ReadStageMask | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+static VkImageMemoryBarrier MakeImageBarrier(VkImage image, uint32 baseLevel, uint32 levelCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+	VkImageMemoryBarrier imageMemoryBarrier = {};
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.pNext = nullptr;
+	imageMemoryBarrier.srcAccessMask = srcAccessMask;
+	imageMemoryBarrier.dstAccessMask = dstAccessMask;
+	imageMemoryBarrier.oldLayout = oldLayout;
+	imageMemoryBarrier.newLayout = newLayout;
+	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.image = image;
+	imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageMemoryBarrier.subresourceRange.baseMipLevel = baseLevel;
+	imageMemoryBarrier.subresourceRange.levelCount = levelCount;
+	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+	imageMemoryBarrier.subresourceRange.layerCount = 1;
+	return imageMemoryBarrier;
+}
+
+static VkCommandPool CreateCommandPool(VkDevice device, const VkAllocationCallbacks *allocator, uint32 queueFamilyIndex, VkCommandBuffer *commandBuffers, uint32 count)
+{
+	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.pNext = nullptr;
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+	VkCommandPool pool = VK_NULL_HANDLE;
+	VkResult result = vkCreateCommandPool(device, &commandPoolCreateInfo, allocator, &pool);
+	ASSERT(result == VK_SUCCESS);
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = nullptr;
+	commandBufferAllocateInfo.commandPool = pool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = count;
+
+	result = vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, commandBuffers);
+	ASSERT(result == VK_SUCCESS);
+
+	return pool;
+}
+
+static void BeginCommandBuffer(VkCommandBuffer commandBuffer)
+{
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = nullptr;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = nullptr;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	ASSERT(result == VK_SUCCESS);
+}
+
+void TVulkanStagingRing::Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, VkQueue queue, uint32 queueFamilyIndex,
+	VkQueue graphicsQueue, uint32 graphicsQueueFamilyIndex, VkDeviceSize size)
+{
+	Device = device;
+	Allocator = allocator;
+	MemoryManager = memoryManager;
+	Queue = queue;
+	GraphicsQueue = graphicsQueue;
+	QueueFamilyIndex = queueFamilyIndex;
+	GraphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+	DestinationSharing = TVulkanBufferSharing();
+	DestinationSharing.Add(graphicsQueueFamilyIndex);
+	DestinationSharing.Add(queueFamilyIndex);
+	Size = size;
+
+	VkBufferCreateInfo bufferCreateInfo = {};
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = nullptr;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = size;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 0;
+	bufferCreateInfo.pQueueFamilyIndices = nullptr;
+
+	VkResult result = vkCreateBuffer(Device, &bufferCreateInfo, Allocator, &Buffer);
+	ASSERT(result == VK_SUCCESS);
+	Memory = MemoryManager->AllocateBuffer(Buffer, TVulkanMemoryUsage::CpuToGpu);
+	ASSERT(Memory.Mapped != nullptr);
+
+	VkCommandBuffer commandBuffers[MaxBatches];
+	Pool = CreateCommandPool(Device, Allocator, QueueFamilyIndex, commandBuffers, MaxBatches);
+
+	VkCommandBuffer acquireCommandBuffers[MaxBatches] = {};
+	if (QueueFamilyIndex != GraphicsQueueFamilyIndex)
+		GraphicsPool = CreateCommandPool(Device, Allocator, GraphicsQueueFamilyIndex, acquireCommandBuffers, MaxBatches);
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.pNext = nullptr;
+	fenceCreateInfo.flags = 0;
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = nullptr;
+	semaphoreCreateInfo.flags = 0;
+
+	for (uint32 i = 0; i < MaxBatches; ++i)
+	{
+		Batches[i] = TBatch();
+		Batches[i].CommandBuffer = commandBuffers[i];
+		result = vkCreateFence(Device, &fenceCreateInfo, Allocator, &Batches[i].Fence);
+		ASSERT(result == VK_SUCCESS);
+
+		if (GraphicsPool != VK_NULL_HANDLE)
+		{
+			Batches[i].AcquireCommandBuffer = acquireCommandBuffers[i];
+			result = vkCreateSemaphore(Device, &semaphoreCreateInfo, Allocator, &Batches[i].Copied);
+			ASSERT(result == VK_SUCCESS);
+		}
+	}
+
+	Head = Tail = UsedBytes = 0u;
+	PendingBegin = PendingBytes = 0u;
+	FirstInFlight = InFlightCount = 0u;
+	Statistics = TVulkanUploadStatistics();
+}
+
+void TVulkanStagingRing::Done()
+{
+	while (InFlightCount > 0u)
+		WaitOldest();
+
+	for (auto &batch : Batches)
+	{
+		vkDestroyFence(Device, batch.Fence, Allocator);
+		if (batch.Copied != VK_NULL_HANDLE)
+			vkDestroySemaphore(Device, batch.Copied, Allocator);
+		batch = TBatch();
+	}
+
+	// Frees the command buffers as well.
+	vkDestroyCommandPool(Device, Pool, Allocator);
+	Pool = VK_NULL_HANDLE;
+	if (GraphicsPool != VK_NULL_HANDLE)
+	{
+		vkDestroyCommandPool(Device, GraphicsPool, Allocator);
+		GraphicsPool = VK_NULL_HANDLE;
+	}
+
+	vkDestroyBuffer(Device, Buffer, Allocator);
+	Buffer = VK_NULL_HANDLE;
+	MemoryManager->Free(Memory);
+
+	PendingCopies.resize(0);
+	Regions.resize(0);
+	PendingImages.resize(0);
+	ImageRegions.resize(0);
+	ImageBarriers.resize(0);
+}
+
+void TVulkanStagingRing::SetDestinationSharing(VkBufferCreateInfo &bufferCreateInfo) const
+{
+	DestinationSharing.Apply(bufferCreateInfo);
+}
+
+void TVulkanStagingRing::ShareDestinations(uint32 queueFamilyIndex)
+{
+	DestinationSharing.Add(queueFamilyIndex);
+}
+
+VkDeviceSize TVulkanStagingRing::Reserve(VkDeviceSize size)
+{
+	const VkDeviceSize alignedSize = AlignUp(size, Alignment);
+	ASSERT(alignedSize <= Size);
+
+	while (true)
+	{
+		if (UsedBytes == 0u)
+			Head = Tail = PendingBegin = 0u;
+
+		// Head == Tail with live data means the ring is full.
+		if (Head > Tail || UsedBytes == 0u)
+		{
+			if (alignedSize <= Size - Head)
+				break;
+
+			// Skip the end of the ring, the padding is released together with the batch that skipped it.
+			if (alignedSize <= Tail)
+			{
+				UsedBytes += Size - Head;
+				PendingBytes += Size - Head;
+				Head = 0u;
+				break;
+			}
+		}
+		else if (alignedSize <= Tail - Head)
+			break;
+
+		++Statistics.StallCount;
+		if (PendingBytes > 0u)
+			Submit();
+		if (InFlightCount > 0u)
+			WaitOldest();
+	}
+
+	const VkDeviceSize offset = Head;
+	Head = (Head + alignedSize) % Size;
+	UsedBytes += alignedSize;
+	PendingBytes += alignedSize;
+	return offset;
+}
+
+void TVulkanStagingRing::Upload(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size)
+{
+	const auto *source = static_cast<const uint8 *>(data);
+	Statistics.UploadedBytes += size;
+
+	// Pieces of at most half the ring, so one upload never has to wait for itself.
+	const VkDeviceSize maxPieceSize = Size / 2u;
+	while (size > 0u)
+	{
+		const VkDeviceSize pieceSize = Min(size, maxPieceSize);
+		const VkDeviceSize ringOffset = Reserve(pieceSize);
+		MemCopy(Memory.Mapped + ringOffset, source, int32(pieceSize));
+
+		auto &copy = PendingCopies.push_back({});
+		copy.Buffer = buffer;
+		copy.Region.srcOffset = ringOffset;
+		copy.Region.dstOffset = offset;
+		copy.Region.size = pieceSize;
+		copy.Sequence = uint32(PendingCopies.size() - 1u);
+		++Statistics.CopyCount;
+
+		source += pieceSize;
+		offset += pieceSize;
+		size -= pieceSize;
+	}
+}
+
+void TVulkanStagingRing::UploadImage(const TVulkanImageUpload &upload, const void *data)
+{
+	ASSERT(upload.UploadedLevelCount >= 1u && upload.UploadedLevelCount <= upload.LevelCount);
+	const auto *source = static_cast<const uint8 *>(data);
+	++Statistics.ImageCount;
+
+	{
+		auto &image = PendingImages.push_back({});
+		image.Upload = upload;
+		image.FirstRegion = uint32(ImageRegions.size());
+		image.RegionCount = 0u;
+		image.Begun = false;
+		image.Complete = false;
+	}
+
+	// Pieces of whole rows of blocks, at most half the ring like buffer uploads. A submit on the way takes the
+	// image's regions so far, the image stays the last one pending.
+	const VkDeviceSize maxPieceSize = Size / 2u;
+	for (uint32 level = 0; level < upload.UploadedLevelCount; ++level)
+	{
+		const uint32 width = Max(upload.Width >> level, 1u);
+		const uint32 height = Max(upload.Height >> level, 1u);
+		const uint32 rowCount = DivCeil(height, upload.BlockSize);
+		const VkDeviceSize rowBytes = VkDeviceSize(DivCeil(width, upload.BlockSize)) * upload.BlockBytes;
+		ASSERT(rowBytes <= maxPieceSize);
+		const uint32 maxPieceRows = uint32(maxPieceSize / rowBytes);
+
+		for (uint32 row = 0; row < rowCount;)
+		{
+			const uint32 pieceRows = Min(rowCount - row, maxPieceRows);
+			const VkDeviceSize pieceSize = pieceRows * rowBytes;
+			const VkDeviceSize ringOffset = Reserve(pieceSize);
+			MemCopy(Memory.Mapped + ringOffset, source, int32(pieceSize));
+
+			auto &region = ImageRegions.push_back({});
+			region.bufferOffset = ringOffset;
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = level;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, int32(row * upload.BlockSize), 0 };
+			region.imageExtent = { width, Min(pieceRows * upload.BlockSize, height - row * upload.BlockSize), 1 };
+			++PendingImages.back().RegionCount;
+			Statistics.UploadedBytes += pieceSize;
+			++Statistics.CopyCount;
+
+			source += pieceSize;
+			row += pieceRows;
+		}
+	}
+	PendingImages.back().Complete = true;
+}
+
+void TVulkanStagingRing::RecordCopies(VkCommandBuffer commandBuffer)
+{
+	// Group by destination and keep the upload order within one buffer, later uploads win where ranges overlap.
+	Sort(PendingCopies.data(), PendingCopies.data() + PendingCopies.size(), [](const TPendingCopy &lhs, const TPendingCopy &rhs) {
+		return lhs.Buffer != rhs.Buffer ? lhs.Buffer < rhs.Buffer : lhs.Sequence < rhs.Sequence;
+	});
+
+	const auto FlushRegions = [&](VkBuffer buffer) {
+		if (Regions.empty())
+			return;
+		vkCmdCopyBuffer(commandBuffer, Buffer, buffer, uint32(Regions.size()), Regions.data());
+		++Statistics.CopyCommandCount;
+		Regions.resize(0);
+	};
+
+	for (size_t i = 0; i < PendingCopies.size(); ++i)
+	{
+		const auto &copy = PendingCopies[i];
+		if (i > 0u && PendingCopies[i - 1u].Buffer != copy.Buffer)
+			FlushRegions(PendingCopies[i - 1u].Buffer);
+
+		const VkBufferCopy &region = copy.Region;
+		if (!Regions.empty())
+		{
+			// Pieces of one upload are back to back on both sides and become a single region.
+			auto &last = Regions.back();
+			if (last.srcOffset + last.size == region.srcOffset && last.dstOffset + last.size == region.dstOffset)
+			{
+				last.size += region.size;
+				continue;
+			}
+
+			// Regions of one copy command must not overlap, rewrites of a range go into the next command.
+			bool overlaps = false;
+			for (size_t j = 0; j < Regions.size() && !overlaps; ++j)
+				overlaps = region.dstOffset < Regions[j].dstOffset + Regions[j].size && Regions[j].dstOffset < region.dstOffset + region.size;
+
+			if (overlaps)
+			{
+				FlushRegions(copy.Buffer);
+				RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+			}
+		}
+		Regions.push_back(region);
+	}
+	FlushRegions(PendingCopies.back().Buffer);
+
+	PendingCopies.resize(0);
+}
+
+void TVulkanStagingRing::Flush(VkDeviceSize begin, VkDeviceSize end, VkDeviceSize bytes)
+{
+	if (bytes == 0u)
+		return;
+
+	if (begin < end)
+	{
+		MemoryManager->Flush(Memory, begin, end - begin);
+	}
+	else
+	{
+		MemoryManager->Flush(Memory, begin, Size - begin);
+		if (end > 0u)
+			MemoryManager->Flush(Memory, 0u, end);
+	}
+}
+
+void TVulkanStagingRing::RecordImageCopies(VkCommandBuffer commandBuffer)
+{
+	ImageBarriers.resize(0);
+	for (size_t i = 0; i < PendingImages.size(); ++i)
+	{
+		const auto &image = PendingImages[i];
+		if (!image.Begun)
+			ImageBarriers.push_back(MakeImageBarrier(image.Upload.Image, 0u, image.Upload.LevelCount, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT));
+	}
+	if (!ImageBarriers.empty())
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, uint32(ImageBarriers.size()), ImageBarriers.data());
+
+	// Every level of an image in one command.
+	for (size_t i = 0; i < PendingImages.size(); ++i)
+	{
+		const auto &image = PendingImages[i];
+		if (image.RegionCount == 0u)
+			continue;
+		vkCmdCopyBufferToImage(commandBuffer, Buffer, image.Upload.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, image.RegionCount, ImageRegions.data() + image.FirstRegion);
+		++Statistics.CopyCommandCount;
+	}
+}
+
+void TVulkanStagingRing::RecordImageFinish(VkCommandBuffer commandBuffer)
+{
+	ImageBarriers.resize(0);
+	for (size_t i = 0; i < PendingImages.size(); ++i)
+	{
+		if (!PendingImages[i].Complete)
+			continue;
+
+		const TVulkanImageUpload &upload = PendingImages[i].Upload;
+		if (upload.UploadedLevelCount == upload.LevelCount)
+		{
+			ImageBarriers.push_back(MakeImageBarrier(upload.Image, 0u, upload.LevelCount, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+			continue;
+		}
+
+		// Each level is blitted from the one before it, which is a blit source from then on.
+		VkImageMemoryBarrier imageMemoryBarrier = MakeImageBarrier(upload.Image, 0u, upload.UploadedLevelCount, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+		for (uint32 level = upload.UploadedLevelCount; level < upload.LevelCount; ++level)
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+			VkImageBlit imageBlit = {};
+			imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageBlit.srcSubresource.mipLevel = level - 1u;
+			imageBlit.srcSubresource.baseArrayLayer = 0;
+			imageBlit.srcSubresource.layerCount = 1;
+			imageBlit.srcOffsets[1] = { int32(Max(upload.Width >> (level - 1u), 1u)), int32(Max(upload.Height >> (level - 1u), 1u)), 1 };
+			imageBlit.dstSubresource = imageBlit.srcSubresource;
+			imageBlit.dstSubresource.mipLevel = level;
+			imageBlit.dstOffsets[1] = { int32(Max(upload.Width >> level, 1u)), int32(Max(upload.Height >> level, 1u)), 1 };
+			vkCmdBlitImage(commandBuffer, upload.Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, upload.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+
+			imageMemoryBarrier.subresourceRange.baseMipLevel = level;
+			imageMemoryBarrier.subresourceRange.levelCount = 1;
+		}
+		Statistics.GeneratedLevelCount += upload.LevelCount - upload.UploadedLevelCount;
+
+		ImageBarriers.push_back(MakeImageBarrier(upload.Image, 0u, upload.LevelCount - 1u, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+		ImageBarriers.push_back(MakeImageBarrier(upload.Image, upload.LevelCount - 1u, 1u, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+	}
+
+	// Like the buffers' barrier, covers every command submitted to the queue afterwards.
+	if (!ImageBarriers.empty())
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, ReadStageMask, 0, 0, nullptr, 0, nullptr, uint32(ImageBarriers.size()), ImageBarriers.data());
+}
+
+void TVulkanStagingRing::RecordOwnershipTransfer(VkCommandBuffer commandBuffer, bool acquire)
+{
+	// Complete images only, the rest of an image split over batches is still to be copied. They keep their
+	// layout, the blits and the final transition are recorded on the graphics queue. New images have no contents
+	// to keep, so the transfer family takes them without an acquire of its own.
+	ImageBarriers.resize(0);
+	for (size_t i = 0; i < PendingImages.size(); ++i)
+	{
+		const auto &image = PendingImages[i];
+		if (!image.Complete)
+			continue;
+		auto &imageMemoryBarrier = ImageBarriers.push_back(MakeImageBarrier(image.Upload.Image, 0u, image.Upload.LevelCount, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, acquire ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT, acquire ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : 0));
+		imageMemoryBarrier.srcQueueFamilyIndex = QueueFamilyIndex;
+		imageMemoryBarrier.dstQueueFamilyIndex = GraphicsQueueFamilyIndex;
+	}
+
+	if (ImageBarriers.empty())
+		return;
+
+	// The acquire is chained to the semaphore wait by its source stages.
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		acquire ? AcquireStageMask : VK_PIPELINE_STAGE_TRANSFER_BIT,
+		acquire ? AcquireStageMask : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		uint32(ImageBarriers.size()), ImageBarriers.data()
+	);
+	if (acquire)
+		Statistics.OwnershipTransferCount += ImageBarriers.size();
+}
+
+void TVulkanStagingRing::SubmitCommandBuffer(VkQueue queue, VkCommandBuffer commandBuffer, VkSemaphore wait, VkPipelineStageFlags waitStageMask, VkSemaphore signal, VkFence fence)
+{
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = nullptr;
+	submitInfo.waitSemaphoreCount = wait != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pWaitSemaphores = &wait;
+	submitInfo.pWaitDstStageMask = &waitStageMask;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = signal != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pSignalSemaphores = &signal;
+
+	VkResult result = vkQueueSubmit(queue, 1, &submitInfo, fence);
+	ASSERT(result == VK_SUCCESS);
+}
+
+void TVulkanStagingRing::Submit()
+{
+	Retire();
+	if (PendingCopies.empty() && PendingImages.empty())
+		return;
+
+	TBatch &batch = Batches[(FirstInFlight + InFlightCount) % MaxBatches];
+	batch.Begin = PendingBegin;
+	batch.End = Head;
+	batch.Bytes = PendingBytes;
+	Flush(batch.Begin, batch.End, batch.Bytes);
+
+	BeginCommandBuffer(batch.CommandBuffer);
+	if (!PendingCopies.empty())
+		RecordCopies(batch.CommandBuffer);
+	RecordImageCopies(batch.CommandBuffer);
+
+	if (batch.AcquireCommandBuffer == VK_NULL_HANDLE)
+	{
+		// Covers every command submitted to the queue afterwards, so the draws need no barriers of their own.
+		RecordMemoryBarrier(batch.CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, ReadStageMask, ReadAccessMask);
+		RecordImageFinish(batch.CommandBuffer);
+
+		VkResult result = vkEndCommandBuffer(batch.CommandBuffer);
+		ASSERT(result == VK_SUCCESS);
+
+		SubmitCommandBuffer(Queue, batch.CommandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, batch.Fence);
+	}
+	else
+	{
+		// The copies run on the transfer queue without waiting for the graphics queue, which only waits for them
+		// where it reads. Destination buffers are shared by both families, only the images change hands.
+		RecordOwnershipTransfer(batch.CommandBuffer, false);
+
+		VkResult result = vkEndCommandBuffer(batch.CommandBuffer);
+		ASSERT(result == VK_SUCCESS);
+
+		SubmitCommandBuffer(Queue, batch.CommandBuffer, VK_NULL_HANDLE, 0, batch.Copied, VK_NULL_HANDLE);
+
+		// Like the barrier above, these cover every command submitted to the graphics queue afterwards. The semaphore
+		// made the copies available, the memory barrier chained to its wait makes them visible to the buffer reads.
+		BeginCommandBuffer(batch.AcquireCommandBuffer);
+		RecordMemoryBarrier(batch.AcquireCommandBuffer, AcquireStageMask, 0, ReadStageMask, ReadAccessMask);
+		RecordOwnershipTransfer(batch.AcquireCommandBuffer, true);
+		RecordImageFinish(batch.AcquireCommandBuffer);
+		result = vkEndCommandBuffer(batch.AcquireCommandBuffer);
+		ASSERT(result == VK_SUCCESS);
+
+		SubmitCommandBuffer(GraphicsQueue, batch.AcquireCommandBuffer, batch.Copied, AcquireStageMask, VK_NULL_HANDLE, batch.Fence);
+	}
+
+	// Only the last image can be incomplete, its remaining regions go into the next batch.
+	const bool carryOver = !PendingImages.empty() && !PendingImages.back().Complete;
+	if (carryOver)
+	{
+		TPendingImage image = PendingImages.back();
+		image.FirstRegion = 0u;
+		image.RegionCount = 0u;
+		image.Begun = true;
+		PendingImages.resize(0);
+		PendingImages.push_back(image);
+	}
+	else
+	{
+		PendingImages.resize(0);
+	}
+	ImageRegions.resize(0);
+
+	PendingBegin = Head;
+	PendingBytes = 0u;
+	++InFlightCount;
+	++Statistics.SubmitCount;
+	Statistics.PeakBytesInFlight = Max(Statistics.PeakBytesInFlight, uint64(UsedBytes));
+
+	// The next batch records into the slot after the newest one, which has to be free by then.
+	if (InFlightCount == MaxBatches)
+	{
+		++Statistics.StallCount;
+		WaitOldest();
+	}
+}
+
+void TVulkanStagingRing::Release(TBatch &batch)
+{
+	VkResult result = vkResetFences(Device, 1, &batch.Fence);
+	ASSERT(result == VK_SUCCESS);
+
+	UsedBytes -= batch.Bytes;
+	Tail = batch.End;
+	FirstInFlight = (FirstInFlight + 1u) % MaxBatches;
+	--InFlightCount;
+}
+
+void TVulkanStagingRing::Retire()
+{
+	while (InFlightCount > 0u && vkGetFenceStatus(Device, Batches[FirstInFlight].Fence) == VK_SUCCESS)
+		Release(Batches[FirstInFlight]);
+}
+
+void TVulkanStagingRing::WaitOldest()
+{
+	TBatch &batch = Batches[FirstInFlight];
+	VkResult result = vkWaitForFences(Device, 1, &batch.Fence, VK_TRUE, TNumericLimits<uint64>::Max());
+	ASSERT(result == VK_SUCCESS);
+	Release(batch);
+}
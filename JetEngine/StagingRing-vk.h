@@ -0,0 +1,163 @@
+#pragma once
+
+// References:
+// https://github.com/KhronosGroup/Vulkan-Docs/wiki/Synchronization-Examples
+// https://developer.nvidia.com/vulkan-memory-management
+
+struct TVulkanUploadStatistics
+{
+	uint64 UploadedBytes = 0u;
+	// Upload calls, including the pieces of uploads larger than the ring.
+	uint64 CopyCount = 0u;
+	// vkCmdCopyBuffer calls, after copies to the same buffer are batched and adjacent regions merged.
+	uint64 CopyCommandCount = 0u;
+	uint64 SubmitCount = 0u;
+	// Times the ring was full and the CPU had to wait for the GPU to finish a batch.
+	uint64 StallCount = 0u;
+	// Images handed from the transfer queue's family to the graphics queue's.
+	uint64 OwnershipTransferCount = 0u;
+	uint64 PeakBytesInFlight = 0u;
+	uint64 ImageCount = 0u;
+	// Levels filled in by blits rather than uploaded.
+	uint64 GeneratedLevelCount = 0u;
+};
+
+// Levels of a new image, uploaded together and made ready to be sampled.
+struct TVulkanImageUpload
+{
+	VkImage Image = VK_NULL_HANDLE;
+	// Of level 0.
+	uint32 Width = 1u;
+	uint32 Height = 1u;
+	uint32 LevelCount = 1u;
+	// Levels in the data, the ones after them are generated by linear blits, which the format has to support.
+	uint32 UploadedLevelCount = 1u;
+	// Texel blocks, 1x1 for uncompressed formats.
+	uint32 BlockSize = 1u;
+	uint32 BlockBytes = 4u;
+};
+
+// Persistently mapped ring of host visible memory. Data is written at the head and copied into device local
+// buffers and images by batched transfer commands, the space is reclaimed once the fence of the batch that read
+// it signals. With a transfer queue of another family than the graphics queue the copies run there, beside the
+// frames: the transfer queue signals a semaphore the graphics queue waits on before it reads. Destination buffers
+// are created shared by both families, and by the readers ShareDestinations adds, see SetDestinationSharing, so a
+// copy into part of a buffer leaves the rest of it intact. New images are released by the transfer family and
+// acquired by the graphics family, which then generates their missing levels. Not thread safe, uploads are issued
+// from the render thread.
+class TVulkanStagingRing
+{
+public:
+	// queue may be graphicsQueue, the copies are then recorded on it directly.
+	void Init(VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, VkQueue queue, uint32 queueFamilyIndex,
+		VkQueue graphicsQueue, uint32 graphicsQueueFamilyIndex, VkDeviceSize size);
+	void Done();
+
+	// Sets the sharing mode of a buffer the ring copies into. Concurrent between the transfer and the graphics family
+	// when they differ, the buffer never changes owner. pQueueFamilyIndices points into the ring.
+	void SetDestinationSharing(VkBufferCreateInfo &bufferCreateInfo) const;
+	// Adds a family that reads the destination buffers besides the graphics one, before any of them is created. Its
+	// queue has to wait for the graphics queue to see the data.
+	void ShareDestinations(uint32 queueFamilyIndex);
+
+	// Copies the data into the ring and queues a transfer into the buffer, which needs VK_BUFFER_USAGE_TRANSFER_DST_BIT
+	// and the sharing mode SetDestinationSharing gives.
+	void Upload(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size);
+	// Copies the levels, tightly packed from level 0 on, into the ring and queues one copy command for all of them.
+	// The image has to be new, with TRANSFER_DST usage and TRANSFER_SRC as well when levels are generated. After
+	// the batch it is in SHADER_READ_ONLY_OPTIMAL for everything submitted to the graphics queue.
+	void UploadImage(const TVulkanImageUpload &upload, const void *data);
+	// Submits the queued transfers, followed by a barrier that makes them visible to vertex, index, uniform and shader
+	// reads of everything submitted to the graphics queue afterwards. Call before submitting the work that uses the data.
+	void Submit();
+	// Reclaims the space of the batches the GPU has finished, without waiting.
+	void Retire();
+
+	const TVulkanUploadStatistics &GetStatistics() const {
+		return Statistics;
+	}
+
+private:
+	static constexpr uint32 MaxBatches = 4u;
+	// Keeps every copy source aligned for texel block sizes and optimalBufferCopyOffsetAlignment alike.
+	static constexpr VkDeviceSize Alignment = 16u;
+
+	struct TPendingCopy
+	{
+		VkBuffer Buffer;
+		VkBufferCopy Region;
+		uint32 Sequence;
+	};
+
+	struct TPendingImage
+	{
+		TVulkanImageUpload Upload;
+		// Regions recorded since the last submit, an image larger than the ring is split over batches.
+		uint32 FirstRegion;
+		uint32 RegionCount;
+		// Moved to TRANSFER_DST_OPTIMAL by an earlier batch.
+		bool Begun;
+		// Every level is in the ring, the batch finishes the image.
+		bool Complete;
+	};
+
+	struct TBatch
+	{
+		VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+		// Signaled on the graphics queue, after the acquire when the buffers change family.
+		VkFence Fence = VK_NULL_HANDLE;
+		// Only used with a transfer queue of its own, the acquire runs on the graphics queue once Copied signals.
+		VkCommandBuffer AcquireCommandBuffer = VK_NULL_HANDLE;
+		VkSemaphore Copied = VK_NULL_HANDLE;
+		// Ring range read by the batch, Bytes includes the padding skipped when the head wrapped.
+		VkDeviceSize Begin = 0u;
+		VkDeviceSize End = 0u;
+		VkDeviceSize Bytes = 0u;
+	};
+
+	VkDeviceSize Reserve(VkDeviceSize size);
+	void RecordCopies(VkCommandBuffer commandBuffer);
+	void RecordImageCopies(VkCommandBuffer commandBuffer);
+	// Generates the missing levels of the complete images and moves them to SHADER_READ_ONLY_OPTIMAL, on the
+	// graphics queue's family.
+	void RecordImageFinish(VkCommandBuffer commandBuffer);
+	// Release or acquire of the images the batch completes, the two halves have to match.
+	void RecordOwnershipTransfer(VkCommandBuffer commandBuffer, bool acquire);
+	void SubmitCommandBuffer(VkQueue queue, VkCommandBuffer commandBuffer, VkSemaphore wait, VkPipelineStageFlags waitStageMask, VkSemaphore signal, VkFence fence);
+	void Flush(VkDeviceSize begin, VkDeviceSize end, VkDeviceSize bytes);
+	void WaitOldest();
+	void Release(TBatch &batch);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	TVulkanMemoryManager *MemoryManager = nullptr;
+	VkQueue Queue = VK_NULL_HANDLE;
+	VkQueue GraphicsQueue = VK_NULL_HANDLE;
+	uint32 QueueFamilyIndex = 0u;
+	uint32 GraphicsQueueFamilyIndex = 0u;
+	TVulkanBufferSharing DestinationSharing;
+	VkCommandPool Pool = VK_NULL_HANDLE;
+	// Graphics family pool of the acquire command buffers.
+	VkCommandPool GraphicsPool = VK_NULL_HANDLE;
+
+	VkBuffer Buffer = VK_NULL_HANDLE;
+	TVulkanAllocation Memory;
+	VkDeviceSize Size = 0u;
+	VkDeviceSize Head = 0u;
+	VkDeviceSize Tail = 0u;
+	VkDeviceSize UsedBytes = 0u;
+	// Start and size of the data written since the last submit.
+	VkDeviceSize PendingBegin = 0u;
+	VkDeviceSize PendingBytes = 0u;
+
+	TBatch Batches[MaxBatches];
+	uint32 FirstInFlight = 0u;
+	uint32 InFlightCount = 0u;
+
+	TVarArray<TPendingCopy> PendingCopies;
+	TVarArray<VkBufferCopy> Regions;
+	TVarArray<TPendingImage> PendingImages;
+	TVarArray<VkBufferImageCopy> ImageRegions;
+	TVarArray<VkImageMemoryBarrier> ImageBarriers;
+	TVulkanUploadStatistics Statistics;
+};
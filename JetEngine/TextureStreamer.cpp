@@ -0,0 +1,389 @@
+#include "Precompiled.h"
+
+#include "TextureStreamer.h"
+
+static constexpr uint32 TextureFileMagic = 0x5845544Au; // "JTEX"
+static constexpr uint32 TextureFileVersion = 1u;
+
+struct TTextureFileHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	uint32 Width;
+	uint32 Height;
+	uint32 MipCount;
+	uint32 Format;
+};
+
+// Bytes of levels [first, end), packed one after the other.
+static uint64 GetLevelRangeSize(const TTextureDesc &desc, uint32 first, uint32 end)
+{
+	uint64 size = 0u;
+	for (uint32 level = first; level < end; ++level)
+		size += GetTextureLevelSize(desc, level);
+	return size;
+}
+
+bool WriteTextureFile(const char *path, const TTextureDesc &desc, const void *levels)
+{
+	ASSERT(desc.MipCount >= 1u && desc.MipCount <= GetTextureMipCount(desc.Width, desc.Height));
+	TTextureFileHeader header;
+	header.Magic = TextureFileMagic;
+	header.Version = TextureFileVersion;
+	header.Width = desc.Width;
+	header.Height = desc.Height;
+	header.MipCount = desc.MipCount;
+	header.Format = uint32(desc.Format);
+
+	const uint64 levelsSize = GetLevelRangeSize(desc, 0u, desc.MipCount);
+	TVarArray<uint8> file;
+	file.resize(size_t(sizeof(header) + levelsSize));
+	MemCopy(file.data(), &header, sizeof(header));
+	MemCopy(file.data() + sizeof(header), levels, size_t(levelsSize));
+	return FS::WriteAtomic(path, file.data(), file.size());
+}
+
+void TTextureStreamer::Init(IGraphicsAPI *api, uint64 budget, uint32 retireFrames)
+{
+	API = api;
+	Budget = budget;
+	RetireFrames = retireFrames;
+	Frame = 1;
+}
+
+void TTextureStreamer::Done()
+{
+	for (uint32 i = 0; i < Textures.size(); ++i)
+	{
+		if (Textures[i].Texture != nullptr)
+			Remove(i);
+	}
+	// The API frees what is left when it is done itself.
+	Statistics.ResidentBytes -= Statistics.RetiringBytes;
+	Statistics.RetiringBytes = 0u;
+	Retired.resize(0);
+	Textures.resize(0);
+	FreeTextures.resize(0);
+	Requests.resize(0);
+	MostRecent = NoLink;
+	LeastRecent = NoLink;
+	API = nullptr;
+}
+
+uint32 TTextureStreamer::Add(const char *path)
+{
+	if (!FS::Exists(path))
+		return InvalidTexture;
+
+	FS::File file = FS::Open(path, FS::Read);
+	const auto *bytes = static_cast<const uint8 *>(file.Platform.Buffer);
+	TTextureFileHeader header;
+	bool valid = file.Size >= sizeof(header);
+	if (valid)
+	{
+		MemCopy(&header, bytes, sizeof(header));
+		valid = header.Magic == TextureFileMagic && header.Version == TextureFileVersion && header.Width != 0u && header.Height != 0u &&
+			header.MipCount >= 1u && header.MipCount <= GetTextureMipCount(header.Width, header.Height) &&
+			header.Format <= uint32(TTextureFormat::BC7Srgb);
+	}
+	TTextureDesc desc;
+	if (valid)
+	{
+		desc.Width = header.Width;
+		desc.Height = header.Height;
+		desc.MipCount = header.MipCount;
+		desc.Format = TTextureFormat(header.Format);
+		// Catches truncated files.
+		valid = file.Size - sizeof(header) >= GetLevelRangeSize(desc, 0u, desc.MipCount);
+	}
+	if (!valid)
+	{
+		DebugPrint("Texture %s is not a valid texture file\n", path);
+		FS::Close(file);
+		return InvalidTexture;
+	}
+
+	uint32 index;
+	if (!FreeTextures.empty())
+	{
+		index = FreeTextures.back();
+		FreeTextures.pop_back();
+	}
+	else
+	{
+		index = uint32(Textures.size());
+		Textures.push_back(TStreamedTexture());
+	}
+
+	TStreamedTexture &texture = Textures[index];
+	texture.File = file;
+	texture.Levels = bytes + sizeof(header);
+	texture.Desc = desc;
+	texture.TailLevel = 0u;
+	while (texture.TailLevel + 1u < desc.MipCount && Max(desc.Width, desc.Height) >> texture.TailLevel > TailSize)
+		++texture.TailLevel;
+	texture.ResidentLevel = desc.MipCount;
+	texture.RequestedLevel = LONG(texture.TailLevel);
+	texture.LastUsed = 0;
+	texture.Load = NoLoad;
+
+	const uint64 tailOffset = GetLevelRangeSize(desc, 0u, texture.TailLevel);
+	texture.Tail.resize(size_t(GetLevelRangeSize(desc, texture.TailLevel, desc.MipCount)));
+	MemCopy(texture.Tail.data(), texture.Levels + tailOffset, texture.Tail.size());
+	Replace(index, texture.TailLevel, texture.Tail.data());
+	Link(index);
+	++Statistics.TextureCount;
+	return index;
+}
+
+void TTextureStreamer::Remove(uint32 index)
+{
+	TStreamedTexture &texture = Textures[index];
+	ASSERT(texture.Texture != nullptr);
+	if (texture.Load != NoLoad)
+	{
+		TLoad &load = Loads[texture.Load];
+		Jobs::Wait(load.Counter);
+		load.Texture = InvalidTexture;
+		load.Data = TVarArray<uint8>();
+		Statistics.PendingBytes -= load.Growth;
+		--LoadsInFlight;
+	}
+
+	Retire(texture);
+	FS::Close(texture.File);
+	Unlink(index);
+	texture = TStreamedTexture();
+	FreeTextures.push_back(index);
+	--Statistics.TextureCount;
+}
+
+void TTextureStreamer::ReportUsage(uint32 index, uint32 screenSize)
+{
+	TStreamedTexture &texture = Textures[index];
+	const uint32 size = Max(texture.Desc.Width, texture.Desc.Height);
+	uint32 level = 0u;
+	while (level < texture.TailLevel && size >> (level + 1u) >= screenSize)
+		++level;
+
+	InterlockedExchange(&texture.LastUsed, Frame);
+	LONG requested = texture.RequestedLevel;
+	while (LONG(level) < requested)
+	{
+		const LONG previous = InterlockedCompareExchange(&texture.RequestedLevel, LONG(level), requested);
+		if (previous == requested)
+			break;
+		requested = previous;
+	}
+}
+
+void TTextureStreamer::Update()
+{
+	CollectRetired();
+	FinishLoads();
+
+	// Unreported textures keep whatever they have until the budget needs it.
+	Requests.resize(0);
+	for (uint32 i = 0; i < Textures.size(); ++i)
+	{
+		TStreamedTexture &texture = Textures[i];
+		if (texture.Texture == nullptr || texture.LastUsed != Frame)
+			continue;
+		Unlink(i);
+		Link(i);
+		const uint32 level = uint32(InterlockedExchange(&texture.RequestedLevel, LONG(texture.TailLevel)));
+		if (level < texture.ResidentLevel && texture.Load == NoLoad)
+			Requests.push_back({ i, level });
+	}
+
+	// The blurriest first, counted in levels missing.
+	Sort(Requests.data(), Requests.data() + Requests.size(), [&](const TRequest &lhs, const TRequest &rhs) {
+		return Textures[lhs.Texture].ResidentLevel - lhs.Level > Textures[rhs.Texture].ResidentLevel - rhs.Level;
+	});
+
+	for (size_t i = 0; i < Requests.size(); ++i)
+	{
+		if (LoadsInFlight == MaxLoadsInFlight)
+		{
+			Statistics.DeferredCount += Requests.size() - i;
+			break;
+		}
+
+		const TRequest &request = Requests[i];
+		const TStreamedTexture &texture = Textures[request.Texture];
+		// The whole chain is created before the resident one retires.
+		const uint64 available = GetAvailableBytes();
+		// Settles for a coarser level when the one asked for does not fit.
+		uint32 level = request.Level;
+		while (level < texture.ResidentLevel && GetLevelRangeSize(texture.Desc, level, texture.Desc.MipCount) > available)
+			++level;
+		if (level == texture.ResidentLevel)
+		{
+			++Statistics.DeferredCount;
+			continue;
+		}
+
+		// Evicted textures only make room once they are freed as well, the load waits for it. What the textures
+		// retiring already free is not evicted again.
+		const uint64 committed = Statistics.ResidentBytes + Statistics.PendingBytes + GetLevelRangeSize(texture.Desc, level, texture.Desc.MipCount);
+		if (committed > Budget)
+		{
+			if (committed - Budget > Statistics.RetiringBytes)
+				Evict(committed - Budget - Statistics.RetiringBytes);
+			++Statistics.DeferredCount;
+			continue;
+		}
+		StartLoad(request.Texture, level);
+	}
+
+	InterlockedIncrement(&Frame);
+}
+
+void TTextureStreamer::LoadLevels(void *data, int32, int32)
+{
+	TLoad &load = *static_cast<TLoad *>(data);
+	MemCopy(load.Data.data(), load.Source, load.Data.size());
+}
+
+void TTextureStreamer::Link(uint32 index)
+{
+	TStreamedTexture &texture = Textures[index];
+	texture.Previous = NoLink;
+	texture.Next = MostRecent;
+	if (MostRecent != NoLink)
+		Textures[MostRecent].Previous = index;
+	else
+		LeastRecent = index;
+	MostRecent = index;
+}
+
+void TTextureStreamer::Unlink(uint32 index)
+{
+	TStreamedTexture &texture = Textures[index];
+	if (texture.Previous != NoLink)
+		Textures[texture.Previous].Next = texture.Next;
+	else
+		MostRecent = texture.Next;
+	if (texture.Next != NoLink)
+		Textures[texture.Next].Previous = texture.Previous;
+	else
+		LeastRecent = texture.Previous;
+	texture.Previous = NoLink;
+	texture.Next = NoLink;
+}
+
+void TTextureStreamer::Replace(uint32 index, uint32 level, const void *data)
+{
+	TStreamedTexture &texture = Textures[index];
+	// Level i of levels [level, MipCount) has the size of level + i of the whole chain, BC blocks included.
+	TTextureDesc desc = texture.Desc;
+	desc.Width = Max(desc.Width >> level, 1u);
+	desc.Height = Max(desc.Height >> level, 1u);
+	desc.MipCount -= level;
+	IGraphicsTexture *replacement = API->CreateTexture(desc, data, desc.MipCount);
+
+	if (texture.Texture != nullptr)
+		Retire(texture);
+	Statistics.ResidentBytes += GetLevelRangeSize(texture.Desc, level, texture.Desc.MipCount);
+	texture.Texture = replacement;
+	texture.ResidentLevel = level;
+}
+
+void TTextureStreamer::Retire(TStreamedTexture &texture)
+{
+	// The API keeps it alive for its frames in flight, RetireFrames Updates.
+	delete texture.Texture;
+	texture.Texture = nullptr;
+	const uint64 bytes = GetLevelRangeSize(texture.Desc, texture.ResidentLevel, texture.Desc.MipCount);
+	Retired.push_back({ bytes, Frame });
+	Statistics.RetiringBytes += bytes;
+}
+
+void TTextureStreamer::CollectRetired()
+{
+	size_t collected = 0u;
+	while (collected < Retired.size() && Frame - Retired[collected].Frame >= LONG(RetireFrames))
+	{
+		Statistics.ResidentBytes -= Retired[collected].Bytes;
+		Statistics.RetiringBytes -= Retired[collected].Bytes;
+		++collected;
+	}
+	for (size_t i = collected; i < Retired.size(); ++i)
+		Retired[i - collected] = Retired[i];
+	Retired.resize(Retired.size() - collected);
+}
+
+bool TTextureStreamer::IsEvictable(const TStreamedTexture &texture) const
+{
+	return texture.LastUsed != Frame && texture.Load == NoLoad && texture.ResidentLevel < texture.TailLevel;
+}
+
+uint64 TTextureStreamer::GetAvailableBytes() const
+{
+	uint64 available = Budget + Statistics.RetiringBytes;
+	for (uint32 i = LeastRecent; i != NoLink; i = Textures[i].Previous)
+	{
+		const TStreamedTexture &texture = Textures[i];
+		if (IsEvictable(texture))
+			available += GetLevelRangeSize(texture.Desc, texture.ResidentLevel, texture.TailLevel);
+	}
+	const uint64 committed = Statistics.ResidentBytes + Statistics.PendingBytes;
+	return available > committed ? available - committed : 0u;
+}
+
+void TTextureStreamer::Evict(uint64 bytes)
+{
+	uint64 evicted = 0u;
+	uint32 i = LeastRecent;
+	while (i != NoLink && evicted < bytes)
+	{
+		TStreamedTexture &texture = Textures[i];
+		const uint32 previous = texture.Previous;
+		if (IsEvictable(texture))
+		{
+			evicted += GetLevelRangeSize(texture.Desc, texture.ResidentLevel, texture.TailLevel);
+			Replace(i, texture.TailLevel, texture.Tail.data());
+			++Statistics.EvictionCount;
+		}
+		i = previous;
+	}
+}
+
+void TTextureStreamer::StartLoad(uint32 index, uint32 level)
+{
+	TStreamedTexture &texture = Textures[index];
+	uint32 slot = 0u;
+	while (Loads[slot].Texture != InvalidTexture)
+		++slot;
+
+	TLoad &load = Loads[slot];
+	load.Texture = index;
+	load.Level = level;
+	load.Growth = GetLevelRangeSize(texture.Desc, level, texture.Desc.MipCount);
+	load.Source = texture.Levels + GetLevelRangeSize(texture.Desc, 0u, level);
+	load.Data.resize(size_t(GetLevelRangeSize(texture.Desc, level, texture.Desc.MipCount)));
+	texture.Load = slot;
+	Statistics.PendingBytes += load.Growth;
+	++LoadsInFlight;
+	Jobs::DispatchBackground(LoadLevels, &load, load.Counter);
+}
+
+void TTextureStreamer::FinishLoads()
+{
+	for (uint32 slot = 0; slot < MaxLoadsInFlight; ++slot)
+	{
+		TLoad &load = Loads[slot];
+		if (load.Texture == InvalidTexture || !Jobs::IsDone(load.Counter))
+			continue;
+
+		Statistics.PendingBytes -= load.Growth;
+		Replace(load.Texture, load.Level, load.Data.data());
+		Textures[load.Texture].Load = NoLoad;
+		++Statistics.LoadCount;
+		Statistics.LoadedBytes += load.Data.size();
+		load.Texture = InvalidTexture;
+		// Chains of the largest textures are too large to keep around.
+		load.Data = TVarArray<uint8>();
+		--LoadsInFlight;
+	}
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "Core/Containers/String.h"
+#include "RenderDevice.h"
+#include "FileSystem.h"
+#include "JobSystem.h"
+
+// References:
+// https://www.gdcvault.com/play/1020471/Virtual-Texturing-in-Software-and
+// https://docs.unrealengine.com/4.27/en-US/RenderingAndGraphics/Textures/Streaming/Overview/
+// https://computergraphics.stackexchange.com/questions/1768/how-can-deferred-texture-streaming-work
+
+struct TTextureStreamingStatistics
+{
+	uint32 TextureCount = 0u;
+	// Bytes of the levels resident on the GPU, tails included, and of the loads in flight.
+	uint64 ResidentBytes = 0u;
+	uint64 PendingBytes = 0u;
+	// Of ResidentBytes, the textures replaced or removed that the API still keeps alive for its frames in flight.
+	uint64 RetiringBytes = 0u;
+	uint64 LoadCount = 0u;
+	uint64 LoadedBytes = 0u;
+	// Textures dropped back to their tail to make room.
+	uint64 EvictionCount = 0u;
+	// Requests left for a later frame, for want of a free load or of room under the budget.
+	uint64 DeferredCount = 0u;
+};
+
+// Writes a file for TTextureStreamer: a header, then levels [0, desc.MipCount) of levels, each tightly packed as
+// GetTextureLevelSize says.
+bool WriteTextureFile(const char *path, const TTextureDesc &desc, const void *levels);
+
+// Keeps the mip levels of textures on the GPU that recent frames asked for, within a budget. Adding a texture
+// loads its tail, the levels no larger than TailSize, which stay resident. Every frame that samples a texture
+// reports how large it is on screen, and Update loads the finer levels it needs on background jobs from the
+// memory mapped file, most recently used textures first. When that would go over the budget, the least recently
+// used textures that went unreported drop back to their tail. A texture whose resident levels change is replaced
+// by a new one holding them, GetTexture returns the current one. The texture it replaces stays in memory until the
+// API's frames in flight are done with it, so it counts against the budget until then, and loads wait for the
+// room it frees. Add, Remove and Update belong to the render thread, ReportUsage can be called from any thread
+// between Updates.
+class TTextureStreamer
+{
+public:
+	static constexpr uint32 InvalidTexture = ~0u;
+	static constexpr uint32 TailSize = 64u;
+	static constexpr uint32 MaxLoadsInFlight = 4u;
+
+	// retireFrames is the number of Updates a deleted texture stays in memory for, the API's frames in flight.
+	void Init(IGraphicsAPI *api, uint64 budget, uint32 retireFrames);
+	// Waits for the loads in flight and removes every texture.
+	void Done();
+
+	// InvalidTexture when the file does not exist or is not a valid texture file.
+	uint32 Add(const char *path);
+	void Remove(uint32 texture);
+
+	// Tails are resident whatever the budget.
+	void SetBudget(uint64 budget) {
+		Budget = budget;
+	}
+	uint64 GetBudget() const {
+		return Budget;
+	}
+
+	// screenSize is the number of pixels the texture's larger side spans on screen, the finest level with at least
+	// one texel per pixel is asked for. Each frame takes the finest level reported since the last Update.
+	void ReportUsage(uint32 texture, uint32 screenSize);
+	// Once per frame, after the API freed what the frames it waited for deleted: swaps in the finished loads, then
+	// starts the loads for the levels reported.
+	void Update();
+
+	// Level i of the texture returned is level GetResidentLevel() + i of the file.
+	IGraphicsTexture *GetTexture(uint32 texture) const {
+		return Textures[texture].Texture;
+	}
+	uint32 GetResidentLevel(uint32 texture) const {
+		return Textures[texture].ResidentLevel;
+	}
+	// The file's, with MipCount filled in.
+	const TTextureDesc &GetDesc(uint32 texture) const {
+		return Textures[texture].Desc;
+	}
+
+	const TTextureStreamingStatistics &GetStatistics() const {
+		return Statistics;
+	}
+
+private:
+	static constexpr uint32 NoLoad = ~0u;
+	static constexpr uint32 NoLink = ~0u;
+
+	struct TStreamedTexture
+	{
+		FS::File File;
+		const uint8 *Levels = nullptr;
+		TTextureDesc Desc;
+		IGraphicsTexture *Texture = nullptr;
+		uint32 ResidentLevel = 0u;
+		uint32 TailLevel = 0u;
+		// Levels [TailLevel, Desc.MipCount), so eviction never reads the file.
+		TVarArray<uint8> Tail;
+		uint32 Load = NoLoad;
+		// Written by ReportUsage, the frame it was last called in and the finest level asked for since the last
+		// Update, TailLevel when none.
+		volatile LONG LastUsed = 0;
+		volatile LONG RequestedLevel = 0;
+		// Least recently used list, most recent first.
+		uint32 Previous = NoLink;
+		uint32 Next = NoLink;
+	};
+
+	struct TLoad
+	{
+		uint32 Texture = InvalidTexture;
+		uint32 Level = 0u;
+		// Bytes the load adds to ResidentBytes once it finishes, its whole chain, as the one it replaces retires.
+		uint64 Growth = 0u;
+		// Copied on a background job, so it is the job that waits for the pages to come in from disk.
+		const uint8 *Source = nullptr;
+		TVarArray<uint8> Data;
+		Jobs::TCounter Counter;
+	};
+
+	struct TRequest
+	{
+		uint32 Texture;
+		uint32 Level;
+	};
+
+	struct TRetired
+	{
+		uint64 Bytes;
+		LONG Frame;
+	};
+
+	static void LoadLevels(void *data, int32 begin, int32 end);
+
+	void Link(uint32 texture);
+	void Unlink(uint32 texture);
+	// Replaces the texture with one holding levels [level, Desc.MipCount) read from data.
+	void Replace(uint32 texture, uint32 level, const void *data);
+	// Deletes the texture's resident levels, counted as retiring until CollectRetired.
+	void Retire(TStreamedTexture &texture);
+	void CollectRetired();
+	bool IsEvictable(const TStreamedTexture &texture) const;
+	// Bytes the budget has room for once the retiring textures are freed, without evicting what the frame uses.
+	uint64 GetAvailableBytes() const;
+	void Evict(uint64 bytes);
+	void StartLoad(uint32 texture, uint32 level);
+	void FinishLoads();
+
+	IGraphicsAPI *API = nullptr;
+	uint64 Budget = 0u;
+	uint32 RetireFrames = 0u;
+	// The frame ReportUsage marks textures with, advanced by Update.
+	volatile LONG Frame = 1;
+
+	TVarArray<TStreamedTexture> Textures;
+	TVarArray<uint32> FreeTextures;
+	uint32 MostRecent = NoLink;
+	uint32 LeastRecent = NoLink;
+	TLoad Loads[MaxLoadsInFlight];
+	uint32 LoadsInFlight = 0u;
+	TVarArray<TRequest> Requests;
+	// Oldest first.
+	TVarArray<TRetired> Retired;
+	TTextureStreamingStatistics Statistics;
+};
@@ -0,0 +1,241 @@
+#include "Precompiled.h"
+
+#include "RenderDevice-vk.h"
+
+static const VkDescriptorType DescriptorTypes[] = {
+	VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+};
+
+void TVulkanUniformRing::Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, VkDeviceSize frameSize,
+	const TVulkanBufferSharing &sharing)
+{
+	Device = device;
+	Allocator = allocator;
+	MemoryManager = memoryManager;
+	Sharing = sharing;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	// Both bindings take the same offset, it has to suit either.
+	Alignment = Max(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment);
+	Range = Min(MaxRange, properties.limits.maxUniformBufferRange);
+
+	const uint32 bindingCount = ArrayLength(DescriptorTypes);
+	VkDescriptorSetLayoutBinding bindings[ArrayLength(DescriptorTypes)];
+	VkDescriptorPoolSize poolSizes[ArrayLength(DescriptorTypes)];
+	for (uint32 i = 0; i < bindingCount; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = DescriptorTypes[i];
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+		bindings[i].pImmutableSamplers = nullptr;
+
+		poolSizes[i].type = DescriptorTypes[i];
+		poolSizes[i].descriptorCount = MaxFrames * MaxChunks;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.pNext = nullptr;
+	setLayoutCreateInfo.flags = 0;
+	setLayoutCreateInfo.bindingCount = bindingCount;
+	setLayoutCreateInfo.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(Device, &setLayoutCreateInfo, Allocator, &SetLayout);
+	ASSERT(result == VK_SUCCESS);
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.pNext = nullptr;
+	poolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	poolCreateInfo.maxSets = MaxFrames * MaxChunks;
+	poolCreateInfo.poolSizeCount = bindingCount;
+	poolCreateInfo.pPoolSizes = poolSizes;
+
+	result = vkCreateDescriptorPool(Device, &poolCreateInfo, Allocator, &Pool);
+	ASSERT(result == VK_SUCCESS);
+
+	const VkDeviceSize capacity = AlignUp(frameSize, Alignment);
+	for (TFrame &frame : Frames)
+	{
+		CreateChunk(frame.Chunks[0], capacity);
+		frame.Current = 0;
+	}
+	FrameSlot = 0u;
+	Statistics = TVulkanUniformStatistics();
+}
+
+void TVulkanUniformRing::Done()
+{
+	for (TFrame &frame : Frames)
+	{
+		for (LONG i = 0; i <= frame.Current; ++i)
+			DestroyChunk(frame.Chunks[i]);
+		frame.Current = 0;
+	}
+
+	DebugPrint("Uniform ring: %llu bytes peak frame, %u growths\n", (unsigned long long)Statistics.PeakFrameBytes, Statistics.GrowthCount);
+
+	// Destroying the pool frees what is left of the sets.
+	vkDestroyDescriptorPool(Device, Pool, Allocator);
+	vkDestroyDescriptorSetLayout(Device, SetLayout, Allocator);
+	Pool = VK_NULL_HANDLE;
+	SetLayout = VK_NULL_HANDLE;
+}
+
+void TVulkanUniformRing::CreateChunk(TChunk &chunk, VkDeviceSize capacity)
+{
+	// Dynamic offsets are 32 bit.
+	ASSERT(capacity <= VkDeviceSize(TNumericLimits<uint32>::Max()) - Range);
+
+	// Room for a whole range past the last offset, the descriptors cover Range bytes from any of them.
+	VkBufferCreateInfo bufferCreateInfo = {};
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = nullptr;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = capacity + Range;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	Sharing.Apply(bufferCreateInfo);
+
+	VkResult result = vkCreateBuffer(Device, &bufferCreateInfo, Allocator, &chunk.Buffer);
+	ASSERT(result == VK_SUCCESS);
+	chunk.Memory = MemoryManager->AllocateBuffer(chunk.Buffer, TVulkanMemoryUsage::CpuToGpu);
+	ASSERT(chunk.Memory.Mapped != nullptr);
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.pNext = nullptr;
+	setAllocateInfo.descriptorPool = Pool;
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &SetLayout;
+
+	result = vkAllocateDescriptorSets(Device, &setAllocateInfo, &chunk.Set);
+	ASSERT(result == VK_SUCCESS);
+
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = chunk.Buffer;
+	bufferInfo.offset = 0u;
+	bufferInfo.range = Range;
+
+	VkWriteDescriptorSet writes[ArrayLength(DescriptorTypes)];
+	for (uint32 i = 0; i < ArrayLength(DescriptorTypes); ++i)
+	{
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].pNext = nullptr;
+		writes[i].dstSet = chunk.Set;
+		writes[i].dstBinding = i;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = DescriptorTypes[i];
+		writes[i].pImageInfo = nullptr;
+		writes[i].pBufferInfo = &bufferInfo;
+		writes[i].pTexelBufferView = nullptr;
+	}
+	vkUpdateDescriptorSets(Device, ArrayLength(writes), writes, 0, nullptr);
+
+	chunk.Capacity = capacity;
+	chunk.Head = 0;
+}
+
+void TVulkanUniformRing::DestroyChunk(TChunk &chunk)
+{
+	VkResult result = vkFreeDescriptorSets(Device, Pool, 1, &chunk.Set);
+	ASSERT(result == VK_SUCCESS);
+	vkDestroyBuffer(Device, chunk.Buffer, Allocator);
+	MemoryManager->Free(chunk.Memory);
+	chunk.Buffer = VK_NULL_HANDLE;
+	chunk.Set = VK_NULL_HANDLE;
+	chunk.Capacity = 0u;
+	chunk.Head = 0;
+}
+
+void TVulkanUniformRing::BeginFrame(uint32 frame)
+{
+	ASSERT(frame < MaxFrames);
+	FrameSlot = frame;
+	TFrame &current = Frames[frame];
+
+	// The frame outgrew its chunk last time, one chunk with room for all of it avoids growing again.
+	if (current.Current > 0)
+	{
+		VkDeviceSize capacity = 0u;
+		for (LONG i = 0; i <= current.Current; ++i)
+		{
+			capacity += current.Chunks[i].Capacity;
+			DestroyChunk(current.Chunks[i]);
+		}
+		CreateChunk(current.Chunks[0], capacity);
+		current.Current = 0;
+	}
+	current.Chunks[0].Head = 0;
+}
+
+void TVulkanUniformRing::EndFrame()
+{
+	TFrame &current = Frames[FrameSlot];
+	VkDeviceSize frameBytes = 0u;
+	for (LONG i = 0; i <= current.Current; ++i)
+	{
+		const TChunk &chunk = current.Chunks[i];
+		const VkDeviceSize usedBytes = Min(VkDeviceSize(chunk.Head), chunk.Capacity);
+		if (usedBytes > 0u)
+			MemoryManager->Flush(chunk.Memory, 0u, usedBytes);
+		frameBytes += usedBytes;
+	}
+
+	Statistics.FrameBytes = frameBytes;
+	Statistics.PeakFrameBytes = Max(Statistics.PeakFrameBytes, frameBytes);
+}
+
+void TVulkanUniformRing::Grow(TFrame &frame, LONG fullChunk, VkDeviceSize size)
+{
+	AcquireSRWLockExclusive(&Lock);
+	// Another thread may have grown the frame already.
+	if (frame.Current == fullChunk)
+	{
+		ASSERT(uint32(fullChunk) + 1u < MaxChunks);
+		CreateChunk(frame.Chunks[fullChunk + 1], Max(frame.Chunks[fullChunk].Capacity * 2u, size));
+		InterlockedExchange(&frame.Current, fullChunk + 1);
+		++Statistics.GrowthCount;
+	}
+	ReleaseSRWLockExclusive(&Lock);
+}
+
+TVulkanUniformAllocation TVulkanUniformRing::Allocate(uint32 size)
+{
+	ASSERT(size <= Range);
+	const VkDeviceSize alignedSize = AlignUp(VkDeviceSize(Max(size, 1u)), Alignment);
+	TFrame &frame = Frames[FrameSlot];
+
+	while (true)
+	{
+		const LONG chunkIndex = frame.Current;
+		TChunk &chunk = frame.Chunks[chunkIndex];
+		const VkDeviceSize offset = VkDeviceSize(InterlockedExchangeAdd64(&chunk.Head, LONG64(alignedSize)));
+		if (offset + alignedSize <= chunk.Capacity)
+		{
+			TVulkanUniformAllocation allocation;
+			allocation.Data = chunk.Memory.Mapped + offset;
+			allocation.Buffer = chunk.Buffer;
+			allocation.Offset = uint32(offset);
+			allocation.Set = chunk.Set;
+			return allocation;
+		}
+		Grow(frame, chunkIndex, alignedSize);
+	}
+}
+
+TVulkanUniformAllocation TVulkanUniformRing::Upload(const void *data, uint32 size)
+{
+	TVulkanUniformAllocation allocation = Allocate(size);
+	MemCopy(allocation.Data, data, int32(size));
+	return allocation;
+}
+
+void TVulkanUniformRing::Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, const TVulkanUniformAllocation &allocation) const
+{
+	const uint32 dynamicOffsets[ArrayLength(DescriptorTypes)] = { allocation.Offset, allocation.Offset };
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, SetIndex, 1, &allocation.Set, ArrayLength(dynamicOffsets), dynamicOffsets);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+// References:
+// https://www.khronos.org/registry/vulkan/specs/1.2/html/vkspec.html#descriptorsets-binding-dynamicoffsets
+// https://developer.nvidia.com/vulkan-shader-resource-binding
+// https://gpuopen.com/learn/vulkan-renderpasses/
+
+struct TVulkanUniformAllocation
+{
+	// Persistently mapped, written by the CPU before the frame is submitted.
+	void *Data = nullptr;
+	VkBuffer Buffer = VK_NULL_HANDLE;
+	// Dynamic offset of the data in Buffer.
+	uint32 Offset = 0u;
+	VkDescriptorSet Set = VK_NULL_HANDLE;
+};
+
+struct TVulkanUniformStatistics
+{
+	// Bytes taken by the last frame, alignment padding included.
+	VkDeviceSize FrameBytes = 0u;
+	VkDeviceSize PeakFrameBytes = 0u;
+	// Chunks added because a frame outgrew the space it had.
+	uint32 GrowthCount = 0u;
+};
+
+// Linear allocator for per draw constants, one per frame in flight. Allocations bump the head of a persistently
+// mapped buffer and are addressed with dynamic offsets into one descriptor set per buffer, so there is no buffer
+// or descriptor update per draw. In HLSL:
+//   [[vk::binding(0, 0)]] cbuffer TDrawConstants { ... };
+//   [[vk::binding(1, 0)]] ByteAddressBuffer DrawData;
+// Both bindings see the same Range bytes from the offset. A frame that runs out of space gets another chunk of
+// twice the size, and once the GPU is done with the frame its chunks are merged into one that fits it next time.
+// Allocate is thread safe and lock free until the frame has to grow.
+class TVulkanUniformRing
+{
+public:
+	static constexpr uint32 MaxFrames = 2u;
+	static constexpr uint32 SetIndex = 0u;
+
+	// sharing holds the queue families that read the constants.
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, TVulkanMemoryManager *memoryManager, VkDeviceSize frameSize,
+		const TVulkanBufferSharing &sharing);
+	// The GPU must be idle.
+	void Done();
+
+	// Starts allocating for the frame, the GPU has to be done with what was allocated the last time it was used.
+	void BeginFrame(uint32 frame);
+	// Makes the frame's writes visible to the device, call before submitting it.
+	void EndFrame();
+
+	// The data is only valid for the current frame, size can be at most GetRange().
+	TVulkanUniformAllocation Allocate(uint32 size);
+	TVulkanUniformAllocation Upload(const void *data, uint32 size);
+
+	// The pipeline layout has GetSetLayout() at SetIndex.
+	void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, const TVulkanUniformAllocation &allocation) const;
+
+	VkDescriptorSetLayout GetSetLayout() const {
+		return SetLayout;
+	}
+
+	uint32 GetRange() const {
+		return Range;
+	}
+
+	const TVulkanUniformStatistics &GetStatistics() const {
+		return Statistics;
+	}
+
+private:
+	// Growing by doubling, far more than any frame needs.
+	static constexpr uint32 MaxChunks = 16u;
+	static constexpr uint32 MaxRange = 64u * 1024u;
+
+	struct TChunk
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		TVulkanAllocation Memory;
+		VkDescriptorSet Set = VK_NULL_HANDLE;
+		VkDeviceSize Capacity = 0u;
+		// Passes Capacity when allocations no longer fit.
+		volatile LONG64 Head = 0;
+	};
+
+	struct TFrame
+	{
+		TChunk Chunks[MaxChunks];
+		// Chunks before it are full.
+		volatile LONG Current = 0;
+	};
+
+	void CreateChunk(TChunk &chunk, VkDeviceSize capacity);
+	void DestroyChunk(TChunk &chunk);
+	void Grow(TFrame &frame, LONG fullChunk, VkDeviceSize size);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *Allocator = nullptr;
+	TVulkanMemoryManager *MemoryManager = nullptr;
+	TVulkanBufferSharing Sharing;
+	VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool Pool = VK_NULL_HANDLE;
+	VkDeviceSize Alignment = 256u;
+	uint32 Range = MaxRange;
+
+	TFrame Frames[MaxFrames];
+	uint32 FrameSlot = 0u;
+	SRWLOCK Lock = SRWLOCK_INIT;
+	TVulkanUniformStatistics Statistics;
+};
@@ -1,4 +1,13 @@
-#pragma once
+// Included once per loading step with the macros of that step defined, so no include guard.
+
+// Loaded straight from the Vulkan library, everything else is resolved through it.
+#if !defined(VK_EXPORTED_FUNCTION)
+#	define VK_EXPORTED_FUNCTION(name)
+#endif
+
+VK_EXPORTED_FUNCTION(vkGetInstanceProcAddr);
+
+#undef VK_EXPORTED_FUNCTION
 
 #if !defined(VK_GLOBAL_LEVEL_FUNCTION)
 #	define VK_GLOBAL_LEVEL_FUNCTION(name)
@@ -15,19 +24,36 @@ VK_GLOBAL_LEVEL_FUNCTION(vkCreateInstance);
 #endif
 
 VK_INSTANCE_LEVEL_FUNCTION(vkDestroyInstance);
-VK_INSTANCE_LEVEL_FUNCTION(vkCreateWin32SurfaceKHR);
-VK_INSTANCE_LEVEL_FUNCTION(vkDestroySurfaceKHR);
 VK_INSTANCE_LEVEL_FUNCTION(vkCreateDevice);
 VK_INSTANCE_LEVEL_FUNCTION(vkGetDeviceProcAddr);
 VK_INSTANCE_LEVEL_FUNCTION(vkEnumeratePhysicalDevices);
 VK_INSTANCE_LEVEL_FUNCTION(vkEnumerateDeviceExtensionProperties);
 VK_INSTANCE_LEVEL_FUNCTION(vkGetPhysicalDeviceProperties);
 VK_INSTANCE_LEVEL_FUNCTION(vkGetPhysicalDeviceFeatures);
+VK_INSTANCE_LEVEL_FUNCTION(vkGetPhysicalDeviceFeatures2);
+VK_INSTANCE_LEVEL_FUNCTION(vkGetPhysicalDeviceProperties2);
 VK_INSTANCE_LEVEL_FUNCTION(vkGetPhysicalDeviceQueueFamilyProperties);
-VK_INSTANCE_LEVEL_FUNCTION(vkGetPhysicalDeviceSurfaceSupportKHR);
+VK_INSTANCE_LEVEL_FUNCTION(vkGetPhysicalDeviceMemoryProperties);
+VK_INSTANCE_LEVEL_FUNCTION(vkGetPhysicalDeviceFormatProperties);
 
 #undef VK_INSTANCE_LEVEL_FUNCTION
 
+// Instance level as well, but only there when VK_KHR_surface is enabled, which headless instances do not.
+#if !defined(VK_SURFACE_FUNCTION)
+#	define VK_SURFACE_FUNCTION(name)
+#endif
+
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
+VK_SURFACE_FUNCTION(vkCreateWin32SurfaceKHR);
+#endif
+VK_SURFACE_FUNCTION(vkDestroySurfaceKHR);
+VK_SURFACE_FUNCTION(vkGetPhysicalDeviceSurfaceSupportKHR);
+VK_SURFACE_FUNCTION(vkGetPhysicalDeviceSurfaceCapabilitiesKHR);
+VK_SURFACE_FUNCTION(vkGetPhysicalDeviceSurfaceFormatsKHR);
+VK_SURFACE_FUNCTION(vkGetPhysicalDeviceSurfacePresentModesKHR);
+
+#undef VK_SURFACE_FUNCTION
+
 #if !defined(VK_DEVICE_LEVEL_FUNCTION)
 #	define VK_DEVICE_LEVEL_FUNCTION(name)
 #endif
@@ -38,7 +64,14 @@ VK_DEVICE_LEVEL_FUNCTION(vkCreateRenderPass);
 VK_DEVICE_LEVEL_FUNCTION(vkCreateFramebuffer);
 VK_DEVICE_LEVEL_FUNCTION(vkCreateShaderModule);
 VK_DEVICE_LEVEL_FUNCTION(vkCreatePipelineLayout);
+VK_DEVICE_LEVEL_FUNCTION(vkCreateDescriptorSetLayout);
+VK_DEVICE_LEVEL_FUNCTION(vkDestroyDescriptorSetLayout);
+VK_DEVICE_LEVEL_FUNCTION(vkCreateDescriptorPool);
+VK_DEVICE_LEVEL_FUNCTION(vkDestroyDescriptorPool);
+VK_DEVICE_LEVEL_FUNCTION(vkAllocateDescriptorSets);
+VK_DEVICE_LEVEL_FUNCTION(vkUpdateDescriptorSets);
 VK_DEVICE_LEVEL_FUNCTION(vkCreateGraphicsPipelines);
+VK_DEVICE_LEVEL_FUNCTION(vkCreateComputePipelines);
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyDevice);
 VK_DEVICE_LEVEL_FUNCTION(vkCreateSemaphore);
 VK_DEVICE_LEVEL_FUNCTION(vkCreateCommandPool);
@@ -48,7 +81,10 @@ VK_DEVICE_LEVEL_FUNCTION(vkCmdPipelineBarrier);
 VK_DEVICE_LEVEL_FUNCTION(vkCmdClearColorImage);
 VK_DEVICE_LEVEL_FUNCTION(vkCmdBeginRenderPass);
 VK_DEVICE_LEVEL_FUNCTION(vkCmdBindPipeline);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdBindDescriptorSets);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdPushConstants);
 VK_DEVICE_LEVEL_FUNCTION(vkCmdDraw);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdDispatch);
 VK_DEVICE_LEVEL_FUNCTION(vkCmdEndRenderPass);
 VK_DEVICE_LEVEL_FUNCTION(vkEndCommandBuffer);
 VK_DEVICE_LEVEL_FUNCTION(vkQueueSubmit);
@@ -61,5 +97,69 @@ VK_DEVICE_LEVEL_FUNCTION(vkDestroyPipeline);
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyRenderPass);
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyFramebuffer);
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyImageView);
+VK_DEVICE_LEVEL_FUNCTION(vkCreateBuffer);
+VK_DEVICE_LEVEL_FUNCTION(vkDestroyBuffer);
+VK_DEVICE_LEVEL_FUNCTION(vkFreeDescriptorSets);
+VK_DEVICE_LEVEL_FUNCTION(vkGetBufferMemoryRequirements);
+VK_DEVICE_LEVEL_FUNCTION(vkGetImageMemoryRequirements);
+VK_DEVICE_LEVEL_FUNCTION(vkAllocateMemory);
+VK_DEVICE_LEVEL_FUNCTION(vkFreeMemory);
+VK_DEVICE_LEVEL_FUNCTION(vkMapMemory);
+VK_DEVICE_LEVEL_FUNCTION(vkUnmapMemory);
+VK_DEVICE_LEVEL_FUNCTION(vkFlushMappedMemoryRanges);
+VK_DEVICE_LEVEL_FUNCTION(vkInvalidateMappedMemoryRanges);
+VK_DEVICE_LEVEL_FUNCTION(vkBindBufferMemory);
+VK_DEVICE_LEVEL_FUNCTION(vkBindImageMemory);
+VK_DEVICE_LEVEL_FUNCTION(vkCreateFence);
+VK_DEVICE_LEVEL_FUNCTION(vkDestroyFence);
+VK_DEVICE_LEVEL_FUNCTION(vkResetFences);
+VK_DEVICE_LEVEL_FUNCTION(vkGetFenceStatus);
+VK_DEVICE_LEVEL_FUNCTION(vkWaitForFences);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdCopyBuffer);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdCopyImageToBuffer);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdCopyBufferToImage);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdBlitImage);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdFillBuffer);
+VK_DEVICE_LEVEL_FUNCTION(vkDeviceWaitIdle);
+VK_DEVICE_LEVEL_FUNCTION(vkResetCommandPool);
+VK_DEVICE_LEVEL_FUNCTION(vkCreatePipelineCache);
+VK_DEVICE_LEVEL_FUNCTION(vkDestroyPipelineCache);
+VK_DEVICE_LEVEL_FUNCTION(vkGetPipelineCacheData);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdExecuteCommands);
+VK_DEVICE_LEVEL_FUNCTION(vkCreateImage);
+VK_DEVICE_LEVEL_FUNCTION(vkDestroyImage);
+VK_DEVICE_LEVEL_FUNCTION(vkCreateQueryPool);
+VK_DEVICE_LEVEL_FUNCTION(vkDestroyQueryPool);
+VK_DEVICE_LEVEL_FUNCTION(vkGetQueryPoolResults);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdResetQueryPool);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdWriteTimestamp);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdBeginQuery);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdEndQuery);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdBindVertexBuffers);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdBindIndexBuffer);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdDrawIndexed);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdDrawIndexedIndirect);
+
+#undef VK_DEVICE_LEVEL_FUNCTION
+
+// Core from 1.2, nullptr on older devices. Only called when the feature they belong to is enabled.
+#if !defined(VK_DEVICE_1_2_FUNCTION)
+#	define VK_DEVICE_1_2_FUNCTION(name)
+#endif
+
+VK_DEVICE_1_2_FUNCTION(vkCmdDrawIndexedIndirectCount);
+
+#undef VK_DEVICE_1_2_FUNCTION
+
+// Device level as well, but only there when VK_KHR_swapchain is enabled, which headless devices do not.
+#if !defined(VK_SWAPCHAIN_FUNCTION)
+#	define VK_SWAPCHAIN_FUNCTION(name)
+#endif
+
+VK_SWAPCHAIN_FUNCTION(vkCreateSwapchainKHR);
+VK_SWAPCHAIN_FUNCTION(vkDestroySwapchainKHR);
+VK_SWAPCHAIN_FUNCTION(vkGetSwapchainImagesKHR);
+VK_SWAPCHAIN_FUNCTION(vkAcquireNextImageKHR);
+VK_SWAPCHAIN_FUNCTION(vkQueuePresentKHR);
 
-#undef VK_DEVICE_LEVEL_FUNCTION
\ No newline at end of file
+#undef VK_SWAPCHAIN_FUNCTION
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Core/Containers/String.h"
+#include "Core/Misc/Hash.h"
+
+// Open addressing with linear probing over a power of two table. Keys are hashed and compared as raw bytes,
+// so they have to be trivially copyable with their padding zeroed. There is no single element removal,
+// the users of the map drop everything at once.
+template <typename TKey, typename TValue>
+class THashMap
+{
+public:
+	TValue *Find(const TKey &key)
+	{
+		if (Count == 0)
+			return nullptr;
+
+		const uint64 hash = HashBytes(&key, sizeof(TKey));
+		for (size_t i = size_t(hash) & Mask();; i = (i + 1) & Mask())
+		{
+			TSlot &slot = Slots[i];
+			if (!slot.Used)
+				return nullptr;
+			if (slot.Hash == hash && memcmp(&slot.Key, &key, sizeof(TKey)) == 0)
+				return &slot.Value;
+		}
+	}
+
+	// The key must not be in the map yet.
+	TValue &Add(const TKey &key, const TValue &value)
+	{
+		// Keeps the load factor at or below 3/4 so probes stay short and always find an empty slot.
+		if ((Count + 1) * 4 > Slots.size() * 3)
+			Grow();
+
+		const uint64 hash = HashBytes(&key, sizeof(TKey));
+		++Count;
+		return Insert(hash, key, value);
+	}
+
+	// Calls function(key, value) for every element, in no particular order.
+	template <typename TFunction>
+	void ForEach(const TFunction &function)
+	{
+		for (size_t i = 0; i < Slots.size(); ++i)
+			if (Slots[i].Used)
+				function(Slots[i].Key, Slots[i].Value);
+	}
+
+	void Clear()
+	{
+		Slots.resize(0);
+		Count = 0;
+	}
+
+	size_t Size() const {
+		return Count;
+	}
+
+private:
+	static constexpr size_t MinCapacity = 16u;
+
+	struct TSlot
+	{
+		uint64 Hash = 0u;
+		TKey Key = {};
+		TValue Value = {};
+		bool Used = false;
+	};
+
+	size_t Mask() const {
+		return Slots.size() - 1;
+	}
+
+	TValue &Insert(uint64 hash, const TKey &key, const TValue &value)
+	{
+		size_t i = size_t(hash) & Mask();
+		while (Slots[i].Used)
+			i = (i + 1) & Mask();
+
+		TSlot &slot = Slots[i];
+		slot.Hash = hash;
+		// Byte copy, assignment is free to skip the padding that Find compares.
+		MemCopy(&slot.Key, &key, int32(sizeof(TKey)));
+		slot.Value = value;
+		slot.Used = true;
+		return slot.Value;
+	}
+
+	void Grow()
+	{
+		TVarArray<TSlot> slots = Move(Slots);
+		Slots.resize(Max(MinCapacity, slots.size() * 2));
+		for (size_t i = 0; i < slots.size(); ++i)
+			if (slots[i].Used)
+				Insert(slots[i].Hash, slots[i].Key, slots[i].Value);
+	}
+
+	TVarArray<TSlot> Slots;
+	size_t Count = 0u;
+};
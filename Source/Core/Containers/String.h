@@ -26,6 +26,11 @@ public:
 		other.Capacity = 0;
 	}
 
+	~TVarArray()
+	{
+		del();
+	}
+
 	TVarArray(const TVarArray& other) :
 		Size(other.Size), Capacity(other.Size)
 	{
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <math.h>
+
 #include "Core/Misc/Utility.h"
 
 // References:
@@ -253,4 +255,155 @@ using Matrix2x2 = Matrix<float32, 2, 2>;
 using Matrix3x3 = Matrix<float32, 3, 3>;
 using Matrix4x4 = Matrix<float32, 4, 4>;
 
-Matrix4x4 BuildPerspectiveMatrix(float fovY, float nearZ, float farZ);
\ No newline at end of file
+template <typename T, int32 n>
+inline Vector<T, n> operator+(const Vector<T, n> &lhs, const Vector<T, n> &rhs)
+{
+    Vector<T, n> result;
+    for (int32 i = 0; i < n; ++i)
+        result[i] = lhs[i] + rhs[i];
+    return result;
+}
+
+template <typename T, int32 n>
+inline Vector<T, n> operator-(const Vector<T, n> &lhs, const Vector<T, n> &rhs)
+{
+    Vector<T, n> result;
+    for (int32 i = 0; i < n; ++i)
+        result[i] = lhs[i] - rhs[i];
+    return result;
+}
+
+template <typename T, int32 n>
+inline Vector<T, n> operator-(const Vector<T, n> &value)
+{
+    Vector<T, n> result;
+    for (int32 i = 0; i < n; ++i)
+        result[i] = -value[i];
+    return result;
+}
+
+template <typename T, int32 n>
+inline Vector<T, n> operator*(const Vector<T, n> &lhs, T rhs)
+{
+    Vector<T, n> result;
+    for (int32 i = 0; i < n; ++i)
+        result[i] = lhs[i] * rhs;
+    return result;
+}
+
+template <typename T, int32 n>
+inline Vector<T, n> operator*(T lhs, const Vector<T, n> &rhs)
+{
+    return rhs * lhs;
+}
+
+template <typename T, int32 n>
+inline Vector<T, n> operator/(const Vector<T, n> &lhs, T rhs)
+{
+    Vector<T, n> result;
+    for (int32 i = 0; i < n; ++i)
+        result[i] = lhs[i] / rhs;
+    return result;
+}
+
+template <typename T, int32 n>
+inline bool operator==(const Vector<T, n> &lhs, const Vector<T, n> &rhs)
+{
+    for (int32 i = 0; i < n; ++i)
+        if (lhs[i] != rhs[i])
+            return false;
+    return true;
+}
+
+template <typename T, int32 n>
+inline T Dot(const Vector<T, n> &lhs, const Vector<T, n> &rhs)
+{
+    T result = T(0);
+    for (int32 i = 0; i < n; ++i)
+        result += lhs[i] * rhs[i];
+    return result;
+}
+
+template <typename T>
+inline Vector<T, 3> Cross(const Vector<T, 3> &lhs, const Vector<T, 3> &rhs)
+{
+    return Vector<T, 3>(
+        lhs.y * rhs.z - lhs.z * rhs.y,
+        lhs.z * rhs.x - lhs.x * rhs.z,
+        lhs.x * rhs.y - lhs.y * rhs.x
+    );
+}
+
+template <typename T, int32 n>
+inline T LengthSquared(const Vector<T, n> &value)
+{
+    return Dot(value, value);
+}
+
+template <typename T, int32 n>
+inline T Length(const Vector<T, n> &value)
+{
+    return T(sqrt(LengthSquared(value)));
+}
+
+template <typename T, int32 n>
+inline Vector<T, n> Normalize(const Vector<T, n> &value)
+{
+    const T length = Length(value);
+    return length > T(0) ? value / length : value;
+}
+
+template <typename T, int32 n>
+inline Vector<T, n> ComponentMin(const Vector<T, n> &lhs, const Vector<T, n> &rhs)
+{
+    Vector<T, n> result;
+    for (int32 i = 0; i < n; ++i)
+        result[i] = Min(lhs[i], rhs[i]);
+    return result;
+}
+
+template <typename T, int32 n>
+inline Vector<T, n> ComponentMax(const Vector<T, n> &lhs, const Vector<T, n> &rhs)
+{
+    Vector<T, n> result;
+    for (int32 i = 0; i < n; ++i)
+        result[i] = Max(lhs[i], rhs[i]);
+    return result;
+}
+
+// Column vector convention: result = matrix * vector, rows are stored in _X.
+template <typename T, int32 Width, int32 Height>
+inline Vector<T, Height> operator*(const Matrix<T, Width, Height> &matrix, const Vector<T, Width> &vector)
+{
+    Vector<T, Height> result;
+    for (int32 i = 0; i < Height; ++i)
+        result[i] = Dot(matrix[i], vector);
+    return result;
+}
+
+Matrix4x4 BuildPerspectiveMatrix(float fovY, float nearZ, float farZ);
+
+// Planes of the frustum of a view projection matrix with depth in [0, 1], as (normal, distance) with normals
+// pointing inside: left, right, bottom, top, near, far.
+// References:
+// https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
+inline void ExtractFrustumPlanes(const Matrix4x4 &viewProjection, Vector4 planes[6])
+{
+    const Vector4 &x = viewProjection[0], &y = viewProjection[1], &z = viewProjection[2], &w = viewProjection[3];
+    planes[0] = w + x;
+    planes[1] = w - x;
+    planes[2] = w + y;
+    planes[3] = w - y;
+    planes[4] = z;
+    planes[5] = w - z;
+    for (int32 i = 0; i < 6; ++i)
+        planes[i] = planes[i] / Length(Vector3(planes[i].x, planes[i].y, planes[i].z));
+}
+
+inline bool IsSphereInFrustum(const Vector4 planes[6], const Vector3 &center, float32 radius)
+{
+    for (int32 i = 0; i < 6; ++i)
+        if (Dot(Vector3(planes[i].x, planes[i].y, planes[i].z), center) + planes[i].w < -radius)
+            return false;
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "Core/Containers/String.h"
+#include "Core/Misc/Utility.h"
+
+// Manages offsets into an externally owned range, the range itself is never touched.
+// Blocks are powers of two and aligned to their own size, so any alignment up to the block size comes for free.
+// References:
+// https://en.wikipedia.org/wiki/Buddy_memory_allocation
+class TBuddyAllocator
+{
+public:
+	static constexpr uint64 InvalidOffset = ~0ull;
+
+	// Both sizes must be powers of two.
+	void Init(uint64 size, uint64 minBlockSize)
+	{
+		MinBlockShift = FloorLog2(minBlockSize);
+		const uint32 unitCount = uint32(size >> MinBlockShift);
+		OrderCount = FloorLog2(unitCount) + 1u;
+
+		FreeLists.resize(OrderCount);
+		for (uint32 order = 0; order < OrderCount; ++order)
+			FreeLists[order] = Nil;
+		Next.resize(unitCount);
+		Previous.resize(unitCount);
+		States.resize(unitCount);
+		UsedSize = 0u;
+
+		States[0] = uint8(FreeBit | (OrderCount - 1u));
+		Link(OrderCount - 1u, 0u);
+	}
+
+	uint64 Allocate(uint64 size, uint64 alignment = 1u)
+	{
+		const uint64 blockSize = NextPowerOfTwo(Max(size, alignment, uint64(1u) << MinBlockShift));
+		const uint32 order = FloorLog2(blockSize) - MinBlockShift;
+		if (order >= OrderCount)
+			return InvalidOffset;
+
+		uint32 current = order;
+		while (current < OrderCount && FreeLists[current] == Nil)
+			++current;
+		if (current == OrderCount)
+			return InvalidOffset;
+
+		const uint32 unit = FreeLists[current];
+		Unlink(current, unit);
+
+		// Split down to the requested order, upper halves go back to the free lists.
+		while (current > order)
+		{
+			--current;
+			const uint32 buddy = unit + (1u << current);
+			States[buddy] = uint8(FreeBit | current);
+			Link(current, buddy);
+		}
+
+		States[unit] = uint8(UsedBit | order);
+		UsedSize += blockSize;
+		return uint64(unit) << MinBlockShift;
+	}
+
+	void Free(uint64 offset)
+	{
+		uint32 unit = uint32(offset >> MinBlockShift);
+		uint32 order = States[unit] & OrderMask;
+		UsedSize -= uint64(1u) << (order + MinBlockShift);
+		States[unit] = 0u;
+
+		while (order + 1u < OrderCount)
+		{
+			const uint32 buddy = unit ^ (1u << order);
+			if (States[buddy] != (FreeBit | order))
+				break;
+
+			Unlink(order, buddy);
+			States[buddy] = 0u;
+			unit = Min(unit, buddy);
+			++order;
+		}
+
+		States[unit] = uint8(FreeBit | order);
+		Link(order, unit);
+	}
+
+	// Size reserved by live blocks, including the rounding to powers of two.
+	uint64 GetUsedSize() const {
+		return UsedSize;
+	}
+
+	uint64 GetSize() const {
+		return uint64(States.size()) << MinBlockShift;
+	}
+
+	bool IsEmpty() const {
+		return UsedSize == 0u;
+	}
+
+	uint64 GetLargestFreeBlock() const
+	{
+		for (uint32 order = OrderCount; order-- > 0u;)
+			if (FreeLists[order] != Nil)
+				return uint64(1u) << (order + MinBlockShift);
+		return 0u;
+	}
+
+private:
+	static constexpr uint32 Nil = ~0u;
+	static constexpr uint8 OrderMask = 0x3Fu;
+	static constexpr uint8 FreeBit = 0x40u;
+	static constexpr uint8 UsedBit = 0x80u;
+
+	void Link(uint32 order, uint32 unit)
+	{
+		Previous[unit] = Nil;
+		Next[unit] = FreeLists[order];
+		if (FreeLists[order] != Nil)
+			Previous[FreeLists[order]] = unit;
+		FreeLists[order] = unit;
+	}
+
+	void Unlink(uint32 order, uint32 unit)
+	{
+		if (Previous[unit] != Nil)
+			Next[Previous[unit]] = Next[unit];
+		else
+			FreeLists[order] = Next[unit];
+		if (Next[unit] != Nil)
+			Previous[Next[unit]] = Previous[unit];
+	}
+
+	uint32 MinBlockShift = 0u;
+	uint32 OrderCount = 0u;
+	uint64 UsedSize = 0u;
+	// Head of the free list per order, in units of the minimum block size.
+	TVarArray<uint32> FreeLists;
+	// Free list links, only meaningful for free block heads.
+	TVarArray<uint32> Next;
+	TVarArray<uint32> Previous;
+	// Order and free/used flags of the block starting at each unit, zero inside blocks.
+	TVarArray<uint8> States;
+};
@@ -67,4 +67,13 @@ struct TOpNot
 	{
 		return !value;
 	}
+};
+
+struct TOpLess
+{
+	template <typename T>
+	inline constexpr bool operator()(const T &lhs, const T &rhs) const
+	{
+		return lhs < rhs;
+	}
 };
\ No newline at end of file
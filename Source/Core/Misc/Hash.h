@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Core/Misc/Types.h"
+
+// References:
+// http://www.isthe.com/chongo/tech/comp/fnv/index.html
+
+inline constexpr uint64 HashSeed = 0xCBF29CE484222325ull;
+
+// 64 bit FNV-1a. Fine for cache keys and checksums, not for data chosen by an attacker.
+inline uint64 HashBytes(const void *data, size_t size, uint64 seed = HashSeed)
+{
+	const auto *bytes = static_cast<const uint8 *>(data);
+	uint64 hash = seed;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
@@ -195,6 +195,74 @@ inline constexpr TOutputIterator FillN(TOutputIterator first, TSize n, const TVa
 	return first;
 }
 
+template <typename TRandomIterator, typename TLess>
+inline constexpr void InsertionSort(TRandomIterator begin, TRandomIterator end, TLess less)
+{
+	if (begin == end)
+		return;
+
+	for (auto curr = begin + 1; curr != end; ++curr)
+	{
+		auto value = Move(*curr);
+		auto hole = curr;
+		for (; hole != begin && less(value, *(hole - 1)); --hole)
+			*hole = Move(*(hole - 1));
+		*hole = Move(value);
+	}
+}
+
+// Quicksort with median of three pivot, falling back to insertion sort for short ranges.
+// Recurses into the smaller partition only, so the stack depth stays logarithmic.
+template <typename TRandomIterator, typename TLess>
+inline constexpr void Sort(TRandomIterator begin, TRandomIterator end, TLess less)
+{
+	while (end - begin > 16)
+	{
+		auto middle = begin + (end - begin) / 2;
+		auto last = end - 1;
+		if (less(*middle, *begin))
+			Swap(*middle, *begin);
+		if (less(*last, *middle))
+		{
+			Swap(*last, *middle);
+			if (less(*middle, *begin))
+				Swap(*middle, *begin);
+		}
+
+		const auto pivot = *middle;
+		auto lo = begin, hi = last;
+		while (true)
+		{
+			while (less(*lo, pivot))
+				++lo;
+			while (less(pivot, *hi))
+				--hi;
+			if (lo >= hi)
+				break;
+			Swap(*lo++, *hi--);
+		}
+
+		auto split = hi + 1;
+		if (split - begin < end - split)
+		{
+			Sort(begin, split, less);
+			begin = split;
+		}
+		else
+		{
+			Sort(split, end, less);
+			end = split;
+		}
+	}
+	InsertionSort(begin, end, less);
+}
+
+template <typename TRandomIterator>
+inline constexpr void Sort(TRandomIterator begin, TRandomIterator end)
+{
+	Sort(begin, end, TOpLess());
+}
+
 template <typename T>
 inline constexpr T Clamp(T x, T a, T b)
 {
@@ -213,6 +281,37 @@ inline constexpr T DivCeil(T x, T y)
 	return (x + y - 1) / y;
 }
 
+template <CIntegral T>
+inline constexpr T AlignUp(T x, T alignment)
+{
+	return DivCeil(x, alignment) * alignment;
+}
+
+template <CIntegral T>
+inline constexpr bool IsPowerOfTwo(T x)
+{
+	return x != 0 && (x & (x - 1)) == 0;
+}
+
+inline constexpr uint32 FloorLog2(uint64 x)
+{
+	uint32 result = 0u;
+	for (uint32 shift = 32u; shift > 0u; shift >>= 1u)
+	{
+		if (x >> shift)
+		{
+			x >>= shift;
+			result += shift;
+		}
+	}
+	return result;
+}
+
+inline constexpr uint64 NextPowerOfTwo(uint64 x)
+{
+	return x <= 1u ? 1u : uint64(1u) << (FloorLog2(x - 1u) + 1u);
+}
+
 template <typename T>
 constexpr void Swap(T &lhs, T &rhs)
 {
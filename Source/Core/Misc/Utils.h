@@ -6,7 +6,11 @@
 #define ALLOCA(type, size) static_cast<type*>(_alloca(sizeof(type) * size))
 #define STR_AND_LEN(str) str, sizeof(str) - 1
 
+#if defined(_WIN32)
 using LibraryType = HMODULE;
+#else
+using LibraryType = void *;
+#endif
 
 template <typename T>
 constexpr int32 ArrayLength(const T &arr) 
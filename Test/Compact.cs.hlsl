@@ -0,0 +1,28 @@
+// One thread per draw, writes the draw with its visible instances. With COMPACT_FLAG only draws with visible
+// instances are written, packed at the front and counted in Counters[0].
+#include "CullCommon.hlsl"
+
+[numthreads(64, 1, 1)]
+void CS_main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= DrawCount)
+		return;
+
+	const uint count = Counters[1 + id.x];
+	// Ready for the next frame's culling.
+	Counters[1 + id.x] = 0;
+
+	TDrawCommand draw = Draws[id.x];
+	draw.InstanceCount = count;
+	if ((Flags & COMPACT_FLAG) == 0)
+	{
+		CulledDraws[id.x] = draw;
+		return;
+	}
+	if (count == 0)
+		return;
+
+	uint slot;
+	InterlockedAdd(Counters[0], 1, slot);
+	CulledDraws[slot] = draw;
+}
@@ -0,0 +1,65 @@
+// One thread per instance, appends the instances that pass the frustum and occlusion tests to their draw's range of Visible.
+#include "CullCommon.hlsl"
+
+// True unless the texels of the previous frame's depth pyramid under the sphere's bounding box are all nearer than the sphere.
+bool IsUnoccluded(float3 center, float radius)
+{
+	float2 minimum = 1.0f;
+	float2 maximum = 0.0f;
+	float nearest = 1.0f;
+	for (uint i = 0; i < 8; ++i)
+	{
+		const float3 corner = center + radius * float3((i & 1) != 0 ? 1.0f : -1.0f, (i & 2) != 0 ? 1.0f : -1.0f, (i & 4) != 0 ? 1.0f : -1.0f);
+		const float4 clip = mul(PreviousViewProjection, float4(corner, 1.0f));
+		// Reaches behind the camera, there is nothing in front of it to hide it.
+		if (clip.w <= 0.0f)
+			return true;
+		const float3 position = clip.xyz / clip.w;
+		const float2 uv = position.xy * 0.5f + 0.5f;
+		minimum = min(minimum, uv);
+		maximum = max(maximum, uv);
+		nearest = min(nearest, position.z);
+	}
+	minimum = saturate(minimum);
+	maximum = saturate(maximum);
+
+	// The level where the box spans at most two texels along each axis.
+	const float2 extent = (maximum - minimum) * PyramidSize;
+	const uint level = min(uint(ceil(log2(max(max(extent.x, extent.y), 1.0f)))), LevelCount - 1);
+	const uint2 size = max(uint2(PyramidSize) >> level, 1);
+	const uint2 first = min(uint2(minimum * size), size - 1);
+	const uint2 last = min(uint2(maximum * size), size - 1);
+	const float depth = max(max(DepthPyramid.Load(int3(first.x, first.y, level)), DepthPyramid.Load(int3(last.x, first.y, level))),
+		max(DepthPyramid.Load(int3(first.x, last.y, level)), DepthPyramid.Load(int3(last.x, last.y, level))));
+	return nearest <= depth;
+}
+
+[numthreads(64, 1, 1)]
+void CS_main(uint3 id : SV_DispatchThreadID)
+{
+	// Counted up by the compaction dispatch that follows.
+	if (id.x == 0)
+		Counters[0] = 0;
+	if (id.x >= InstanceCount)
+		return;
+
+	const TInstance instance = Instances[id.x];
+	const float4 bounds = Bounds[instance.Mesh];
+	const float3x4 transform = float3x4(instance.Transform[0], instance.Transform[1], instance.Transform[2]);
+	const float3 center = mul(transform, float4(bounds.xyz, 1.0f));
+	const float3 scale = float3(
+		dot(transform._m00_m10_m20, transform._m00_m10_m20),
+		dot(transform._m01_m11_m21, transform._m01_m11_m21),
+		dot(transform._m02_m12_m22, transform._m02_m12_m22));
+	const float radius = bounds.w * sqrt(max(scale.x, max(scale.y, scale.z)));
+
+	for (uint i = 0; i < 6; ++i)
+		if (dot(Planes[i].xyz, center) + Planes[i].w < -radius)
+			return;
+	if ((Flags & OCCLUSION_FLAG) != 0 && !IsUnoccluded(center, radius))
+		return;
+
+	uint slot;
+	InterlockedAdd(Counters[1 + instance.Draw], 1, slot);
+	Visible[Draws[instance.Draw].FirstInstance + slot] = id.x;
+}
@@ -0,0 +1,42 @@
+// Shared by Cull.cs.hlsl and Compact.cs.hlsl, matches TVulkanInstance, VkDrawIndexedIndirectCommand and the
+// constants and set of TVulkanCulling.
+struct TInstance
+{
+	float4 Transform[3];
+	uint Mesh;
+	uint Material;
+	uint Draw;
+	uint Padding;
+};
+
+struct TDrawCommand
+{
+	uint IndexCount;
+	uint InstanceCount;
+	uint FirstIndex;
+	int VertexOffset;
+	uint FirstInstance;
+};
+
+#define OCCLUSION_FLAG 1
+#define COMPACT_FLAG 2
+
+[[vk::binding(0, 0)]] cbuffer TCullConstants
+{
+	float4 Planes[6];
+	row_major float4x4 PreviousViewProjection;
+	uint InstanceCount;
+	uint DrawCount;
+	uint Flags;
+	uint LevelCount;
+	float2 PyramidSize;
+};
+
+[[vk::binding(0, 2)]] StructuredBuffer<TInstance> Instances;
+[[vk::binding(1, 2)]] StructuredBuffer<float4> Bounds;
+[[vk::binding(2, 2)]] StructuredBuffer<TDrawCommand> Draws;
+// Compacted draw count, then the visible instances of each draw.
+[[vk::binding(3, 2)]] RWStructuredBuffer<uint> Counters;
+[[vk::binding(4, 2)]] RWStructuredBuffer<uint> Visible;
+[[vk::binding(5, 2)]] RWStructuredBuffer<TDrawCommand> CulledDraws;
+[[vk::binding(6, 2)]] Texture2D<float> DepthPyramid;
@@ -0,0 +1,30 @@
+// One level of the depth pyramid, the farthest depth of the texels of the level below that each texel covers.
+[[vk::binding(0, 0)]] cbuffer TSizes
+{
+	uint2 SourceSize;
+	uint2 Size;
+};
+
+[[vk::binding(0, 2)]] Texture2D<float> Source;
+[[vk::binding(1, 2)]] RWTexture2D<float> Destination;
+
+[numthreads(8, 8, 1)]
+void CS_main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= Size.x || id.y >= Size.y)
+		return;
+
+	// The last row and column of an odd sized source fold into the last texel.
+	const uint2 begin = id.xy * 2;
+	uint2 end = begin + 2;
+	if (id.x == Size.x - 1)
+		end.x = SourceSize.x;
+	if (id.y == Size.y - 1)
+		end.y = SourceSize.y;
+
+	float depth = 0.0f;
+	for (uint y = begin.y; y < end.y; ++y)
+		for (uint x = begin.x; x < end.x; ++x)
+			depth = max(depth, Source.Load(int3(x, y, 0)));
+	Destination[id.xy] = depth;
+}
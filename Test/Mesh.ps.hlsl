@@ -0,0 +1,4 @@
+float4 PS_main(float4 position : SV_POSITION, float3 normal : NORMAL) : SV_TARGET0
+{
+	return float4(normalize(normal) * 0.5f + 0.5f, 1.0f);
+}
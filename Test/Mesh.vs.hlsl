@@ -0,0 +1,52 @@
+// Draws the mesh buffer's instances, vertices are TVertex and the instance is at SV_InstanceID in the bindless buffer
+// at DrawIndices.InstanceSlot, see TVulkanMeshBuffer. Draws written by TVulkanCulling index its visible list instead,
+// in the bindless buffer at DrawIndices.VisibleSlot.
+[[vk::binding(0, 0)]] cbuffer TDrawConstants
+{
+	row_major float4x4 ViewProjection;
+};
+
+[[vk::binding(0, 1)]] ByteAddressBuffer Buffers[];
+
+struct TDrawIndices
+{
+	uint InstanceSlot;
+	// 0xFFFFFFFF when the draws are not culled.
+	uint VisibleSlot;
+};
+
+[[vk::push_constant]] TDrawIndices DrawIndices;
+
+// sizeof(TVulkanInstance), the transform's rows come first.
+#define INSTANCE_SIZE 64
+
+struct VS_input
+{
+	float3 Position : POSITION;
+	float3 Normal : NORMAL;
+	float2 TextureCoord : TEXCOORD0;
+};
+
+struct VS_output
+{
+	float4 Position : SV_POSITION;
+	float3 Normal : NORMAL;
+};
+
+VS_output VS_main(in VS_input input, uint instanceID : SV_InstanceID)
+{
+	uint instance = instanceID;
+	if (DrawIndices.VisibleSlot != 0xFFFFFFFF)
+		instance = Buffers[DrawIndices.VisibleSlot].Load(instanceID * 4);
+
+	const uint address = instance * INSTANCE_SIZE;
+	const float3x4 transform = float3x4(
+		asfloat(Buffers[DrawIndices.InstanceSlot].Load4(address + 0)),
+		asfloat(Buffers[DrawIndices.InstanceSlot].Load4(address + 16)),
+		asfloat(Buffers[DrawIndices.InstanceSlot].Load4(address + 32)));
+
+	VS_output output;
+	output.Position = mul(ViewProjection, float4(mul(transform, float4(input.Position, 1.0f)), 1.0f));
+	output.Normal = normalize(mul((float3x3)transform, input.Normal));
+	return output;
+}
@@ -1,7 +1,16 @@
 #include "pch.h"
 
+#include "Precompiled.h"
 #include "Core/Containers/String.h"
+#include "Core/Containers/HashMap.h"
 #include "Core/Misc/Utility.h"
+#include "Core/Math/Math.h"
+#include "Core/Memory/BuddyAllocator.h"
+
+#include "CommandList.h"
+#include "MeshBVH.h"
+#include "MeshSimplifier.h"
+#include "TextureStreamer.h"
 
 TEST(TestMinMax, TestMisc) {
 	EXPECT_EQ(1, Min(1, 2, 3, 4));
@@ -14,6 +23,564 @@ TEST(TestMinMax, TestMisc) {
 	EXPECT_EQ(MakePair(-2, 4), MinMax(4, 3, -2));
 }
 
+TEST(TestSort, TestMisc) {
+	constexpr int32 valueCount = 20;
+	int32 values[valueCount] = { 5, -3, 9, 1, 1, 0, 42, -7, 8, 3, 3, 2, 17, 11, 6, 4, 10, 12, -1, 7 };
+	Sort(values, values + valueCount);
+	for (int32 i = 1; i < valueCount; ++i)
+		EXPECT_LE(values[i - 1], values[i]);
+
+	constexpr int32 descendingCount = 64;
+	int32 descending[descendingCount];
+	for (int32 i = 0; i < descendingCount; ++i)
+		descending[i] = i;
+	Sort(descending, descending + descendingCount, [](int32 lhs, int32 rhs) { return lhs > rhs; });
+	for (int32 i = 0; i < descendingCount; ++i)
+		EXPECT_EQ(descendingCount - 1 - i, descending[i]);
+}
+
+TEST(TestVector, TestMisc) {
+	const Vector3 x(1.0f, 0.0f, 0.0f), y(0.0f, 1.0f, 0.0f);
+	EXPECT_EQ(Vector3(0.0f, 0.0f, 1.0f), Cross(x, y));
+	EXPECT_EQ(0.0f, Dot(x, y));
+	EXPECT_EQ(5.0f, Length(Vector3(3.0f, 4.0f, 0.0f)));
+	EXPECT_EQ(Vector3(1.0f, 1.0f, 0.0f), x + y);
+	EXPECT_EQ(Vector3(2.0f, 0.0f, 0.0f), x * 2.0f);
+	EXPECT_EQ(Vector4(1.0f, 2.0f, 3.0f, 1.0f), Matrix4x4::Identity() * Vector4(1.0f, 2.0f, 3.0f, 1.0f));
+}
+
+TEST(TestFrustum, TestMisc) {
+	// Identity clip space: x and y in [-1, 1], z in [0, 1].
+	Vector4 planes[6];
+	ExtractFrustumPlanes(Matrix4x4::Identity(), planes);
+	EXPECT_EQ(Vector4(1.0f, 0.0f, 0.0f, 1.0f), planes[0]);
+	EXPECT_EQ(Vector4(0.0f, 0.0f, 1.0f, 0.0f), planes[4]);
+	EXPECT_TRUE(IsSphereInFrustum(planes, Vector3(0.0f, 0.0f, 0.5f), 0.1f));
+	EXPECT_TRUE(IsSphereInFrustum(planes, Vector3(1.5f, 0.0f, 0.5f), 0.6f));
+	EXPECT_FALSE(IsSphereInFrustum(planes, Vector3(1.5f, 0.0f, 0.5f), 0.4f));
+	EXPECT_FALSE(IsSphereInFrustum(planes, Vector3(0.0f, 0.0f, -1.0f), 0.5f));
+}
+
+// A gridSize x gridSize quad grid over [0, scale]^2, raised by height(x, y) * scale.
+template <typename THeight>
+static TMesh BuildGridMesh(int32 gridSize, float32 scale, THeight height)
+{
+	TMesh mesh;
+	for (int32 y = 0; y <= gridSize; ++y)
+	{
+		for (int32 x = 0; x <= gridSize; ++x)
+		{
+			const float32 u = float32(x) / float32(gridSize), v = float32(y) / float32(gridSize);
+			mesh.TVertexBuffer.push_back({ Vector3(u * scale, v * scale, height(u, v) * scale), Vector3(0.0f, 0.0f, 1.0f), Vector2(u, v) });
+		}
+	}
+	for (int32 y = 0; y < gridSize; ++y)
+	{
+		for (int32 x = 0; x < gridSize; ++x)
+		{
+			const uint16 corner = uint16(y * (gridSize + 1) + x);
+			const uint16 quad[6] = { corner, uint16(corner + 1), uint16(corner + gridSize + 1), uint16(corner + 1), uint16(corner + gridSize + 2), uint16(corner + gridSize + 1) };
+			for (uint16 index : quad)
+				mesh.IndexBuffer.push_back(index);
+		}
+	}
+	return mesh;
+}
+
+TEST(TestMeshSimplifier, TestMisc) {
+	constexpr int32 gridSize = 16;
+	const TMesh flat = BuildGridMesh(gridSize, 1.0f, [](float32, float32) { return 0.0f; });
+
+	TSimplifyOptions options;
+	options.TargetIndexCount = int32(flat.IndexBuffer.size()) / 4 / 3 * 3;
+	float32 error = -1.0f;
+	const TMesh simplified = SimplifyMesh(flat, options, &error);
+	EXPECT_LE(simplified.IndexBuffer.size(), size_t(options.TargetIndexCount));
+	EXPECT_GT(simplified.IndexBuffer.size(), 0u);
+	EXPECT_EQ(0u, simplified.IndexBuffer.size() % 3u);
+	// Collapsing within a plane moves nothing off it.
+	EXPECT_EQ(0.0f, error);
+
+	// Locked borders: every vertex on the outline is still there, and none has moved onto it.
+	int32 borderCount = 0;
+	for (size_t i = 0; i < simplified.TVertexBuffer.size(); ++i)
+	{
+		const auto &vertex = simplified.TVertexBuffer[i];
+		const bool onBorder = vertex.Position.x == 0.0f || vertex.Position.x == 1.0f || vertex.Position.y == 0.0f || vertex.Position.y == 1.0f;
+		borderCount += onBorder ? 1 : 0;
+		EXPECT_EQ(0.0f, vertex.Position.z);
+	}
+	EXPECT_EQ(4 * gridSize, borderCount);
+
+	// The error is a distance, so it scales with the mesh, not with its area.
+	const auto Bumps = [](float32 u, float32 v) { return 0.05f * sinf(u * 6.0f) * cosf(v * 5.0f); };
+	options.AttributeWeight = 0.0f;
+	float32 smallError = 0.0f, largeError = 0.0f;
+	SimplifyMesh(BuildGridMesh(gridSize, 1.0f, Bumps), options, &smallError);
+	SimplifyMesh(BuildGridMesh(gridSize, 10.0f, Bumps), options, &largeError);
+	EXPECT_GT(smallError, 0.0f);
+	EXPECT_LT(smallError, 0.05f);
+	EXPECT_NEAR(10.0f, largeError / smallError, 0.1f);
+}
+
+TEST(TestMeshSimplifier, TestUnwelded) {
+	// A vertex per face corner, as LoadObj emits them: copies of one vertex are welded rather than locked as seams.
+	constexpr int32 gridSize = 16;
+	const auto Bumps = [](float32 u, float32 v) { return 0.05f * sinf(u * 6.0f) * cosf(v * 5.0f); };
+	const TMesh welded = BuildGridMesh(gridSize, 1.0f, Bumps);
+	TMesh unwelded;
+	for (size_t i = 0; i < welded.IndexBuffer.size(); ++i)
+	{
+		unwelded.IndexBuffer.push_back(uint16(unwelded.TVertexBuffer.size()));
+		unwelded.TVertexBuffer.push_back(welded.TVertexBuffer[welded.IndexBuffer[i]]);
+	}
+
+	TSimplifyOptions options;
+	options.TargetIndexCount = int32(unwelded.IndexBuffer.size()) / 4 / 3 * 3;
+	const TMesh simplified = SimplifyMesh(unwelded, options);
+	EXPECT_LE(simplified.IndexBuffer.size(), size_t(options.TargetIndexCount));
+	EXPECT_GT(simplified.IndexBuffer.size(), 0u);
+	// Only the welded vertices are left.
+	EXPECT_LT(simplified.TVertexBuffer.size(), welded.TVertexBuffer.size());
+
+	const TMeshLodChain chain = BuildLodChain(unwelded, 4);
+	EXPECT_EQ(4u, chain.Levels.size());
+	for (size_t level = 1; level < chain.Levels.size(); ++level)
+	{
+		EXPECT_LT(chain.Levels[level].Mesh.IndexBuffer.size(), chain.Levels[level - 1].Mesh.IndexBuffer.size());
+		EXPECT_GE(chain.Levels[level].Error, chain.Levels[level - 1].Error);
+	}
+
+	// Texture coordinates that jump across the middle column make it a seam, none of its vertices move.
+	TMesh seamed = unwelded;
+	const float32 seamX = 0.5f;
+	for (size_t i = 0; i < seamed.IndexBuffer.size(); i += 3)
+	{
+		TVertex *triangle[3] = { &seamed.TVertexBuffer[i], &seamed.TVertexBuffer[i + 1], &seamed.TVertexBuffer[i + 2] };
+		if (triangle[0]->Position.x + triangle[1]->Position.x + triangle[2]->Position.x > seamX * 3.0f)
+			for (TVertex *vertex : triangle)
+				vertex->TextureCoord.x += 1.0f;
+	}
+	const TMesh seamedSimplified = SimplifyMesh(seamed, options);
+	EXPECT_LT(seamedSimplified.IndexBuffer.size(), seamed.IndexBuffer.size());
+	for (int32 y = 0; y <= gridSize; ++y)
+	{
+		const Vector3 &position = welded.TVertexBuffer[y * (gridSize + 1) + gridSize / 2].Position;
+		ASSERT_EQ(seamX, position.x);
+		bool found = false;
+		for (size_t i = 0; i < seamedSimplified.TVertexBuffer.size(); ++i)
+			found |= seamedSimplified.TVertexBuffer[i].Position == position;
+		EXPECT_TRUE(found);
+	}
+}
+
+// Moller-Trumbore against every triangle, in double precision.
+static TRayHit IntersectBruteForce(const TMesh &mesh, const TRay &ray)
+{
+	TRayHit hit;
+	hit.T = ray.MaxT;
+	for (uint32 triangle = 0; triangle < uint32(mesh.IndexBuffer.size() / 3); ++triangle)
+	{
+		double p[3][3];
+		for (int32 k = 0; k < 3; ++k)
+			for (int32 axis = 0; axis < 3; ++axis)
+				p[k][axis] = mesh.TVertexBuffer[mesh.IndexBuffer[triangle * 3 + k]].Position[axis];
+		double d[3], e1[3], e2[3], s[3];
+		for (int32 axis = 0; axis < 3; ++axis)
+		{
+			d[axis] = ray.Direction[axis];
+			e1[axis] = p[1][axis] - p[0][axis];
+			e2[axis] = p[2][axis] - p[0][axis];
+			s[axis] = ray.Origin[axis] - p[0][axis];
+		}
+		const double pv[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+		const double determinant = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+		if (determinant == 0.0)
+			continue;
+		const double u = (s[0] * pv[0] + s[1] * pv[1] + s[2] * pv[2]) / determinant;
+		const double q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+		const double v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / determinant;
+		const double t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / determinant;
+		if (u >= 0.0 && v >= 0.0 && u + v <= 1.0 && t > ray.MinT && t < hit.T)
+		{
+			hit.T = float32(t);
+			hit.U = float32(u);
+			hit.V = float32(v);
+			hit.TriangleIndex = triangle;
+		}
+	}
+	return hit;
+}
+
+// Every query has to agree with the brute force one on the hit triangle and distance.
+static void CheckMeshBVH(const TMesh &mesh, const TRay *rays, int32 rayCount)
+{
+	TMeshBVH bvh;
+	bvh.Build(mesh);
+	ASSERT_TRUE(!bvh.IsEmpty());
+
+	TVarArray<TRayHit> batchHits;
+	batchHits.resize(rayCount);
+	bvh.Intersect(rays, batchHits.data(), rayCount);
+
+	for (int32 i = 0; i < rayCount; ++i)
+	{
+		const TRayHit expected = IntersectBruteForce(mesh, rays[i]);
+		const float32 tolerance = 1e-4f * Max(1.0f, expected.T);
+
+		TRayHit hit;
+		EXPECT_EQ(expected.IsHit(), bvh.Intersect(rays[i], hit));
+		EXPECT_EQ(expected.TriangleIndex, hit.TriangleIndex);
+		EXPECT_EQ(expected.TriangleIndex, batchHits[i].TriangleIndex);
+		EXPECT_EQ(expected.IsHit(), bvh.Occluded(rays[i]));
+		if (expected.IsHit())
+		{
+			EXPECT_NEAR(expected.T, hit.T, tolerance);
+			EXPECT_NEAR(expected.T, batchHits[i].T, tolerance);
+		}
+
+		// The same ray in every lane of a packet.
+		TRayPacket4 packet;
+		for (int32 lane = 0; lane < 4; ++lane)
+		{
+			for (int32 axis = 0; axis < 3; ++axis)
+			{
+				packet.Origin[axis][lane] = rays[i].Origin[axis];
+				packet.Direction[axis][lane] = rays[i].Direction[axis];
+			}
+			packet.MinT[lane] = rays[i].MinT;
+			packet.MaxT[lane] = rays[i].MaxT;
+		}
+		TRayHit4 packetHits;
+		bvh.Intersect(packet, packetHits);
+		for (int32 lane = 0; lane < 4; ++lane)
+			EXPECT_EQ(expected.TriangleIndex, packetHits.TriangleIndex[lane]);
+	}
+}
+
+TEST(TestMeshBVH, TestMisc) {
+	Jobs::Init(0);
+
+	// Rays from above the bumps towards points inside random triangles, every fourth one stopping halfway.
+	const TMesh bumpy = BuildGridMesh(32, 1.0f, [](float32 u, float32 v) { return 0.1f * sinf(u * 9.0f) * cosf(v * 7.0f); });
+	uint32 seed = 12345u;
+	const auto Random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return float32(seed >> 8) / float32(1u << 24);
+	};
+	constexpr int32 rayCount = 256;
+	TRay rays[rayCount];
+	for (int32 i = 0; i < rayCount; ++i)
+	{
+		const uint32 triangle = uint32(Random() * float32(bumpy.IndexBuffer.size() / 3)) % uint32(bumpy.IndexBuffer.size() / 3);
+		const float32 u = 0.1f + 0.4f * Random(), v = 0.1f + 0.4f * Random();
+		const Vector3 &p0 = bumpy.TVertexBuffer[bumpy.IndexBuffer[triangle * 3 + 0]].Position;
+		const Vector3 &p1 = bumpy.TVertexBuffer[bumpy.IndexBuffer[triangle * 3 + 1]].Position;
+		const Vector3 &p2 = bumpy.TVertexBuffer[bumpy.IndexBuffer[triangle * 3 + 2]].Position;
+		const Vector3 target = p0 + (p1 - p0) * u + (p2 - p0) * v;
+		rays[i].Origin = Vector3(Random() * 3.0f - 1.0f, Random() * 3.0f - 1.0f, 1.0f);
+		rays[i].Direction = target - rays[i].Origin;
+		rays[i].MaxT = i % 4 == 3 ? 0.5f : TNumericLimits<float32>::Max();
+	}
+	CheckMeshBVH(bumpy, rays, rayCount);
+
+	// Sizes growing geometrically along a line make the SAH splits lopsided.
+	TMesh chain;
+	constexpr int32 chainLength = 300;
+	for (int32 i = 0; i < chainLength; ++i)
+	{
+		const float32 x = powf(1.15f, float32(i)), size = x * 0.1f;
+		chain.TVertexBuffer.push_back({ Vector3(x, 0.0f, 0.0f), Vector3(0.0f, 0.0f, 1.0f), Vector2(0.0f, 0.0f) });
+		chain.TVertexBuffer.push_back({ Vector3(x + size, 0.0f, 0.0f), Vector3(0.0f, 0.0f, 1.0f), Vector2(0.0f, 0.0f) });
+		chain.TVertexBuffer.push_back({ Vector3(x, size, 0.0f), Vector3(0.0f, 0.0f, 1.0f), Vector2(0.0f, 0.0f) });
+		for (int32 k = 0; k < 3; ++k)
+			chain.IndexBuffer.push_back(uint16(i * 3 + k));
+	}
+	TRay chainRays[chainLength];
+	for (int32 i = 0; i < chainLength; ++i)
+	{
+		const float32 x = powf(1.15f, float32(i)), size = x * 0.1f;
+		chainRays[i].Origin = Vector3(x + size * 0.25f, size * 0.25f, 1.0f);
+		chainRays[i].Direction = Vector3(0.0f, 0.0f, -1.0f);
+	}
+	CheckMeshBVH(chain, chainRays, chainLength);
+
+	Jobs::Done();
+}
+
+// Keeps deleted textures in memory for FramesInFlight frames, as a backend with that many frames in flight does.
+class TFakeGraphicsAPI : public IGraphicsAPI
+{
+public:
+	static constexpr uint32 FramesInFlight = 2u;
+
+	class TFakeTexture : public IGraphicsTexture
+	{
+	public:
+		TFakeTexture(TFakeGraphicsAPI *api, const TTextureDesc &desc, uint64 size) :
+			IGraphicsTexture(api, desc), Size(size) {}
+		~TFakeTexture() override {
+			static_cast<TFakeGraphicsAPI *>(ParentDevice)->Deleted.push_back({ Size, static_cast<TFakeGraphicsAPI *>(ParentDevice)->Frame });
+		}
+
+		uint64 Size;
+	};
+
+	struct TDeleted
+	{
+		uint64 Size;
+		uint64 Frame;
+	};
+
+	void Init(const IWindow *) override {}
+	void Done() override {}
+	IGraphicsBuffer *CreateBuffer(int32) override {
+		return nullptr;
+	}
+	IGraphicsTexture *CreateTexture(const TTextureDesc &desc, const void *, uint32 levelCount) override {
+		uint64 size = 0u;
+		for (uint32 level = 0; level < levelCount; ++level)
+			size += GetTextureLevelSize(desc, level);
+		AllocatedBytes += size;
+		return new TFakeTexture(this, desc, size);
+	}
+	IGraphicsPipeline *CreatePipeline(const TPipelineDesc &) override {
+		return nullptr;
+	}
+	void Submit(const TCommandList &) override {}
+	void Submit(const float32 *, const TCommandList *const *, int32) override {}
+
+	// Frees what the frame FramesInFlight back deleted.
+	void BeginFrame() {
+		size_t kept = 0u;
+		for (size_t i = 0; i < Deleted.size(); ++i)
+		{
+			if (Deleted[i].Frame + FramesInFlight <= Frame)
+				AllocatedBytes -= Deleted[i].Size;
+			else
+				Deleted[kept++] = Deleted[i];
+		}
+		Deleted.resize(kept);
+	}
+	void EndFrame() {
+		++Frame;
+	}
+
+	uint64 AllocatedBytes = 0u;
+	uint64 Frame = 0u;
+	TVarArray<TDeleted> Deleted;
+};
+
+TEST(TestTextureStreamer, TestBudget) {
+	Jobs::Init(0);
+	const char *path = "TextureStreamerTest.jtex";
+	TTextureDesc desc;
+	desc.Width = 256u;
+	desc.Height = 256u;
+	desc.MipCount = GetTextureMipCount(desc.Width, desc.Height);
+	desc.Format = TTextureFormat::RGBA8;
+	uint64 chainSize = 0u;
+	for (uint32 level = 0; level < desc.MipCount; ++level)
+		chainSize += GetTextureLevelSize(desc, level);
+	TVarArray<uint8> levels;
+	levels.resize(size_t(chainSize));
+	ASSERT_TRUE(WriteTextureFile(path, desc, levels.data()));
+
+	// Room for one full chain and the tails, not for two chains.
+	const uint64 budget = chainSize + chainSize / 2u;
+	TFakeGraphicsAPI api;
+	TTextureStreamer streamer;
+	streamer.Init(&api, budget, TFakeGraphicsAPI::FramesInFlight);
+	EXPECT_EQ(TTextureStreamer::InvalidTexture, streamer.Add("Missing.jtex"));
+	const uint32 first = streamer.Add(path);
+	const uint32 second = streamer.Add(path);
+	ASSERT_NE(TTextureStreamer::InvalidTexture, first);
+	ASSERT_NE(TTextureStreamer::InvalidTexture, second);
+	// 256 >> 2 is TailSize.
+	const uint32 tailLevel = streamer.GetResidentLevel(first);
+	EXPECT_EQ(2u, tailLevel);
+
+	// Asks for the texture at full size every frame until it gets there. What the API holds, textures deleted for
+	// frames still in flight included, is what the streamer counts, and stays within the budget.
+	const auto Stream = [&](uint32 texture) {
+		for (uint32 frame = 0; frame < 10u && streamer.GetResidentLevel(texture) != 0u; ++frame)
+		{
+			api.BeginFrame();
+			streamer.ReportUsage(texture, desc.Width);
+			streamer.Update();
+			api.EndFrame();
+			EXPECT_EQ(api.AllocatedBytes, streamer.GetStatistics().ResidentBytes);
+			EXPECT_LE(streamer.GetStatistics().ResidentBytes, budget);
+		}
+		EXPECT_EQ(0u, streamer.GetResidentLevel(texture));
+	};
+
+	Stream(first);
+	EXPECT_EQ(0u, streamer.GetStatistics().EvictionCount);
+	// The first texture is evicted, the second one waits for its chain to be freed.
+	Stream(second);
+	EXPECT_EQ(tailLevel, streamer.GetResidentLevel(first));
+	EXPECT_EQ(1u, streamer.GetStatistics().EvictionCount);
+	EXPECT_LT(0u, streamer.GetStatistics().DeferredCount);
+	EXPECT_EQ(2u, streamer.GetStatistics().LoadCount);
+
+	streamer.Done();
+	EXPECT_EQ(0u, streamer.GetStatistics().ResidentBytes);
+	EXPECT_EQ(0u, streamer.GetStatistics().TextureCount);
+	FS::Remove(path);
+	Jobs::Done();
+}
+
+TEST(TestCommandList, TestMisc) {
+	IGraphicsPipeline pipeline(nullptr, TPipelineDesc());
+	IGraphicsBuffer vertexBuffer(nullptr);
+	IGraphicsBuffer indexBuffer(nullptr);
+	const float32 clearColor[4] = { 0.0f, 0.25f, 0.5f, 1.0f };
+	const uint32 constants[2] = { 7u, 9u };
+
+	// The small capacity makes the list grow while recording.
+	TCommandList list(16u);
+	list.Barrier(&vertexBuffer, TResourceState::TransferDestination, TResourceState::VertexBuffer);
+	list.BeginRenderPass(clearColor);
+	list.BindPipeline(&pipeline);
+	list.BindVertexBuffer(&vertexBuffer);
+	list.BindIndexBuffer(&indexBuffer, TIndexType::Uint32);
+	list.PushConstants(constants, sizeof(constants));
+	list.DrawIndexed(36u, 2u);
+	// Redundant, dropped.
+	list.BindPipeline(&pipeline);
+	list.BindVertexBuffer(&vertexBuffer);
+	list.BindIndexBuffer(&indexBuffer, TIndexType::Uint32);
+	// A different offset is not.
+	list.BindVertexBuffer(&vertexBuffer, 64u);
+	list.Draw(3u);
+	list.EndRenderPass();
+	// The pipeline is bound again in a new render pass, the buffers are not.
+	list.BeginRenderPass(nullptr);
+	list.BindPipeline(&pipeline);
+	list.BindVertexBuffer(&vertexBuffer, 64u);
+	list.Draw(6u);
+	list.EndRenderPass();
+	EXPECT_EQ(14u, list.GetCommandCount());
+
+	TCommandReader reader(list);
+	TCommandType type;
+	uint32 commandCount = 0u;
+	const auto Expect = [&](TCommandType expected) {
+		ASSERT_TRUE(reader.Next(type));
+		EXPECT_EQ(expected, type);
+		++commandCount;
+	};
+
+	Expect(TCommandType::Barrier);
+	const TBarrierCommand barrier = reader.Read<TBarrierCommand>();
+	EXPECT_EQ(&vertexBuffer, barrier.Buffer);
+	EXPECT_EQ(TResourceState::TransferDestination, barrier.Before);
+	EXPECT_EQ(TResourceState::VertexBuffer, barrier.After);
+	Expect(TCommandType::BeginRenderPass);
+	const TBeginRenderPassCommand beginRenderPass = reader.Read<TBeginRenderPassCommand>();
+	EXPECT_TRUE(beginRenderPass.Clear);
+	EXPECT_EQ(0.5f, beginRenderPass.ClearColor[2]);
+	Expect(TCommandType::BindPipeline);
+	EXPECT_EQ(&pipeline, reader.Read<TBindPipelineCommand>().Pipeline);
+	Expect(TCommandType::BindVertexBuffer);
+	EXPECT_EQ(0u, reader.Read<TBindVertexBufferCommand>().Offset);
+	Expect(TCommandType::BindIndexBuffer);
+	const TBindIndexBufferCommand bindIndexBuffer = reader.Read<TBindIndexBufferCommand>();
+	EXPECT_EQ(&indexBuffer, bindIndexBuffer.Buffer);
+	EXPECT_EQ(TIndexType::Uint32, bindIndexBuffer.Type);
+	Expect(TCommandType::PushConstants);
+	const uint8 size = reader.Read<TPushConstantsCommand>().Size;
+	ASSERT_EQ(sizeof(constants), size);
+	EXPECT_EQ(0, memcmp(constants, reader.ReadBytes(size), size));
+	Expect(TCommandType::DrawIndexed);
+	const TDrawIndexedCommand drawIndexed = reader.Read<TDrawIndexedCommand>();
+	EXPECT_EQ(36u, drawIndexed.IndexCount);
+	EXPECT_EQ(2u, drawIndexed.InstanceCount);
+	Expect(TCommandType::BindVertexBuffer);
+	EXPECT_EQ(64u, reader.Read<TBindVertexBufferCommand>().Offset);
+	Expect(TCommandType::Draw);
+	EXPECT_EQ(3u, reader.Read<TDrawCommand>().VertexCount);
+	Expect(TCommandType::EndRenderPass);
+	Expect(TCommandType::BeginRenderPass);
+	EXPECT_FALSE(reader.Read<TBeginRenderPassCommand>().Clear);
+	Expect(TCommandType::BindPipeline);
+	reader.Read<TBindPipelineCommand>();
+	Expect(TCommandType::Draw);
+	EXPECT_EQ(6u, reader.Read<TDrawCommand>().VertexCount);
+	Expect(TCommandType::EndRenderPass);
+	EXPECT_FALSE(reader.Next(type));
+	EXPECT_EQ(list.GetCommandCount(), commandCount);
+
+	// Reset forgets what was bound too. A continued render pass writes neither its beginning nor its end.
+	list.Reset();
+	EXPECT_EQ(0u, list.GetSize());
+	list.ContinueRenderPass();
+	list.BindPipeline(&pipeline);
+	list.BindVertexBuffer(&vertexBuffer, 64u);
+	list.Draw(3u);
+	list.EndRenderPass();
+	EXPECT_EQ(3u, list.GetCommandCount());
+	TCommandReader continued(list);
+	ASSERT_TRUE(continued.Next(type));
+	EXPECT_EQ(TCommandType::BindPipeline, type);
+	continued.Read<TBindPipelineCommand>();
+	ASSERT_TRUE(continued.Next(type));
+	EXPECT_EQ(TCommandType::BindVertexBuffer, type);
+	continued.Read<TBindVertexBufferCommand>();
+	ASSERT_TRUE(continued.Next(type));
+	EXPECT_EQ(TCommandType::Draw, type);
+	continued.Read<TDrawCommand>();
+	EXPECT_FALSE(continued.Next(type));
+}
+
+TEST(TestBuddyAllocator, TestMisc) {
+	TBuddyAllocator allocator;
+	allocator.Init(1024u, 64u);
+	EXPECT_EQ(1024u, allocator.GetLargestFreeBlock());
+
+	const uint64 a = allocator.Allocate(100u);
+	const uint64 b = allocator.Allocate(64u);
+	const uint64 c = allocator.Allocate(10u, 256u);
+	EXPECT_EQ(0u, a % 128u);
+	EXPECT_EQ(0u, c % 256u);
+	EXPECT_NE(a, b);
+	EXPECT_EQ(128u + 64u + 256u, allocator.GetUsedSize());
+	EXPECT_EQ(TBuddyAllocator::InvalidOffset, allocator.Allocate(1024u));
+
+	allocator.Free(b);
+	allocator.Free(a);
+	allocator.Free(c);
+	EXPECT_TRUE(allocator.IsEmpty());
+	EXPECT_EQ(1024u, allocator.GetLargestFreeBlock());
+	EXPECT_EQ(0u, allocator.Allocate(1024u));
+}
+
+TEST(TestHashMap, TestMisc) {
+	THashMap<uint64, int32> map;
+	EXPECT_EQ(nullptr, map.Find(1u));
+
+	constexpr int32 count = 1000;
+	for (int32 i = 0; i < count; ++i)
+		map.Add(uint64(i) * 7919u, i);
+	EXPECT_EQ(size_t(count), map.Size());
+	for (int32 i = 0; i < count; ++i)
+	{
+		const int32 *value = map.Find(uint64(i) * 7919u);
+		ASSERT_NE(nullptr, value);
+		EXPECT_EQ(i, *value);
+	}
+	EXPECT_EQ(nullptr, map.Find(1u));
+
+	int32 sum = 0;
+	map.ForEach([&](uint64, int32 value) { sum += value; });
+	EXPECT_EQ(count * (count - 1) / 2, sum);
+
+	map.Clear();
+	EXPECT_EQ(0u, map.Size());
+	EXPECT_EQ(nullptr, map.Find(0u));
+}
+
 TEST(TestTypeTraits, TestIntegral) {
 	EXPECT_EQ(true, IsIntegral<bool>);
 	EXPECT_EQ(true, IsIntegral<char>);